@@ -115,10 +115,14 @@ public:
  * @param out the path to a build directory.
  *            ( This directory will be loaded into the store by the caller )
  * @param pkgs a list of packages to include in the build environment.
+ * @param resolveLinks whether to link files to their final targets rather
+ *                     than through links in the packages that provide them.
+ *                     Files which resolve to the same target do not conflict.
  */
 void
 buildEnvironment( const std::string &            out,
-                  std::vector<RealisedPackage> & pkgs );
+                  std::vector<RealisedPackage> & pkgs,
+                  bool                           resolveLinks = false );
 
 /* -------------------------------------------------------------------------- */
 
@@ -0,0 +1,121 @@
+/* ========================================================================== *
+ *
+ * @file flox/buildenv/bundle.hh
+ *
+ * @brief Export and import the closure of a store path as a single file.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+
+#include <nix/path.hh>
+#include <nix/store-api.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/core/exceptions.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::buildenv {
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Version of the bundle format written by @a exportBundle. */
+static constexpr uint64_t BUNDLE_VERSION = 1;
+
+/** @brief Compression method used by @a exportBundle by default. */
+static constexpr std::string_view BUNDLE_DEFAULT_COMPRESSION = "xz";
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @class flox::buildenv::InvalidBundleException
+ * @brief An exception thrown when a bundle is malformed or its contents
+ *        fail verification.
+ * @{
+ */
+FLOX_DEFINE_EXCEPTION( InvalidBundleException,
+                       EC_INVALID_BUNDLE,
+                       "invalid bundle" )
+/** @} */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Summary reported by @a exportBundle and @a importBundle. */
+struct BundleSummary
+{
+  /** Store path whose closure the bundle contains. */
+  std::string root;
+  /** Store paths written to or added from the bundle. */
+  uint64_t paths = 0;
+  /** Store paths skipped because they were already valid. */
+  uint64_t skipped = 0;
+  /** Total NAR size of the written or added paths. */
+  uint64_t narSize = 0;
+}; /* End struct `BundleSummary' */
+
+
+/** @brief Convert a @a flox::buildenv::BundleSummary to a JSON object. */
+void
+to_json( nlohmann::json & jto, const BundleSummary & summary );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Write the closure of @a root to the file @a bundlePath.
+ *
+ * A bundle is an uncompressed header naming its format version, compression
+ * method, and root, followed by a compressed stream of entries.
+ * Each store path in the closure appears exactly once, dependencies first,
+ * as its path-info metadata followed by its NAR.
+ *
+ * NARs are streamed from the store through the compressor, so memory use
+ * does not depend on the size of the closure.
+ *
+ * @param store The store to read the closure from.
+ * @param root The store path whose closure is exported.
+ * @param bundlePath Path to the bundle file to create.
+ * @param compression A compression method known to `nix`, such as
+ *                    `xz`, `zstd`, or `none`.
+ */
+BundleSummary
+exportBundle( nix::Store &                  store,
+              const nix::StorePath &        root,
+              const std::filesystem::path & bundlePath,
+              const std::string &           compression
+              = std::string( BUNDLE_DEFAULT_COMPRESSION ) );
+
+
+/**
+ * @brief Add every store path in the bundle @a bundlePath to @a store.
+ *
+ * Paths which are already valid are skipped.
+ * Each NAR is hashed while it is streamed into the store, and paths whose
+ * hash or size differ from their metadata are rejected.
+ * Entries are added dependencies first, so an interrupted import never
+ * registers a path without its references.
+ */
+BundleSummary
+importBundle( nix::Store & store, const std::filesystem::path & bundlePath );
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::buildenv
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
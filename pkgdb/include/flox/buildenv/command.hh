@@ -9,12 +9,14 @@
 
 #pragma once
 
+#include <filesystem>
 #include <optional>
 #include <string>
 
 #include <nix/ref.hh>
 #include <nlohmann/json.hpp>
 
+#include "flox/buildenv/bundle.hh"
 #include "flox/core/command.hh"
 #include "flox/core/nix-state.hh"
 #include "flox/core/types.hh"
@@ -40,6 +42,9 @@ private:
   std::optional<std::string> storePath;
   bool                       buildContainer;
 
+  /** Where to read and update the container's layer plan. */
+  std::optional<std::filesystem::path> layerPlanPath;
+
 
 public:
 
@@ -62,6 +67,108 @@ public:
 }; /* End struct `BuildEnvCommand' */
 
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Write the closure of a store path to a bundle file. */
+class BundleExportCommand : NixState
+{
+
+private:
+
+  command::VerboseParser parser;
+  std::string            storePath;
+  std::filesystem::path  output;
+  std::string            compression { BUNDLE_DEFAULT_COMPRESSION };
+
+
+public:
+
+  BundleExportCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `bundle export` routine.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `BundleExportCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Add the store paths in a bundle file to the local store. */
+class BundleImportCommand : NixState
+{
+
+private:
+
+  command::VerboseParser parser;
+  std::filesystem::path  bundlePath;
+
+
+public:
+
+  BundleImportCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `bundle import` routine.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `BundleImportCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Move environment closures between stores as single files. */
+class BundleCommand
+{
+
+private:
+
+  command::VerboseParser parser;    /**< `bundle`        parser */
+  BundleExportCommand    cmdExport; /**< `bundle export` command */
+  BundleImportCommand    cmdImport; /**< `bundle import` command */
+
+
+public:
+
+  BundleCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `bundle` sub-command.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `BundleCommand' */
+
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox::buildenv
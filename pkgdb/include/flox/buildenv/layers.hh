@@ -0,0 +1,174 @@
+/* ========================================================================== *
+ *
+ * @file flox/buildenv/layers.hh
+ *
+ * @brief Plan how the closure of an environment is split into container
+ *        image layers.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <nix/path.hh>
+#include <nix/store-api.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/core/exceptions.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::buildenv {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief The default maximum number of layers in a container image,
+ *        matching `dockerTools.streamLayeredImage`.
+ */
+static constexpr unsigned LAYERS_DEFAULT_MAX = 100;
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @class flox::buildenv::InvalidLayerPlanException
+ * @brief An exception thrown when a layer plan cannot be read or parsed.
+ * @{
+ */
+FLOX_DEFINE_EXCEPTION( InvalidLayerPlanException,
+                       EC_INVALID_LAYER_PLAN,
+                       "invalid layer plan" )
+/** @} */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Store paths mapped to the store paths they reference. */
+using ReferenceGraph = std::map<std::string, std::set<std::string>>;
+
+
+/**
+ * @brief Get the reference graph of the closure of @a root, reading the
+ *        references of each path with `queryPathInfo`.
+ *
+ * Self references are omitted.
+ */
+[[nodiscard]] ReferenceGraph
+getReferenceGraph( nix::Store & store, const nix::StorePath & root );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief An assignment of the store paths in a closure to image layers.
+ *
+ * Every layer but the last holds a single store path, and the last holds
+ * every remaining path.
+ * This is the shape `dockerTools.streamLayeredImage` produces from an
+ * ordered list of paths, so a plan is applied by ordering the image's paths
+ * as @a getOrderedPaths lists them.
+ */
+struct LayerPlan
+{
+
+  /** Maximum number of layers, including the image's customisation layer. */
+  unsigned maxLayers = LAYERS_DEFAULT_MAX;
+
+  /** Store paths in each layer, from the bottom of the image up. */
+  std::vector<std::vector<std::string>> layers;
+
+
+  /** @brief Get every store path of the plan in layer order. */
+  [[nodiscard]] std::vector<std::string>
+  getOrderedPaths() const;
+
+  /** @brief Count the layers shared with @a other. */
+  [[nodiscard]] std::size_t
+  countSharedLayers( const LayerPlan & other ) const;
+
+  [[nodiscard]] bool
+  operator==( const LayerPlan & other ) const
+    = default;
+
+
+}; /* End struct `LayerPlan' */
+
+
+/** @brief Convert a JSON object to a @a flox::buildenv::LayerPlan. */
+void
+from_json( const nlohmann::json & jfrom, LayerPlan & plan );
+
+/** @brief Convert a @a flox::buildenv::LayerPlan to a JSON object. */
+void
+to_json( nlohmann::json & jto, const LayerPlan & plan );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Plan the layers of the closure described by @a graph.
+ *
+ * Store paths are ranked by stability and then by popularity:
+ * - Paths which had their own layer in @a previous keep it, in the same
+ *   order, so images built from both plans share those layers.
+ * - Other paths are ranked by the number of paths in the closure which
+ *   depend on them, so shared base libraries come before paths specific to
+ *   the environment.
+ *
+ * The highest ranked paths get their own layer, leaving one layer for the
+ * image's customisation layer and one for every remaining path.
+ * @a root is always in the last layer, since it changes with every
+ * version of an environment.
+ *
+ * @param graph The reference graph of the closure of @a root.
+ * @param root The store path of the environment.
+ * @param maxLayers The maximum number of layers, which must be at least 2.
+ * @param previous The plan of a previous version of the environment.
+ */
+[[nodiscard]] LayerPlan
+planLayers( const ReferenceGraph &           graph,
+            const std::string &              root,
+            unsigned                         maxLayers = LAYERS_DEFAULT_MAX,
+            const std::optional<LayerPlan> & previous  = std::nullopt );
+
+/** @brief Plan the layers of the closure of @a root in @a store. */
+[[nodiscard]] LayerPlan
+planLayers( nix::Store &                     store,
+            const nix::StorePath &           root,
+            unsigned                         maxLayers = LAYERS_DEFAULT_MAX,
+            const std::optional<LayerPlan> & previous  = std::nullopt );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Read a layer plan written by @a writeLayerPlan.
+ * @return The plan, or `std::nullopt` if @a path doesn't exist.
+ */
+[[nodiscard]] std::optional<LayerPlan>
+readLayerPlan( const std::filesystem::path & path );
+
+/** @brief Write @a plan to @a path as JSON. */
+void
+writeLayerPlan( const std::filesystem::path & path, const LayerPlan & plan );
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::buildenv
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -18,6 +18,7 @@
 #include <nix/store-api.hh>
 
 #include "flox/buildenv/buildenv.hh"
+#include "flox/buildenv/layers.hh"
 #include "flox/core/exceptions.hh"
 #include "flox/resolver/lockfile.hh"
 #include <nix/build-result.hh>
@@ -331,15 +332,18 @@ createFloxEnv( nix::ref<nix::EvalState> & state,
  * @param references Set of store paths that the environment depends on.
  * @param originalPackage Map of store paths to the locked package definition
  *                        that provided them.
+ * @param resolveLinks Whether to link files to their final targets,
+ *                     see @a flox::buildenv::buildEnvironment.
  * @return The combined store path of the environment.
  */
-const nix::StorePath &
+nix::StorePath
 createEnvironmentStorePath(
-  std::vector<RealisedPackage> & pkgs,
   nix::EvalState &               state,
+  std::vector<RealisedPackage> & pkgs,
   nix::StorePathSet &            references,
   std::map<nix::StorePath, std::pair<std::string, resolver::LockedPackageRaw>> &
-    originalPackage );
+       originalPackage,
+  bool resolveLinks = false );
 
 
 /* -------------------------------------------------------------------------- */
@@ -349,12 +353,15 @@ createEnvironmentStorePath(
  * @param state A `nix` evaluator.
  * @param environmentStorePath A storepath containing a realised environment.
  * @param system system to build the environment for.
+ * @param layerPlan The layers to split the environment's closure into,
+ *                  see @a flox::buildenv::planLayers.
  * @return A @a nix::StorePath to a container builder.
  */
 nix::StorePath
 createContainerBuilder( nix::EvalState &       state,
                         const nix::StorePath & environmentStorePath,
-                        const System &         system );
+                        const System &         system,
+                        const LayerPlan &      layerPlan );
 
 
 /* -------------------------------------------------------------------------- */
@@ -9,12 +9,15 @@
 
 #pragma once
 
+#include <iostream>
 #include <memory>
+#include <ostream>
 #include <string>
 #include <string_view>
 
 #include <argparse/argparse.hpp>
 #include <nix/flake/flakeref.hh>
+#include <nlohmann/json.hpp>
 
 #include "flox/core/exceptions.hh"
 #include "flox/core/nix-state.hh"
@@ -83,6 +86,13 @@ public:
   argparse::Argument &
   addFlakeRefArg( argparse::ArgumentParser & parser );
 
+  /**
+   * @brief Extend an argument parser to accept a `--rules PATH` argument
+   *        which sets the `scrape` rules of @a registryInput.
+   */
+  argparse::Argument &
+  addScrapeRulesArg( argparse::ArgumentParser & parser );
+
   /**
    * @brief Return the parsed @a RegistryInput.
    * @return The parsed @a RegistryInput.
@@ -124,6 +134,43 @@ struct AttrPathMixin
 }; /* End struct `AttrPathMixin' */
 
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Encodings of the records a command writes to `stdout`. */
+enum output_format {
+  OF_JSON    = 0, /**< One JSON object per line. */
+  OF_CBOR    = 1, /**< Length prefixed CBOR. */
+  OF_MSGPACK = 2  /**< Length prefixed MessagePack. */
+}; /* End enum `output_format' */
+
+/**
+ * @brief The encoding used by @a writeRecord.
+ *
+ * This is global so that errors caught by `main` are written in the same
+ * format as the records of the command that threw them.
+ */
+extern output_format outputFormat;
+
+/**
+ * @brief Add an `--output-format FORMAT` option to a parser, setting the
+ *        global @a outputFormat.
+ *
+ * FORMAT is one of `json`, `cbor`, or `msgpack`.
+ */
+argparse::Argument &
+addOutputFormatArg( argparse::ArgumentParser & parser );
+
+/**
+ * @brief Write a record to @a oss using @a outputFormat.
+ *
+ * JSON records are terminated by a newline.
+ * Binary records are framed by their length in bytes as a 32 bit big endian
+ * unsigned integer, so readers never scan for delimiters.
+ */
+void
+writeRecord( const nlohmann::json & record, std::ostream & oss = std::cout );
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
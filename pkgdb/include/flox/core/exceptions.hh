@@ -111,6 +111,14 @@ enum error_category {
    * due to file I/O failing.
    */
   EC_ACTIVATION_SCRIPT_BUILD_ERROR,
+  /** A bundle could not be read, or its contents failed verification. */
+  EC_INVALID_BUNDLE,
+  /** A vulnerability advisory feed could not be read or parsed. */
+  EC_INVALID_ADVISORY_FEED,
+  /** A container layer plan could not be read or parsed. */
+  EC_INVALID_LAYER_PLAN,
+  /** A package usage file could not be read or parsed. */
+  EC_INVALID_USAGE_FILE,
 }; /* End enum `error_category' */
 
 
@@ -301,6 +309,32 @@ public:
 }; /* End class `NixEvalException' */
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @class flox::CaughtException
+ * @brief An exception thrown when an otherwise unhandled exception is caught.
+ *        This ensures proper JSON formatting.
+ * @{
+ */
+FLOX_DEFINE_EXCEPTION( CaughtException,
+                       EC_FAILURE,
+                       "caught an unhandled exception" )
+/** @} */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @class flox::NixException
+ * @brief An exception thrown when an otherwise unhandled Nix exception is
+ *        caught. This ensures proper JSON formatting.
+ * @{
+ */
+FLOX_DEFINE_EXCEPTION( NixException, EC_NIX, "caught a nix exception" )
+/** @} */
+
+
 /* -------------------------------------------------------------------------- */
 
 // TODO: wrap usage of `nix::flake::Fingerprint' with these.
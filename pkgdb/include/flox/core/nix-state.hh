@@ -9,6 +9,7 @@
 
 #pragma once
 
+#include <functional>
 #include <memory>
 
 #include <nix/eval.hh>
@@ -52,6 +53,16 @@ void
 initNix();
 
 
+/**
+ * @brief Set `nix` verbosity from the `_FLOX_PKGDB_VERBOSITY` environment
+ *        variable, which is an integer from 0 to 4.
+ *
+ * Unset or unrecognized values leave the current verbosity unchanged.
+ */
+void
+setVerbosityFromEnv();
+
+
 /* -------------------------------------------------------------------------- */
 
 /** @brief Mixin which provides a lazy handle to a `nix` store connection. */
@@ -63,6 +74,19 @@ private:
   std::shared_ptr<nix::Store> store; /**< `nix` store connection.   */
 
 
+protected:
+
+  /**
+   * @brief Use an existing store connection, such as one shared by a
+   *        long lived session, instead of opening a new one.
+   */
+  void
+  setStore( const nix::ref<nix::Store> & store )
+  {
+    this->store = static_cast<std::shared_ptr<nix::Store>>( store );
+  }
+
+
 public:
 
   /* Copy/Move base class boilerplate */
@@ -113,6 +137,29 @@ public:
 }; /* End class `NixStoreMixin' */
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Registers a hook which is called with each evaluator opened by
+ *        @a flox::NixState just before it is destroyed.
+ *
+ * Caches keyed by evaluator, such as those of primops, use this to drop
+ * their entries along with the evaluator rather than outliving it.
+ * Hooks should be registered with static lifetime like `nix::RegisterPrimOp`.
+ */
+struct RegisterEvalStateHook
+{
+  using Hook = std::function<void( const nix::EvalState & )>;
+
+  explicit RegisterEvalStateHook( Hook onDestroy );
+}; /* End struct `RegisterEvalStateHook' */
+
+
+/** @brief Run each @a RegisterEvalStateHook and delete @a state. */
+void
+destroyEvalState( nix::EvalState * state );
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -155,9 +202,11 @@ public:
   {
     if ( this->state == nullptr )
       {
-        this->state = std::make_shared<nix::EvalState>( nix::SearchPath(),
-                                                        this->getStore(),
-                                                        this->getStore() );
+        this->state = std::shared_ptr<nix::EvalState>(
+          new nix::EvalState( nix::SearchPath(),
+                              this->getStore(),
+                              this->getStore() ),
+          destroyEvalState );
         this->state->repair = nix::NoRepair;
       }
     return static_cast<nix::ref<nix::EvalState>>( this->state );
@@ -67,6 +67,7 @@ private:
   System                     _system;
   Subtree                    _subtree;
   std::optional<std::string> _license;
+  std::vector<License>       _licenses;
 
 
   void
@@ -179,6 +180,12 @@ public:
     return std::nullopt;
   }
 
+  [[nodiscard]] std::vector<License>
+  getLicenses() const override
+  {
+    return this->_licenses;
+  }
+
   [[nodiscard]] std::vector<std::string>
   getOutputs() const override
   {
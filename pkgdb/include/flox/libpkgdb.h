@@ -0,0 +1,202 @@
+/* ========================================================================== *
+ *
+ * @file flox/libpkgdb.h
+ *
+ * @brief C interface to `libpkgdb` for searching, locking, and building
+ *        environments without spawning `pkgdb` processes.
+ *
+ * Every structure is opaque and every value crossing the interface is either
+ * a plain C type or a NUL terminated JSON string using the same formats as
+ * the `pkgdb` executable.
+ *
+ * Functions returning `int` return `0` on success, and otherwise one of the
+ * error codes used as `pkgdb` exit statuses.
+ * After an error @a pkgdb_session_last_error returns the error as a JSON
+ * object in the same form that `pkgdb` prints.
+ *
+ * A session may only be used by one thread at a time.
+ * Registry inputs locked and opened by one operation are reused by later
+ * operations of the same session, so a session should be freed to pick up
+ * new revisions of unpinned inputs.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#ifndef FLOX_LIBPKGDB_H
+#define FLOX_LIBPKGDB_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Version of this interface.
+ *
+ * This is only incremented when existing declarations change incompatibly.
+ */
+#define PKGDB_ABI_VERSION 1
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Shared `nix` state and error reporting for a set of operations. */
+typedef struct pkgdb_session pkgdb_session;
+
+/** @brief A locked flake with a package database. */
+typedef struct pkgdb_input pkgdb_input;
+
+/**
+ * @brief Receives each record of a query as a JSON object.
+ *
+ * @a json is only valid until the callback returns.
+ * Returning a non-zero value stops the query without reporting an error.
+ */
+typedef int ( *pkgdb_record_callback )( const char * json, void * userdata );
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief The @a PKGDB_ABI_VERSION the library was built with. */
+unsigned int
+pkgdb_abi_version( void );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Create a session, initializing `nix` on first use.
+ *
+ * Verbosity is read from `_FLOX_PKGDB_VERBOSITY` as it is by `pkgdb`.
+ *
+ * @param session Set to the new session, which is freed with
+ *                @a pkgdb_session_free.
+ */
+int
+pkgdb_session_new( pkgdb_session ** session );
+
+/** @brief Free a session and its `nix` state. */
+void
+pkgdb_session_free( pkgdb_session * session );
+
+/**
+ * @brief The last error reported by @a session as a JSON object, or `NULL`
+ *        if its last operation succeeded.
+ *
+ * The string is owned by @a session and is valid until its next operation.
+ */
+const char *
+pkgdb_session_last_error( const pkgdb_session * session );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Lock a flake and open its package database.
+ *
+ * The database is scraped lazily by @a pkgdb_input_query.
+ *
+ * @param registryInput A registry input such as
+ *                      `{ "from": { "type": "github", ... } }`.
+ * @param input Set to the new input, which is freed with @a pkgdb_input_free
+ *              before @a session is freed.
+ */
+int
+pkgdb_input_open( pkgdb_session * session,
+                  const char *    registryInput,
+                  pkgdb_input **  input );
+
+/** @brief Free an input opened by @a pkgdb_input_open. */
+void
+pkgdb_input_free( pkgdb_input * input );
+
+/**
+ * @brief Query the package database of @a input.
+ *
+ * Only the subtrees and systems named by the query are scraped.
+ *
+ * @param queryArgs A `PkgQueryArgs` object such as
+ *                  `{ "pname": "hello", "systems": ["x86_64-linux"] }`.
+ * @param callback Called with each package in the form `pkgdb search`
+ *                 prints.
+ */
+int
+pkgdb_input_query( pkgdb_session *       session,
+                   pkgdb_input *         input,
+                   const char *          queryArgs,
+                   pkgdb_record_callback callback,
+                   void *                userdata );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Search the inputs of a manifest's registry.
+ *
+ * @param searchParams Parameters in the form taken by `pkgdb search`.
+ * @param callback Called with each line `pkgdb search` would print.
+ */
+int
+pkgdb_search( pkgdb_session *       session,
+              const char *          searchParams,
+              pkgdb_record_callback callback,
+              void *                userdata );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Lock a manifest.
+ *
+ * @param manifestPath Path to a `manifest.{toml,yaml,json}` file.
+ * @param lockfilePath Path to an existing lockfile, or `NULL`.
+ * @param lockfile Set to the new lockfile's JSON, which is freed with
+ *                 @a pkgdb_string_free.
+ */
+int
+pkgdb_lock( pkgdb_session * session,
+            const char *    manifestPath,
+            const char *    lockfilePath,
+            char **         lockfile );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Build the environment described by a lockfile.
+ *
+ * @param lockfile The lockfile's JSON.
+ * @param system The system to build for, or `NULL` for the current system.
+ * @param storePath Set to the environment's store path, which is freed with
+ *                  @a pkgdb_string_free.
+ */
+int
+pkgdb_buildenv( pkgdb_session * session,
+                const char *    lockfile,
+                const char *    system,
+                char **         storePath );
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Free a string returned by `libpkgdb`. */
+void
+pkgdb_string_free( char * str );
+
+
+/* -------------------------------------------------------------------------- */
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* FLOX_LIBPKGDB_H */
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
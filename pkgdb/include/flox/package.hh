@@ -31,6 +31,36 @@
 
 namespace flox {
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief A single license from a package's `meta.license` field. */
+struct License
+{
+  /** The `spdxId`, `shortName`, or `fullName` of the license. */
+  std::string                name;
+  std::optional<std::string> spdxId;          /**< `spdxId` if defined. */
+  std::optional<bool>        free;            /**< `free` if defined. */
+  std::optional<bool>        redistributable; /**< `redistributable`. */
+
+  [[nodiscard]] bool
+  operator==( const License & other ) const
+  {
+    return ( this->name == other.name ) && ( this->spdxId == other.spdxId )
+           && ( this->free == other.free )
+           && ( this->redistributable == other.redistributable );
+  }
+}; /* End struct `License' */
+
+
+/** @brief Convert a JSON object to a @a flox::License. */
+void
+from_json( const nlohmann::json & jfrom, License & license );
+
+/** @brief Convert a @a flox::License to a JSON object. */
+void
+to_json( nlohmann::json & jto, const License & license );
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -91,6 +121,19 @@ public:
   [[nodiscard]] virtual std::optional<std::string>
   getLicense() const = 0;
 
+  /**
+   * @return Every license listed by `meta.license`, which may be a single
+   *         license or a list of licenses.
+   *         By default this is the license reported by @a getLicense.
+   */
+  [[nodiscard]] virtual std::vector<License>
+  getLicenses() const
+  {
+    std::optional<std::string> license = this->getLicense();
+    if ( ! license.has_value() ) { return {}; }
+    return { License { *license, license, std::nullopt, std::nullopt } };
+  }
+
   /** @return The derivation `outputs` list. */
   [[nodiscard]] virtual std::vector<std::string>
   getOutputs() const = 0;
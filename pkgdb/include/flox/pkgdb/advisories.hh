@@ -0,0 +1,227 @@
+/* ========================================================================== *
+ *
+ * @file flox/pkgdb/advisories.hh
+ *
+ * @brief A local store of vulnerability advisories matched against packages
+ *        by `pname` and version.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <sqlite3pp.hh>
+
+#include "flox/core/exceptions.hh"
+#include "flox/pkgdb/read.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::pkgdb {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @class flox::pkgdb::InvalidAdvisoryFeedException
+ * @brief An exception thrown when an advisory feed cannot be read or parsed.
+ * @{
+ */
+FLOX_DEFINE_EXCEPTION( InvalidAdvisoryFeedException,
+                       EC_INVALID_ADVISORY_FEED,
+                       "invalid advisory feed" )
+/** @} */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A range of versions affected by an advisory.
+ *
+ * Versions are ordered by `nix::compareVersions`, as they are by
+ * `builtins.compareVersions`.
+ * Missing bounds are unbounded.
+ */
+struct AffectedRange
+{
+  /** The first affected version. */
+  std::optional<std::string> introduced;
+  /** The first version which is no longer affected. */
+  std::optional<std::string> fixed;
+  /** The last affected version, for advisories without a fix. */
+  std::optional<std::string> lastAffected;
+
+  /** @brief Whether @a version lies within this range. */
+  [[nodiscard]] bool
+  contains( std::string_view version ) const;
+
+  [[nodiscard]] bool
+  operator==( const AffectedRange & other ) const
+    = default;
+
+}; /* End struct `AffectedRange' */
+
+
+/** @brief Convert a JSON object to an @a flox::pkgdb::AffectedRange. */
+void
+from_json( const nlohmann::json & jfrom, AffectedRange & range );
+
+/** @brief Convert an @a flox::pkgdb::AffectedRange to a JSON object. */
+void
+to_json( nlohmann::json & jto, const AffectedRange & range );
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief A known vulnerability affecting some versions of a package. */
+struct Advisory
+{
+  /** Primary identifier, such as `CVE-2024-0001`. */
+  std::string id;
+  /** Other identifiers for the same vulnerability. */
+  std::vector<std::string> aliases;
+  /** The `pname` of affected packages. */
+  std::string pname;
+  /** Severity as reported by the feed, such as `high`. */
+  std::optional<std::string> severity;
+  /** Affected versions, where an empty list affects every version. */
+  std::vector<AffectedRange> affected;
+
+  [[nodiscard]] bool
+  operator==( const Advisory & other ) const
+    = default;
+
+}; /* End struct `Advisory' */
+
+
+/** @brief Convert a JSON object to an @a flox::pkgdb::Advisory. */
+void
+from_json( const nlohmann::json & jfrom, Advisory & advisory );
+
+/** @brief Convert an @a flox::pkgdb::Advisory to a JSON object. */
+void
+to_json( nlohmann::json & jto, const Advisory & advisory );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Get the path to the default advisory database.
+ *
+ * The environment variable `PKGDB_ADVISORIES` is respected if it is set,
+ * otherwise `${XDG_DATA_HOME:-$HOME/.local/share}/flox/advisories.sqlite`
+ * is used.
+ * This lies outside of the cache directory so imported advisories survive
+ * `pkgdb gc` and schema changes.
+ */
+[[nodiscard]] std::filesystem::path
+getAdvisoryDbPath();
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A SQLite3 database of vulnerability advisories.
+ *
+ * Each affected range is stored as its own row indexed by `pname`, so
+ * matching a package reads only the advisories for its `pname`.
+ */
+class AdvisoryDb
+{
+
+public:
+
+  sqlite3pp::database   db;     /**< SQLite3 database handle. */
+  std::filesystem::path dbPath; /**< Absolute path to database. */
+
+
+private:
+
+  /**
+   * Lookup of advisories by `pname`, prepared on first use.
+   * This is declared after @a db so that it is finalized first.
+   */
+  std::unique_ptr<sqlite3pp::query> matchQuery;
+
+
+public:
+
+  /**
+   * @brief Open an advisory database.
+   * @param dbPath Path to the database.
+   * @param create Whether to create the database if it doesn't exist.
+   */
+  explicit AdvisoryDb( const std::filesystem::path & dbPath
+                       = getAdvisoryDbPath(),
+                       bool create = false );
+
+  AdvisoryDb( const AdvisoryDb & ) = delete;
+  AdvisoryDb( AdvisoryDb && )      = delete;
+  ~AdvisoryDb()                    = default;
+
+  AdvisoryDb &
+  operator=( const AdvisoryDb & )
+    = delete;
+  AdvisoryDb &
+  operator=( AdvisoryDb && )
+    = delete;
+
+  /**
+   * @brief Open the default advisory database if one has been imported.
+   * @return The database, or `nullptr` if none exists.
+   */
+  [[nodiscard]] static std::unique_ptr<AdvisoryDb>
+  openDefault();
+
+  /**
+   * @brief Replace the database's advisories with those of a feed file.
+   *
+   * A feed is a JSON list of advisories such as
+   * `[{ "id": "CVE-2024-0001", "pname": "hello", "severity": "high",
+   *     "affected": [{ "introduced": "2.0", "fixed": "2.12.1" }] }]`.
+   * @return The number of advisories imported.
+   */
+  std::size_t
+  importFeed( const std::filesystem::path & feedPath );
+
+  /** @brief Replace the database's advisories with @a advisories. */
+  void
+  setAdvisories( const std::vector<Advisory> & advisories );
+
+  /**
+   * @brief Get the advisories affecting a version of a package.
+   *
+   * Only the matching ranges of each advisory are listed in `affected`.
+   */
+  [[nodiscard]] std::vector<Advisory>
+  match( const std::string & pname, const std::string & version );
+
+  /**
+   * @brief Move rows of @a dbRO with known advisories after the others,
+   *        retaining the order of each partition.
+   */
+  void
+  demoteVulnerable( PkgDbReadOnly & dbRO, std::vector<row_id> & rows );
+
+
+}; /* End class `AdvisoryDb' */
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::pkgdb
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -85,6 +85,14 @@ private:
   std::optional<PkgDbInput> input;
   /** Whether to force re-evaluation. */
   bool force = false;
+  /** A metadata dump to import instead of evaluating the flake. */
+  std::optional<std::filesystem::path> metadataDump;
+  /** Whether to index the files provided by scraped packages. */
+  bool provides = false;
+  /** A local binary cache with listings of unrealised outputs. */
+  std::optional<std::filesystem::path> binaryCache;
+  /** Whether to group scraped packages which share an output hash. */
+  bool aliases = false;
 
   /** @brief Initialize @a input from @a registryInput. */
   void
@@ -266,6 +274,12 @@ private:
   /** minimum age of files not being accessed. */
   int gcStaleAgeDays = DEF_STALE_AGE_IN_DAYS;
 
+  /** Whether to vacuum remaining databases and their eval caches. */
+  bool vacuum = false;
+
+  /** Whether to prune eval caches of fully scraped databases. */
+  bool pruneEvalCaches = false;
+
   /** Cache dir to collect garbage in */
   std::optional<std::filesystem::path> cacheDir;
 
@@ -289,6 +303,212 @@ public:
 
 }; /* End class `GCCommand' */
 
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Find packages which provide an executable or shared library.
+ *
+ * Packages must first be indexed with `pkgdb scrape --provides`.
+ */
+class ProvidesCommand : public PkgDbMixin<PkgDbReadOnly>
+{
+
+private:
+
+  command::VerboseParser parser;
+  std::string            file;           /**< File name to lookup. */
+  bool                   prefix = false; /**< Match file names by prefix. */
+  std::optional<System>  system;
+
+
+public:
+
+  ProvidesCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `provides` routine.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `ProvidesCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Replace the advisory database with the contents of a feed file. */
+class AdvisoriesImportCommand : public DbPathMixin
+{
+
+private:
+
+  command::VerboseParser parser;
+  std::filesystem::path  feed; /**< Path to the feed file. */
+
+
+public:
+
+  AdvisoriesImportCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `advisories import` routine.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `AdvisoriesImportCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief List the advisories affecting a version of a package. */
+class AdvisoriesMatchCommand : public DbPathMixin
+{
+
+private:
+
+  command::VerboseParser parser;
+  std::string            pname;
+  std::string            version;
+
+
+public:
+
+  AdvisoriesMatchCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `advisories match` routine.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `AdvisoriesMatchCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Manage the local vulnerability advisory database. */
+class AdvisoriesCommand
+{
+
+private:
+
+  command::VerboseParser  parser;    /**< `advisories`        parser */
+  AdvisoriesImportCommand cmdImport; /**< `advisories import` command */
+  AdvisoriesMatchCommand  cmdMatch;  /**< `advisories match`  command */
+
+
+public:
+
+  AdvisoriesCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `advisories` sub-command.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `AdvisoriesCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Add the counts of a usage file to the usage database. */
+class UsageImportCommand : public DbPathMixin
+{
+
+private:
+
+  command::VerboseParser parser;
+  std::filesystem::path  file; /**< Path to the usage file. */
+
+
+public:
+
+  UsageImportCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `usage import` routine.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `UsageImportCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Manage the local record of locked packages. */
+class UsageCommand
+{
+
+private:
+
+  command::VerboseParser parser;    /**< `usage`        parser */
+  UsageImportCommand     cmdImport; /**< `usage import` command */
+
+
+public:
+
+  UsageCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `usage` sub-command.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `UsageCommand' */
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox::pkgdb
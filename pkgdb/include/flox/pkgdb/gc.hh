@@ -9,7 +9,9 @@
 
 #pragma once
 
+#include <cstdint>
 #include <filesystem>
+#include <optional>
 #include <vector>
 
 
@@ -24,6 +26,76 @@ namespace flox::pkgdb {
 findStaleDatabases( const std::filesystem::path & cacheDir, int minAgeDays );
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Get the directory holding `nix` eval caches.
+ *
+ * This is `${XDG_CACHE_HOME:-$HOME/.cache}/nix/eval-cache-v<VERSION>`, and
+ * must track the eval cache version of the `nix` we link against.
+ */
+[[nodiscard]] std::filesystem::path
+getEvalCacheDir();
+
+
+/**
+ * @brief Get the eval cache belonging to a package database.
+ *
+ * Databases are named `<FINGERPRINT>[.<RULES-HASH>].sqlite` and eval caches
+ * `<FINGERPRINT>.sqlite`, so this is the eval cache named after the first
+ * component of @a dbPath's filename.
+ * @return The path to the eval cache, or `std::nullopt` if none exists.
+ */
+[[nodiscard]] std::optional<std::filesystem::path>
+findEvalCache( const std::filesystem::path & dbPath,
+               const std::filesystem::path & evalCacheDir = getEvalCacheDir() );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Get the eval caches of @a toDelete that no other database in
+ *        @a cacheDir shares.
+ *
+ * Databases of the same flake scraped with different rules share an eval
+ * cache, which must be kept until the last of them is deleted.
+ */
+[[nodiscard]] std::vector<std::filesystem::path>
+findStaleEvalCaches(
+  const std::filesystem::path &              cacheDir,
+  const std::vector<std::filesystem::path> & toDelete,
+  const std::filesystem::path &              evalCacheDir = getEvalCacheDir() );
+
+
+/**
+ * @brief Whether every attribute set recorded by a package database has
+ *        finished scraping.
+ */
+[[nodiscard]] bool
+isFullyScraped( const std::filesystem::path & dbPath );
+
+
+/**
+ * @brief Rebuild a SQLite3 database to release unused pages.
+ * @return The number of bytes reclaimed.
+ */
+std::uintmax_t
+vacuumDatabase( const std::filesystem::path & path );
+
+
+/**
+ * @brief Remove cached `meta` attributes of derivations from an eval cache.
+ *
+ * Once a flake is fully scraped `pkgdb` reads package metadata from its own
+ * database, so these are only read again to re-scrape.
+ * Removed attributes are simply re-evaluated if they are needed.
+ *
+ * @return The number of attributes removed.
+ */
+std::uintmax_t
+pruneEvalCache( const std::filesystem::path & path );
+
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox::pkgdb
@@ -16,6 +16,7 @@
 #include <string>
 #include <string_view>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -47,6 +48,7 @@ namespace flox::pkgdb {
 
 /* Forward declare */
 class PkgDb;
+class ScrapeRules;
 
 /* -------------------------------------------------------------------------- */
 
@@ -63,6 +65,30 @@ private:
    * error occured in the nix evalutaion. Chosen arbitrarily, but with the
    * intent to avoid posix overlap. */
   static const int EXIT_FAILURE_NIX_EVAL = 150;
+  /* Exit code used during multi-process scraping to indicate that the
+   * database could not be written, which is never blamed on the attributes
+   * being scraped. */
+  static const int EXIT_FAILURE_DATABASE = 151;
+
+  /** @brief The outcome of a single scraping child process. */
+  struct ScrapeChildResult
+  {
+    /** Raw status reported by `waitpid`. */
+    int status = 0;
+    /** The last attribute the child reported it was processing. */
+    std::optional<AttrPath> lastAttrib;
+    /** An error message reported by the child, if any. */
+    std::optional<std::string> error;
+    /** The number of attributes beneath the prefix, if reported. */
+    std::optional<size_t> numAttribs;
+  }; /* End struct `ScrapeChildResult' */
+
+  /**
+   * @brief Fork a child to scrape child attributes @a startIdx through
+   *        @a startIdx + @a count of @a prefix, and wait for it to exit.
+   */
+  ScrapeChildResult
+  runScrapeChild( const AttrPath & prefix, size_t startIdx, size_t count );
 
   /* Provided by `FloxFlakeInput':
    *   nix::ref<nix::FlakeRef>             flakeRef
@@ -71,6 +97,12 @@ private:
    *   std::optional<std::vector<Subtree>> enabledSubtrees
    */
 
+  /**
+   * Rules used to filter attributes while scraping, or `nullptr` if the input
+   * uses the default rules.
+   */
+  std::shared_ptr<const ScrapeRules> scrapeRules;
+
   /** Path to the flake's pkgdb SQLite3 file. */
   std::filesystem::path dbPath;
 
@@ -107,6 +139,24 @@ private:
   bool
   initDbRO();
 
+  /**
+   * @brief Merge the `scrape` rules of @a input with the default rules.
+   * @return The merged rules, or `nullptr` if @a input has no rules.
+   */
+  [[nodiscard]] static std::shared_ptr<const ScrapeRules>
+  mkScrapeRules( const RegistryInput & input );
+
+  /**
+   * @brief Get the path to the database for @a flake in @a cacheDir.
+   *
+   * Inputs with non-default @a scrapeRules use a name suffixed with the hash
+   * of their rules so that they don't clobber fully scraped databases.
+   */
+  [[nodiscard]] static std::filesystem::path
+  genDbPath( const FloxFlake &                          flake,
+             const std::filesystem::path &              cacheDir,
+             const std::shared_ptr<const ScrapeRules> & scrapeRules );
+
 
 public:
 
@@ -140,6 +190,7 @@ public:
               ,
               const std::string & name = "" )
     : FloxFlakeInput( store, input )
+    , scrapeRules( mkScrapeRules( input ) )
     , dbPath( std::move( dbPath ) )
     , name( name.empty() ? std::nullopt : std::make_optional( name ) )
   {
@@ -160,8 +211,8 @@ public:
               const std::filesystem::path & cacheDir = getPkgDbCachedir(),
               const std::string &           name     = "" )
     : FloxFlakeInput( store, input )
-    , dbPath( genPkgDbName( this->getFlake()->lockedFlake.getFingerprint(),
-                            cacheDir ) )
+    , scrapeRules( mkScrapeRules( input ) )
+    , dbPath( genDbPath( *this->getFlake(), cacheDir, this->scrapeRules ) )
     , name( name.empty() ? std::nullopt : std::make_optional( name ) )
   {
     this->init();
@@ -187,6 +238,10 @@ public:
   void
   closeDbReadWrite();
 
+  /** @brief Get the rules used to filter attributes while scraping. */
+  [[nodiscard]] const ScrapeRules &
+  getScrapeRules() const;
+
   /** @return Filesystem path to the flake's package database. */
   [[nodiscard]] std::filesystem::path
   getDbPath() const
@@ -211,28 +266,84 @@ public:
    * If a read/write connection is already open when @a scrapePrefix is called
    * it will remain open, but if the connection is opened by @a scrapePrefix
    * it will be closed after scraping is completed.
+   *
+   * Pages are scraped in child processes.  If a child fails after reaching
+   * an attribute, its page is bisected and retried until the failing
+   * attribute is isolated.  That attribute is recorded in the `Quarantine`
+   * table, skipped by this and later scrapes, and reported as a warning once
+   * scraping is complete.
+   * Evaluation errors and exceeding the per-attribute time limit set by
+   * `FLOX_SCRAPE_ATTR_TIMEOUT` ( seconds ) quarantine the attribute
+   * immediately, while other failures such as crashes or exceeding
+   * `FLOX_SCRAPE_MEMORY_LIMIT` ( MiB ) must reproduce once more first.
+   * Failures before any attribute is reached or while writing the database,
+   * such as a locked database, are retried once and then throw
+   * a @a PkgDbException.
    * @param prefix Attribute path to scrape.
    */
   void
   scrapePrefix( const flox::AttrPath & prefix );
 
   /**
-   * @brief Scrapes one page of attributes directly beneath @a prefix.  Used
-   * specifically as a child process in @a scrapePrefix. Attributes N to N + @a
-   * pageSize where N is @a pageSize * @a pageIdx will be scraped, depth first.
+   * @brief Scrapes a range of attributes directly beneath @a prefix.  Used
+   * specifically as a child process in @a scrapePrefix. Attributes
+   * @a startIdx to @a startIdx + @a count will be scraped, depth first.
+   *
+   * Before each attribute is processed its path is written to @a reportFd as
+   * a line of JSON, and evaluation errors are reported the same way, so that
+   * the parent can identify attributes which crash or hang the child.
+   * The time and memory limits described in @a scrapePrefix are applied here.
    *
    * @param input The PkgDbInput to scrape from.  This is passed to this static
    * helper rather than relying on a method and using *this* to encourage
    * encapsulation.
    * @param prefix The prefix to process attributes beneath.
-   * @param pageIdx The page of attributes to process
-   * @param pageSize The number of attributes per page.
+   * @param startIdx The index of the first attribute to process.
+   * @param count The number of attributes to process.
+   * @param reportFd File descriptor used to report progress to the parent.
    */
   static int
   scrapePrefixWorker( PkgDbInput *     input,
                       const AttrPath & prefix,
-                      size_t           pageIdx,
-                      size_t           pageSize );
+                      size_t           startIdx,
+                      size_t           count,
+                      int              reportFd );
+
+  /**
+   * @brief Record the files provided by packages beneath @a prefix for
+   *        `pkgdb provides`.
+   *
+   * Output store paths are evaluated through the flake's eval cache.
+   * Outputs which are neither valid in the local store nor listed in
+   * @a binaryCache are skipped, as are packages which fail to evaluate.
+   * Existing records for indexed outputs are replaced.
+   *
+   * @param prefix Attribute path prefix of packages to index.
+   *               It should already be scraped.
+   * @param binaryCache Optional local binary cache directory with
+   *                    `<hash>.ls` listings.
+   * @return The number of outputs whose files were recorded.
+   */
+  size_t
+  indexProvides( const flox::AttrPath &                       prefix,
+                 const std::optional<std::filesystem::path> & binaryCache
+                 = std::nullopt );
+
+  /**
+   * @brief Record the output hash of packages beneath @a prefix, and group
+   *        packages which share one as aliases of a canonical package.
+   *
+   * Only packages without a recorded hash are evaluated, so repeated calls
+   * are cheap.
+   * Packages which fail to evaluate are skipped.
+   *
+   * @param prefix Attribute path prefix of packages to index.
+   *               It should already be scraped.
+   * @return The number of packages in the database which are aliases.
+   * @see flox::pkgdb::PkgDb::updateAliases()
+   */
+  size_t
+  indexAliases( const flox::AttrPath & prefix );
 
   /** @brief Add/set a shortname for this input. */
   void
@@ -273,6 +384,26 @@ public:
 }; /* End struct `PkgDbInput' */
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Registry inputs locked and opened by a long lived caller such as a
+ *        `libpkgdb` session, kept so that later environments reuse their
+ *        locks, evaluators, and database handles.
+ */
+struct PkgDbInputCache
+{
+
+  /** Locked forms of registry inputs keyed by their unlocked JSON form. */
+  std::unordered_map<std::string, RegistryInput> locked;
+
+  /** Opened inputs keyed by their name and JSON form. */
+  std::unordered_map<std::string, std::shared_ptr<PkgDbInput>> inputs;
+
+
+}; /* End struct `PkgDbInputCache' */
+
+
 /* -------------------------------------------------------------------------- */
 
 /** @brief Factory for @a PkgDbInput. */
@@ -284,6 +415,9 @@ private:
   nix::ref<nix::Store>  store;    /**< `nix` store connection. */
   std::filesystem::path cacheDir; /**< Cache directory. */
 
+  /** Inputs to reuse and record opened inputs in, if any. */
+  std::shared_ptr<PkgDbInputCache> cache;
+
 
 public:
 
@@ -292,19 +426,20 @@ public:
   /** @brief Construct a factory using a `nix` evaluator. */
   explicit PkgDbInputFactory( nix::ref<nix::Store> & store,
                               std::filesystem::path  cacheDir
-                              = getPkgDbCachedir() )
-    : store( store ), cacheDir( std::move( cacheDir ) )
+                              = getPkgDbCachedir(),
+                              std::shared_ptr<PkgDbInputCache> cache
+                              = nullptr )
+    : store( store )
+    , cacheDir( std::move( cacheDir ) )
+    , cache( std::move( cache ) )
   {}
 
-  /** @brief Construct an input from a @a RegistryInput. */
+  /**
+   * @brief Construct an input from a @a RegistryInput, or reuse the input
+   *        @a cache holds for it.
+   */
   [[nodiscard]] std::shared_ptr<PkgDbInput>
-  mkInput( const std::string & name, const RegistryInput & input )
-  {
-    return std::make_shared<PkgDbInput>( this->store,
-                                         input,
-                                         this->cacheDir,
-                                         name );
-  }
+  mkInput( const std::string & name, const RegistryInput & input );
 
 
 }; /* End class `PkgDbInputFactory' */
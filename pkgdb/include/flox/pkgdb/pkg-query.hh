@@ -85,9 +85,31 @@ struct PkgQueryArgs
    * Return a single result for each package descriptor used by `search` and
    * `install`. This is a bit hacky as pkgdb shouldn't really have knowledge of
    * that format. But it's nicer to perform deduplication in SQL.
+   *
+   * The best ranked row for each `relPath` is kept, using the same ordering
+   * as the final results.
    */
   bool deduplicate = false;
 
+  /**
+   * Return a single result for each group of packages sharing an output
+   * hash, as recorded by @a flox::pkgdb::PkgDbInput::indexAliases().
+   *
+   * The best ranked row of each group is kept, which is the canonical
+   * package unless ordering prefers one of its aliases.
+   */
+  bool collapseAliases = false;
+
+  /**
+   * Rank packages which were locked more often on this machine before
+   * others with equally exact matches, using the precomputed ranks of
+   * @a flox::pkgdb::UsageDb.
+   *
+   * The usage database must be attached to connections queried with these
+   * arguments by @a flox::pkgdb::UsageDb::attach().
+   */
+  bool rankByUsage = false;
+
   // TODO: would it be better to expose matchPname, matchAttrName,
   // matchDescription, and matchRelPath fields that we join with OR rather than
   // exposing fields that match against multiple columns?
@@ -107,12 +129,20 @@ struct PkgQueryArgs
   std::optional<std::string> pnameOrAttrName;
 
   /**
-   * Filter results to those explicitly marked with the given licenses.
+   * Filter results to those whose licenses are all among the given licenses.
+   * Packages without any recorded license are excluded.
    *
    * NOTE: License strings should be SPDX Ids ( short names ).
    */
   std::optional<std::vector<std::string>> licenses;
 
+  /**
+   * Filter out results having any of the given licenses.
+   *
+   * NOTE: License strings should be SPDX Ids ( short names ).
+   */
+  std::optional<std::vector<std::string>> deniedLicenses;
+
   /** Whether to include packages which are explicitly marked `broken`. */
   bool allowBroken = false;
 
@@ -141,6 +171,15 @@ struct PkgQueryArgs
    */
   std::optional<flox::AttrPath> relPath;
 
+  /**
+   * Filter results to packages with an output that provides a file with
+   * this name, as recorded by @a flox::pkgdb::PkgDbInput::indexProvides().
+   */
+  std::optional<std::string> provides;
+
+  /** Whether @a provides should match the start of file names. */
+  bool providesPrefix = false;
+
 
   /** @brief Reset argset to its _default_ state. */
   void
@@ -171,6 +210,58 @@ struct PkgQueryArgs
 void
 to_json( nlohmann::json & jto, const PkgQueryArgs & args );
 
+/**
+ * @brief Convert a JSON object to an @a flox::pkgdb::PkgQueryArgs.
+ *
+ * Keys match those written by `to_json`, and `null` values leave the
+ * corresponding field at its default.
+ * Throws @a flox::pkgdb::InvalidPkgQueryArg for unrecognized keys or values
+ * of the wrong type.
+ */
+void
+from_json( const nlohmann::json & jfrom, PkgQueryArgs & args );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Build an SQL condition on `Packages.id` which holds for packages
+ *        permitted by a license policy.
+ *
+ * A package is permitted by @a allowed if it has at least one license and
+ * all of its licenses are allowed, and by @a denied if none of its licenses
+ * are denied.
+ * Empty lists and `std::nullopt` impose no restriction.
+ *
+ * @param binds Host parameters used by the condition are added here.
+ * @return The condition, or an empty string if there is no restriction.
+ */
+[[nodiscard]] std::string
+licensePolicyCondition(
+  const std::optional<std::vector<std::string>> & allowed,
+  const std::optional<std::vector<std::string>> & denied,
+  std::unordered_map<std::string, std::string> & binds );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A `Packages.id` paired with the columns used to identify the same
+ *        package across multiple inputs.
+ *
+ * These are returned by @a flox::pkgdb::PkgQuery::executeKeyed() so that
+ * results may be merged across inputs or systems without _hydrating_ rows
+ * that are discarded.
+ */
+struct PkgQueryResult
+{
+  row_id      id;          /**< `Packages.id` of the result. */
+  std::string relPath;     /**< JSON list form of the result's `relPath`. */
+  std::string version;     /**< `Packages.version` or an empty string. */
+  System      system;      /**< The system the result was found for. */
+  std::string description; /**< The description or an empty string. */
+}; /* End struct `PkgQueryResult' */
+
 
 /* -------------------------------------------------------------------------- */
 
@@ -288,10 +379,33 @@ private:
   void
   init();
 
+  /**
+   * @brief Produce an unbound SQL statement exporting @a columns.
+   *
+   * This is used by @a str() and by routines which need to expose columns
+   * other than @a exportedColumns.
+   */
+  [[nodiscard]] std::string
+  str( const std::vector<std::string> & columns ) const;
+
+  /** @brief Create a bound SQLite query exporting @a columns. */
+  [[nodiscard]] std::shared_ptr<sqlite3pp::query>
+  bind( sqlite3pp::database &             pdb,
+        const std::vector<std::string> & columns ) const;
+
   /** @brief A helper to format and escape a string for use in a LIKE clause */
   static std::string
   mkPatternString( const std::string & matchString );
 
+  /**
+   * @brief A helper to escape a string for use as a prefix in a GLOB clause.
+   *
+   * Unlike `LIKE`, `GLOB` is case sensitive so SQLite can answer it with a
+   * range scan over an index.
+   */
+  static std::string
+  mkGlobPrefixString( const std::string & prefix );
+
 public:
 
   PkgQuery() { this->init(); }
@@ -338,6 +452,29 @@ public:
   [[nodiscard]] std::vector<row_id>
   execute( sqlite3pp::database & pdb ) const;
 
+  /**
+   * @brief Query a given database returning an ordered list of
+   *        satisfactory `Packages.id`s along with their `relPath`,
+   *        `version`, `system`, and `description`.
+   *
+   * This performs `semver` filtering.
+   * These keys allow results from multiple inputs to be merged without
+   * reading any other columns.
+   */
+  [[nodiscard]] std::vector<PkgQueryResult>
+  executeKeyed( sqlite3pp::database & pdb ) const;
+
+  /**
+   * @brief Check whether a given database has any satisfactory packages.
+   *
+   * When no `semver` filtering is required this uses an unordered `EXISTS`
+   * probe which stops at the first matching row.
+   * This is useful when a caller only needs to rule out candidates, since it
+   * avoids ranking results that would be discarded.
+   */
+  [[nodiscard]] bool
+  hasResults( sqlite3pp::database & pdb ) const;
+
 
 }; /* End class `PkgQuery' */
 
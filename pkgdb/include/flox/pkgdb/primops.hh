@@ -40,37 +40,31 @@ prim_getFingerprint( nix::EvalState & state,
 
 /* -------------------------------------------------------------------------- */
 
-// TODO
-#if 0
-
 /**
- * @brief Lookup packages in a `pkgdb` database.
+ * @brief Search a flake's package database.
+ *
+ * The flake's database is scraped as needed for the queried subtrees and
+ * systems, and opened inputs are memoized for the lifetime of @a state.
+ * Results are read from the database, so package values are never forced.
  *
  * Takes the following arguments:
- * - `fingerprint`: _fingerprint_ hash for the target flake.
- * - `query`: An attribut set containing `flox::resolver::PkgQueryArgs`.
+ * - `flakeRef`: Either an attribute set or string flake-ref.
+ * - `query`: An attribute set containing `flox::pkgdb::PkgQueryArgs`.
  *
  * Example:
  * ```
- * builtins.queryPackages ( builtins.getFingerprint "github:NixOS/nixpkgs" ) {
- *   name              = null;     # :: null|string
- *   pname             = "hello";  # :: null|string
- *   version           = null;     # :: null|string
- *   semver            = null;     # :: null|string
- *   partialMatch      = null;     # :: null|string
- *   partialNameMatch  = null;     # :: null|string
- *   pnameOrAttrName   = null;     # :: null|string
- *   relPath           = null;     # :: null|list of strings
- *   licenses          = null;     # :: null|list of strings
- *   allowBroken       = false;    # :: null|bool            ( default: false )
- *   allowUnfree       = true;     # :: null|bool            ( default: true )
- *   preferPreReleases = false;    # :: null|bool            ( default: false )
- *   subtrees          = null;     # :: null|list of strings
- *   systems           = null;     # :: null|list of strings ( default:
- * current-system )
+ * builtins.searchPackages "github:NixOS/nixpkgs" {
+ *   pname   = "hello";                 # :: null|string
+ *   semver  = "^2";                    # :: null|string
+ *   systems = [ "x86_64-linux" ];      # :: null|list of strings
  * }
  *
- * # => [6066]
+ * # => [{ attrPath    = ["legacyPackages" "x86_64-linux" "hello"];
+ * #       pname       = "hello";
+ * #       version     = "2.12.1";
+ * #       description = "A program that produces a familiar, ...";
+ * #       system      = "x86_64-linux";
+ * #    }]
  * ```
  *
  * @param state The `nix` evaluator's state.
@@ -80,14 +74,17 @@ prim_getFingerprint( nix::EvalState & state,
  * @param value An allocated `nix::Value` to store the result in.
  */
 void
-prim_queryPackages( nix::EvalState &  state,
-                    const nix::PosIdx pos,
-                    nix::Value **     args,
-                    nix::Value &      value );
+prim_searchPackages( nix::EvalState & state,
+                     nix::PosIdx      pos,
+                     nix::Value **    args,
+                     nix::Value &     value );
 
 
 /* -------------------------------------------------------------------------- */
 
+// TODO
+#if 0
+
 /**
  * @brief Get information about a package from a `pkgdb` database.
  *
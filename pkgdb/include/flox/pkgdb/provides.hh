@@ -0,0 +1,75 @@
+/* ========================================================================== *
+ *
+ * @file flox/pkgdb/provides.hh
+ *
+ * @brief Index the executables and shared libraries installed by packages.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <filesystem>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include <nix/path.hh>
+#include <nix/store-api.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/pkgdb/read.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::pkgdb {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Whether a file should be recorded in the provider index.
+ *
+ * Every file directly beneath `bin` or `sbin` is recorded, along with shared
+ * objects such as `libz.so` or `libz.so.1` directly beneath `lib`.
+ */
+[[nodiscard]] bool
+isProvidedFile( std::string_view dir, std::string_view file );
+
+
+/**
+ * @brief List the provided files in a `nix` binary cache `.ls` listing.
+ * @param listing A parsed listing, such as those written by caches with
+ *                `write-nar-listing = true`.
+ */
+[[nodiscard]] std::vector<ProvidedFile>
+listProvidedFiles( const nlohmann::json & listing );
+
+
+/**
+ * @brief List the provided files of a store path.
+ *
+ * The path's contents are read from @a store if it is valid there.
+ * Otherwise the `<hash>.ls` listing in the local binary cache directory
+ * @a binaryCache is read, if one was given.
+ *
+ * @return The files the path provides, or `std::nullopt` if its contents
+ *         are unavailable.
+ */
+[[nodiscard]] std::optional<std::vector<ProvidedFile>>
+listProvidedFiles( nix::Store &                                 store,
+                   const nix::StorePath &                       path,
+                   const std::optional<std::filesystem::path> & binaryCache
+                   = std::nullopt );
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::pkgdb
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -11,6 +11,7 @@
 
 #include <filesystem>
 #include <functional>
+#include <map>
 #include <queue>
 #include <string>
 #include <thread>
@@ -110,7 +111,7 @@ operator<<( std::ostream & oss, const SqlVersions & versions );
 
 
 /** The current SQLite3 schema versions. */
-constexpr SqlVersions sqlVersions = { .tables = 3, .views = 4 };
+constexpr SqlVersions sqlVersions = { .tables = 7, .views = 5 };
 
 
 /* -------------------------------------------------------------------------- */
@@ -125,6 +126,25 @@ FLOX_DEFINE_EXCEPTION( PkgDbException, EC_PKG_DB, "error running pkgdb" )
 /** @} */
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A file installed by a package output which `pkgdb provides`
+ *        can lookup.
+ */
+struct ProvidedFile
+{
+  std::string dir;  /**< Directory in the output, e.g. `bin`. */
+  std::string file; /**< Name of the file, e.g. `hello`. */
+
+  [[nodiscard]] bool
+  operator==( const ProvidedFile & other ) const
+  {
+    return ( this->dir == other.dir ) && ( this->file == other.file );
+  }
+}; /* End struct `ProvidedFile' */
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -142,6 +162,34 @@ std::filesystem::path
 genPkgDbName( const Fingerprint &           fingerprint,
               const std::filesystem::path & cacheDir = getPkgDbCachedir() );
 
+/**
+ * @brief Find existing databases in @a cacheDir for a given flake reference
+ *        among the databases of @a fingerprints.
+ *
+ * A database matches when every attribute of @a ref appears with the same
+ * value in its `LockedFlake.attrs`, so a reference to a single revision
+ * matches that revision's database regardless of its `narHash`.
+ * Only databases of @a fingerprints are opened, and nothing is fetched,
+ * locked, or scraped.
+ * @return Absolute paths to matching databases.
+ */
+std::vector<std::filesystem::path>
+findPkgDbs( const nix::FlakeRef &            ref,
+            const std::vector<Fingerprint> & fingerprints,
+            const std::filesystem::path &    cacheDir = getPkgDbCachedir() );
+
+/**
+ * @brief Find existing databases in @a cacheDir for a given fingerprint.
+ *
+ * This includes the database named by @a genPkgDbName and those of inputs
+ * with scrape rules, which are named `<FINGERPRINT>.<RULES-HASH>.sqlite`.
+ * @return Absolute paths to matching databases, with the database named by
+ *         @a genPkgDbName first if it exists.
+ */
+std::vector<std::filesystem::path>
+findPkgDbs( const Fingerprint &           fingerprint,
+            const std::filesystem::path & cacheDir = getPkgDbCachedir() );
+
 
 /* -------------------------------------------------------------------------- */
 
@@ -358,6 +406,35 @@ public:
   bool
   hasPackage( const flox::AttrPath & path );
 
+  /**
+   * @brief Get the attributes which were quarantined while scraping.
+   * @param prefix Only list attributes beneath this attribute path prefix.
+   * @return A map of absolute attribute paths to the reason they were
+   *         quarantined.
+   */
+  std::map<flox::AttrPath, std::string>
+  getQuarantined( const flox::AttrPath & prefix = {} );
+
+  /**
+   * @brief Get the files recorded for a package by
+   *        @a flox::pkgdb::PkgDbInput::indexProvides().
+   * @param row The `Packages.id` to lookup.
+   * @return Paths relative to the package's outputs such as `bin/hello`,
+   *         in lexicographical order.
+   */
+  std::vector<std::string>
+  getProvidedFiles( row_id row );
+
+  /**
+   * @brief Get the other packages which share a package's output hash, as
+   *        recorded by @a flox::pkgdb::PkgDbInput::indexAliases().
+   * @param row The `Packages.id` to lookup.
+   * @return Relative attribute paths with the canonical package first, and
+   *         the remaining aliases in lexicographical order.
+   */
+  std::vector<flox::AttrPath>
+  getAliases( row_id row );
+
   /**
    * @brief Get the `Description.description` for a given `Description.id`.
    * @param descriptionId The row id to lookup.
@@ -376,6 +453,19 @@ public:
   std::vector<row_id>
   getPackages( const PkgQueryArgs & params );
 
+  /**
+   * @brief Return the members of @a rows which are not permitted by a
+   *        license policy.
+   *
+   * This is a single query answered by the `PackagesLicenses` indexes.
+   * @see flox::pkgdb::licensePolicyCondition
+   */
+  std::vector<row_id>
+  getLicenseViolations(
+    const std::vector<row_id> &                     rows,
+    const std::optional<std::vector<std::string>> & allowed,
+    const std::optional<std::vector<std::string>> & denied );
+
   /**
    * @brief Get metadata about a single package.
    *
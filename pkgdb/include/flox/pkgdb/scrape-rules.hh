@@ -32,6 +32,21 @@ struct ScrapeRulesRaw
   std::vector<AttrPathGlob> disallowPackage;
   std::vector<AttrPathGlob> allowRecursive;
   std::vector<AttrPathGlob> disallowRecursive;
+  /**
+   * Limits scraping to these prefixes when non-empty.
+   * Attributes which are neither beneath nor an ancestor of a prefix in
+   * @a scope are skipped.
+   */
+  std::vector<AttrPathGlob> scope;
+
+  /** @brief Whether no rules are defined. */
+  [[nodiscard]] bool
+  empty() const
+  {
+    return this->allowPackage.empty() && this->disallowPackage.empty()
+           && this->allowRecursive.empty() && this->disallowRecursive.empty()
+           && this->scope.empty();
+  }
 }; /* End struct `ScrapeRulesRaw` */
 
 
@@ -39,6 +54,10 @@ struct ScrapeRulesRaw
 void
 from_json( const nlohmann::json & jfrom, ScrapeRulesRaw & rules );
 
+/** @brief Convert a @a flox::pkgdb::ScrapeRulesRaw to a JSON object. */
+void
+to_json( nlohmann::json & jto, const ScrapeRulesRaw & rules );
+
 
 /* -------------------------------------------------------------------------- */
 
@@ -118,12 +137,22 @@ struct RulesTreeNode
    *
    * This will add a node at @a relPath, relative to this node with the given
    * rule, setting new descendant nodes to SR_DEFAULT along the way.  Trying to
-   * overwrite an existing rule that is not SR_DEFAULT will throw an exception.
+   * overwrite an existing rule that is not SR_DEFAULT will throw an exception
+   * unless @a overwrite is set.
    *
    * @see @a flox::pkgdb::RulesTreeNode::applyRules
    */
   void
-  addRule( AttrPathGlob & relPath, ScrapeRule rule );
+  addRule( AttrPathGlob & relPath, ScrapeRule rule, bool overwrite = false );
+
+  /**
+   * @brief Add each rule in @a raw in order of precedence.
+   *
+   * The @a flox::pkgdb::ScrapeRulesRaw::scope field is not part of the tree
+   * and is ignored.
+   */
+  void
+  addRules( const ScrapeRulesRaw & raw, bool overwrite = false );
 
   /**
    * @brief Get the rule at a path, or @a flox::pkgdb::SR_DEFAULT as a fallback.
@@ -170,16 +199,24 @@ public:
    */
   explicit ScrapeRules( const std::string_view & rulesJSON );
 
+  /**
+   * @brief Creates a set of rules by merging @a overlay into @a base.
+   *
+   * Rules in @a overlay replace those in @a base for the same path, and its
+   * `scope` replaces that of @a base if it is non-empty.
+   * The hash covers both sets of rules.
+   */
+  ScrapeRules( const ScrapeRules & base, const ScrapeRulesRaw & overlay );
+
   /**
    * @brief Applies the rules of the tree to the @a path provided.  See @a
    * RulesTreeNode::applyRules() for further details.
    *
+   * Paths outside of the scope are disallowed, and ancestors of a
+   * scope prefix are allowed.
    */
   [[nodiscard]] std::optional<bool>
-  applyRules( const AttrPath & path ) const
-  {
-    return rootNode.applyRules( path );
-  }
+  applyRules( const AttrPath & path ) const;
 
   /**
    * @brief Returns the root tree node of the rules tree.
@@ -203,8 +240,9 @@ public:
 
 private:
 
-  RulesTreeNode rootNode;
-  nix::Hash     hash;
+  RulesTreeNode             rootNode;
+  nix::Hash                 hash;
+  std::vector<AttrPathGlob> scope;
 }; /* End clss `ScrapeRules' */
 
 /** @brief Convert a JSON object to a @a flox::pkgdb::RulesTreeNode. */
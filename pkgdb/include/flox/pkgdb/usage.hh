@@ -0,0 +1,187 @@
+/* ========================================================================== *
+ *
+ * @file flox/pkgdb/usage.hh
+ *
+ * @brief A local record of how often packages are locked, used to rank
+ *        search results.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+#include <sqlite3pp.hh>
+
+#include "flox/core/exceptions.hh"
+#include "flox/core/types.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::pkgdb {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @class flox::pkgdb::InvalidUsageFileException
+ * @brief An exception thrown when a usage file cannot be read or parsed.
+ * @{
+ */
+FLOX_DEFINE_EXCEPTION( InvalidUsageFileException,
+                       EC_INVALID_USAGE_FILE,
+                       "invalid usage file" )
+/** @} */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief The number of times a package was locked. */
+struct PackageUsage
+{
+  /** The `pname` of the package. */
+  std::string pname;
+  /** The attribute path of the package following its subtree and system. */
+  AttrPath relPath;
+  /** The number of times the package was locked. */
+  std::uint64_t count = 1;
+
+  [[nodiscard]] bool
+  operator==( const PackageUsage & other ) const
+    = default;
+
+}; /* End struct `PackageUsage' */
+
+
+/** @brief Convert a JSON object to an @a flox::pkgdb::PackageUsage. */
+void
+from_json( const nlohmann::json & jfrom, PackageUsage & usage );
+
+/** @brief Convert an @a flox::pkgdb::PackageUsage to a JSON object. */
+void
+to_json( nlohmann::json & jto, const PackageUsage & usage );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Get the rank of a package locked @a count times.
+ *
+ * Ranks are the number of bits needed to represent @a count, so packages
+ * which were never locked have rank `0`, and a package's rank only changes
+ * when its count doubles.
+ * This keeps search results stable as counts grow, leaving packages with
+ * similar counts to be ordered by the usual heuristics.
+ */
+[[nodiscard]] unsigned
+getUsageRank( std::uint64_t count );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Get the path to the default usage database.
+ *
+ * The environment variable `PKGDB_USAGE` is respected if it is set,
+ * otherwise `${XDG_DATA_HOME:-$HOME/.local/share}/flox/usage.sqlite`
+ * is used.
+ * Setting `PKGDB_USAGE` to an empty string disables recording and ranking
+ * by usage, in which case an empty path is returned.
+ */
+[[nodiscard]] std::filesystem::path
+getUsageDbPath();
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A SQLite3 database recording how often packages are locked on this
+ *        machine.
+ *
+ * Each `( pname, relPath )` pair is a row of the `Usage` table holding its
+ * count and precomputed rank.
+ * Recording usage only writes the rows of the recorded packages, so the cost
+ * of an update doesn't grow with the number of packages recorded before it.
+ */
+class UsageDb
+{
+
+public:
+
+  sqlite3pp::database   db;     /**< SQLite3 database handle. */
+  std::filesystem::path dbPath; /**< Absolute path to database. */
+
+
+  /**
+   * @brief Open a usage database.
+   * @param dbPath Path to the database.
+   * @param create Whether to create the database if it doesn't exist.
+   */
+  explicit UsageDb( const std::filesystem::path & dbPath = getUsageDbPath(),
+                    bool                          create = false );
+
+  UsageDb( const UsageDb & ) = delete;
+  UsageDb( UsageDb && )      = delete;
+  ~UsageDb()                 = default;
+
+  UsageDb &
+  operator=( const UsageDb & )
+    = delete;
+  UsageDb &
+  operator=( UsageDb && )
+    = delete;
+
+  /**
+   * @brief Add the counts of @a usages to those already recorded.
+   * @return The number of rows written.
+   */
+  std::size_t
+  record( const std::vector<PackageUsage> & usages );
+
+  /**
+   * @brief Add the counts of a usage file to those already recorded.
+   *
+   * A usage file is a JSON list of usages such as
+   * `[{ "pname": "git", "relPath": ["git"], "count": 12 }]`.
+   * @return The number of usages imported.
+   */
+  std::size_t
+  importFile( const std::filesystem::path & usagePath );
+
+  /** @brief Get the number of times a package was recorded as locked. */
+  [[nodiscard]] std::uint64_t
+  getCount( const std::string & pname, const AttrPath & relPath );
+
+  /**
+   * @brief Attach the usage database at @a dbPath to another connection as
+   *        `usage`, so that its queries may read the `usage.Usage` table.
+   *
+   * This is a no-op if a database is already attached as `usage`.
+   * @return `true` if a database is attached, `false` if @a dbPath is empty
+   *         or doesn't exist.
+   */
+  static bool
+  attach( sqlite3pp::database &         other,
+          const std::filesystem::path & dbPath = getUsageDbPath() );
+
+
+}; /* End class `UsageDb' */
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::pkgdb
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -10,6 +10,10 @@
 #pragma once
 
 #include <filesystem>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <set>
 #include <stack>
 #include <tuple>
 
@@ -27,6 +31,9 @@ namespace flox::pkgdb {
 
 /* -------------------------------------------------------------------------- */
 
+/* Forward declare */
+class ScrapeRules;
+
 /** @brief A set of arguments used by @a flox::pkgdb::PkgDb::scrape. */
 using Target = std::tuple<flox::AttrPath, flox::Cursor, row_id>;
 
@@ -45,6 +52,26 @@ using Todos = std::stack<Target, std::list<Target>>;
 class PkgDb : public PkgDbReadOnly
 {
 
+  /**
+   * Quarantined `( Quarantine.parentId, Quarantine.attrName )` pairs, loaded
+   * by @a scrapeRange on first use.
+   */
+  std::optional<std::set<std::pair<row_id, std::string>>> quarantined;
+
+  /**
+   * Rules used to filter attributes while scraping, or `nullptr` to use
+   * @a flox::pkgdb::getDefaultRules().
+   */
+  std::shared_ptr<const ScrapeRules> scrapeRules;
+
+  /**
+   * Lookup of a package's `id` by `( parentId, attrName )`, prepared on first
+   * use by @a addPackage.
+   * The database handle belongs to the base class, so this is finalized
+   * first.
+   */
+  std::unique_ptr<sqlite3pp::query> packageIdQuery;
+
   /* Internal Helpers */
 
 protected:
@@ -120,8 +147,12 @@ public:
    * Creates database if one does not exist.
    * @param flake Flake associated with the db. Used to write input metadata.
    * @param dbPath Absolute path to database file.
+   * @param scrapeRules Rules used to filter attributes while scraping,
+   *                    or `nullptr` to use the default rules.
    */
-  PkgDb( const nix::flake::LockedFlake & flake, std::string_view dbPath );
+  PkgDb( const nix::flake::LockedFlake &    flake,
+         std::string_view                   dbPath,
+         std::shared_ptr<const ScrapeRules> scrapeRules = nullptr );
 
   /**
    * @brief Opens a DB associated with a locked flake.
@@ -133,6 +164,10 @@ public:
     : PkgDb( flake, genPkgDbName( flake.getFingerprint() ).string() )
   {}
 
+  /** @brief Get the rules used to filter attributes while scraping. */
+  [[nodiscard]] const ScrapeRules &
+  getScrapeRules() const;
+
   /* Connecting and locking */
 
   /**
@@ -204,6 +239,19 @@ public:
   row_id
   addOrGetDescriptionId( const std::string & description );
 
+  /**
+   * @brief Get the `Licenses.id` for a given license if it exists, or
+   *        insert a new row for @a license and return its `id`.
+   *
+   * Licenses are identified by @a flox::License::name, and the first
+   * recorded `spdxId`, `free`, and `redistributable` fields are kept.
+   * @param license A license listed by a package.
+   * @return A unique `row_id` ( unsigned 64bit int ) associated
+   *         with @a license.
+   */
+  row_id
+  addOrGetLicenseId( const License & license );
+
   /**
    * @brief Adds a package to the database.
    * @param parentId The `pathId` associated with the parent path.
@@ -217,6 +265,19 @@ public:
               std::string_view     attrName,
               const flox::Cursor & cursor );
 
+  /**
+   * @brief Adds a package to the database.
+   * @param parentId The `pathId` associated with the parent path.
+   * @param attrName The name of the attribute name to be added ( last element
+   *                 of the attribute path ).
+   * @param pkg A package definition to read metadata from.
+   * @return The `Packages.id` value for the added package.
+   */
+  row_id
+  addPackage( row_id           parentId,
+              std::string_view attrName,
+              const Package &  pkg );
+
   /* Updates */
 
   /**
@@ -259,6 +320,101 @@ public:
           uint               pageSize,
           uint               pageIdx );
 
+  /**
+   * @brief Scrape package definitions from a range of an attribute set.
+   *
+   * Processes the child attributes @a startIdx through
+   * @a startIdx + @a count of the attribute set rooted at @a target, depth
+   * first.  Quarantined attributes are skipped.
+   *
+   * @param syms Symbol table from @a cursor evaluator.
+   * @param target A tuple containing the attribute path to scrape, a cursor,
+   *               and a SQLite _row id_.
+   * @param startIdx Index of the first child attribute to process.
+   * @param count The maximum number of child attributes to process.
+   * @return True if the entire attribute set has been processed.
+   */
+  bool
+  scrapeRange( nix::SymbolTable & syms,
+               const Target &     target,
+               size_t             startIdx,
+               size_t             count );
+
+  /**
+   * @brief Record an attribute which could not be scraped so that later
+   *        scrapes skip it.
+   * @param path Absolute attribute path to quarantine.
+   * @param reason Human readable description of the failure.
+   */
+  void
+  addQuarantine( const flox::AttrPath & path, std::string_view reason );
+
+  /**
+   * @brief Remove quarantine records for all attributes beneath @a prefix so
+   *        that they will be retried.
+   * @param prefix Attribute path prefix to clear.
+   */
+  void
+  clearQuarantine( const flox::AttrPath & prefix );
+
+  /**
+   * @brief Replace the files recorded for one output of a package.
+   * @param row The `Packages.id` of the package.
+   * @param output The name of the output, e.g. `out`.
+   * @param files Files installed by the output.
+   */
+  void
+  setProvidedFiles( row_id                            row,
+                    const std::string &               output,
+                    const std::vector<ProvidedFile> & files );
+
+  /**
+   * @brief Record the hash part of a package's `outPath`.
+   *
+   * Aliases are not updated until @a updateAliases() is called.
+   * @param row The `Packages.id` of the package.
+   * @param outHash The hash part of the package's `outPath`.
+   */
+  void
+  setOutHash( row_id row, std::string_view outHash );
+
+  /**
+   * @brief Group packages sharing an `outHash` under a canonical package.
+   *
+   * The canonical package of a group is the one with the shallowest and then
+   * shortest relative attribute path.
+   * Every other member has `aliasOf` set to its id, while packages without a
+   * recorded `outHash` are never aliases.
+   * @return The number of packages which are aliases.
+   */
+  size_t
+  updateAliases();
+
+  /**
+   * Optional hook invoked by @a scrapeRange with the absolute attribute path
+   * of each attribute before it is processed.
+   */
+  std::function<void( const flox::AttrPath & )> onScrapeAttrib;
+
+  /**
+   * @brief Populate the attribute set @a prefix from a precomputed metadata
+   *        dump instead of evaluating it.
+   *
+   * The dump is a JSON object mapping attribute paths relative to @a prefix
+   * to package metadata, in the format produced by
+   * `nix-env -qaP --json --meta`.
+   * Entries are stream-parsed and filtered by the same @a ScrapeRules used
+   * by @a scrape, and the source of the dump is recorded in `DbScrapeMeta`.
+   * On success @a prefix is marked as done.
+   *
+   * @param prefix Attribute set prefix such as `legacyPackages.x86_64-linux`.
+   * @param dumpPath Path to the metadata dump.
+   * @return The number of packages added.
+   */
+  size_t
+  importMetadataDump( const flox::AttrPath &        prefix,
+                      const std::filesystem::path & dumpPath );
+
   /**
    * @brief Helper function for @a scrape to process a single attribute, adding
    * child attributes to the @a todo queue when appropriate to recurse.
@@ -47,6 +47,8 @@ public:
   std::optional<bool>        broken;
   std::optional<bool>        unfree;
   std::optional<std::string> description;
+  /** Every license listed, if @a license alone doesn't describe them. */
+  std::vector<License> licenses;
 
   explicit RawPackage( AttrPath                         path    = {},
                        std::string_view                 name    = {},
@@ -113,6 +115,13 @@ public:
     return this->license;
   }
 
+  [[nodiscard]] std::vector<License>
+  getLicenses() const override
+  {
+    if ( this->licenses.empty() ) { return Package::getLicenses(); }
+    return this->licenses;
+  }
+
   [[nodiscard]] std::vector<std::string>
   getOutputs() const override
   {
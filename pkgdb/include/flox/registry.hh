@@ -24,6 +24,7 @@
 #include "flox/core/util.hh"
 #include "flox/flox-flake.hh"
 #include "flox/pkgdb/pkg-query.hh"
+#include "flox/pkgdb/scrape-rules.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -139,6 +140,13 @@ struct RegistryInput : public InputPreferences
 
   std::shared_ptr<nix::FlakeRef> from; /**< A parsed flake reference. */
 
+  /**
+   * Scraping rules merged with @a flox::pkgdb::getDefaultRules() for this
+   * input, such as a `scope` limiting scraping to a few prefixes.
+   * Inputs with different rules are scraped to separate databases.
+   */
+  std::optional<pkgdb::ScrapeRulesRaw> scrape;
+
   RegistryInput() = default;
 
   RegistryInput( const std::optional<std::vector<Subtree>> & subtrees,
@@ -168,6 +176,14 @@ struct RegistryInput : public InputPreferences
         return false;
       }
 
+    if ( ( this->scrape.has_value() != other.scrape.has_value() )
+         || ( this->scrape.has_value()
+              && ( nlohmann::json( *this->scrape )
+                   != nlohmann::json( *other.scrape ) ) ) )
+      {
+        return false;
+      }
+
     if ( this->from == other.from ) { return true; }
 
     if ( ( this->from == nullptr ) || ( other.from == nullptr ) )
@@ -9,9 +9,11 @@
 
 #pragma once
 
+#include <cstddef>
 #include <filesystem>
 #include <optional>
 
+#include "flox/core/nix-state.hh"
 #include "flox/resolver/manifest-raw.hh"
 #include "flox/resolver/mixins.hh"
 #include "flox/search/command.hh"
@@ -31,6 +33,12 @@ private:
 
   command::VerboseParser parser;
 
+  /** Systems to lock, set by `--native`. */
+  lock_mode mode = LM_ALL;
+
+  /** Whether `--complete` was given, which requires an existing lockfile. */
+  bool complete = false;
+
 
 public:
 
@@ -44,6 +52,20 @@ public:
     return this->parser;
   }
 
+  /**
+   * @brief Set the files to lock without parsing any arguments.
+   * @param manifestPath Path to the project's manifest.
+   * @param lockfilePath Path to the project's existing lockfile, if any.
+   */
+  void
+  setFiles( const std::filesystem::path &                manifestPath,
+            const std::optional<std::filesystem::path> & lockfilePath
+            = std::nullopt );
+
+  /** @brief Lock the manifest, returning the contents of its lockfile. */
+  [[nodiscard]] nlohmann::json
+  lock();
+
   /**
    * @brief Execute the `lock` routine.
    * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
@@ -208,7 +230,12 @@ public:
 
 /* -------------------------------------------------------------------------- */
 
-/** @brief Check a locked manifest. */
+/**
+ * @brief Check a locked manifest.
+ *
+ * Packages are also matched against the default advisory database when one
+ * has been imported with `pkgdb advisories import`.
+ */
 class CheckCommand
 {
 
@@ -307,6 +334,127 @@ public:
 }; /* End class `ManifestCommand' */
 
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Show semantic differences between two lockfiles. */
+class LockfileDiffCommand : NixState
+{
+
+private:
+
+  std::filesystem::path oldLockfilePath;
+  std::filesystem::path newLockfilePath;
+
+  /** Whether to evaluate store paths of packages which may have changed. */
+  bool storePaths = false;
+
+  /** Whether to measure closure sizes in the local store. */
+  bool closureSize = false;
+
+  command::VerboseParser parser;
+
+
+public:
+
+  LockfileDiffCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `diff` routine.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `LockfileDiffCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Re-evaluate the packages of a lockfile to check that they still
+ *        match their locked inputs.
+ *
+ * This doesn't derive from @a flox::NixState since evaluation happens in
+ * forked children, which must not share the parent's store connection.
+ */
+class LockfileVerifyCommand
+{
+
+private:
+
+  std::filesystem::path lockfilePath;
+
+  /** The maximum number of evaluators to run at once. */
+  std::size_t jobs;
+
+  /** Whether to report packages which match their locked inputs. */
+  bool all = false;
+
+  command::VerboseParser parser;
+
+
+public:
+
+  LockfileVerifyCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `verify` routine.
+   * @return `EXIT_SUCCESS` if every package matches its locked input,
+   *         otherwise `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `LockfileVerifyCommand' */
+
+
+/* -------------------------------------------------------------------------- */
+
+class LockfileCommand
+{
+
+private:
+
+  command::VerboseParser parser;    /**< `lockfile`        parser */
+  LockfileDiffCommand    cmdDiff;   /**< `lockfile diff`   command */
+  LockfileVerifyCommand  cmdVerify; /**< `lockfile verify` command */
+
+
+public:
+
+  LockfileCommand();
+
+  [[nodiscard]] command::VerboseParser &
+  getParser()
+  {
+    return this->parser;
+  }
+
+  /**
+   * @brief Execute the `lockfile` sub-command.
+   * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
+   */
+  int
+  run();
+
+
+}; /* End class `LockfileCommand' */
+
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox::resolver
@@ -316,6 +316,20 @@ public:
 void
 to_json( nlohmann::json & jto, const ManifestDescriptor & descriptor );
 
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Get a fingerprint of the fields of @a descriptor which decide what
+ *        package it resolves to.
+ *
+ * Descriptors with equal fingerprints may reuse each other's locks.
+ * `optional`, `systems`, `group`, and `priority` are left out since they
+ * don't change the package.
+ */
+[[nodiscard]] std::string
+getResolutionFingerprint( const ManifestDescriptor & descriptor );
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -9,9 +9,13 @@
 
 #pragma once
 
+#include <map>
 #include <memory>
 #include <optional>
+#include <string>
 #include <string_view>
+#include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -20,6 +24,7 @@
 #include "flox/core/exceptions.hh"
 #include "flox/core/nix-state.hh"
 #include "flox/core/types.hh"
+#include "flox/pkgdb/advisories.hh"
 #include "flox/pkgdb/input.hh"
 #include "flox/pkgdb/pkg-query.hh"
 #include "flox/registry.hh"
@@ -90,6 +95,32 @@ using ResolutionResult = std::variant<ResolutionFailure, SystemPackages>;
 using Upgrades = std::variant<bool, std::vector<GroupName>>;
 
 
+/** @brief Systems locked by @a flox::resolver::Environment::createLockfile. */
+enum lock_mode {
+  LM_ALL    = 0, /**< Lock every system. */
+  LM_NATIVE = 1  /**< Lock the current system and defer the others. */
+}; /* End enum `lock_mode' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief An input+rev that a group of descriptors may be resolved in.
+ *
+ * Candidates are tried in order by
+ * @a flox::resolver::Environment::solveGroup().
+ */
+struct GroupCandidate
+{
+  /** The locked input recorded for packages resolved in @a dbRO. */
+  LockedInputRaw input;
+  /** Package database for @a input. */
+  std::shared_ptr<pkgdb::PkgDbReadOnly> dbRO;
+  /** Base query parameters with the input's preferences already filled. */
+  pkgdb::PkgQueryArgs args;
+}; /* End struct `GroupCandidate' */
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -120,6 +151,13 @@ private:
   /** Previous generation of the lockfile ( if any ). */
   std::optional<Lockfile> oldLockfile;
 
+  /**
+   * Lockfiles of included environments whose locks may be adopted by groups
+   * which @a oldLockfile can't reuse.
+   * @see flox::resolver::composeManifest
+   */
+  std::vector<Lockfile> includedLockfiles;
+
 
   /** Groups to force an upgrade for, even if they are already locked. Note that
    * no error is thrown if a non-existent group is specified here. */
@@ -128,6 +166,9 @@ private:
   /** New/modified lockfile being edited. */
   std::optional<LockfileRaw> lockfileRaw;
 
+  /** Systems being locked by @a createLockfile. */
+  lock_mode lockMode = LM_ALL;
+
   std::optional<RegistryRaw> combinedRegistryRaw;
 
   std::optional<Options> combinedOptions;
@@ -139,6 +180,28 @@ private:
 
   std::shared_ptr<Registry<pkgdb::PkgDbInputFactory>> dbs;
 
+  /** Inputs shared with other environments of a long lived session. */
+  std::shared_ptr<pkgdb::PkgDbInputCache> inputCache;
+
+  /** Databases for `options.group-revisions` keyed by input name. */
+  std::optional<
+    std::unordered_map<std::string,
+                       std::vector<std::shared_ptr<pkgdb::PkgDbReadOnly>>>>
+    revisionDbs;
+
+  /**
+   * Install IDs locked to packages which violate the license policy, keyed by
+   * @a oldLockfile or a member of @a includedLockfiles, and by system.
+   */
+  std::map<std::pair<const Lockfile *, System>, std::unordered_set<InstallID>>
+    licenseViolations;
+
+  /**
+   * The default advisory database, opened on first use.
+   * This is `nullptr` if no advisories have been imported.
+   */
+  std::optional<std::unique_ptr<pkgdb::AdvisoryDb>> advisories;
+
 
   static LockedPackageRaw
   lockPackage( const LockedInputRaw & input,
@@ -163,17 +226,55 @@ private:
   [[nodiscard]] bool
   upgradingGroup( const GroupName & name ) const;
 
+  /**
+   * @brief Get the install IDs of packages locked by @a lockfile for
+   *        @a system which `options.allow.licenses` or
+   *        `options.deny.licenses` do not permit.
+   *
+   * Packages are checked with a single query per input database.
+   * Inputs without a cached database are assumed to comply.
+   *
+   * @param lockfile Either @a oldLockfile or a member of
+   *                 @a includedLockfiles.
+   */
+  [[nodiscard]] const std::unordered_set<InstallID> &
+  getLicenseViolations( const Lockfile & lockfile, const System & system );
+
+  /**
+   * @brief Whether @a group can reuse its locks from @a oldLockfile.
+   *
+   * Groups with packages that violate the license policy are locked again.
+   *
+   * @param oldLockfile Either @a oldLockfile or a member of
+   *                    @a includedLockfiles.
+   */
+  [[nodiscard]] bool
+  groupIsReusable( const GroupName &          name,
+                   const InstallDescriptors & group,
+                   const Lockfile &           oldLockfile,
+                   const System &             system );
+
+  /**
+   * @brief Get the lockfile whose locks @a group can reuse.
+   *
+   * @a oldLockfile is preferred, followed by @a includedLockfiles in order,
+   * so a group is only adopted from an included environment when it is
+   * unchanged in that environment.
+   *
+   * @return The lockfile, or `nullptr` if the group must be locked again.
+   */
+  [[nodiscard]] const Lockfile *
+  getGroupLockfile( const GroupName &          name,
+                    const InstallDescriptors & group,
+                    const System &             system );
+
   /**
    * @brief Get groups that need to be locked as opposed to reusing locks from
-   *        @a oldLockfile.
+   *        @a oldLockfile or @a includedLockfiles.
    */
   [[nodiscard]] Groups
   getUnlockedGroups( const System & system );
 
-  /** @brief Get groups with locks that can be reused from @a oldLockfile. */
-  [[nodiscard]] Groups
-  getLockedGroups( const System & system );
-
   /**
    * @brief Get a merged form of @a oldLockfile or @a globalManifest
    *        ( if available ) and @a manifest options.
@@ -186,29 +287,51 @@ private:
   [[nodiscard]] const Options &
   getCombinedOptions();
 
-  /** @brief Try to resolve a descriptor in a given package database. */
-  [[nodiscard]] std::optional<pkgdb::row_id>
-  tryResolveDescriptorIn( const ManifestDescriptor & descriptor,
-                          const pkgdb::PkgDbInput &  input,
-                          const System &             system );
+  /**
+   * @brief Create a group candidate for @a input using the combined base
+   *        query parameters and the input's preferences.
+   *
+   * @param input A registry input.
+   * @param dbRO A database for another revision of @a input, or `nullptr`
+   *             to use @a input itself.
+   */
+  [[nodiscard]] GroupCandidate
+  mkGroupCandidate( const pkgdb::PkgDbInput &             input,
+                    std::shared_ptr<pkgdb::PkgDbReadOnly> dbRO = nullptr );
+
+  /**
+   * @brief Get the fingerprints of the registry's inputs and of every input
+   *        locked by @a oldLockfile or @a includedLockfiles.
+   */
+  [[nodiscard]] std::vector<pkgdb::Fingerprint>
+  getKnownFingerprints();
 
   /**
-   * @brief Try to resolve a group of descriptors in a given package database.
+   * @brief Get existing databases for the revisions of an input listed in
+   *        `options.group-revisions`, newest first.
    *
-   * @return InstallID of the package that can't be resolved if resolution
-   *         fails, otherwise a set of resolved packages for the system.
+   * Only databases of @a getKnownFingerprints are opened, rather than every
+   * database in the cache directory.
    */
-  [[nodiscard]] std::variant<InstallID, SystemPackages>
-  tryResolveGroupIn( const InstallDescriptors & group,
-                     const pkgdb::PkgDbInput &  input,
-                     const System &             system );
+  [[nodiscard]] const std::vector<std::shared_ptr<pkgdb::PkgDbReadOnly>> &
+  getRevisionDbs( const std::string & inputName );
+
+  /**
+   * @brief Get the default advisory database.
+   * @return The database, or `nullptr` if no advisories have been imported.
+   */
+  [[nodiscard]] pkgdb::AdvisoryDb *
+  getAdvisories();
 
   /**
    * @brief Try to resolve a group of descriptors
    *
    * Attempts to resolve using a locked input from the old lockfile if it exists
    * for the group. If not, inputs from the combined environment registry
-   * are used.
+   * are used, each followed by its `options.group-revisions`.
+   *
+   * Systems left pending by an @a LM_NATIVE lock have no locked inputs of
+   * their own, so the group's input on another locked system is tried first.
    *
    * @param group The group of descriptors to resolve.
    * @param system The system to resolve for.
@@ -236,6 +359,36 @@ private:
 
 protected:
 
+  /**
+   * @brief Resolve a group of descriptors in the first of @a candidates which
+   *        satisfies every required member.
+   *
+   * This is a first-fit search rather than a backtracking solver: candidates
+   * are tried in order, and in the chosen candidate each member independently
+   * takes its best ranked row.
+   * Candidates are ruled out with cheap existence queries before any rows
+   * are ranked.
+   * A member which rules out a candidate is checked first against the
+   * remaining candidates since it is the most likely to fail again.
+   *
+   * @param group The group of descriptors to resolve.
+   * @param candidates Inputs+revs to try, in order of preference.
+   * @param system The system to resolve for.
+   * @param numPinned The number of leading @a candidates which are pinned by
+   *                  an old lockfile.
+   *                  Choosing any later candidate is reported as an upgrade.
+   * @param advisories If set, packages with known advisories are only
+   *                   chosen when no other package matches a descriptor.
+   * @return The first failing _install ID_ for each candidate if no
+   *         candidate satisfies the group, otherwise the resolved packages.
+   */
+  [[nodiscard]] static ResolutionResult
+  solveGroup( const InstallDescriptors &          group,
+              const std::vector<GroupCandidate> & candidates,
+              const System &                      system,
+              size_t                              numPinned  = 0,
+              pkgdb::AdvisoryDb *                 advisories = nullptr );
+
   /**
    * @brief Get locked input from a lockfile to try to use to resolve a group
    *        of packages.
@@ -286,10 +439,12 @@ public:
   Environment( std::optional<GlobalManifest> globalManifest,
                EnvironmentManifest           manifest,
                std::optional<Lockfile>       oldLockfile,
-               Upgrades                      upgrades = false )
+               Upgrades                      upgrades          = false,
+               std::vector<Lockfile>         includedLockfiles = {} )
     : globalManifest( std::move( globalManifest ) )
     , manifest( std::move( manifest ) )
     , oldLockfile( std::move( oldLockfile ) )
+    , includedLockfiles( std::move( includedLockfiles ) )
     , upgrades( std::move( upgrades ) )
   {}
 
@@ -300,6 +455,22 @@ public:
     , oldLockfile( std::move( oldLockfile ) )
   {}
 
+  /**
+   * @brief Share a store connection and opened inputs with other
+   *        environments of a long lived session.
+   *
+   * Inputs are locked and opened once per session rather than once per
+   * environment.
+   * This must be called before the registry is locked or opened.
+   */
+  void
+  useSession( const nix::ref<nix::Store> &            store,
+              std::shared_ptr<pkgdb::PkgDbInputCache> inputCache )
+  {
+    this->setStore( store );
+    this->inputCache = std::move( inputCache );
+  }
+
   [[nodiscard]] const std::optional<GlobalManifest> &
   getGlobalManifest() const
   {
@@ -330,12 +501,19 @@ public:
   [[nodiscard]] std::optional<ManifestRaw>
   getOldManifestRaw() const;
 
-  [[nodiscard]] std::optional<Lockfile>
+  [[nodiscard]] const std::optional<Lockfile> &
   getOldLockfile() const
   {
     return this->oldLockfile;
   }
 
+  /** @brief Get the lockfiles of included environments. */
+  [[nodiscard]] const std::vector<Lockfile> &
+  getIncludedLockfiles() const
+  {
+    return this->includedLockfiles;
+  }
+
   /**
    * @brief Get a merged form of @a oldLockfile ( if available ),
    *        @a globalManifest ( if available ) and @a manifest registries.
@@ -362,15 +540,29 @@ public:
     return this->getManifest().getSystems();
   }
 
-  /** @brief Lazily initialize and get the combined registry's DBs. */
+  /**
+   * @brief Lazily initialize and get the combined registry's DBs.
+   *
+   * Inputs are scraped for every system, or only the current system while
+   * creating an @a LM_NATIVE lock.
+   */
   [[nodiscard]] nix::ref<Registry<pkgdb::PkgDbInputFactory>>
   getPkgDbRegistry();
 
   // TODO: (Question) Should we lock the combined options and fill registry
   //                  `default` fields in inputs?
-  /** @brief Create a new lockfile from @a manifest. */
+  /**
+   * @brief Create a new lockfile from @a manifest.
+   *
+   * With @a LM_NATIVE only the current system is resolved.
+   * Other systems are copied from @a oldLockfile when all of their groups
+   * are already locked, and are otherwise listed as `pending-systems`
+   * to be locked later with @a LM_ALL.
+   * If the manifest doesn't support the current system every system is
+   * locked.
+   */
   [[nodiscard]] Lockfile
-  createLockfile();
+  createLockfile( lock_mode mode = LM_ALL );
 
 
 }; /* End class `Environment' */
@@ -0,0 +1,141 @@
+/* ========================================================================== *
+ *
+ * @file flox/resolver/lockfile-diff.hh
+ *
+ * @brief Semantic differences between two lockfiles.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "flox/core/types.hh"
+#include "flox/resolver/lockfile.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::resolver {
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief The kind of change made to a locked package. */
+enum package_change_type {
+  PC_ADDED   = 0, /**< Locked in the new lockfile, and not listed in the old. */
+  PC_REMOVED = 1, /**< Locked in the old lockfile, and not listed in the new. */
+  PC_CHANGED = 2  /**< Listed in both lockfiles, but locked differently. */
+}; /* End enum `package_change_type' */
+
+NLOHMANN_JSON_SERIALIZE_ENUM( package_change_type,
+                              { { PC_ADDED, "added" },
+                                { PC_REMOVED, "removed" },
+                                { PC_CHANGED, "changed" } } )
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Store information about one side of a @a PackageChange. */
+struct PackageStoreInfo
+{
+  /** Maps output names to their store paths. */
+  std::map<std::string, std::string> outputs;
+  /**
+   * Total NAR size of the closure of every output, or `std::nullopt` if any
+   * output is missing from the local store.
+   */
+  std::optional<uint64_t> closureSize;
+}; /* End struct `PackageStoreInfo' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief A change to a single _install ID_ on a single system.
+ *
+ * Packages may be listed in a lockfile without being locked, such as optional
+ * packages which failed to resolve.
+ * A package listed in both lockfiles but only locked in one of them is
+ * changed, with only one of @a oldPackage and @a newPackage set, matching
+ * what `manifest upgrade` reports as upgraded.
+ * A package which is only listed in one lockfile, and isn't locked there,
+ * is not a change.
+ */
+struct PackageChange
+{
+
+  System              system;
+  InstallID           installId;
+  package_change_type type;
+
+  std::optional<LockedPackageRaw> oldPackage;
+  std::optional<LockedPackageRaw> newPackage;
+
+  /** Only filled by callers which evaluate store paths. */
+  std::optional<PackageStoreInfo> oldStoreInfo;
+  std::optional<PackageStoreInfo> newStoreInfo;
+
+
+  /**
+   * @brief Whether the package's store paths may differ between lockfiles.
+   *
+   * Store paths are determined by the locked input and attribute path, so
+   * changes to other fields such as `priority` cannot change them.
+   */
+  [[nodiscard]] bool
+  mayChangeStorePaths() const;
+
+  /**
+   * @brief List the names of fields which differ between
+   *        @a oldPackage and @a newPackage.
+   *
+   * Fields are named `version`, `input`, `attr-path`, `priority`, `info`, and
+   * `outputs` ( only when both sides have store information ).
+   */
+  [[nodiscard]] std::vector<std::string>
+  getChangedFields() const;
+
+
+}; /* End struct `PackageChange' */
+
+
+/** @brief Convert a @a flox::resolver::PackageChange to a JSON object. */
+void
+to_json( nlohmann::json & jto, const PackageChange & change );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Collect the changes to locked packages between two lockfiles.
+ *
+ * Packages are looked up by system and _install ID_ in the lockfiles'
+ * hash maps, so matching runs in time linear in the number of packages.
+ * Unchanged packages are omitted, and only the changes are sorted.
+ * Systems pending in @a newLockfile are skipped rather than reported as
+ * removing all of their packages.
+ *
+ * @return Changes ordered by system and then _install ID_.
+ */
+[[nodiscard]] std::vector<PackageChange>
+diffLockfiles( const LockfileRaw & oldLockfile,
+               const LockfileRaw & newLockfile );
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::resolver
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -0,0 +1,142 @@
+/* ========================================================================== *
+ *
+ * @file flox/resolver/lockfile-verify.hh
+ *
+ * @brief Re-evaluate locked packages to detect lockfiles which no longer
+ *        match their locked inputs.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <cstddef>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <nix/eval.hh>
+#include <nix/flake/flake.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/core/types.hh"
+#include "flox/resolver/lockfile.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::resolver {
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief A field of a locked package's `info` which evaluates differently. */
+struct InfoMismatch
+{
+  std::string    field;     /**< Name of the field, such as `version`. */
+  nlohmann::json locked;    /**< Value recorded in the lockfile. */
+  nlohmann::json evaluated; /**< Value evaluated from the locked input. */
+}; /* End struct `InfoMismatch' */
+
+
+/** @brief Convert a JSON object to a @a flox::resolver::InfoMismatch. */
+void
+from_json( const nlohmann::json & jfrom, InfoMismatch & mismatch );
+
+/** @brief Convert a @a flox::resolver::InfoMismatch to a JSON object. */
+void
+to_json( nlohmann::json & jto, const InfoMismatch & mismatch );
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief The result of re-evaluating a single locked package. */
+struct PackageVerification
+{
+
+  System    system;
+  InstallID installId;
+
+  /** Fields of the package's `info` which differ from evaluation. */
+  std::vector<InfoMismatch> mismatches;
+
+  /** Evaluated store paths keyed by output name. */
+  std::map<std::string, std::string> outputs;
+
+  /** Set if the package could not be evaluated. */
+  std::optional<std::string> error;
+
+
+  /** @brief Whether the package evaluates as it was locked. */
+  [[nodiscard]] bool
+  isValid() const
+  {
+    return this->mismatches.empty() && ( ! this->error.has_value() );
+  }
+
+
+}; /* End struct `PackageVerification' */
+
+
+/** @brief Convert a JSON object to a @a flox::resolver::PackageVerification. */
+void
+from_json( const nlohmann::json & jfrom, PackageVerification & verification );
+
+/** @brief Convert a @a flox::resolver::PackageVerification to a JSON object. */
+void
+to_json( nlohmann::json & jto, const PackageVerification & verification );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Compare a locked package's `info` against @a evaluated.
+ *
+ * Only `pname`, `version`, `license`, `broken`, and `unfree` are compared,
+ * and only when the lockfile records them.
+ */
+[[nodiscard]] std::vector<InfoMismatch>
+compareLockedInfo( const nlohmann::json & locked,
+                   const nlohmann::json & evaluated );
+
+
+/**
+ * @brief Re-evaluate a locked package in its already locked input.
+ *
+ * Evaluation errors are thrown rather than recorded in the result.
+ */
+[[nodiscard]] PackageVerification
+verifyPackage( nix::ref<nix::EvalState> &      state,
+               const nix::flake::LockedFlake & flake,
+               const System &                  system,
+               const InstallID &               iid,
+               const LockedPackageRaw &        pkg );
+
+
+/**
+ * @brief Re-evaluate every locked package of a lockfile using a pool of
+ *        forked evaluators.
+ *
+ * Packages are ordered by input before being split between evaluators, so
+ * each evaluator locks a flake and opens its eval cache once for every input
+ * it is given.
+ * Packages assigned to an evaluator which dies are reported with an error.
+ *
+ * @param lockfile The lockfile to verify.
+ * @param jobs The maximum number of evaluators to run at once.
+ * @return Results ordered by system and then _install ID_.
+ */
+[[nodiscard]] std::vector<PackageVerification>
+verifyLockfile( const LockfileRaw & lockfile, std::size_t jobs );
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::resolver
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
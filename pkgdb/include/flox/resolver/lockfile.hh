@@ -12,13 +12,16 @@
 #pragma once
 
 #include <unordered_map>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
 #include "flox/core/exceptions.hh"
 #include "flox/core/types.hh"
+#include "flox/pkgdb/advisories.hh"
 #include "flox/pkgdb/input.hh"
 #include "flox/pkgdb/read.hh"
+#include "flox/pkgdb/usage.hh"
 #include "flox/registry.hh"
 #include "flox/resolver/manifest.hh"
 
@@ -210,6 +213,12 @@ struct LockfileRaw
   std::unordered_map<System, SystemPackages> packages;
   unsigned                                   lockfileVersion = 0;
 
+  /**
+   * Systems listed in the manifest whose packages have not been locked yet.
+   * These are filled in by a later lock without `--native`.
+   */
+  std::vector<System> pendingSystems;
+
 
   ~LockfileRaw()                     = default;
   LockfileRaw()                      = default;
@@ -229,6 +238,7 @@ struct LockfileRaw
    *
    * This checks that:
    * - The lockfile version is supported.
+   * - Pending systems do not have any locked packages.
    */
   void
   check() const;
@@ -275,6 +285,8 @@ private:
   EnvironmentManifest manifest;
   /** Maps `{ <FINGERPRINT>: <INPUT> }` for all `packages` members' inputs. */
   RegistryRaw packagesRegistryRaw;
+  /** Maps `{ <GROUP-NAME>: [<INSTALL-ID>...] }` for groups in @a manifest. */
+  std::unordered_map<GroupName, std::vector<InstallID>> groupMembers;
 
 
   /**
@@ -302,8 +314,11 @@ private:
   check() const;
 
   /**
-   * @brief Initialize @a manifest and @a packagesRegistryRaw from
-   *        @a lockfileRaw.
+   * @brief Initialize @a manifest, @a packagesRegistryRaw, and
+   *        @a groupMembers from @a lockfileRaw.
+   *
+   * These indexes are immutable once built, so resolution can look up old
+   * locks by reference rather than copying @a lockfileRaw for every group.
    */
   void
   init();
@@ -366,6 +381,32 @@ public:
     return this->getManifest().getDescriptors();
   }
 
+  /**
+   * @brief Get the packages locked for @a system.
+   * @return The packages, or `nullptr` if @a system isn't locked.
+   */
+  [[nodiscard]] const SystemPackages *
+  getSystemPackages( const System & system ) const;
+
+  /**
+   * @brief Get the package locked for @a iid on @a system.
+   * @return The package, or `nullptr` if @a iid isn't locked or failed to
+   *         resolve on @a system.
+   */
+  [[nodiscard]] const LockedPackageRaw *
+  getLockedPackage( const System & system, const InstallID & iid ) const;
+
+  /**
+   * @brief Get the fingerprint of the old descriptor of @a iid.
+   * @return The fingerprint, or `nullptr` if @a iid wasn't installed.
+   * @see flox::resolver::getResolutionFingerprint
+   */
+  [[nodiscard]] const std::string *
+  getDescriptorFingerprint( const InstallID & iid ) const
+  {
+    return this->getManifest().getDescriptorFingerprint( iid );
+  }
+
   /**
    * @brief Get the @a packagesRegistryRaw, containing all inputs used by
    *        `packages.**` members of the lockfile.
@@ -388,6 +429,13 @@ public:
   std::size_t
   removeUnusedInputs();
 
+  /**
+   * @brief Whether @a system is listed in the manifest but its packages have
+   *        not been locked yet.
+   */
+  [[nodiscard]] bool
+  isPending( const System & system ) const;
+
 
   /**
    * @brief Check the lockfile's `packages.**` members for consistency with the
@@ -400,6 +448,29 @@ public:
   checkPackages( const std::optional<flox::System> & system
                  = std::nullopt ) const;
 
+  /**
+   * @brief Match the lockfile's `packages.**` members against known
+   *        vulnerability advisories by `pname` and version.
+   *
+   * A package locked for several systems is reported once per advisory.
+   * @return A warning for each advisory affecting a locked package.
+   */
+  [[nodiscard]] std::vector<CheckPackageWarning>
+  checkAdvisories( pkgdb::AdvisoryDb &                 advisories,
+                   const std::optional<flox::System> & system
+                   = std::nullopt ) const;
+
+  /**
+   * @brief Get the packages locked by this lockfile which @a previous didn't
+   *        lock, to be recorded by @a flox::pkgdb::UsageDb::record().
+   *
+   * Each `( pname, relPath )` pair is counted once however many systems it
+   * is locked for, so re-locking an unchanged environment records nothing.
+   */
+  [[nodiscard]] std::vector<pkgdb::PackageUsage>
+  getNewUsage( const std::optional<LockfileRaw> & previous
+               = std::nullopt ) const;
+
 }; /* End class `Lockfile' */
 
 
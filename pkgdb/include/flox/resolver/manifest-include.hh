@@ -0,0 +1,86 @@
+/* ========================================================================== *
+ *
+ * @file flox/resolver/manifest-include.hh
+ *
+ * @brief Compose manifests from the manifests and lockfiles of other
+ *        environments listed in their `include` field.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#pragma once
+
+#include <filesystem>
+#include <vector>
+
+#include "flox/resolver/lockfile.hh"
+#include "flox/resolver/manifest-raw.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::resolver {
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief A manifest with its includes composed into it. */
+struct ComposedManifest
+{
+
+  /** The composed manifest, which has no `include` field. */
+  ManifestRaw manifest;
+
+  /**
+   * Lockfiles of included environments, outermost first, whose locked
+   * packages may be adopted by groups that are unchanged by the composition.
+   * Each lockfile's `manifest` is the composed manifest of that environment.
+   */
+  std::vector<LockfileRaw> includedLocks;
+
+}; /* End struct `ComposedManifest' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Compose a manifest with the manifests and lockfiles it includes.
+ *
+ * Each member of `include` is a path to a manifest, or to a lockfile whose
+ * `manifest` is included and whose locks may be adopted.
+ * Relative paths are resolved from @a baseDir, and includes of included
+ * manifests are resolved from their own directories.
+ *
+ * - `install`, `vars`, and `registry.inputs` members of the including
+ *   manifest override those of its includes.
+ *   Includes may define the same member only if they define it identically,
+ *   unless the including manifest overrides it.
+ * - `options` and registry `defaults` and `priority` of later includes
+ *   override those of earlier includes, and are overridden by the including
+ *   manifest.
+ * - `profile` and `hook` scripts are concatenated in include order, followed
+ *   by those of the including manifest.
+ * - `env-base` is never included.
+ *
+ * Included lockfiles are dropped if the composed manifest declares any of
+ * their registry inputs differently, since their locks no longer apply.
+ *
+ * @throws InvalidManifestFileException if includes conflict or form a cycle.
+ */
+[[nodiscard]] ComposedManifest
+composeManifest( ManifestRaw manifest, const std::filesystem::path & baseDir );
+
+/** @brief Read a manifest from @a manifestPath and compose its includes. */
+[[nodiscard]] ComposedManifest
+composeManifest( const std::filesystem::path & manifestPath );
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::resolver
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
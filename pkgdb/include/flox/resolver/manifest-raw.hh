@@ -13,6 +13,7 @@
 #pragma once
 
 #include <algorithm>
+#include <map>
 #include <optional>
 #include <string>
 #include <string_view>
@@ -122,6 +123,12 @@ struct Options
   }; /* End struct `Allows' */
   std::optional<Allows> allow;
 
+  struct Denies
+  {
+    std::optional<std::vector<std::string>> licenses;
+  }; /* End struct `Denies' */
+  std::optional<Denies> deny;
+
   struct Semver
   {
     std::optional<bool> preferPreReleases;
@@ -130,6 +137,27 @@ struct Options
 
   std::optional<std::string> packageGroupingStrategy;
   std::optional<std::string> activationStrategy;
+
+  /**
+   * Additional revisions of registry inputs to consider when resolving
+   * groups, keyed by input name.
+   * Only revisions which already have a package database, and which are
+   * a registry input or were previously locked, are used.
+   */
+  std::optional<std::map<std::string, std::vector<std::string>>>
+    groupRevisions;
+
+  /**
+   * Whether to prefer packages without known vulnerability advisories when
+   * resolving groups.
+   */
+  std::optional<bool> demoteVulnerable;
+
+  /**
+   * Whether to link files in built environments to their final targets
+   * rather than through links in the packages that provide them.
+   */
+  std::optional<bool> resolveLinks;
   // TODO: Other options
 
 
@@ -333,6 +361,14 @@ struct ManifestRaw : public GlobalManifestRaw
 
   std::optional<HookRaw> hook;
 
+  /**
+   * Paths to manifests or lockfiles of other environments to compose into
+   * this manifest, relative to this manifest's directory.
+   * These are resolved by @a flox::resolver::composeManifest, which leaves
+   * this field unset.
+   */
+  std::optional<std::vector<std::string>> include;
+
 
   ~ManifestRaw() override            = default;
   ManifestRaw()                      = default;
@@ -394,6 +430,7 @@ struct ManifestRaw : public GlobalManifestRaw
     this->vars    = std::nullopt;
     this->hook    = std::nullopt;
     this->profile = std::nullopt;
+    this->include = std::nullopt;
   }
 
   /**
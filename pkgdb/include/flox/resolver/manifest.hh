@@ -206,6 +206,11 @@ public:
         args.licenses = this->manifestRaw.options->allow->licenses;
       }
 
+    if ( this->manifestRaw.options->deny.has_value() )
+      {
+        args.deniedLicenses = this->manifestRaw.options->deny->licenses;
+      }
+
     if ( this->manifestRaw.options->semver.has_value()
          && this->manifestRaw.options->semver->preferPreReleases.has_value() )
       {
@@ -291,6 +296,12 @@ private:
    */
   InstallDescriptors descriptors;
 
+  /**
+   * Fingerprints of @a descriptors keyed by _install ID_.
+   * @see flox::resolver::getResolutionFingerprint
+   */
+  std::unordered_map<InstallID, std::string> fingerprints;
+
 
   /**
    * @brief Assert the validity of the manifest, throwing an exception if it
@@ -337,7 +348,10 @@ private:
       }
   }
 
-  /** @brief Initialize @a descriptors from @a manifestRaw. */
+  /**
+   * @brief Initialize @a descriptors and @a fingerprints from
+   *        @a manifestRaw.
+   */
   void
   initDescriptors()
   {
@@ -357,6 +371,10 @@ private:
           }
       }
     this->check();
+    for ( const auto & [iid, desc] : this->descriptors )
+      {
+        this->fingerprints.emplace( iid, getResolutionFingerprint( desc ) );
+      }
   }
 
 
@@ -394,6 +412,20 @@ public:
     return this->descriptors;
   }
 
+  /**
+   * @brief Get the fingerprint of the descriptor of @a iid, computed once when
+   *        the manifest is loaded.
+   * @return The fingerprint, or `nullptr` if @a iid isn't installed.
+   * @see flox::resolver::getResolutionFingerprint
+   */
+  [[nodiscard]] const std::string *
+  getDescriptorFingerprint( const InstallID & iid ) const
+  {
+    auto fingerprint = this->fingerprints.find( iid );
+    if ( fingerprint == this->fingerprints.end() ) { return nullptr; }
+    return &fingerprint->second;
+  }
+
   /**
    * @brief Returns all descriptors, grouping those with a _group_ field, and
    *        returning those without a group field in the group named
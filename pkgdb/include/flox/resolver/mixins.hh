@@ -10,8 +10,10 @@
 #pragma once
 
 #include <filesystem>
+#include <memory>
 #include <optional>
 #include <string_view>
+#include <vector>
 
 #include "flox/core/exceptions.hh"
 #include "flox/resolver/environment.hh"
@@ -99,6 +101,12 @@ private:
    */
   std::optional<GlobalManifestRaw> globalManifestRaw;
 
+  /**
+   * Lockfiles of environments included by the project's manifest, whose
+   * locks may be adopted.
+   */
+  std::vector<LockfileRaw> includedLocks;
+
   /** Raw contents of project's lockfile ( if any ). */
   std::optional<LockfileRaw> lockfileRaw;
 
@@ -112,6 +120,12 @@ private:
    * constructor. */
   std::optional<Upgrades> upgrades;
 
+  /** Store connection shared by a long lived session ( if any ). */
+  std::shared_ptr<nix::Store> sessionStore;
+
+  /** Inputs shared by a long lived session ( if any ). */
+  std::shared_ptr<pkgdb::PkgDbInputCache> sessionInputs;
+
 
 protected:
 
@@ -156,6 +170,7 @@ protected:
    * @brief Set @a manifestRaw by loading a manifest from @a `maybePath`.
    *
    * Overrides any previous value before @a manifest is initialized.
+   * Any `include` field is composed relative to the manifest's directory.
    *
    * @throws @a EnvironmentMixinException if called after @a manifest is
    * initialized, as it is no longer allowed to change the manifest.
@@ -168,6 +183,7 @@ protected:
    * @brief Manually set @a manifestRaw.
    *
    * Overrides any previous value before @a manifest is initialized.
+   * Any `include` field is composed relative to the current directory.
    *
    * @throws @a EnvironmentMixinException if called after @a manifest is
    * initialized, as it is no longer allowed to change the manifest.
@@ -294,6 +310,17 @@ public:
   [[nodiscard]] Environment &
   getEnvironment();
 
+  /**
+   * @brief Share a store connection and opened inputs with other
+   *        environments of a long lived session.
+   *
+   * @throws @a EnvironmentMixinException if called after @a environment is
+   *         initialized.
+   */
+  void
+  useSession( const nix::ref<nix::Store> &            store,
+              std::shared_ptr<pkgdb::PkgDbInputCache> inputs );
+
   /* -------------------------- argument parsers ---------------------------- */
 
   /**
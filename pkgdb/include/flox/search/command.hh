@@ -10,8 +10,11 @@
 #pragma once
 
 #include <functional>
+#include <utility>
 #include <vector>
 
+#include <nlohmann/json.hpp>
+
 #include "flox/flox-flake.hh"
 #include "flox/pkgdb/command.hh"
 #include "flox/pkgdb/input.hh"
@@ -69,6 +72,31 @@ public:
     return this->parser;
   }
 
+  using flox::resolver::GAEnvironmentMixin::useSession;
+
+  /** @brief Set search parameters without parsing any arguments. */
+  void
+  setParams( SearchParams params )
+  {
+    this->params = std::move( params );
+  }
+
+  /**
+   * @brief Run the search, passing each record to @a onRecord.
+   *
+   * When the query sets a `limit` the first record is
+   * `{ "result-count": <N> }`, and every other record is a result from
+   * @a flox::pkgdb::PkgDbInput::getRowJSON.
+   * When the query sets `collapse-systems` each result replaces `id`,
+   * `system`, and `absPath` with `systems` and `ids` keyed by system.
+   * When the query sets `collapse-aliases` each result lists the relative
+   * attribute paths of its aliases as `aliases`.
+   *
+   * @param onRecord Called with each record, returning `false` to stop.
+   */
+  void
+  search( const std::function<bool( const nlohmann::json & )> & onRecord );
+
   /**
    * @brief Execute the `search` routine.
    * @return `EXIT_SUCCESS` or `EXIT_FAILURE`.
@@ -56,6 +56,19 @@ struct SearchQuery
    */
   bool deduplicate = false;
 
+  /**
+   * Emit a single result for rows of each input sharing a `relPath`,
+   * `version`, and `description` across the requested systems, listing the
+   * `systems` they were found for and each system's row id.
+   */
+  bool collapseSystems = false;
+
+  /**
+   * Emit a single result for packages of each input which share an output
+   * hash, listing the relative attribute paths of the others as `aliases`.
+   */
+  bool collapseAliases = false;
+
   /** Filter results by partial match on pname, attrName, or description */
   std::optional<std::string> partialMatch;
 
@@ -8,15 +8,51 @@
   # the system to build for
   system,
   containerSystem,
+  # a JSON layer plan, see `flox/buildenv/layers.hh'
+  layerPlan ? null,
 }: let
   environment = builtins.storePath environmentOutPath;
   pkgs = nixpkgsFlake.legacyPackages.${system};
   containerPkgs = nixpkgsFlake.legacyPackages.${containerSystem};
   lib = pkgs.lib;
+  plan =
+    if layerPlan == null
+    then null
+    else builtins.fromJSON layerPlan;
+
+  # streamLayeredImage gives each of the first `maxLayers - 2` paths listed by
+  # `referencesByPopularity` its own layer and puts the rest in one layer,
+  # so list the planned paths first, in their planned order.
+  # Paths the plan doesn't know about, like the shell below, follow them.
+  dockerTools =
+    if plan == null
+    then pkgs.dockerTools
+    else
+      pkgs.dockerTools.override {
+        buildPackages =
+          pkgs.buildPackages
+          // {
+            referencesByPopularity = path: let
+              popular = pkgs.buildPackages.referencesByPopularity path;
+              planned = pkgs.writeText "planned-paths" (
+                lib.concatMapStrings (p: p + "\n") (lib.concatLists plan.layers)
+              );
+            in
+              pkgs.runCommand "planned-references" {} ''
+                grep -Fxf ${popular} ${planned} > $out || true
+                grep -Fxvf ${planned} ${popular} >> $out || true
+              '';
+          };
+      };
+
   lowPriority = pkg: pkg.overrideAttrs (old: old // {meta = (old.meta or {}) // {priority = 10000;};});
 
   buildLayeredImageArgs = {
     name = "flox-env-container";
+    maxLayers =
+      if plan == null
+      then 100
+      else plan."max-layers";
     # symlinkJoin fails when drv contains a symlinked bin directory, so wrap in an additional buildEnv
     contents = pkgs.buildEnv {
       name = "contents";
@@ -53,4 +89,4 @@
     };
   };
 in
-  pkgs.dockerTools.streamLayeredImage buildLayeredImageArgs
+  dockerTools.streamLayeredImage buildLayeredImageArgs
@@ -8,9 +8,12 @@
  * -------------------------------------------------------------------------- */
 
 #include <algorithm>
+#include <optional>
+#include <unordered_map>
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <nix/globals.hh>
 #include <nix/util.hh>
 
 #include "flox/buildenv/realise.hh"
@@ -26,9 +29,128 @@ struct BuildEnvState
 {
   std::map<std::string, Priority> priorities {};
   unsigned long                   symlinks = 0;
+
+  /** Whether links point to the final targets of their sources. */
+  bool resolveLinks = false;
+
+  /** Links are only resolved to targets inside this directory. */
+  std::string storeDir = nix::settings.nixStore;
+
+  /** Final targets of resolved paths, shared by every package of a build. */
+  std::unordered_map<std::string, std::string> targets {};
+
+  /** Unresolved sources of resolved links, used to report conflicts. */
+  std::map<std::string, std::string> sources {};
 };
 
 
+/* -------------------------------------------------------------------------- */
+
+/** Maximum number of links followed while resolving a path. */
+static const unsigned maxLinkDepth = 40;
+
+
+/**
+ * @brief Resolve @a path to its final target, following links in every
+ *        component of the path.
+ *
+ * Resolved paths are cached in @a state, so a link shared by many files,
+ * such as a linked `bin` directory, is only read once per build.
+ *
+ * @return The final target of @a path, or `std::nullopt` if a component of
+ *         the path does not exist, as with dangling links, or links nest
+ *         too deeply to resolve.
+ */
+static std::optional<std::string>
+resolveTarget( BuildEnvState &     state,
+               const std::string & path,
+               unsigned            depth = 0 )
+{
+  if ( path == "/" ) { return path; }
+  if ( auto cached = state.targets.find( path ); cached != state.targets.end() )
+    {
+      return cached->second;
+    }
+  if ( maxLinkDepth < depth ) { return std::nullopt; }
+
+  auto join = []( const std::string & dir, std::string_view name )
+  { return ( dir == "/" ? "" : dir ) + "/" + std::string( name ); };
+
+  auto dir = resolveTarget( state, std::string( nix::dirOf( path ) ), depth );
+  if ( ! dir.has_value() ) { return std::nullopt; }
+  auto resolved = join( *dir, nix::baseNameOf( path ) );
+
+  struct stat st
+  {};
+  if ( lstat( resolved.c_str(), &st ) == -1 )
+    {
+      if ( ( errno == ENOENT ) || ( errno == ENOTDIR ) )
+        {
+          return std::nullopt;
+        }
+      throw nix::SysError( "getting status of '%1%'", resolved );
+    }
+
+  if ( S_ISLNK( st.st_mode ) )
+    {
+      /* Walk the link's target one component at a time so that `..' is
+       * applied to an already resolved directory. */
+      auto target = nix::readLink( resolved );
+      resolved    = nix::hasPrefix( target, "/" ) ? "/" : *dir;
+      for ( const auto & name :
+            nix::tokenizeString<std::vector<std::string>>( target, "/" ) )
+        {
+          if ( name == "." ) { continue; }
+          if ( name == ".." ) { resolved = nix::dirOf( resolved ); }
+          else
+            {
+              auto next
+                = resolveTarget( state, join( resolved, name ), depth + 1 );
+              if ( ! next.has_value() ) { return std::nullopt; }
+              resolved = std::move( *next );
+            }
+        }
+    }
+
+  state.targets.emplace( path, resolved );
+  return resolved;
+}
+
+
+/**
+ * @brief Get the path a link to @a srcFile should point to.
+ *
+ * When links are resolved this is the final target of @a srcFile, unless
+ * it cannot be resolved or resolves to a path outside of the store, which
+ * may not exist wherever the environment is used.
+ * Otherwise @a srcFile is linked unchanged.
+ */
+static std::string
+linkTargetOf( BuildEnvState & state, const std::string & srcFile )
+{
+  if ( ! state.resolveLinks ) { return srcFile; }
+  auto target = resolveTarget( state, srcFile );
+  if ( target.has_value() && nix::hasPrefix( *target, state.storeDir + "/" ) )
+    {
+      return *target;
+    }
+  return srcFile;
+}
+
+
+/** @brief Get the unresolved source of the link at @a dstFile. */
+static std::string
+sourceOf( const BuildEnvState & state, const std::string & dstFile )
+{
+  if ( auto source = state.sources.find( dstFile );
+       source != state.sources.end() )
+    {
+      return source->second;
+    }
+  return nix::readLink( dstFile );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 
@@ -105,6 +227,13 @@ createLinks( BuildEnvState &     state,
         {
           continue;
         }
+
+      /* Link to the final target of `srcFile' rather than through every
+       * link along the way.
+       * `srcFile' is still used to recurse and to report conflicts so that
+       * files are attributed to the package that provided them. */
+      auto linkTarget = linkTargetOf( state, srcFile );
+
       // todo: understand and document these branches
       // the short description is:
       // link directories in the source directory to the target directory
@@ -140,6 +269,9 @@ createLinks( BuildEnvState &     state,
                         srcFile,
                         target );
                     }
+                  auto source = state.resolveLinks
+                                  ? sourceOf( state, dstFile )
+                                  : target;
                   if ( unlink( dstFile.c_str() ) == -1 )
                     {
                       throw nix::SysError( "unlinking '%1%'", dstFile );
@@ -152,7 +284,7 @@ createLinks( BuildEnvState &     state,
                                            dstFile );
                     }
                   createLinks( state,
-                               target,
+                               source,
                                dstFile,
                                state.priorities[dstFile] );
                   createLinks( state, srcFile, dstFile, priority );
@@ -184,9 +316,15 @@ createLinks( BuildEnvState &     state,
                     {
 
                       // ... and have different parents -> conflict
+                      // unless both resolve to the same file
                       if ( prevPriority.parentPath != priority.parentPath )
                         {
-                          throw FileConflict( nix::readLink( dstFile ),
+                          if ( state.resolveLinks
+                               && ( nix::readLink( dstFile ) == linkTarget ) )
+                            {
+                              continue;
+                            }
+                          throw FileConflict( sourceOf( state, dstFile ),
                                               srcFile,
                                               priority.priority );
                         }
@@ -220,8 +358,9 @@ createLinks( BuildEnvState &     state,
             }
         }
 
-      nix::createSymlink( srcFile, dstFile );
+      nix::createSymlink( linkTarget, dstFile );
       state.priorities[dstFile] = priority;
+      if ( state.resolveLinks ) { state.sources[dstFile] = srcFile; }
       state.symlinks++;
     }
 }
@@ -233,9 +372,12 @@ createLinks( BuildEnvState &     state,
 // todo: break this function up to reduce complexity
 // NOLINTBEGIN(readability-function-cognitive-complexity)
 void
-buildEnvironment( const std::string & out, std::vector<RealisedPackage> & pkgs )
+buildEnvironment( const std::string &            out,
+                  std::vector<RealisedPackage> & pkgs,
+                  bool                           resolveLinks )
 {
   BuildEnvState state;
+  state.resolveLinks = resolveLinks;
 
   std::set<std::string> done;
   std::set<std::string> postponed;
@@ -339,6 +481,12 @@ buildEnvironment( const std::string & out, std::vector<RealisedPackage> & pkgs )
       nix::logger->log(
         nix::lvlDebug,
         nix::fmt( "created %d symlinks in user environment", state.symlinks ) );
+      if ( resolveLinks )
+        {
+          nix::logger->log( nix::lvlDebug,
+                            nix::fmt( "resolved %d paths in user environment",
+                                      state.targets.size() ) );
+        }
     }
 }
 // NOLINTEND(readability-function-cognitive-complexity)
@@ -0,0 +1,262 @@
+/* ========================================================================== *
+ *
+ * @file buildenv/bundle.cc
+ *
+ * @brief Export and import the closure of a store path as a single file.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <fcntl.h>
+#include <string>
+#include <vector>
+
+#include <nix/archive.hh>
+#include <nix/compression.hh>
+#include <nix/content-address.hh>
+#include <nix/hash.hh>
+#include <nix/path-info.hh>
+#include <nix/serialise.hh>
+#include <nix/store-api.hh>
+#include <nix/util.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/buildenv/bundle.hh"
+#include "flox/core/util.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::buildenv {
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Leading string of every bundle. */
+static constexpr std::string_view BUNDLE_MAGIC = "flox-bundle";
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+to_json( nlohmann::json & jto, const BundleSummary & summary )
+{
+  jto = { { "root", summary.root },
+          { "paths", summary.paths },
+          { "skipped", summary.skipped },
+          { "nar-size", summary.narSize } };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Serialize the metadata needed to re-register a store path. */
+[[nodiscard]] static nlohmann::json
+pathInfoToJSON( const nix::Store & store, const nix::ValidPathInfo & info )
+{
+  std::vector<std::string> references;
+  for ( const auto & ref : info.references )
+    {
+      references.emplace_back( store.printStorePath( ref ) );
+    }
+
+  nlohmann::json jto
+    = { { "path", store.printStorePath( info.path ) },
+        { "narHash", info.narHash.to_string( nix::SRI, true ) },
+        { "narSize", info.narSize },
+        { "references", std::move( references ) },
+        { "deriver", nullptr },
+        { "sigs", info.sigs },
+        { "ca", nullptr } };
+  if ( info.deriver.has_value() )
+    {
+      jto["deriver"] = store.printStorePath( *info.deriver );
+    }
+  if ( info.ca.has_value() )
+    {
+      jto["ca"] = nix::renderContentAddress( info.ca );
+    }
+  return jto;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Deserialize metadata written by @a pathInfoToJSON. */
+[[nodiscard]] static nix::ValidPathInfo
+pathInfoFromJSON( const nix::Store & store, const nlohmann::json & jfrom )
+{
+  try
+    {
+      nix::ValidPathInfo info(
+        store.parseStorePath( jfrom.at( "path" ).get<std::string>() ),
+        nix::Hash::parseSRI( jfrom.at( "narHash" ).get<std::string>() ) );
+      info.narSize = jfrom.at( "narSize" ).get<uint64_t>();
+      for ( const auto & ref : jfrom.at( "references" ) )
+        {
+          info.references.insert(
+            store.parseStorePath( ref.get<std::string>() ) );
+        }
+      if ( const auto & deriver = jfrom.at( "deriver" ); ! deriver.is_null() )
+        {
+          info.deriver = store.parseStorePath( deriver.get<std::string>() );
+        }
+      info.sigs = jfrom.at( "sigs" ).get<nix::StringSet>();
+      if ( const auto & cad = jfrom.at( "ca" ); ! cad.is_null() )
+        {
+          info.ca = nix::ContentAddress::parse( cad.get<std::string>() );
+        }
+      return info;
+    }
+  catch ( nlohmann::json::exception & err )
+    {
+      throw InvalidBundleException( "failed to read path info",
+                                    extract_json_errmsg( err ) );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+BundleSummary
+exportBundle( nix::Store &                  store,
+              const nix::StorePath &        root,
+              const std::filesystem::path & bundlePath,
+              const std::string &           compression )
+{
+  nix::StorePathSet closure;
+  store.computeFSClosure( root, closure );
+
+  /* `topoSortPaths' lists referrers first, so reverse it to write every path
+   * after its references. */
+  nix::StorePaths sorted = store.topoSortPaths( closure );
+  std::reverse( sorted.begin(), sorted.end() );
+
+  nix::AutoCloseFD fd = open( bundlePath.c_str(),
+                              O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                              0666 );
+  if ( ! fd )
+    {
+      throw nix::SysError( "opening bundle '%s'", bundlePath.string() );
+    }
+  nix::FdSink fileSink( fd.get() );
+
+  BundleSummary summary;
+  summary.root = store.printStorePath( root );
+
+  fileSink << BUNDLE_MAGIC << BUNDLE_VERSION << compression << summary.root;
+
+  /* NARs are streamed straight into the compressor. */
+  auto compressor = nix::makeCompressionSink( compression, fileSink, true );
+  for ( const auto & path : sorted )
+    {
+      auto info = store.queryPathInfo( path );
+      *compressor << 1 << pathInfoToJSON( store, *info ).dump();
+      store.narFromPath( path, *compressor );
+      ++summary.paths;
+      summary.narSize += info->narSize;
+    }
+  *compressor << 0;
+  compressor->finish();
+  fileSink.flush();
+
+  return summary;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+BundleSummary
+importBundle( nix::Store & store, const std::filesystem::path & bundlePath )
+{
+  nix::AutoCloseFD fd = open( bundlePath.c_str(), O_RDONLY | O_CLOEXEC );
+  if ( ! fd )
+    {
+      throw nix::SysError( "opening bundle '%s'", bundlePath.string() );
+    }
+  nix::FdSource fileSource( fd.get() );
+
+  BundleSummary summary;
+  try
+    {
+      if ( nix::readString( fileSource ) != BUNDLE_MAGIC )
+        {
+          throw InvalidBundleException(
+            nix::fmt( "'%s' is not a bundle", bundlePath.string() ) );
+        }
+      if ( auto version = nix::readNum<uint64_t>( fileSource );
+           version != BUNDLE_VERSION )
+        {
+          throw InvalidBundleException(
+            nix::fmt( "unsupported bundle version %d", version ) );
+        }
+      std::string compression = nix::readString( fileSource );
+      summary.root            = nix::readString( fileSource );
+
+      /* Decompress lazily as entries are read. */
+      auto source = nix::sinkToSource(
+        [&]( nix::Sink & sink )
+        {
+          auto decompressor = nix::makeDecompressionSink( compression, sink );
+          fileSource.drainInto( *decompressor );
+          decompressor->finish();
+        } );
+
+      while ( true )
+        {
+          auto tag = nix::readNum<uint64_t>( *source );
+          if ( tag == 0 ) { break; }
+          if ( tag != 1 )
+            {
+              throw InvalidBundleException(
+                nix::fmt( "unexpected entry tag %d", tag ) );
+            }
+
+          nix::ValidPathInfo info = pathInfoFromJSON(
+            store,
+            nlohmann::json::parse( nix::readString( *source ) ) );
+
+          if ( store.isValidPath( info.path ) )
+            {
+              /* Parse the NAR without writing it to skip past it. */
+              nix::ParseSink nullSink;
+              nix::parseDump( nullSink, *source );
+              ++summary.skipped;
+              continue;
+            }
+
+          debugLog( "importing " + store.printStorePath( info.path ) );
+          /* The store hashes the NAR as it is streamed in and rejects it if
+           * its hash or size differ from `info', so signatures are not
+           * required. */
+          store.addToStore( info, *source, nix::NoRepair, nix::NoCheckSigs );
+          ++summary.paths;
+          summary.narSize += info.narSize;
+        }
+    }
+  catch ( const nix::EndOfFile & err )
+    {
+      throw InvalidBundleException(
+        nix::fmt( "bundle '%s' is truncated", bundlePath.string() ),
+        err.what() );
+    }
+  catch ( nlohmann::json::exception & err )
+    {
+      throw InvalidBundleException( "failed to parse path info",
+                                    extract_json_errmsg( err ) );
+    }
+
+  return summary;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::buildenv
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
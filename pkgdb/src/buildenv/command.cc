@@ -9,7 +9,9 @@
 
 #include <nix/local-fs-store.hh>
 
+#include "flox/buildenv/bundle.hh"
 #include "flox/buildenv/command.hh"
+#include "flox/buildenv/layers.hh"
 #include "flox/buildenv/realise.hh"
 #include "flox/resolver/lockfile.hh"
 
@@ -73,6 +75,14 @@ BuildEnvCommand::BuildEnvCommand() : parser( "buildenv" )
     .help( "build a container builder script" )
     .nargs( 0 )
     .action( [&]( const auto & ) { this->buildContainer = true; } );
+
+  this->parser.add_argument( "--layer-plan" )
+    .help( "path to read and update the container's layer plan at" )
+    .metavar( "PATH" )
+    .nargs( 1 )
+    .action( [&]( const std::string & str ) { this->layerPlanPath = str; } );
+
+  command::addOutputFormatArg( this->parser );
 }
 
 
@@ -108,7 +118,7 @@ BuildEnvCommand::run()
       /* Print the resulting store path */
       nlohmann::json result
         = { { "store_path", store->printStorePath( storePath ) } };
-      std::cout << result.dump() << '\n';
+      command::writeRecord( result );
       return EXIT_SUCCESS;
     }
 
@@ -122,12 +132,36 @@ BuildEnvCommand::run()
     {
       debugLog( "container requested, building container build script" );
 
+      /* Keep the layers of a previous build stable where possible. */
+      std::optional<LayerPlan> previousPlan;
+      if ( this->layerPlanPath.has_value() )
+        {
+          previousPlan = readLayerPlan( *this->layerPlanPath );
+        }
+      auto layerPlan = planLayers( *store,
+                                   storePath,
+                                   previousPlan.has_value()
+                                     ? previousPlan->maxLayers
+                                     : LAYERS_DEFAULT_MAX,
+                                   previousPlan );
+      if ( previousPlan.has_value() )
+        {
+          debugLog( nix::fmt( "reusing %d of %d layers from the previous plan",
+                              layerPlan.countSharedLayers( *previousPlan ),
+                              layerPlan.layers.size() ) );
+        }
+
       auto containerBuilderStorePath
-        = createContainerBuilder( *state, storePath, system );
+        = createContainerBuilder( *state, storePath, system, layerPlan );
 
       debugLog( "built container builder: "
                 + store->printStorePath( containerBuilderStorePath ) );
 
+      if ( this->layerPlanPath.has_value() )
+        {
+          writeLayerPlan( *this->layerPlanPath, layerPlan );
+        }
+
       storePath = containerBuilderStorePath;
     };
 
@@ -140,11 +174,118 @@ BuildEnvCommand::run()
   /* Print the resulting store path */
   nlohmann::json result
     = { { "store_path", store->printStorePath( storePath ) } };
-  std::cout << result.dump() << '\n';
+  command::writeRecord( result );
+
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+BundleExportCommand::BundleExportCommand() : parser( "export" )
+{
+  this->parser.add_description(
+    "Write the closure of a store path to a single compressed file" );
+
+  this->parser.add_argument( "store-path" )
+    .help( "store path, or a link to one, whose closure is exported" )
+    .required()
+    .metavar( "STORE-PATH" )
+    .action( [&]( const std::string & str ) { this->storePath = str; } );
 
+  this->parser.add_argument( "--output", "-o" )
+    .help( "path to write the bundle to" )
+    .required()
+    .metavar( "FILE" )
+    .action( [&]( const std::string & str )
+             { this->output = nix::absPath( str ); } );
+
+  this->parser.add_argument( "--compression" )
+    .help( "compression method, such as `xz', `zstd', or `none'" )
+    .metavar( "METHOD" )
+    .action( [&]( const std::string & str ) { this->compression = str; } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+BundleExportCommand::run()
+{
+  auto store = this->getStore();
+  auto root  = store->followLinksToStorePath( this->storePath );
+
+  debugLog( nix::fmt( "exporting closure of '%s' to '%s'",
+                      store->printStorePath( root ),
+                      this->output.string() ) );
+
+  BundleSummary summary
+    = exportBundle( *store, root, this->output, this->compression );
+
+  std::cout << nlohmann::json( summary ).dump() << '\n';
   return EXIT_SUCCESS;
 }
 
+
+/* -------------------------------------------------------------------------- */
+
+BundleImportCommand::BundleImportCommand() : parser( "import" )
+{
+  this->parser.add_description(
+    "Add the store paths in a bundle to the store, verifying their hashes" );
+
+  this->parser.add_argument( "bundle" )
+    .help( "path to a bundle written by `bundle export'" )
+    .required()
+    .metavar( "FILE" )
+    .action( [&]( const std::string & str )
+             { this->bundlePath = nix::absPath( str ); } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+BundleImportCommand::run()
+{
+  auto          store   = this->getStore();
+  BundleSummary summary = importBundle( *store, this->bundlePath );
+
+  std::cout << nlohmann::json( summary ).dump() << '\n';
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+BundleCommand::BundleCommand() : parser( "bundle" )
+{
+  this->parser.add_description(
+    "Move environment closures between stores as single files" );
+  this->parser.add_subparser( this->cmdExport.getParser() );
+  this->parser.add_subparser( this->cmdImport.getParser() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+BundleCommand::run()
+{
+  if ( this->parser.is_subcommand_used( "export" ) )
+    {
+      return this->cmdExport.run();
+    }
+  if ( this->parser.is_subcommand_used( "import" ) )
+    {
+      return this->cmdImport.run();
+    }
+  std::cerr << this->parser << '\n';
+  throw flox::FloxException( "You must provide a valid 'bundle' subcommand" );
+  return EXIT_FAILURE;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox::buildenv
@@ -0,0 +1,293 @@
+/* ========================================================================== *
+ *
+ * @file buildenv/layers.cc
+ *
+ * @brief Plan how the closure of an environment is split into container
+ *        image layers.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <nix/path.hh>
+#include <nix/store-api.hh>
+#include <nix/util.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/buildenv/layers.hh"
+#include "flox/core/util.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::buildenv {
+
+/* -------------------------------------------------------------------------- */
+
+ReferenceGraph
+getReferenceGraph( nix::Store & store, const nix::StorePath & root )
+{
+  ReferenceGraph              graph;
+  std::vector<nix::StorePath> pending = { root };
+  while ( ! pending.empty() )
+    {
+      nix::StorePath path = pending.back();
+      pending.pop_back();
+
+      std::string printed = store.printStorePath( path );
+      if ( graph.contains( printed ) ) { continue; }
+      auto & references = graph[printed];
+
+      auto info = store.queryPathInfo( path );
+      for ( const auto & reference : info->references )
+        {
+          if ( reference == path ) { continue; }
+          references.emplace( store.printStorePath( reference ) );
+          pending.emplace_back( reference );
+        }
+    }
+  return graph;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<std::string>
+LayerPlan::getOrderedPaths() const
+{
+  std::vector<std::string> paths;
+  for ( const auto & layer : this->layers )
+    {
+      paths.insert( paths.end(), layer.begin(), layer.end() );
+    }
+  return paths;
+}
+
+
+std::size_t
+LayerPlan::countSharedLayers( const LayerPlan & other ) const
+{
+  std::set<std::set<std::string>> otherLayers;
+  for ( const auto & layer : other.layers )
+    {
+      otherLayers.emplace( layer.begin(), layer.end() );
+    }
+  return std::count_if( this->layers.begin(),
+                        this->layers.end(),
+                        [&]( const auto & layer )
+                        {
+                          return otherLayers.contains(
+                            std::set<std::string>( layer.begin(),
+                                                   layer.end() ) );
+                        } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+from_json( const nlohmann::json & jfrom, LayerPlan & plan )
+{
+  assertIsJSONObject<InvalidLayerPlanException>( jfrom, "layer plan" );
+  for ( const auto & [key, value] : jfrom.items() )
+    {
+      try
+        {
+          if ( key == "max-layers" ) { value.get_to( plan.maxLayers ); }
+          else if ( key == "layers" ) { value.get_to( plan.layers ); }
+          else
+            {
+              throw InvalidLayerPlanException(
+                "unrecognized layer plan field: '" + key + "'" );
+            }
+        }
+      catch ( nlohmann::json::exception & err )
+        {
+          throw InvalidLayerPlanException( "couldn't parse layer plan field '"
+                                             + key + "'",
+                                           extract_json_errmsg( err ) );
+        }
+    }
+}
+
+
+void
+to_json( nlohmann::json & jto, const LayerPlan & plan )
+{
+  jto = { { "max-layers", plan.maxLayers }, { "layers", plan.layers } };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Count the paths in @a graph which depend on each path, directly or
+ *        through other paths.
+ */
+[[nodiscard]] static std::map<std::string, std::size_t>
+countDependents( const ReferenceGraph & graph )
+{
+  ReferenceGraph referrers;
+  for ( const auto & [path, references] : graph )
+    {
+      for ( const auto & reference : references )
+        {
+          referrers[reference].emplace( path );
+        }
+    }
+
+  std::map<std::string, std::size_t> dependents;
+  for ( const auto & [path, _] : graph )
+    {
+      std::set<std::string>    seen;
+      std::vector<std::string> pending = { path };
+      while ( ! pending.empty() )
+        {
+          std::string current = std::move( pending.back() );
+          pending.pop_back();
+          auto found = referrers.find( current );
+          if ( found == referrers.end() ) { continue; }
+          for ( const auto & referrer : found->second )
+            {
+              if ( seen.emplace( referrer ).second )
+                {
+                  pending.emplace_back( referrer );
+                }
+            }
+        }
+      seen.erase( path );
+      dependents.emplace( path, seen.size() );
+    }
+  return dependents;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+LayerPlan
+planLayers( const ReferenceGraph &           graph,
+            const std::string &              root,
+            unsigned                         maxLayers,
+            const std::optional<LayerPlan> & previous )
+{
+  if ( maxLayers < 2 )
+    {
+      throw InvalidLayerPlanException(
+        "a layer plan needs at least 2 layers, but "
+        + std::to_string( maxLayers ) + " were requested" );
+    }
+  if ( ! graph.contains( root ) )
+    {
+      throw InvalidLayerPlanException( "root '" + root
+                                       + "' is missing from its closure" );
+    }
+
+  /* Paths which had their own layer keep their previous position. */
+  std::map<std::string, std::size_t> previousLayer;
+  if ( previous.has_value() && ( 1 < previous->layers.size() ) )
+    {
+      for ( std::size_t idx = 0; idx + 1 < previous->layers.size(); ++idx )
+        {
+          for ( const auto & path : previous->layers[idx] )
+            {
+              previousLayer.emplace( path, idx );
+            }
+        }
+    }
+
+  auto dependents = countDependents( graph );
+
+  std::vector<std::string> ranked;
+  for ( const auto & [path, _] : graph )
+    {
+      if ( path != root ) { ranked.emplace_back( path ); }
+    }
+  auto outranks = [&]( const std::string & lhs, const std::string & rhs )
+  {
+    auto lhsPrev = previousLayer.find( lhs );
+    auto rhsPrev = previousLayer.find( rhs );
+    bool lhsKept = lhsPrev != previousLayer.end();
+    bool rhsKept = rhsPrev != previousLayer.end();
+    if ( lhsKept != rhsKept ) { return lhsKept; }
+    if ( lhsKept ) { return lhsPrev->second < rhsPrev->second; }
+    return dependents.at( rhs ) < dependents.at( lhs );
+  };
+  std::stable_sort( ranked.begin(), ranked.end(), outranks );
+
+  /* One layer is left for the image's customisation layer, and one for the
+   * remaining paths. */
+  std::size_t dedicated
+    = std::min<std::size_t>( maxLayers - 2, ranked.size() );
+
+  LayerPlan plan;
+  plan.maxLayers = maxLayers;
+  for ( std::size_t idx = 0; idx < dedicated; ++idx )
+    {
+      plan.layers.push_back( { ranked[idx] } );
+    }
+  std::vector<std::string> rest( ranked.begin() + dedicated, ranked.end() );
+  rest.emplace_back( root );
+  plan.layers.emplace_back( std::move( rest ) );
+  return plan;
+}
+
+
+LayerPlan
+planLayers( nix::Store &                     store,
+            const nix::StorePath &           root,
+            unsigned                         maxLayers,
+            const std::optional<LayerPlan> & previous )
+{
+  return planLayers( getReferenceGraph( store, root ),
+                     store.printStorePath( root ),
+                     maxLayers,
+                     previous );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::optional<LayerPlan>
+readLayerPlan( const std::filesystem::path & path )
+{
+  if ( ! std::filesystem::exists( path ) ) { return std::nullopt; }
+  std::ifstream input( path );
+  try
+    {
+      return nlohmann::json::parse( input ).get<LayerPlan>();
+    }
+  catch ( nlohmann::json::exception & err )
+    {
+      throw InvalidLayerPlanException(
+        nix::fmt( "failed to parse layer plan '%s'", path.string() ),
+        extract_json_errmsg( err ) );
+    }
+}
+
+
+void
+writeLayerPlan( const std::filesystem::path & path, const LayerPlan & plan )
+{
+  nix::writeFile( path, nlohmann::json( plan ).dump( 2 ) + "\n" );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::buildenv
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
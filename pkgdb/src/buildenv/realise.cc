@@ -156,13 +156,14 @@ createEnvironmentStorePath(
   std::vector<RealisedPackage> & pkgs,
   nix::StorePathSet &            references,
   std::map<nix::StorePath, std::pair<std::string, resolver::LockedPackageRaw>> &
-    originalPackage )
+       originalPackage,
+  bool resolveLinks )
 {
   /* build the profile into a tempdir */
   auto tempDir = nix::createTempDir();
   try
     {
-      buildenv::buildEnvironment( tempDir, pkgs );
+      buildenv::buildEnvironment( tempDir, pkgs, resolveLinks );
     }
   catch ( buildenv::FileConflict & err )
     {
@@ -200,6 +201,12 @@ static std::vector<std::pair<std::string, resolver::LockedPackageRaw>>
 getLockedPackages( resolver::Lockfile & lockfile, const System & system )
 {
   traceLog( "creating FloxEnv" );
+  if ( lockfile.isPending( system ) )
+    {
+      throw SystemNotSupportedByLockfile(
+        "'" + system + "' has not been locked yet",
+        "run `pkgdb manifest lock --complete' to lock pending systems" );
+    }
   auto packages = lockfile.getLockfileRaw().packages.find( system );
   if ( packages == lockfile.getLockfileRaw().packages.end() )
     {
@@ -876,17 +883,23 @@ createFloxEnv( nix::ref<nix::EvalState> & state,
   pkgs.push_back( profileScriptsPath );
   references.insert( profileScriptsReference );
 
+  const auto & options      = lockfile.getManifestRaw().options;
+  bool         resolveLinks = options.has_value()
+                      && options->resolveLinks.value_or( false );
+
   return createEnvironmentStorePath( *state,
                                      pkgs,
                                      references,
-                                     originalPackage );
+                                     originalPackage,
+                                     resolveLinks );
 }
 
 
 nix::StorePath
 createContainerBuilder( nix::EvalState &       state,
                         const nix::StorePath & environmentStorePath,
-                        const System &         system )
+                        const System &         system,
+                        const LayerPlan &      layerPlan )
 {
   static const nix::FlakeRef nixpkgsRef
     = nix::parseFlakeRef( COMMON_NIXPKGS_URL );
@@ -915,8 +928,11 @@ createContainerBuilder( nix::EvalState &       state,
   nix::Value vContainerSystem {};
   vContainerSystem.mkString( system );
 
+  nix::Value vLayerPlan {};
+  vLayerPlan.mkString( nlohmann::json( layerPlan ).dump() );
+
   nix::Value vBindings {};
-  auto       bindings = state.buildBindings( 4 );
+  auto       bindings = state.buildBindings( 5 );
   bindings.push_back(
     { state.symbols.create( "nixpkgsFlake" ), &vNixpkgsFlake } );
   bindings.push_back(
@@ -924,6 +940,7 @@ createContainerBuilder( nix::EvalState &       state,
   bindings.push_back( { state.symbols.create( "system" ), &vSystem } );
   bindings.push_back(
     { state.symbols.create( "containerSystem" ), &vContainerSystem } );
+  bindings.push_back( { state.symbols.create( "layerPlan" ), &vLayerPlan } );
 
   vBindings.mkAttrs( bindings );
 
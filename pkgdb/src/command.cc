@@ -8,7 +8,10 @@
  * -------------------------------------------------------------------------- */
 
 #include <algorithm>
+#include <array>
+#include <cstdint>
 #include <optional>
+#include <ostream>
 #include <string>
 #include <variant>
 #include <vector>
@@ -76,6 +79,23 @@ InlineInputMixin::addFlakeRefArg( argparse::ArgumentParser & parser )
 }
 
 
+argparse::Argument &
+InlineInputMixin::addScrapeRulesArg( argparse::ArgumentParser & parser )
+{
+  return parser.add_argument( "--rules" )
+    .help( "a JSON file of scraping rules to merge with the default rules" )
+    .metavar( "PATH" )
+    .nargs( 1 )
+    .action(
+      [&]( const std::string & path )
+      {
+        this->registryInput.scrape
+          = readAndCoerceJSON( nix::absPath( path ) )
+              .get<pkgdb::ScrapeRulesRaw>();
+      } );
+}
+
+
 argparse::Argument &
 InlineInputMixin::addSubtreeArg( argparse::ArgumentParser & parser )
 {
@@ -134,6 +154,59 @@ AttrPathMixin::fixupAttrPath()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+output_format outputFormat = OF_JSON;
+
+
+argparse::Argument &
+addOutputFormatArg( argparse::ArgumentParser & parser )
+{
+  return parser.add_argument( "--output-format" )
+    .help( "encoding of output records, being one of 'json', 'cbor', or "
+           "'msgpack'. Binary records are prefixed by their length." )
+    .metavar( "FORMAT" )
+    .nargs( 1 )
+    .action(
+      []( const std::string & format )
+      {
+        if ( format == "json" ) { outputFormat = OF_JSON; }
+        else if ( format == "cbor" ) { outputFormat = OF_CBOR; }
+        else if ( format == "msgpack" ) { outputFormat = OF_MSGPACK; }
+        else
+          {
+            throw InvalidArgException( "unrecognized output format '" + format
+                                       + "'" );
+          }
+      } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+writeRecord( const nlohmann::json & record, std::ostream & oss )
+{
+  if ( outputFormat == OF_JSON )
+    {
+      oss << record.dump() << '\n';
+      return;
+    }
+
+  std::vector<std::uint8_t> bytes = ( outputFormat == OF_CBOR )
+                                      ? nlohmann::json::to_cbor( record )
+                                      : nlohmann::json::to_msgpack( record );
+  auto size = static_cast<std::uint32_t>( bytes.size() );
+  std::array<char, 4> header = { static_cast<char>( ( size >> 24 ) & 0xff ),
+                                 static_cast<char>( ( size >> 16 ) & 0xff ),
+                                 static_cast<char>( ( size >> 8 ) & 0xff ),
+                                 static_cast<char>( size & 0xff ) };
+  oss.write( header.data(), header.size() );
+  oss.write( reinterpret_cast<const char *>( bytes.data() ),
+             static_cast<std::streamsize>( bytes.size() ) );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox::command
@@ -8,6 +8,7 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <optional>
 #include <stdexcept>
 
 #include <nix/eval-cache.hh>
@@ -20,6 +21,59 @@
 
 namespace flox {
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Read a single license attrset from `meta.license`.
+ *
+ * Lists of licenses hold attrsets, which the evaluation cache can't
+ * traverse, so these yield `std::nullopt`.
+ */
+[[nodiscard]] static std::optional<License>
+readLicense( const MaybeCursor & cursor )
+{
+  auto getString = [&]( const char * attr ) -> std::optional<std::string>
+  {
+    try
+      {
+        if ( MaybeCursor field = cursor->maybeGetAttr( attr );
+             field != nullptr )
+          {
+            return field->getString();
+          }
+      }
+    catch ( ... )
+      {}
+    return std::nullopt;
+  };
+  auto getBool = [&]( const char * attr ) -> std::optional<bool>
+  {
+    try
+      {
+        if ( MaybeCursor field = cursor->maybeGetAttr( attr );
+             field != nullptr )
+          {
+            return field->getBool();
+          }
+      }
+    catch ( ... )
+      {}
+    return std::nullopt;
+  };
+
+  License license;
+  license.spdxId                  = getString( "spdxId" );
+  std::optional<std::string> name = license.spdxId;
+  if ( ! name.has_value() ) { name = getString( "shortName" ); }
+  if ( ! name.has_value() ) { name = getString( "fullName" ); }
+  if ( ! name.has_value() ) { return std::nullopt; }
+  license.name            = std::move( *name );
+  license.free            = getBool( "free" );
+  license.redistributable = getBool( "redistributable" );
+  return license;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 void
@@ -67,6 +121,10 @@ FlakePackage::init( bool checkDrv )
             }
           catch ( ... )
             {}
+          if ( auto license = readLicense( cursor ); license.has_value() )
+            {
+              this->_licenses.emplace_back( std::move( *license ) );
+            }
         }
     }
 
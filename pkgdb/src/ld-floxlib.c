@@ -15,15 +15,25 @@
  *              of the GNU dynamic linker and how it calls la_objsearch()
  *              repeatedly in the process of searching for a library in
  *              various locations.
+ *
+ *              FLOX_ENV_LIB_DIRS is read exactly once and copied into a
+ *              private array so that the process environment is never
+ *              modified. Candidates are only returned to the dynamic linker
+ *              if their ELF header matches the class, machine and OSABI of
+ *              this library, and names which could not be found in any
+ *              directory are remembered so that repeated lookups of the same
+ *              missing library do not hit the filesystem again.
  */
 
 #ifndef _GNU_SOURCE
 #  define _GNU_SOURCE
 #endif /* _GNU_SOURCE */
 
+#include <elf.h>
 #include <fcntl.h>
 #include <limits.h>
 #include <link.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -37,29 +47,277 @@
 __asm__( ".symver close,close@GLIBC_2.17" );
 __asm__( ".symver fprintf,fprintf@GLIBC_2.17" );
 __asm__( ".symver getenv,getenv@GLIBC_2.17" );
+__asm__( ".symver malloc,malloc@GLIBC_2.17" );
 __asm__( ".symver open,open@GLIBC_2.17" );
+__asm__( ".symver read,read@GLIBC_2.17" );
 __asm__( ".symver snprintf,snprintf@GLIBC_2.17" );
 __asm__( ".symver stderr,stderr@GLIBC_2.17" );
+__asm__( ".symver strcmp,strcmp@GLIBC_2.17" );
+__asm__( ".symver strdup,strdup@GLIBC_2.17" );
+__asm__( ".symver strlen,strlen@GLIBC_2.17" );
 __asm__( ".symver strrchr,strrchr@GLIBC_2.17" );
-__asm__( ".symver strtok,strtok@GLIBC_2.17" );
 #elif defined( __x86_64__ )
 // x86_64 Linux goes back to 2.2.5.
 __asm__( ".symver close,close@GLIBC_2.2.5" );
 __asm__( ".symver fprintf,fprintf@GLIBC_2.2.5" );
 __asm__( ".symver getenv,getenv@GLIBC_2.2.5" );
+__asm__( ".symver malloc,malloc@GLIBC_2.2.5" );
 __asm__( ".symver open,open@GLIBC_2.2.5" );
+__asm__( ".symver read,read@GLIBC_2.2.5" );
 __asm__( ".symver snprintf,snprintf@GLIBC_2.2.5" );
 __asm__( ".symver stderr,stderr@GLIBC_2.2.5" );
+__asm__( ".symver strcmp,strcmp@GLIBC_2.2.5" );
+__asm__( ".symver strdup,strdup@GLIBC_2.2.5" );
+__asm__( ".symver strlen,strlen@GLIBC_2.2.5" );
 __asm__( ".symver strrchr,strrchr@GLIBC_2.2.5" );
-__asm__( ".symver strtok,strtok@GLIBC_2.2.5" );
 #else
 // Punt .. just go with default symbol bindings and hope for the best.
 #endif
 
+// The ELF machine type of the objects we are willing to serve up.
+#if defined( __aarch64__ )
+#  define FLOXLIB_ELF_MACHINE EM_AARCH64
+#elif defined( __x86_64__ )
+#  define FLOXLIB_ELF_MACHINE EM_X86_64
+#elif defined( __i386__ )
+#  define FLOXLIB_ELF_MACHINE EM_386
+#elif defined( __arm__ )
+#  define FLOXLIB_ELF_MACHINE EM_ARM
+#elif defined( __riscv )
+#  define FLOXLIB_ELF_MACHINE EM_RISCV
+#elif defined( __powerpc64__ )
+#  define FLOXLIB_ELF_MACHINE EM_PPC64
+#else
+// Unknown machine .. skip the machine check and only validate the class.
+#  define FLOXLIB_ELF_MACHINE EM_NONE
+#endif
+
+#if __ELF_NATIVE_CLASS == 64
+#  define FLOXLIB_ELF_CLASS ELFCLASS64
+#else
+#  define FLOXLIB_ELF_CLASS ELFCLASS32
+#endif
+
+// Number of slots in the negative lookup cache, must be a power of two.
+#define FLOXLIB_MISS_CACHE_SIZE 256
+
 static int  audit_ld_floxlib = -1;
 static int  debug_ld_floxlib = -1;
 static char name_buf[PATH_MAX];
 
+// Private copy of `FLOX_ENV_LIB_DIRS' split into individual directories.
+// This is populated once by `init_lib_dirs()' and never modified afterwards.
+static int           lib_dirs_initialized = 0;
+static const char ** lib_dirs             = NULL;
+static size_t        lib_dirs_count       = 0;
+
+// Hashes of basenames which were not found in any of `lib_dirs', alongside
+// private copies of the basenames themselves to rule out hash collisions.
+// A hash of zero marks an empty slot.
+static uint64_t miss_cache[FLOXLIB_MISS_CACHE_SIZE];
+static char *   miss_cache_names[FLOXLIB_MISS_CACHE_SIZE];
+static size_t   miss_cache_count = 0;
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Split `FLOX_ENV_LIB_DIRS' into a private, immutable array of directories.
+ * The environment buffer returned by `getenv' is copied first so that
+ * subsequent lookups ( and child processes ) still see the original value.
+ * Empty entries are skipped.
+ */
+static void
+init_lib_dirs( void )
+{
+  lib_dirs_initialized = 1;
+
+  const char * env = getenv( "FLOX_ENV_LIB_DIRS" );
+  if ( ( env == NULL ) || ( env[0] == '\0' ) ) { return; }
+
+  size_t len = strlen( env );
+  char * buf = malloc( len + 1 );
+  if ( buf == NULL ) { return; }
+
+  // Copy the buffer, converting separators to terminators and counting the
+  // number of non-empty entries as we go.
+  size_t count    = 0;
+  int    in_entry = 0;
+  for ( size_t idx = 0; idx <= len; ++idx )
+    {
+      if ( ( env[idx] == ':' ) || ( env[idx] == '\0' ) )
+        {
+          buf[idx] = '\0';
+          in_entry = 0;
+        }
+      else
+        {
+          buf[idx] = env[idx];
+          if ( ! in_entry ) { ++count; }
+          in_entry = 1;
+        }
+    }
+
+  if ( count == 0 ) { return; }
+
+  const char ** dirs = malloc( count * sizeof( const char * ) );
+  if ( dirs == NULL ) { return; }
+
+  size_t nth = 0;
+  for ( size_t idx = 0; idx < len; ++idx )
+    {
+      if ( ( buf[idx] != '\0' )
+           && ( ( idx == 0 ) || ( buf[idx - 1] == '\0' ) ) )
+        {
+          dirs[nth++] = buf + idx;
+        }
+    }
+
+  lib_dirs       = dirs;
+  lib_dirs_count = count;
+
+  if ( debug_ld_floxlib )
+    {
+      for ( size_t idx = 0; idx < lib_dirs_count; ++idx )
+        {
+          fprintf( stderr,
+                   "DEBUG: init_lib_dirs() FLOX_ENV_LIB_DIRS[%zu]: %s\n",
+                   idx,
+                   lib_dirs[idx] );
+        }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** FNV-1a hash of a basename, never returning zero. */
+static uint64_t
+hash_name( const char * name )
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for ( const unsigned char * chr = (const unsigned char *) name; *chr != '\0';
+        ++chr )
+    {
+      hash ^= *chr;
+      hash *= 0x100000001b3ULL;
+    }
+  return ( hash == 0 ) ? 1 : hash;
+}
+
+/**
+ * Return non-zero if @a name, whose hash is @a hash, was previously recorded
+ * as a miss.
+ * The stored name is compared on every hash match so that a collision with
+ * another missing library never skips the search for @a name.
+ */
+static int
+miss_cache_contains( uint64_t hash, const char * name )
+{
+  size_t slot = hash & ( FLOXLIB_MISS_CACHE_SIZE - 1 );
+  for ( size_t probe = 0; probe < FLOXLIB_MISS_CACHE_SIZE; ++probe )
+    {
+      size_t idx = ( slot + probe ) & ( FLOXLIB_MISS_CACHE_SIZE - 1 );
+      if ( miss_cache[idx] == 0 ) { return 0; }
+      if ( ( miss_cache[idx] == hash )
+           && ( strcmp( miss_cache_names[idx], name ) == 0 ) )
+        {
+          return 1;
+        }
+    }
+  return 0;
+}
+
+/**
+ * Record @a name, whose hash is @a hash, as a miss.
+ * Once the cache is three quarters full, or if @a name cannot be copied, new
+ * misses are simply not recorded, which keeps probe sequences short and only
+ * costs a repeated search.
+ */
+static void
+miss_cache_insert( uint64_t hash, const char * name )
+{
+  if ( ( miss_cache_count * 4 ) >= ( FLOXLIB_MISS_CACHE_SIZE * 3 ) ) { return; }
+  size_t slot = hash & ( FLOXLIB_MISS_CACHE_SIZE - 1 );
+  for ( size_t probe = 0; probe < FLOXLIB_MISS_CACHE_SIZE; ++probe )
+    {
+      size_t idx = ( slot + probe ) & ( FLOXLIB_MISS_CACHE_SIZE - 1 );
+      if ( miss_cache[idx] == 0 )
+        {
+          char * copy = strdup( name );
+          if ( copy == NULL ) { return; }
+          miss_cache[idx]       = hash;
+          miss_cache_names[idx] = copy;
+          ++miss_cache_count;
+          return;
+        }
+      if ( ( miss_cache[idx] == hash )
+           && ( strcmp( miss_cache_names[idx], name ) == 0 ) )
+        {
+          return;
+        }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * Check that the file at @a path is an ELF shared object that the dynamic
+ * linker running this process could actually load, i.e. one which matches
+ * our own ELF class, machine, and a compatible OSABI.
+ *
+ * This costs exactly one `open', one `read', and one `close' per candidate.
+ */
+static int
+is_compatible_elf( const char * path )
+{
+  int fd = open( path, O_RDONLY | O_CLOEXEC );
+  if ( fd == -1 ) { return 0; }
+
+  ElfW( Ehdr ) ehdr;
+  ssize_t nread = read( fd, &ehdr, sizeof( ehdr ) );
+  close( fd );
+
+  const char * reason = NULL;
+  if ( nread != (ssize_t) sizeof( ehdr ) ) { reason = "short read"; }
+  else if ( ( ehdr.e_ident[EI_MAG0] != ELFMAG0 )
+            || ( ehdr.e_ident[EI_MAG1] != ELFMAG1 )
+            || ( ehdr.e_ident[EI_MAG2] != ELFMAG2 )
+            || ( ehdr.e_ident[EI_MAG3] != ELFMAG3 ) )
+    {
+      reason = "not an ELF file";
+    }
+  else if ( ehdr.e_ident[EI_CLASS] != FLOXLIB_ELF_CLASS )
+    {
+      reason = "wrong ELF class";
+    }
+  else if ( ( ehdr.e_ident[EI_OSABI] != ELFOSABI_SYSV )
+            && ( ehdr.e_ident[EI_OSABI] != ELFOSABI_GNU ) )
+    {
+      reason = "wrong ELF OSABI";
+    }
+  else if ( ehdr.e_type != ET_DYN ) { reason = "not a shared object"; }
+  else if ( ( FLOXLIB_ELF_MACHINE != EM_NONE )
+            && ( ehdr.e_machine != FLOXLIB_ELF_MACHINE ) )
+    {
+      reason = "wrong ELF machine";
+    }
+
+  if ( ( reason != NULL ) && debug_ld_floxlib )
+    {
+      fprintf( stderr,
+               "DEBUG: la_objsearch() skipping %s: %s\n",
+               path,
+               reason );
+    }
+
+  return reason == NULL;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
 unsigned int
 la_version( unsigned int version )
 {
@@ -69,6 +327,8 @@ la_version( unsigned int version )
 char *
 la_objsearch( const char * name, uintptr_t * cookie, unsigned int flag )
 {
+  (void) cookie;
+
   if ( debug_ld_floxlib < 0 )
     {
       debug_ld_floxlib = ( getenv( "LD_FLOXLIB_DEBUG" ) != NULL );
@@ -91,62 +351,72 @@ la_objsearch( const char * name, uintptr_t * cookie, unsigned int flag )
   // Only look for the library once the dynamic linker has exhausted
   // all of the other possible search locations, and only if it isn't
   // already specified by way of an explicit path.
-  if ( flag == LA_SER_DEFAULT )
+  if ( flag != LA_SER_DEFAULT ) { return (char *) name; }
+
+  int fd = open( name, O_RDONLY | O_CLOEXEC );
+  if ( fd != -1 )
     {
-      int fd = open( name, O_RDONLY );
-      if ( fd != -1 ) { close( fd ); }
-      else
-        {
-          char * basename          = strrchr( name, '/' );
-          char * flox_env_lib_dirs = getenv( "FLOX_ENV_LIB_DIRS" );
+      close( fd );
+      return (char *) name;
+    }
+
+  if ( ! lib_dirs_initialized ) { init_lib_dirs(); }
+  if ( lib_dirs_count == 0 ) { return (char *) name; }
 
-          if ( basename != NULL ) { basename++; }
-          else { basename = (char *) name; }
+  const char * basename = strrchr( name, '/' );
+  if ( basename != NULL ) { basename++; }
+  else { basename = name; }
 
-          if ( flox_env_lib_dirs != NULL )
+  // Skip names which we already failed to find.
+  uint64_t hash = hash_name( basename );
+  if ( miss_cache_contains( hash, basename ) )
+    {
+      if ( debug_ld_floxlib )
+        {
+          fprintf( stderr,
+                   "DEBUG: la_objsearch() cached miss: %s\n",
+                   basename );
+        }
+      return (char *) name;
+    }
+
+  // Iterate over the directories in FLOX_ENV_LIB_DIRS looking for a
+  // compatible copy of the requested library.
+  // If found, return the full path to the library and otherwise return
+  // the original name.
+  for ( size_t idx = 0; idx < lib_dirs_count; ++idx )
+    {
+      int len = snprintf( name_buf,
+                          sizeof( name_buf ),
+                          "%s/%s",
+                          lib_dirs[idx],
+                          basename );
+      if ( ( len < 0 ) || ( ( (size_t) len ) >= sizeof( name_buf ) ) )
+        {
+          continue;
+        }
+      if ( debug_ld_floxlib )
+        {
+          fprintf( stderr, "DEBUG: la_objsearch() checking: %s\n", name_buf );
+        }
+      if ( is_compatible_elf( name_buf ) )
+        {
+          if ( audit_ld_floxlib < 0 )
             {
-              // Iterate over the colon-separated list of paths in
-              // FLOX_ENV_LIB_DIRS looking for the requested library.
-              // If found, return the full path to the library and
-              // otherwise return the original name.
-              char * flox_env_library_dir = NULL;
-              flox_env_library_dir        = strtok( flox_env_lib_dirs, ":" );
-              while ( flox_env_library_dir != NULL )
-                {
-                  (void) snprintf( name_buf,
-                                   sizeof( name_buf ),
-                                   "%s/%s",
-                                   flox_env_library_dir,
-                                   basename );
-                  if ( debug_ld_floxlib )
-                    {
-                      fprintf( stderr,
-                               "DEBUG: la_objsearch() checking: %s\n",
-                               name_buf );
-                    }
-                  fd = open( name_buf, O_RDONLY );
-                  if ( fd != -1 )
-                    {
-                      close( fd );
-                      if ( audit_ld_floxlib < 0 )
-                        {
-                          audit_ld_floxlib
-                            = ( getenv( "LD_FLOXLIB_AUDIT" ) != NULL );
-                        }
-                      if ( audit_ld_floxlib || debug_ld_floxlib )
-                        {
-                          fprintf( stderr,
-                                   "AUDIT: la_objsearch() resolved %s -> %s\n",
-                                   name,
-                                   name_buf );
-                        }
-                      return name_buf;
-                    }
-                  flox_env_library_dir = strtok( NULL, ":" );
-                }
+              audit_ld_floxlib = ( getenv( "LD_FLOXLIB_AUDIT" ) != NULL );
             }
+          if ( audit_ld_floxlib || debug_ld_floxlib )
+            {
+              fprintf( stderr,
+                       "AUDIT: la_objsearch() resolved %s -> %s\n",
+                       name,
+                       name_buf );
+            }
+          return name_buf;
         }
     }
+
+  miss_cache_insert( hash, basename );
   return (char *) name;
 }
 /* vim: set et ts=4: */
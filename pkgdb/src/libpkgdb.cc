@@ -0,0 +1,411 @@
+/* ========================================================================== *
+ *
+ * @file libpkgdb.cc
+ *
+ * @brief C interface to `libpkgdb`.
+ *
+ * Each entry point wraps the same routines used by `pkgdb` subcommands, and
+ * converts exceptions to error codes instead of letting them cross the
+ * C boundary.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <memory>
+#include <new>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include <nix/error.hh>
+#include <nix/globals.hh>
+#include <nix/store-api.hh>
+#include <nix/util.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/buildenv/realise.hh"
+#include "flox/core/command.hh"
+#include "flox/core/exceptions.hh"
+#include "flox/core/nix-state.hh"
+#include "flox/core/util.hh"
+#include "flox/libpkgdb.h"
+#include "flox/pkgdb/input.hh"
+#include "flox/pkgdb/pkg-query.hh"
+#include "flox/registry.hh"
+#include "flox/resolver/command.hh"
+#include "flox/resolver/lockfile.hh"
+#include "flox/search/command.hh"
+#include "flox/search/params.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+struct pkgdb_session : public flox::NixState
+{
+  /** The last error as a JSON object, if the last operation failed. */
+  std::optional<std::string> lastError;
+
+  /** Registry inputs locked and opened by this session's operations. */
+  std::shared_ptr<flox::pkgdb::PkgDbInputCache> inputs
+    = std::make_shared<flox::pkgdb::PkgDbInputCache>();
+}; /* End struct `pkgdb_session' */
+
+
+struct pkgdb_input
+{
+  std::shared_ptr<flox::pkgdb::PkgDbInput> input;
+}; /* End struct `pkgdb_input' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Record @a err as the last error of @a session. */
+static int
+setLastError( pkgdb_session & session, const flox::FloxException & err )
+{
+  session.lastError = nlohmann::json( err ).dump();
+  return err.getErrorCode();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run @a operation, converting any exception it throws to an error
+ *        code in the same way as `pkgdb`'s `main` routine.
+ */
+template<typename Operation>
+static int
+guard( pkgdb_session * session, Operation && operation ) noexcept
+{
+  if ( session == nullptr ) { return flox::EC_INVALID_ARG; }
+  session->lastError = std::nullopt;
+  try
+    {
+      operation();
+      return flox::EC_OKAY;
+    }
+  catch ( const flox::FloxException & err )
+    {
+      return setLastError( *session, err );
+    }
+  catch ( const nix::Error & err )
+    {
+      return setLastError(
+        *session,
+        flox::NixException( "running libpkgdb operation",
+                            nix::filterANSIEscapes( err.what(), true ) ) );
+    }
+  catch ( const std::exception & err )
+    {
+      return setLastError(
+        *session,
+        flox::CaughtException( "running libpkgdb operation", err.what() ) );
+    }
+  catch ( ... )
+    {
+      return setLastError(
+        *session,
+        flox::CaughtException( "running libpkgdb operation" ) );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Parse a JSON argument, naming it as @a what in errors. */
+[[nodiscard]] static nlohmann::json
+parseArg( const char * json, std::string_view what )
+{
+  if ( json == nullptr )
+    {
+      throw flox::command::InvalidArgException(
+        nix::fmt( "'%s' must not be NULL", what ) );
+    }
+  try
+    {
+      return nlohmann::json::parse( json );
+    }
+  catch ( nlohmann::json::exception & err )
+    {
+      throw flox::command::InvalidArgException(
+        nix::fmt( "failed to parse '%s'", what ),
+        flox::extract_json_errmsg( err ) );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Copy @a str to a buffer freed by @a pkgdb_string_free. */
+[[nodiscard]] static char *
+copyString( const std::string & str )
+{
+  char * copy = strdup( str.c_str() );
+  if ( copy == nullptr ) { throw std::bad_alloc(); }
+  return copy;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+extern "C" {
+
+/* -------------------------------------------------------------------------- */
+
+unsigned int
+pkgdb_abi_version( void )
+{
+  return PKGDB_ABI_VERSION;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+pkgdb_session_new( pkgdb_session ** session )
+{
+  if ( session == nullptr ) { return flox::EC_INVALID_ARG; }
+  *session = nullptr;
+  try
+    {
+      // Required to download flakes, but don't override if already set.
+      setenv( "NIX_SSL_CERT_FILE", NIXPKGS_CACERT_BUNDLE_CRT, 0 );
+      flox::initNix();
+      flox::setVerbosityFromEnv();
+      *session = new pkgdb_session();
+      return flox::EC_OKAY;
+    }
+  catch ( const flox::FloxException & err )
+    {
+      return err.getErrorCode();
+    }
+  catch ( const nix::Error & )
+    {
+      return flox::EC_NIX;
+    }
+  catch ( ... )
+    {
+      return flox::EC_FAILURE;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+pkgdb_session_free( pkgdb_session * session )
+{
+  delete session;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+const char *
+pkgdb_session_last_error( const pkgdb_session * session )
+{
+  if ( ( session == nullptr ) || ( ! session->lastError.has_value() ) )
+    {
+      return nullptr;
+    }
+  return session->lastError->c_str();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+pkgdb_input_open( pkgdb_session * session,
+                  const char *    registryInput,
+                  pkgdb_input **  input )
+{
+  return guard( session,
+                [&]()
+                {
+                  if ( input == nullptr )
+                    {
+                      throw flox::command::InvalidArgException(
+                        "'input' must not be NULL" );
+                    }
+                  flox::RegistryInput regInput
+                    = parseArg( registryInput, "registryInput" );
+                  nix::ref<nix::Store> store = session->getStore();
+                  *input                     = new pkgdb_input {
+                    std::make_shared<flox::pkgdb::PkgDbInput>( store,
+                                                               regInput ) };
+                } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+pkgdb_input_free( pkgdb_input * input )
+{
+  delete input;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+pkgdb_input_query( pkgdb_session *       session,
+                   pkgdb_input *         input,
+                   const char *          queryArgs,
+                   pkgdb_record_callback callback,
+                   void *                userdata )
+{
+  return guard(
+    session,
+    [&]()
+    {
+      if ( ( input == nullptr ) || ( callback == nullptr ) )
+        {
+          throw flox::command::InvalidArgException(
+            "'input' and 'callback' must not be NULL" );
+        }
+      flox::pkgdb::PkgQueryArgs args = parseArg( queryArgs, "queryArgs" );
+      args.check();
+
+      /* Only scrape the prefixes the query can match. */
+      auto & dbInput = *input->input;
+      for ( const auto & subtree :
+            args.subtrees.value_or( dbInput.getSubtrees() ) )
+        {
+          for ( const auto & system : args.systems )
+            {
+              dbInput.scrapePrefix(
+                { static_cast<std::string>( to_string( subtree ) ),
+                  system } );
+            }
+        }
+
+      auto dbRO = dbInput.getDbReadOnly();
+      auto rows = flox::pkgdb::PkgQuery( args ).execute( dbRO->db );
+      for ( const auto & row : rows )
+        {
+          if ( callback( dbInput.getRowJSON( row ).dump().c_str(), userdata )
+               != 0 )
+            {
+              return;
+            }
+        }
+    } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+pkgdb_search( pkgdb_session *       session,
+              const char *          searchParams,
+              pkgdb_record_callback callback,
+              void *                userdata )
+{
+  return guard( session,
+                [&]()
+                {
+                  if ( callback == nullptr )
+                    {
+                      throw flox::command::InvalidArgException(
+                        "'callback' must not be NULL" );
+                    }
+                  flox::search::SearchCommand command;
+                  command.useSession( session->getStore(), session->inputs );
+                  command.setParams(
+                    parseArg( searchParams, "searchParams" )
+                      .get<flox::search::SearchParams>() );
+                  command.search(
+                    [&]( const nlohmann::json & record )
+                    {
+                      return callback( record.dump().c_str(), userdata ) == 0;
+                    } );
+                } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+pkgdb_lock( pkgdb_session * session,
+            const char *    manifestPath,
+            const char *    lockfilePath,
+            char **         lockfile )
+{
+  return guard( session,
+                [&]()
+                {
+                  if ( ( manifestPath == nullptr ) || ( lockfile == nullptr ) )
+                    {
+                      throw flox::command::InvalidArgException(
+                        "'manifestPath' and 'lockfile' must not be NULL" );
+                    }
+                  flox::resolver::LockCommand command;
+                  command.useSession( session->getStore(), session->inputs );
+                  command.setFiles(
+                    manifestPath,
+                    ( lockfilePath == nullptr )
+                      ? std::nullopt
+                      : std::make_optional<std::filesystem::path>(
+                        lockfilePath ) );
+                  *lockfile = copyString( command.lock().dump() );
+                } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+pkgdb_buildenv( pkgdb_session * session,
+                const char *    lockfile,
+                const char *    system,
+                char **         storePath )
+{
+  return guard(
+    session,
+    [&]()
+    {
+      if ( storePath == nullptr )
+        {
+          throw flox::command::InvalidArgException(
+            "'storePath' must not be NULL" );
+        }
+      flox::resolver::LockfileRaw lockfileRaw
+        = parseArg( lockfile, "lockfile" );
+      flox::resolver::Lockfile locked( std::move( lockfileRaw ) );
+      auto state = session->getState();
+      auto built = flox::buildenv::createFloxEnv(
+        state,
+        locked,
+        ( system == nullptr ) ? nix::settings.thisSystem.get()
+                              : std::string( system ) );
+      *storePath = copyString( session->getStore()->printStorePath( built ) );
+    } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+pkgdb_string_free( char * str )
+{
+  std::free( str );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // extern "C"
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
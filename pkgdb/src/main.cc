@@ -23,6 +23,7 @@
 #include "flox/buildenv/command.hh"
 #include "flox/core/command.hh"
 #include "flox/core/exceptions.hh"
+#include "flox/core/nix-state.hh"
 #include "flox/eval.hh"
 #include "flox/parse/command.hh"
 #include "flox/pkgdb/command.hh"
@@ -33,59 +34,10 @@
 
 /* -------------------------------------------------------------------------- */
 
-namespace flox {
-
 #ifndef NIXPKGS_CACERT_BUNDLE_CRT
 #  error "NIXPKGS_CACERT_BUNDLE_CRT must be set"
 #endif
 
-/* -------------------------------------------------------------------------- */
-
-/**
- * @class CaughtException
- * @brief An exception thrown when an otherwise unhandled exception is caught.
- *        This ensures proper JSON formatting.
- * @{
- */
-FLOX_DEFINE_EXCEPTION( CaughtException,
-                       EC_FAILURE,
-                       "caught an unhandled exception" )
-/** @} */
-
-
-/* -------------------------------------------------------------------------- */
-
-/**
- * @class NixException
- * @brief An exception thrown when an otherwise unhandled Nix exception is
- *        caught. This ensures proper JSON formatting.
- * @{
- */
-FLOX_DEFINE_EXCEPTION( NixException, EC_NIX, "caught a nix exception" )
-/** @} */
-
-
-/* -------------------------------------------------------------------------- */
-
-}  // namespace flox
-
-/* -------------------------------------------------------------------------- */
-
-void
-setVerbosityFromEnv()
-{
-  auto * valueChars = std::getenv( "_FLOX_PKGDB_VERBOSITY" );
-  if ( valueChars == nullptr ) { return; }
-  std::string value( valueChars );
-  if ( value == std::string( "0" ) ) { nix::verbosity = nix::lvlError; }
-  else if ( value == std::string( "1" ) ) { nix::verbosity = nix::lvlInfo; }
-  else if ( value == std::string( "2" ) ) { nix::verbosity = nix::lvlDebug; }
-  else if ( value == std::string( "3" ) ) { nix::verbosity = nix::lvlChatty; }
-  else if ( value == std::string( "4" ) ) { nix::verbosity = nix::lvlVomit; }
-  // Put this at the end so that if we *want* logging it will show up
-  traceLog( "found _FLOX_PKGDB_VERBOSITY=" + value );
-}
-
 
 /* -------------------------------------------------------------------------- */
 
@@ -109,12 +61,24 @@ run( int argc, char * argv[] )
   flox::pkgdb::GCCommand cmdGC;
   prog.add_subparser( cmdGC.getParser() );
 
+  flox::pkgdb::ProvidesCommand cmdProvides;
+  prog.add_subparser( cmdProvides.getParser() );
+
+  flox::pkgdb::AdvisoriesCommand cmdAdvisories;
+  prog.add_subparser( cmdAdvisories.getParser() );
+
+  flox::pkgdb::UsageCommand cmdUsage;
+  prog.add_subparser( cmdUsage.getParser() );
+
   flox::search::SearchCommand cmdSearch;
   prog.add_subparser( cmdSearch.getParser() );
 
   flox::resolver::ManifestCommand cmdManifest;
   prog.add_subparser( cmdManifest.getParser() );
 
+  flox::resolver::LockfileCommand cmdLockfile;
+  prog.add_subparser( cmdLockfile.getParser() );
+
   flox::parse::ParseCommand cmdParse;
   prog.add_subparser( cmdParse.getParser() );
 
@@ -127,6 +91,9 @@ run( int argc, char * argv[] )
   flox::buildenv::BuildEnvCommand cmdBuildEnv;
   prog.add_subparser( cmdBuildEnv.getParser() );
 
+  flox::buildenv::BundleCommand cmdBundle;
+  prog.add_subparser( cmdBundle.getParser() );
+
 
   /* Parse Args */
   try
@@ -139,19 +106,27 @@ run( int argc, char * argv[] )
     }
 
   /* Set the verbosity level requested by flox */
-  setVerbosityFromEnv();
+  flox::setVerbosityFromEnv();
 
   /* Run subcommand */
   if ( prog.is_subcommand_used( "scrape" ) ) { return cmdScrape.run(); }
   if ( prog.is_subcommand_used( "get" ) ) { return cmdGet.run(); }
   if ( prog.is_subcommand_used( "list" ) ) { return cmdList.run(); }
   if ( prog.is_subcommand_used( "gc" ) ) { return cmdGC.run(); }
+  if ( prog.is_subcommand_used( "provides" ) ) { return cmdProvides.run(); }
+  if ( prog.is_subcommand_used( "advisories" ) )
+    {
+      return cmdAdvisories.run();
+    }
+  if ( prog.is_subcommand_used( "usage" ) ) { return cmdUsage.run(); }
   if ( prog.is_subcommand_used( "search" ) ) { return cmdSearch.run(); }
   if ( prog.is_subcommand_used( "manifest" ) ) { return cmdManifest.run(); }
+  if ( prog.is_subcommand_used( "lockfile" ) ) { return cmdLockfile.run(); }
   if ( prog.is_subcommand_used( "parse" ) ) { return cmdParse.run(); }
   if ( prog.is_subcommand_used( "repl" ) ) { return cmdRepl.run(); }
   if ( prog.is_subcommand_used( "eval" ) ) { return cmdEval.run(); }
   if ( prog.is_subcommand_used( "buildenv" ) ) { return cmdBuildEnv.run(); }
+  if ( prog.is_subcommand_used( "bundle" ) ) { return cmdBundle.run(); }
 
   // TODO: better error for this,
   // likely only occurs if we add a new command without handling it (?)
@@ -164,7 +139,7 @@ printAndReturnException( const flox::FloxException & err )
 {
   if ( isatty( STDOUT_FILENO ) == 0 )
     {
-      std::cout << nlohmann::json( err ).dump() << '\n';
+      flox::command::writeRecord( nlohmann::json( err ) );
     }
   else { std::cerr << err.what() << '\n'; }
 
@@ -8,6 +8,9 @@
  * -------------------------------------------------------------------------- */
 
 #include <cstddef>
+#include <cstdlib>
+#include <string>
+#include <vector>
 
 #include <nix/config.hh>
 #include <nix/error.hh>
@@ -18,6 +21,7 @@
 #include <nix/util.hh>
 
 #include "flox/core/nix-state.hh"
+#include "flox/core/util.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -60,6 +64,50 @@ initNix()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Hooks run before an evaluator opened by `NixState' is destroyed. */
+static std::vector<RegisterEvalStateHook::Hook> &
+getEvalStateHooks()
+{
+  static std::vector<RegisterEvalStateHook::Hook> hooks;
+  return hooks;
+}
+
+
+RegisterEvalStateHook::RegisterEvalStateHook( Hook onDestroy )
+{
+  getEvalStateHooks().emplace_back( std::move( onDestroy ) );
+}
+
+
+void
+destroyEvalState( nix::EvalState * state )
+{
+  if ( state == nullptr ) { return; }
+  for ( const auto & hook : getEvalStateHooks() ) { hook( *state ); }
+  delete state;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+setVerbosityFromEnv()
+{
+  auto * valueChars = std::getenv( "_FLOX_PKGDB_VERBOSITY" );
+  if ( valueChars == nullptr ) { return; }
+  std::string value( valueChars );
+  if ( value == std::string( "0" ) ) { nix::verbosity = nix::lvlError; }
+  else if ( value == std::string( "1" ) ) { nix::verbosity = nix::lvlInfo; }
+  else if ( value == std::string( "2" ) ) { nix::verbosity = nix::lvlDebug; }
+  else if ( value == std::string( "3" ) ) { nix::verbosity = nix::lvlChatty; }
+  else if ( value == std::string( "4" ) ) { nix::verbosity = nix::lvlVomit; }
+  // Put this at the end so that if we *want* logging it will show up
+  traceLog( "found _FLOX_PKGDB_VERBOSITY=" + value );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox
@@ -16,6 +16,50 @@
 
 namespace flox {
 
+/* -------------------------------------------------------------------------- */
+
+void
+from_json( const nlohmann::json & jfrom, License & license )
+{
+  license.spdxId          = std::nullopt;
+  license.free            = std::nullopt;
+  license.redistributable = std::nullopt;
+  /* Plain strings are treated as `spdxId's. */
+  if ( jfrom.is_string() )
+    {
+      jfrom.get_to( license.name );
+      license.spdxId = license.name;
+      return;
+    }
+  jfrom.at( "name" ).get_to( license.name );
+  if ( auto field = jfrom.find( "spdxId" );
+       ( field != jfrom.end() ) && ( ! field->is_null() ) )
+    {
+      license.spdxId = field->get<std::string>();
+    }
+  if ( auto field = jfrom.find( "free" );
+       ( field != jfrom.end() ) && ( ! field->is_null() ) )
+    {
+      license.free = field->get<bool>();
+    }
+  if ( auto field = jfrom.find( "redistributable" );
+       ( field != jfrom.end() ) && ( ! field->is_null() ) )
+    {
+      license.redistributable = field->get<bool>();
+    }
+}
+
+
+void
+to_json( nlohmann::json & jto, const License & license )
+{
+  jto = { { "name", license.name },
+          { "spdxId", license.spdxId },
+          { "free", license.free },
+          { "redistributable", license.redistributable } };
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 std::string
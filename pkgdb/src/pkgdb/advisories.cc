@@ -0,0 +1,479 @@
+/* ========================================================================== *
+ *
+ * @file pkgdb/advisories.cc
+ *
+ * @brief A local store of vulnerability advisories, and implementation of
+ *        the `pkgdb advisories` subcommands.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <nix/names.hh>
+#include <nix/util.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/core/util.hh"
+#include "flox/pkgdb/advisories.hh"
+#include "flox/pkgdb/command.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::pkgdb {
+
+/* -------------------------------------------------------------------------- */
+
+static const char * sql_advisories = R"SQL(
+CREATE TABLE IF NOT EXISTS Advisories (
+  id            INTEGER PRIMARY KEY
+, advisoryId    TEXT    NOT NULL
+, aliases       JSON
+, pname         TEXT    NOT NULL
+, severity      TEXT
+, introduced    TEXT
+, fixed         TEXT
+, lastAffected  TEXT
+);
+
+CREATE INDEX IF NOT EXISTS idx_Advisories_pname ON Advisories ( pname )
+)SQL";
+
+
+/* -------------------------------------------------------------------------- */
+
+bool
+AffectedRange::contains( std::string_view version ) const
+{
+  if ( this->introduced.has_value()
+       && ( nix::compareVersions( version, *this->introduced ) < 0 ) )
+    {
+      return false;
+    }
+  if ( this->fixed.has_value()
+       && ( 0 <= nix::compareVersions( version, *this->fixed ) ) )
+    {
+      return false;
+    }
+  if ( this->lastAffected.has_value()
+       && ( 0 < nix::compareVersions( version, *this->lastAffected ) ) )
+    {
+      return false;
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Read an optional string member of a feed entry. */
+static void
+getOptional( const nlohmann::json &       jfrom,
+             const char *                 key,
+             std::optional<std::string> & value )
+{
+  if ( auto field = jfrom.find( key );
+       ( field != jfrom.end() ) && ( ! field->is_null() ) )
+    {
+      value = field->get<std::string>();
+    }
+  else { value = std::nullopt; }
+}
+
+
+void
+from_json( const nlohmann::json & jfrom, AffectedRange & range )
+{
+  getOptional( jfrom, "introduced", range.introduced );
+  getOptional( jfrom, "fixed", range.fixed );
+  getOptional( jfrom, "lastAffected", range.lastAffected );
+}
+
+
+void
+to_json( nlohmann::json & jto, const AffectedRange & range )
+{
+  jto = nlohmann::json::object();
+  if ( range.introduced.has_value() )
+    {
+      jto.emplace( "introduced", *range.introduced );
+    }
+  if ( range.fixed.has_value() ) { jto.emplace( "fixed", *range.fixed ); }
+  if ( range.lastAffected.has_value() )
+    {
+      jto.emplace( "lastAffected", *range.lastAffected );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+from_json( const nlohmann::json & jfrom, Advisory & advisory )
+{
+  jfrom.at( "id" ).get_to( advisory.id );
+  jfrom.at( "pname" ).get_to( advisory.pname );
+  getOptional( jfrom, "severity", advisory.severity );
+  advisory.aliases  = jfrom.value( "aliases", std::vector<std::string> {} );
+  advisory.affected = jfrom.value( "affected", std::vector<AffectedRange> {} );
+}
+
+
+void
+to_json( nlohmann::json & jto, const Advisory & advisory )
+{
+  jto = { { "id", advisory.id },
+          { "aliases", advisory.aliases },
+          { "pname", advisory.pname },
+          { "severity", advisory.severity },
+          { "affected", advisory.affected } };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::filesystem::path
+getAdvisoryDbPath()
+{
+  if ( std::optional<std::string> fromEnv = nix::getEnv( "PKGDB_ADVISORIES" );
+       fromEnv.has_value() )
+    {
+      return *fromEnv;
+    }
+  return std::filesystem::path( nix::getDataDir() ) / "flox"
+         / "advisories.sqlite";
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+AdvisoryDb::AdvisoryDb( const std::filesystem::path & dbPath, bool create )
+  : dbPath( dbPath )
+{
+  if ( create )
+    {
+      std::filesystem::create_directories( this->dbPath.parent_path() );
+      this->db.connect( this->dbPath.string().c_str(),
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE );
+    }
+  else
+    {
+      if ( ! std::filesystem::exists( this->dbPath ) )
+        {
+          throw PkgDbException( "no such advisory database '"
+                                + this->dbPath.string() + "'" );
+        }
+      this->db.connect( this->dbPath.string().c_str(),
+                        SQLITE_OPEN_READWRITE );
+    }
+  this->db.set_busy_timeout( DB_BUSY_TIMEOUT );
+
+  if ( sql_rc rcode = this->db.execute_all( sql_advisories );
+       isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to initialize advisory database '%s':(%d) %s",
+                  this->dbPath.string(),
+                  rcode,
+                  this->db.error_msg() ) );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::unique_ptr<AdvisoryDb>
+AdvisoryDb::openDefault()
+{
+  std::filesystem::path dbPath = getAdvisoryDbPath();
+  if ( ! std::filesystem::exists( dbPath ) ) { return nullptr; }
+  return std::make_unique<AdvisoryDb>( dbPath );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::size_t
+AdvisoryDb::importFeed( const std::filesystem::path & feedPath )
+{
+  std::ifstream feed( feedPath );
+  if ( ! feed.is_open() )
+    {
+      throw InvalidAdvisoryFeedException(
+        nix::fmt( "unable to open advisory feed '%s'", feedPath.string() ) );
+    }
+
+  std::vector<Advisory> advisories;
+  try
+    {
+      nlohmann::json::parse( feed ).get_to( advisories );
+    }
+  catch ( const nlohmann::json::exception & err )
+    {
+      throw InvalidAdvisoryFeedException(
+        nix::fmt( "failed to parse advisory feed '%s'", feedPath.string() ),
+        extract_json_errmsg( err ) );
+    }
+
+  this->setAdvisories( advisories );
+  return advisories.size();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+AdvisoryDb::setAdvisories( const std::vector<Advisory> & advisories )
+{
+  /* Don't hold a statement open on the table while it is replaced. */
+  this->matchQuery = nullptr;
+
+  this->db.execute( "BEGIN TRANSACTION" );
+  try
+    {
+      this->db.execute( "DELETE FROM Advisories" );
+
+      sqlite3pp::command cmd( this->db, R"SQL(
+        INSERT INTO Advisories (
+          advisoryId, aliases, pname, severity, introduced, fixed
+        , lastAffected
+        ) VALUES ( ?, ?, ?, ?, ?, ?, ? )
+      )SQL" );
+
+      auto bindOptional
+        = [&]( int idx, const std::optional<std::string> & value )
+      {
+        if ( value.has_value() ) { cmd.bind( idx, *value, sqlite3pp::copy ); }
+        else { cmd.bind( idx ); }
+      };
+
+      for ( const auto & advisory : advisories )
+        {
+          std::string aliases = nlohmann::json( advisory.aliases ).dump();
+          /* An advisory without ranges affects every version. */
+          std::vector<AffectedRange> ranges = advisory.affected;
+          if ( ranges.empty() ) { ranges.emplace_back(); }
+          for ( const auto & range : ranges )
+            {
+              cmd.reset();
+              cmd.bind( 1, advisory.id, sqlite3pp::copy );
+              cmd.bind( 2, aliases, sqlite3pp::copy );
+              cmd.bind( 3, advisory.pname, sqlite3pp::copy );
+              bindOptional( 4, advisory.severity );
+              bindOptional( 5, range.introduced );
+              bindOptional( 6, range.fixed );
+              bindOptional( 7, range.lastAffected );
+              if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+                {
+                  throw PkgDbException(
+                    nix::fmt( "failed to add advisory '%s'", advisory.id ),
+                    this->db.error_msg() );
+                }
+            }
+        }
+    }
+  catch ( ... )
+    {
+      this->db.execute( "ROLLBACK TRANSACTION" );
+      throw;
+    }
+  this->db.execute( "COMMIT TRANSACTION" );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<Advisory>
+AdvisoryDb::match( const std::string & pname, const std::string & version )
+{
+  if ( this->matchQuery == nullptr )
+    {
+      this->matchQuery = std::make_unique<sqlite3pp::query>( this->db, R"SQL(
+        SELECT advisoryId, aliases, severity, introduced, fixed, lastAffected
+        FROM Advisories WHERE ( pname = ? ) ORDER BY advisoryId, id
+      )SQL" );
+    }
+  sqlite3pp::query & qry = *this->matchQuery;
+  qry.reset();
+  qry.bind( 1, pname, sqlite3pp::copy );
+
+  auto getColumn = []( const sqlite3pp::query::rows & row,
+                       int idx ) -> std::optional<std::string>
+  {
+    if ( row.column_type( idx ) == SQLITE_NULL ) { return std::nullopt; }
+    return row.get<std::string>( idx );
+  };
+
+  std::vector<Advisory> rsl;
+  for ( const auto & row : qry )
+    {
+      AffectedRange range { getColumn( row, 3 ),
+                            getColumn( row, 4 ),
+                            getColumn( row, 5 ) };
+      if ( ! range.contains( version ) ) { continue; }
+
+      /* Collect the matching ranges of each advisory. */
+      auto advisoryId = row.get<std::string>( 0 );
+      if ( rsl.empty() || ( rsl.back().id != advisoryId ) )
+        {
+          Advisory advisory;
+          advisory.id    = std::move( advisoryId );
+          advisory.pname = pname;
+          nlohmann::json::parse( row.get<std::string>( 1 ) )
+            .get_to( advisory.aliases );
+          advisory.severity = getColumn( row, 2 );
+          rsl.emplace_back( std::move( advisory ) );
+        }
+      if ( range != AffectedRange {} )
+        {
+          rsl.back().affected.emplace_back( std::move( range ) );
+        }
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+AdvisoryDb::demoteVulnerable( PkgDbReadOnly & dbRO, std::vector<row_id> & rows )
+{
+  sqlite3pp::query qry(
+    dbRO.db,
+    "SELECT pname, version FROM Packages WHERE ( id = ? )" );
+  auto isVulnerable = [&]( row_id row )
+  {
+    qry.reset();
+    qry.bind( 1, static_cast<long long>( row ) );
+    auto itr = qry.begin();
+    if ( ( itr == qry.end() ) || ( ( *itr ).column_type( 1 ) == SQLITE_NULL ) )
+      {
+        return false;
+      }
+    return ! this
+              ->match( ( *itr ).get<std::string>( 0 ),
+                       ( *itr ).get<std::string>( 1 ) )
+              .empty();
+  };
+  std::stable_partition( rows.begin(),
+                         rows.end(),
+                         [&]( row_id row ) { return ! isVulnerable( row ); } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+AdvisoriesImportCommand::AdvisoriesImportCommand() : parser( "import" )
+{
+  this->parser.add_description(
+    "Replace the advisory database with the contents of a feed file" );
+  this->addDatabasePathOption( this->parser );
+  this->parser.add_argument( "feed" )
+    .help( "path to a JSON list of advisories" )
+    .required()
+    .metavar( "FEED" )
+    .action( [&]( const std::string & feed )
+             { this->feed = nix::absPath( feed ); } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+AdvisoriesImportCommand::run()
+{
+  AdvisoryDb  advisories( this->dbPath.value_or( getAdvisoryDbPath() ),
+                         true );
+  std::size_t count = advisories.importFeed( this->feed );
+  std::cout << nlohmann::json { { "database-path", advisories.dbPath },
+                                { "advisories", count } }
+                 .dump()
+            << '\n';
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+AdvisoriesMatchCommand::AdvisoriesMatchCommand() : parser( "match" )
+{
+  this->parser.add_description(
+    "List the advisories affecting a version of a package" );
+  this->addDatabasePathOption( this->parser );
+  this->parser.add_argument( "pname" )
+    .help( "the package's `pname'" )
+    .required()
+    .metavar( "PNAME" )
+    .action( [&]( const std::string & pname ) { this->pname = pname; } );
+  this->parser.add_argument( "version" )
+    .help( "the package's version" )
+    .required()
+    .metavar( "VERSION" )
+    .action( [&]( const std::string & version )
+             { this->version = version; } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+AdvisoriesMatchCommand::run()
+{
+  AdvisoryDb advisories( this->dbPath.value_or( getAdvisoryDbPath() ) );
+  for ( const auto & advisory :
+        advisories.match( this->pname, this->version ) )
+    {
+      std::cout << nlohmann::json( advisory ).dump() << '\n';
+    }
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+AdvisoriesCommand::AdvisoriesCommand() : parser( "advisories" )
+{
+  this->parser.add_description( "Manage local vulnerability advisories" );
+  this->parser.add_subparser( this->cmdImport.getParser() );
+  this->parser.add_subparser( this->cmdMatch.getParser() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+AdvisoriesCommand::run()
+{
+  if ( this->parser.is_subcommand_used( "import" ) )
+    {
+      return this->cmdImport.run();
+    }
+  if ( this->parser.is_subcommand_used( "match" ) )
+    {
+      return this->cmdMatch.run();
+    }
+  std::cerr << this->parser << '\n';
+  throw flox::FloxException(
+    "You must provide a valid 'advisories' subcommand" );
+  return EXIT_FAILURE;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::pkgdb
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -11,12 +11,16 @@
 
 #include <algorithm>
 #include <chrono>
+#include <cstdint>
 #include <cstdlib>
 #include <filesystem>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <optional>
 #include <string>
 #include <sys/stat.h>
+#include <unordered_set>
 #include <utime.h>
 #include <variant>
 #include <vector>
@@ -27,6 +31,7 @@
 #include <nix/logging.hh>
 #include <nix/types.hh>
 #include <nix/util.hh>
+#include <sqlite3pp.hh>
 
 #include "flox/core/command.hh"
 #include "flox/core/exceptions.hh"
@@ -90,6 +95,191 @@ findStaleDatabases( const std::filesystem::path & cacheDir, int minAgeDays )
   return toDelete;
 }
 
+
+/* -------------------------------------------------------------------------- */
+
+std::filesystem::path
+getEvalCacheDir()
+{
+  /* Matches `nix::eval_cache::AttrDb' as of `nix' 2.17. */
+  return std::filesystem::path( nix::getCacheDir() ) / "nix" / "eval-cache-v5";
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Get the fingerprint of the flake a database was scraped from. */
+static std::string
+getDbFingerprint( const std::filesystem::path & dbPath )
+{
+  std::string name = dbPath.filename().string();
+  return name.substr( 0, name.find( '.' ) );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::optional<std::filesystem::path>
+findEvalCache( const std::filesystem::path & dbPath,
+               const std::filesystem::path & evalCacheDir )
+{
+  std::filesystem::path evalCache
+    = evalCacheDir / ( getDbFingerprint( dbPath ) + ".sqlite" );
+  if ( std::filesystem::exists( evalCache ) ) { return evalCache; }
+  return std::nullopt;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<std::filesystem::path>
+findStaleEvalCaches( const std::filesystem::path &              cacheDir,
+                     const std::vector<std::filesystem::path> & toDelete,
+                     const std::filesystem::path &              evalCacheDir )
+{
+  std::unordered_set<std::string> kept;
+  for ( const auto & entry : std::filesystem::directory_iterator( cacheDir ) )
+    {
+      const std::filesystem::path & path = entry.path();
+      if ( ( std::find( toDelete.begin(), toDelete.end(), path )
+             == toDelete.end() )
+           && isSQLiteDb( path ) )
+        {
+          kept.emplace( getDbFingerprint( path ) );
+        }
+    }
+
+  std::vector<std::filesystem::path> stale;
+  for ( const auto & path : toDelete )
+    {
+      if ( kept.contains( getDbFingerprint( path ) ) ) { continue; }
+      auto evalCache = findEvalCache( path, evalCacheDir );
+      if ( evalCache.has_value()
+           && ( std::find( stale.begin(), stale.end(), *evalCache )
+                == stale.end() ) )
+        {
+          stale.emplace_back( std::move( *evalCache ) );
+        }
+    }
+  return stale;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Run @a fn on a file, restoring its access time afterwards.
+ *
+ * Staleness is judged by access time, so reading or rebuilding a file while
+ * collecting garbage must not make it appear to be in use.
+ */
+static void
+withAccessTime( const std::filesystem::path & path,
+                const std::function<void()> & fn )
+{
+  struct stat before
+  {};
+  bool known = stat( path.c_str(), &before ) == 0;
+  fn();
+  if ( ! known ) { return; }
+
+  struct stat after
+  {};
+  if ( stat( path.c_str(), &after ) != 0 ) { return; }
+  struct utimbuf newTimes
+  {};
+  newTimes.actime  = before.st_atime;
+  newTimes.modtime = after.st_mtime;
+  utime( path.c_str(), &newTimes );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+bool
+isFullyScraped( const std::filesystem::path & dbPath )
+{
+  bool rsl = false;
+  withAccessTime(
+    dbPath,
+    [&]()
+    {
+      sqlite3pp::database db( dbPath.c_str(), SQLITE_OPEN_READONLY );
+      sqlite3pp::query    qry(
+        db,
+        "SELECT COUNT( id ) FROM AttrSets WHERE ( done = FALSE )" );
+      rsl = ( *qry.begin() ).get<long long>( 0 ) == 0;
+    } );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::uintmax_t
+vacuumDatabase( const std::filesystem::path & path )
+{
+  std::uintmax_t before = std::filesystem::file_size( path );
+  withAccessTime( path,
+                  [&]()
+                  {
+                    sqlite3pp::database db( path.c_str() );
+                    if ( isSQLError( db.execute( "VACUUM" ) ) )
+                      {
+                        throw FloxException( "failed to vacuum database '"
+                                               + path.string() + "'",
+                                             db.error_msg() );
+                      }
+                  } );
+  std::uintmax_t after = std::filesystem::file_size( path );
+  return ( after < before ) ? ( before - after ) : 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::uintmax_t
+pruneEvalCache( const std::filesystem::path & path )
+{
+  /* `nix' caches `type = "derivation"' for each package it checks, which
+   * identifies the `meta' attribute sets belonging to derivations. */
+  static constexpr const char * prune = R"SQL(
+    WITH RECURSIVE Pruned ( id ) AS (
+      SELECT Meta.rowid FROM Attributes AS Meta
+      INNER JOIN Attributes AS Type
+        ON ( Type.parent = Meta.parent ) AND ( Type.name = 'type' )
+      WHERE ( Meta.name = 'meta' ) AND ( Type.value = 'derivation' )
+      UNION
+      SELECT Attributes.rowid FROM Attributes
+      INNER JOIN Pruned ON ( Attributes.parent = Pruned.id )
+    )
+    DELETE FROM Attributes WHERE ( rowid IN ( SELECT id FROM Pruned ) )
+  )SQL";
+
+  std::uintmax_t pruned = 0;
+  withAccessTime(
+    path,
+    [&]()
+    {
+      sqlite3pp::database db( path.c_str() );
+      auto countAttrs = [&]() -> std::uintmax_t
+      {
+        sqlite3pp::query qry( db, "SELECT COUNT( * ) FROM Attributes" );
+        return static_cast<std::uintmax_t>(
+          ( *qry.begin() ).get<long long>( 0 ) );
+      };
+      std::uintmax_t before = countAttrs();
+      if ( isSQLError( db.execute( prune ) ) )
+        {
+          throw FloxException( "failed to prune eval cache '" + path.string()
+                                 + "'",
+                               db.error_msg() );
+        }
+      pruned = before - countAttrs();
+    } );
+  return pruned;
+}
+
 /* -------------------------------------------------------------------------- */
 
 GCCommand::GCCommand() : parser( "gc" )
@@ -117,6 +307,20 @@ GCCommand::GCCommand() : parser( "gc" )
     .default_value( false )
     .implicit_value( true )
     .action( [&]( const auto & ) { this->dryRun = true; } );
+
+  this->parser.add_argument( "--vacuum" )
+    .help( "rebuild remaining databases and their eval caches to release "
+           "unused space" )
+    .default_value( false )
+    .implicit_value( true )
+    .action( [&]( const auto & ) { this->vacuum = true; } );
+
+  this->parser.add_argument( "--prune-eval-caches" )
+    .help( "remove package metadata from eval caches of fully scraped "
+           "databases" )
+    .default_value( false )
+    .implicit_value( true )
+    .action( [&]( const auto & ) { this->pruneEvalCaches = true; } );
 }
 
 
@@ -143,17 +347,87 @@ GCCommand::run()
     }
 
   auto toDelete = findStaleDatabases( cacheDir, this->gcStaleAgeDays );
-
+  std::filesystem::path evalCacheDir = getEvalCacheDir();
+  std::uintmax_t        reclaimed    = 0;
+
+  auto remove = [&]( const std::filesystem::path & path )
+  {
+    std::cout << "deleting " << path;
+    reclaimed += std::filesystem::file_size( path );
+    if ( this->dryRun ) { std::cout << " (dry run)" << '\n'; }
+    else
+      {
+        std::cout << '\n';
+        std::filesystem::remove( path );
+      }
+  };
+
+  /* Eval caches are expired along with the last of their databases. */
   std::cout << "Found " << toDelete.size() << " stale databases." << '\n';
-  for ( const auto & path : toDelete )
+  auto staleEvalCaches
+    = findStaleEvalCaches( cacheDir, toDelete, evalCacheDir );
+  for ( const auto & path : toDelete ) { remove( path ); }
+  for ( const auto & path : staleEvalCaches ) { remove( path ); }
+
+  if ( this->vacuum || this->pruneEvalCaches )
     {
-      std::cout << "deleting " << path;
-      if ( this->dryRun ) { std::cout << " (dry run)" << '\n'; }
-      else
+      /* Eval caches shared by several databases are handled once, after
+       * checking whether every database using them is fully scraped. */
+      std::map<std::filesystem::path, bool> evalCaches;
+      for ( const auto & entry :
+            std::filesystem::directory_iterator( cacheDir ) )
         {
-          std::cout << '\n';
-          std::filesystem::remove( path );
+          const std::filesystem::path & path = entry.path();
+          if ( ( std::find( toDelete.begin(), toDelete.end(), path )
+                 != toDelete.end() )
+               || ( ! isSQLiteDb( path ) ) )
+            {
+              continue;
+            }
+          if ( auto evalCache = findEvalCache( path, evalCacheDir );
+               evalCache.has_value() )
+            {
+              auto [scraped, _] = evalCaches.try_emplace( *evalCache, true );
+              scraped->second = scraped->second
+                                && ( ( ! this->pruneEvalCaches )
+                                     || isFullyScraped( path ) );
+            }
+          if ( this->vacuum && ( ! this->dryRun ) )
+            {
+              reclaimed += vacuumDatabase( path );
+            }
         }
+
+      for ( const auto & [evalCache, scraped] : evalCaches )
+        {
+          /* Only prune caches which won't be needed to finish a scrape. */
+          bool prune = this->pruneEvalCaches && scraped;
+          if ( prune )
+            {
+              std::cout << "pruning " << evalCache;
+              if ( this->dryRun ) { std::cout << " (dry run)" << '\n'; }
+              else
+                {
+                  std::cout << ": removed " << pruneEvalCache( evalCache )
+                            << " attributes" << '\n';
+                  reclaimed += vacuumDatabase( evalCache );
+                }
+            }
+          else if ( this->vacuum && ( ! this->dryRun ) )
+            {
+              reclaimed += vacuumDatabase( evalCache );
+            }
+        }
+    }
+
+  if ( this->dryRun )
+    {
+      std::cout << "Would reclaim " << nix::showBytes( reclaimed ) << "."
+                << '\n';
+    }
+  else
+    {
+      std::cout << "Reclaimed " << nix::showBytes( reclaimed ) << "." << '\n';
     }
 
   return EXIT_SUCCESS;
@@ -7,23 +7,33 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
 #include <list>
 #include <map>
 #include <optional>
 #include <ostream>
+#include <sys/resource.h>
 #include <sys/wait.h>
 #include <tuple>
+#include <unistd.h>
 
 #include <nix/error.hh>
 #include <nix/eval.hh>
 #include <nix/fmt.hh>
 #include <nix/logging.hh>
 #include <nix/nixexpr.hh>
+#include <nix/store-api.hh>
+#include <nix/util.hh>
 #include <nlohmann/json.hpp>
 #include <sqlite3pp.hh>
 
 #include "flox/core/exceptions.hh"
+#include "flox/core/util.hh"
 #include "flox/pkgdb/input.hh"
 #include "flox/pkgdb/scrape-rules.hh"
 #include "flox/pkgdb/write.hh"
@@ -41,6 +51,47 @@ class Store;
 
 namespace flox::pkgdb {
 
+/* -------------------------------------------------------------------------- */
+
+std::shared_ptr<const ScrapeRules>
+PkgDbInput::mkScrapeRules( const RegistryInput & input )
+{
+  if ( ( ! input.scrape.has_value() ) || input.scrape->empty() )
+    {
+      return nullptr;
+    }
+  return std::make_shared<const ScrapeRules>( getDefaultRules(),
+                                              *input.scrape );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::filesystem::path
+PkgDbInput::genDbPath( const FloxFlake &                          flake,
+                       const std::filesystem::path &              cacheDir,
+                       const std::shared_ptr<const ScrapeRules> & scrapeRules )
+{
+  std::filesystem::path dbPath
+    = genPkgDbName( flake.lockedFlake.getFingerprint(), cacheDir );
+  if ( scrapeRules == nullptr ) { return dbPath; }
+  /* Drop the `md5:' prefix. */
+  std::string rulesHash = scrapeRules->hashString();
+  rulesHash.erase( 0, rulesHash.find( ':' ) + 1 );
+  return dbPath.replace_extension( rulesHash + ".sqlite" );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+const ScrapeRules &
+PkgDbInput::getScrapeRules() const
+{
+  if ( this->scrapeRules == nullptr ) { return getDefaultRules(); }
+  return *this->scrapeRules;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 bool
@@ -55,7 +106,9 @@ PkgDbInput::initDbRO()
       nix::logger->log(
         nix::lvlTalkative,
         nix::fmt( "Creating database '%s'", this->dbPath.string() ) );
-      PkgDb( this->getFlake()->lockedFlake, this->dbPath.string() );
+      PkgDb( this->getFlake()->lockedFlake,
+             this->dbPath.string(),
+             this->scrapeRules );
       isFresh = true;
     }
 
@@ -87,7 +140,7 @@ PkgDbInput::init()
       /* If the schema version is not as expected, or the rules hash is
        * different (rules update), delete the file, free the `dbRo` object in
        * memory, and re-init the file. */
-      const ScrapeRules & scrapeRules  = getDefaultRules();
+      const ScrapeRules & scrapeRules  = this->getScrapeRules();
       SqlVersions         dbVersions   = this->dbRO->getDbVersion();
       ScrapeMeta          dbScrapeMeta = this->dbRO->getDbScrapeMeta();
       if ( bool rulesMatch
@@ -111,7 +164,9 @@ PkgDbInput::init()
         {
           /* This will actually do much more than updating the views, but it is
            * handled correctly in SQL. */
-          PkgDb( this->getFlake()->lockedFlake, this->dbPath.string() );
+          PkgDb( this->getFlake()->lockedFlake,
+                 this->dbPath.string(),
+                 this->scrapeRules );
         }
 
       /* If the schema version is still wrong throw an error, but we don't
@@ -136,7 +191,8 @@ PkgDbInput::getDbReadWrite()
   if ( this->dbRW == nullptr )
     {
       this->dbRW = std::make_shared<PkgDb>( this->getFlake()->lockedFlake,
-                                            this->dbPath.string() );
+                                            this->dbPath.string(),
+                                            this->scrapeRules );
     }
   return static_cast<nix::ref<PkgDb>>( this->dbRW );
 }
@@ -200,14 +256,143 @@ PkgDbInput::getScrapingPageSize()
   return PkgDbInput::minPageSize;
 }
 
+/**
+ * @brief Read a non-negative scraping limit from the environment.
+ * @return The value of @a envVar, or 0 ( unlimited ) if it is unset.
+ */
+static size_t
+getScrapeLimit( const char * envVar )
+{
+  const char * envValue = std::getenv( envVar );
+  if ( ( envValue == nullptr ) || ( ! isUInt( envValue ) ) ) { return 0; }
+  return std::stoul( envValue );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** Number of times a page is retried after a failure unrelated to the
+ * attributes being scraped, or before quarantining an attribute after
+ * a failure which may not reproduce. */
+static const size_t maxScrapeRetries = 1;
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Describe why a scraping child failed. */
+static std::string
+describeChildFailure( int status, const std::optional<std::string> & error )
+{
+  if ( WIFSIGNALED( status ) )
+    {
+      if ( WTERMSIG( status ) == SIGALRM )
+        {
+          return "exceeded the per-attribute time limit";
+        }
+      return nix::fmt( "abnormal child exit, signal: %d (%s)",
+                       WTERMSIG( status ),
+                       strsignal( WTERMSIG( status ) ) );
+    }
+  if ( error.has_value() ) { return *error; }
+  return nix::fmt( "exit code %d", WEXITSTATUS( status ) );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+PkgDbInput::ScrapeChildResult
+PkgDbInput::runScrapeChild( const AttrPath & prefix,
+                            size_t           startIdx,
+                            size_t           count )
+{
+  std::array<int, 2> fds {};
+  if ( pipe( fds.data() ) == -1 )
+    {
+      throw PkgDbException( "failed to create pipe to scrape attributes" );
+    }
+
+  pid_t pid = fork();
+  if ( pid == -1 )
+    {
+      close( fds[0] );
+      close( fds[1] );
+      throw PkgDbException( "fork to scrape attributes failed" );
+    }
+  if ( pid == 0 )
+    {
+      /*
+       * It is critical for the forked child process to NOT run the exit
+       * handlers (as will be done in calling `exit()`).
+       * Doing so will cause the child to try and cleanup threads and such,
+       * that the parent is still using, specifically the nix download
+       * thread. Calling `_exit()` does not call the exit handlers and
+       * allows the child to exit cleanly without interrupting the parent.
+       */
+      close( fds[0] );
+      _exit( scrapePrefixWorker( this, prefix, startIdx, count, fds[1] ) );
+    }
+
+  //
+  // This is the parent process
+  close( fds[1] );
+  debugLog( nix::fmt( "scrapePrefix: Waiting for forked process, pid: %d, "
+                      "attributes: %d-%d",
+                      pid,
+                      startIdx,
+                      startIdx + count ) );
+
+  /* Only the most recent report is kept, it identifies the attribute being
+   * processed if the child dies. */
+  ScrapeChildResult      result;
+  std::string            buffer;
+  std::array<char, 4096> chunk {};
+  ssize_t                nread = 0;
+  while ( ( nread = read( fds[0], chunk.data(), chunk.size() ) ) != 0 )
+    {
+      if ( nread < 0 )
+        {
+          if ( errno == EINTR ) { continue; }
+          break;
+        }
+      buffer.append( chunk.data(), nread );
+      for ( size_t eol = buffer.find( '\n' ); eol != std::string::npos;
+            eol        = buffer.find( '\n' ) )
+        {
+          nlohmann::json msg
+            = nlohmann::json::parse( buffer.substr( 0, eol ), nullptr, false );
+          buffer.erase( 0, eol + 1 );
+          if ( ! msg.is_object() ) { continue; }
+          if ( auto attrib = msg.find( "attrib" ); attrib != msg.end() )
+            {
+              result.lastAttrib = attrib->get<AttrPath>();
+            }
+          if ( auto error = msg.find( "error" ); error != msg.end() )
+            {
+              result.error = error->get<std::string>();
+            }
+          if ( auto size = msg.find( "size" ); size != msg.end() )
+            {
+              result.numAttribs = size->get<size_t>();
+            }
+        }
+    }
+  close( fds[0] );
+
+  waitpid( pid, &result.status, 0 );
+  debugLog( nix::fmt( "scrapePrefix: Forked process exited, exitcode: %d",
+                      result.status ) );
+  return result;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
 // NOLINTBEGIN cognitive complexity (nesting and logging macros)
 void
 PkgDbInput::scrapePrefix( const flox::AttrPath & prefix )
 {
   if ( this->getDbReadOnly()->completedAttrSet( prefix ) ) { return; }
 
-  Todos todo;
-
   // Close the db and clean up if we have anything open in preparation for the
   // child to take over.
   this->closeDbReadWrite();
@@ -215,77 +400,136 @@ PkgDbInput::scrapePrefix( const flox::AttrPath & prefix )
 
   bool         scrapingComplete = false;
   const size_t pageSize         = getScrapingPageSize();
-  size_t       pageIdx          = 0;
+  size_t       nextIdx          = 0;
+
+  /* Ranges of attributes being bisected after a failure as
+   * `( startIdx, count )' pairs.  The back is processed first so that ranges
+   * complete in order. */
+  std::vector<std::pair<size_t, size_t>> pending;
+  /* Attributes quarantined during this scrape. */
+  std::map<AttrPath, std::string> quarantined;
+  /* Consecutive failures which were retried without making progress. */
+  size_t retries = 0;
 
   while ( ! scrapingComplete )
     {
-      pid_t pid = fork();
-      if ( pid == -1 )
+      size_t startIdx = nextIdx;
+      size_t count    = pageSize;
+      if ( pending.empty() ) { nextIdx += pageSize; }
+      else
         {
-          throw PkgDbException( "fork to scrape attributes failed" );
+          std::tie( startIdx, count ) = pending.back();
+          pending.pop_back();
         }
-      if ( 0 < pid )
+
+      ScrapeChildResult result
+        = this->runScrapeChild( prefix, startIdx, count );
+
+      if ( WIFEXITED( result.status ) )
         {
-          //
-          // This is the parent process
-          int status = 0;
-          debugLog(
-            nix::fmt( "scrapePrefix: Waiting for forked process, pid: %d",
-                      pid ) );
-          waitpid( pid, &status, 0 );
-          debugLog(
-            nix::fmt( "scrapePrefix: Forked process exited, exitcode: %d",
-                      status ) );
-
-          if ( WIFEXITED( status ) )
+          if ( WEXITSTATUS( result.status ) == EXIT_SUCCESS )
             {
-              if ( WEXITSTATUS( status ) == EXIT_SUCCESS )
-                {
-                  debugLog( "scrapePrefix: Child reports all pages complete" );
-                  scrapingComplete = true;
-                }
-              else if ( WEXITSTATUS( status ) == EXIT_CHILD_INCOMPLETE )
-                {
-                  debugLog( "scrapePrefix: Child reports additional "
-                            "pages to process" );
-                  // Make sure to increment the pageIdx here (in the parent)
-                  pageIdx++;
-                  scrapingComplete = false;
-                }
-              else  // ( WEXITSTATUS( status ) != EXIT_SUCCESS )
-                {
-                  debugLog( "scrapePrefix: Child reports failure, aborting" );
-                  if ( WEXITSTATUS( status ) == EXIT_FAILURE_NIX_EVAL )
-                    {
-                      throw PkgDbException(
-                        "scraping failed: NixEvalException reported. "
-                        "See child log for details." );
-                    }
-
-                  throw PkgDbException(
-                    nix::fmt( "scraping failed: exit code %d",
-                              WEXITSTATUS( status ) ) );
-                }
+              debugLog( "scrapePrefix: Child reports all pages complete" );
+              scrapingComplete = true;
+              continue;
             }
-          else
+          if ( WEXITSTATUS( result.status ) == EXIT_CHILD_INCOMPLETE )
             {
-              throw PkgDbException(
-                nix::fmt( "scraping failed: abnormal child exit, signal: %d",
-                          WTERMSIG( status ) ) );
+              debugLog( "scrapePrefix: Child reports additional "
+                        "pages to process" );
+              retries = 0;
+              continue;
             }
         }
-      else
+
+      std::string reason
+        = describeChildFailure( result.status, result.error );
+
+      /* Failures before reaching any attribute, or while writing the
+       * database, can't be blamed on the attributes being scraped, so the
+       * page is retried and then scraping is aborted. */
+      if ( ( ! result.lastAttrib.has_value() )
+           || ( WIFEXITED( result.status )
+                && ( WEXITSTATUS( result.status )
+                     == EXIT_FAILURE_DATABASE ) ) )
+        {
+          if ( maxScrapeRetries <= retries )
+            {
+              throw PkgDbException( "scraping failed: " + reason );
+            }
+          debugLog( nix::fmt( "scrapePrefix: Child reports failure, "
+                              "retrying attributes %d-%d: %s",
+                              startIdx,
+                              startIdx + count,
+                              reason ) );
+          ++retries;
+          pending.emplace_back( startIdx, count );
+          continue;
+        }
+
+      /* Don't bisect past the end of the attribute set. */
+      if ( result.numAttribs.has_value() && ( startIdx < *result.numAttribs ) )
+        {
+          count = std::min( count, *result.numAttribs - startIdx );
+        }
+
+      if ( 1 < count )
+        {
+          debugLog( nix::fmt( "scrapePrefix: Child reports failure, "
+                              "bisecting attributes %d-%d: %s",
+                              startIdx,
+                              startIdx + count,
+                              reason ) );
+          size_t half = count / 2;
+          pending.emplace_back( startIdx + half, count - half );
+          pending.emplace_back( startIdx, half );
+          continue;
+        }
+
+      /* Evaluation errors and the per-attribute time limit are blamed on the
+       * attribute right away, but other failures such as crashes or
+       * exceeding the memory limit must reproduce before it is
+       * quarantined. */
+      bool evalFailure = ( WIFEXITED( result.status )
+                           && ( WEXITSTATUS( result.status )
+                                == EXIT_FAILURE_NIX_EVAL ) )
+                         || ( WIFSIGNALED( result.status )
+                              && ( WTERMSIG( result.status ) == SIGALRM ) );
+      if ( ( ! evalFailure ) && ( retries < maxScrapeRetries ) )
         {
-          /*
-           * It is critical for the forked child process to NOT run the exit
-           * handlers (as will be done in calling `exit()`).
-           * Doing so will cause the child to try and cleanup threads and such,
-           * that the parent is still using, specifically the nix download
-           * thread. Calling `_exit()` does not call the exit handlers and
-           * allows the child to exit cleanly without interrupting the parent.
-           */
-          _exit( scrapePrefixWorker( this, prefix, pageIdx, pageSize ) );
+          debugLog( nix::fmt( "scrapePrefix: Child reports failure, "
+                              "retrying attribute %d: %s",
+                              startIdx,
+                              reason ) );
+          ++retries;
+          pending.emplace_back( startIdx, count );
+          continue;
         }
+      retries = 0;
+
+      /* The failure is isolated to a single attribute's subtree, quarantine
+       * the attribute that was being processed and retry the rest. */
+      const AttrPath & path = *result.lastAttrib;
+      if ( quarantined.contains( path ) )
+        {
+          throw PkgDbException(
+            nix::fmt( "scraping failed: unable to isolate failure in '%s': %s",
+                      concatStringsSep( ".", path ),
+                      reason ) );
+        }
+      debugLog( nix::fmt( "scrapePrefix: quarantining attribute '%s': %s",
+                          concatStringsSep( ".", path ),
+                          reason ) );
+      PkgDb( this->dbPath.string() ).addQuarantine( path, reason );
+      quarantined.emplace( path, reason );
+      pending.emplace_back( startIdx, count );
+    }
+
+  for ( const auto & [path, reason] : quarantined )
+    {
+      nix::warn( "skipped attribute '%s' which could not be scraped: %s",
+                 concatStringsSep( ".", path ),
+                 reason );
     }
 }
 // NOLINTEND
@@ -293,11 +537,48 @@ PkgDbInput::scrapePrefix( const flox::AttrPath & prefix )
 int
 PkgDbInput::scrapePrefixWorker( PkgDbInput *     input,
                                 const AttrPath & prefix,
-                                const size_t     pageIdx,
-                                const size_t     pageSize )
+                                const size_t     startIdx,
+                                const size_t     count,
+                                int              reportFd )
 {
+  /* Progress is only used to diagnose failures, so errors writing it
+   * are ignored. */
+  auto report = [reportFd]( const nlohmann::json & msg )
+  {
+    try
+      {
+        nix::writeFull( reportFd, msg.dump() + "\n", false );
+      }
+    catch ( ... )
+      {}
+  };
+
+  if ( size_t memLimit = getScrapeLimit( "FLOX_SCRAPE_MEMORY_LIMIT" );
+       0 < memLimit )
+    {
+      struct rlimit limit {};
+      limit.rlim_cur = limit.rlim_max = memLimit * 1024 * 1024;
+      setrlimit( RLIMIT_AS, &limit );
+    }
+
+  /* Restart the timer for every attribute, `SIGALRM' terminates the child. */
+  const size_t attrTimeout = getScrapeLimit( "FLOX_SCRAPE_ATTR_TIMEOUT" );
+  if ( 0 < attrTimeout )
+    {
+      sigset_t alarmSet;
+      sigemptyset( &alarmSet );
+      sigaddset( &alarmSet, SIGALRM );
+      sigprocmask( SIG_UNBLOCK, &alarmSet, nullptr );
+      signal( SIGALRM, SIG_DFL );
+    }
+
   /* Open a read/write connection. */
   auto chunkDbRW = input->getDbReadWrite();
+  chunkDbRW->onScrapeAttrib = [&]( const AttrPath & path )
+  {
+    report( { { "attrib", path } } );
+    if ( 0 < attrTimeout ) { alarm( static_cast<unsigned>( attrTimeout ) ); }
+  };
 
   /* Start a transaction */
   chunkDbRW->execute( "BEGIN TRANSACTION" );
@@ -310,31 +591,55 @@ PkgDbInput::scrapePrefixWorker( PkgDbInput *     input,
 
   try
     {
-      debugLog( nix::fmt( "scrapePrefix(child): scraping page %d of "
-                          "%d attributes",
-                          pageIdx,
-                          pageSize ) );
-      targetComplete = chunkDbRW->scrape( input->getFlake()->state->symbols,
-                                          rootTarget,
-                                          pageSize,
-                                          pageIdx );
+      debugLog( nix::fmt( "scrapePrefix(child): scraping attributes %d-%d",
+                          startIdx,
+                          startIdx + count ) );
+      report( { { "size", std::get<1>( rootTarget )->getAttrs().size() } } );
+      targetComplete
+        = chunkDbRW->scrapeRange( input->getFlake()->state->symbols,
+                                  rootTarget,
+                                  startIdx,
+                                  count );
+      alarm( 0 );
     }
   catch ( const nix::EvalError & err )
     {
       debugLog( nix::fmt( "scrapePrefix(child): caught nix::EvalError: %s",
                           err.msg().c_str() ) );
+      report( { { "error", nix::filterANSIEscapes( err.msg(), true ) } } );
       chunkDbRW->execute( "ROLLBACK TRANSACTION" );
       input->closeDbReadWrite();
       input->freeFlake();
       return EXIT_FAILURE_NIX_EVAL;
     }
+  catch ( const PkgDbException & err )
+    {
+      debugLog( nix::fmt( "scrapePrefix(child): caught PkgDbException: %s",
+                          err.what() ) );
+      report( { { "error", err.what() } } );
+      chunkDbRW->execute( "ROLLBACK TRANSACTION" );
+      input->closeDbReadWrite();
+      input->freeFlake();
+      return EXIT_FAILURE_DATABASE;
+    }
+  catch ( const std::exception & err )
+    {
+      debugLog( nix::fmt( "scrapePrefix(child): caught exception: %s",
+                          err.what() ) );
+      report( { { "error", err.what() } } );
+      chunkDbRW->execute( "ROLLBACK TRANSACTION" );
+      input->closeDbReadWrite();
+      input->freeFlake();
+      return EXIT_FAILURE;
+    }
 
   /* Close the transaction. */
   chunkDbRW->execute( "COMMIT TRANSACTION" );
-  debugLog(
-    nix::fmt( "scrapePrefix(child): scraping page %d complete, lastPage: %d",
-              pageIdx,
-              targetComplete ) );
+  debugLog( nix::fmt( "scrapePrefix(child): scraping attributes %d-%d "
+                      "complete, lastPage: %d",
+                      startIdx,
+                      startIdx + count,
+                      targetComplete ) );
   try
     {
       input->closeDbReadWrite();
@@ -369,6 +674,78 @@ PkgDbInput::scrapeSystems( const std::vector<System> & systems )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+size_t
+PkgDbInput::indexAliases( const flox::AttrPath & prefix )
+{
+  /* Collect `( id, path )' for each package beneath `prefix' whose output
+   * hash hasn't been recorded yet. */
+  std::vector<std::pair<row_id, flox::AttrPath>> packages;
+  {
+    auto             dbRO = this->getDbReadOnly();
+    sqlite3pp::query qry( dbRO->db, R"SQL(
+      SELECT Packages.id, v_PackagesPaths.path
+      FROM Packages
+      INNER JOIN v_PackagesPaths ON ( Packages.id = v_PackagesPaths.id )
+      WHERE ( Packages.outHash IS NULL )
+    )SQL" );
+    for ( const auto & row : qry )
+      {
+        auto path = nlohmann::json::parse( row.get<std::string>( 1 ) )
+                      .get<flox::AttrPath>();
+        if ( ! hasPrefix( prefix, path ) ) { continue; }
+        packages.emplace_back( static_cast<row_id>( row.get<long long>( 0 ) ),
+                               std::move( path ) );
+      }
+  }
+
+  auto & store = *this->getFlake()->state->store;
+
+  /* Evaluate everything before opening a write connection so that the
+   * database isn't locked while we wait on the evaluator. */
+  std::vector<std::pair<row_id, std::string>> hashes;
+  for ( const auto & [row, path] : packages )
+    {
+      try
+        {
+          MaybeCursor cursor = this->getFlake()->maybeOpenCursor( path );
+          if ( cursor == nullptr ) { continue; }
+          auto storePath
+            = store.parseStorePath( cursor->getAttr( "outPath" )->getString() );
+          hashes.emplace_back( row, std::string( storePath.hashPart() ) );
+        }
+      catch ( const nix::Error & err )
+        {
+          debugLog( nix::fmt( "indexAliases: skipping '%s': %s",
+                              concatStringsSep( ".", path ),
+                              err.what() ) );
+        }
+    }
+
+  auto   dbRW = this->getDbReadWrite();
+  size_t aliases = 0;
+  dbRW->execute( "BEGIN TRANSACTION" );
+  try
+    {
+      for ( const auto & [row, hash] : hashes )
+        {
+          dbRW->setOutHash( row, hash );
+        }
+      aliases = dbRW->updateAliases();
+    }
+  catch ( ... )
+    {
+      dbRW->execute( "ROLLBACK TRANSACTION" );
+      throw;
+    }
+  dbRW->execute( "COMMIT TRANSACTION" );
+  this->closeDbReadWrite();
+
+  return aliases;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 nlohmann::json
@@ -381,6 +758,37 @@ PkgDbInput::getRowJSON( row_id row )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+std::shared_ptr<PkgDbInput>
+PkgDbInputFactory::mkInput( const std::string &   name,
+                            const RegistryInput & input )
+{
+  if ( this->cache == nullptr )
+    {
+      return std::make_shared<PkgDbInput>( this->store,
+                                           input,
+                                           this->cacheDir,
+                                           name );
+    }
+
+  /* `name' is part of the key since it is reported by search results. */
+  std::string key = name + '\0' + nlohmann::json( input ).dump();
+  if ( auto cached = this->cache->inputs.find( key );
+       cached != this->cache->inputs.end() )
+    {
+      debugLog( "reusing input '" + name + "' opened by this session" );
+      return cached->second;
+    }
+  auto opened = std::make_shared<PkgDbInput>( this->store,
+                                              input,
+                                              this->cacheDir,
+                                              name );
+  this->cache->inputs.emplace( std::move( key ), opened );
+  return opened;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 void
@@ -0,0 +1,361 @@
+/* ========================================================================== *
+ *
+ * @file pkgdb/metadata-dump.cc
+ *
+ * @brief Populate a package set database from a precomputed metadata dump
+ *        such as those produced by `nix-env -qaP --json --meta`.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <nix/hash.hh>
+#include <nix/names.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/core/util.hh"
+#include "flox/pkgdb/scrape-rules.hh"
+#include "flox/pkgdb/write.hh"
+#include "flox/raw-package.hh"
+#include "versions.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::pkgdb {
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Read a list of strings from a dump field, returning @a fallback if
+ *        the field is missing or has the wrong type.
+ *
+ * Objects are treated as lists of their keys so that `outputs` may be
+ * given as either `[ "out", "dev" ]` or `{ "out": null, "dev": null }`.
+ */
+static std::vector<std::string>
+getStringsOr( const nlohmann::ordered_json &   value,
+              const std::vector<std::string> & fallback )
+{
+  std::vector<std::string> rsl;
+  if ( value.is_array() )
+    {
+      for ( const auto & elem : value )
+        {
+          if ( elem.is_string() ) { rsl.emplace_back( elem ); }
+        }
+    }
+  else if ( value.is_object() )
+    {
+      for ( const auto & [key, _] : value.items() ) { rsl.emplace_back( key ); }
+    }
+  return rsl.empty() ? fallback : rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Convert a single metadata dump entry to a @a flox::RawPackage.
+ *
+ * Fields are interpreted the same way @a flox::FlakePackage interprets
+ * their evaluated counterparts.
+ */
+static RawPackage
+packageFromDumpEntry( AttrPath path, const nlohmann::ordered_json & entry )
+{
+  auto getString
+    = []( const nlohmann::ordered_json & obj,
+          const char *                   key ) -> std::optional<std::string>
+  {
+    if ( auto field = obj.find( key );
+         ( field != obj.end() ) && field->is_string() )
+      {
+        return field->get<std::string>();
+      }
+    return std::nullopt;
+  };
+  auto getBool = []( const nlohmann::ordered_json & obj,
+                     const char * key ) -> std::optional<bool>
+  {
+    if ( auto field = obj.find( key );
+         ( field != obj.end() ) && field->is_boolean() )
+      {
+        return field->get<bool>();
+      }
+    return std::nullopt;
+  };
+  /* Licenses are named by `spdxId', `shortName', or `fullName'. */
+  auto getLicense = [&]( const nlohmann::ordered_json & obj )
+    -> std::optional<License>
+  {
+    if ( ! obj.is_object() ) { return std::nullopt; }
+    License                    license;
+    license.spdxId                  = getString( obj, "spdxId" );
+    std::optional<std::string> name = license.spdxId;
+    if ( ! name.has_value() ) { name = getString( obj, "shortName" ); }
+    if ( ! name.has_value() ) { name = getString( obj, "fullName" ); }
+    if ( ! name.has_value() ) { return std::nullopt; }
+    license.name            = std::move( *name );
+    license.free            = getBool( obj, "free" );
+    license.redistributable = getBool( obj, "redistributable" );
+    return license;
+  };
+
+  std::string name = getString( entry, "name" ).value_or( path.back() );
+
+  /* Fall back to parsing `name' if `pname' or `version' are missing. */
+  nix::DrvName               drvName( name );
+  std::string                pname = getString( entry, "pname" )
+                        .value_or( std::string( drvName.name ) );
+  std::optional<std::string> version = getString( entry, "version" );
+  if ( ! version.has_value() ) { version = drvName.version; }
+  if ( version.has_value() && version->empty() ) { version = std::nullopt; }
+
+  std::optional<std::string> semver;
+  if ( version.has_value() ) { semver = versions::coerceSemver( *version ); }
+
+  std::vector<std::string> outputs = { "out" };
+  if ( auto field = entry.find( "outputs" ); field != entry.end() )
+    {
+      outputs = getStringsOr( *field, outputs );
+    }
+
+  /* Default to every output up to and including `out'. */
+  std::vector<std::string> outputsToInstall;
+  for ( const auto & output : outputs )
+    {
+      outputsToInstall.emplace_back( output );
+      if ( output == "out" ) { break; }
+    }
+
+  std::optional<std::string> license;
+  std::vector<License>       licenses;
+  std::optional<bool>        broken;
+  std::optional<bool>        unfree;
+  std::optional<std::string> description;
+  if ( auto meta = entry.find( "meta" );
+       ( meta != entry.end() ) && meta->is_object() )
+    {
+      if ( auto field = meta->find( "outputsToInstall" ); field != meta->end() )
+        {
+          outputsToInstall = getStringsOr( *field, outputsToInstall );
+        }
+      /* Only single licenses fill `license', matching `FlakePackage', but
+       * every license of a list is recorded. */
+      if ( auto field = meta->find( "license" ); field != meta->end() )
+        {
+          if ( field->is_object() )
+            {
+              license = getString( *field, "spdxId" );
+              if ( auto parsed = getLicense( *field ); parsed.has_value() )
+                {
+                  licenses.emplace_back( std::move( *parsed ) );
+                }
+            }
+          else if ( field->is_array() )
+            {
+              for ( const auto & elem : *field )
+                {
+                  if ( auto parsed = getLicense( elem ); parsed.has_value() )
+                    {
+                      licenses.emplace_back( std::move( *parsed ) );
+                    }
+                }
+            }
+        }
+      broken      = getBool( *meta, "broken" );
+      unfree      = getBool( *meta, "unfree" );
+      description = getString( *meta, "description" );
+    }
+
+  RawPackage pkg( std::move( path ),
+                  name,
+                  pname,
+                  std::move( version ),
+                  std::move( semver ),
+                  std::move( license ),
+                  outputs,
+                  outputsToInstall,
+                  broken,
+                  unfree,
+                  std::move( description ) );
+  pkg.licenses = std::move( licenses );
+  return pkg;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+// NOLINTBEGIN(readability-function-cognitive-complexity)
+size_t
+PkgDb::importMetadataDump( const flox::AttrPath &        prefix,
+                           const std::filesystem::path & dumpPath )
+{
+  if ( prefix.size() < 2 )
+    {
+      throw PkgDbException(
+        nix::fmt( "metadata dumps must be imported under a "
+                  "`<SUBTREE>.<SYSTEM>' prefix, but got '%s'",
+                  concatStringsSep( ".", prefix ) ) );
+    }
+
+  std::ifstream dump( dumpPath );
+  if ( ! dump.is_open() )
+    {
+      throw PkgDbException(
+        nix::fmt( "unable to open metadata dump '%s'", dumpPath.string() ) );
+    }
+
+  const ScrapeRules & rules   = this->getScrapeRules();
+  auto                subtree = Subtree( prefix.front() );
+
+  /* `AttrSets.id' for each prefix we have seen so far. */
+  std::map<AttrPath, row_id> attrSetIds;
+  attrSetIds.emplace( prefix, this->addOrGetAttrSetId( prefix ) );
+
+  auto getAttrSetId = [&]( const AttrPath & path ) -> row_id
+  {
+    if ( auto known = attrSetIds.find( path ); known != attrSetIds.end() )
+      {
+        return known->second;
+      }
+    AttrPath parent( path.begin(), path.end() - 1 );
+    /* Parents are always inserted before their children. */
+    row_id id = this->addOrGetAttrSetId( path.back(), attrSetIds.at( parent ) );
+    attrSetIds.emplace( path, id );
+    return id;
+  };
+
+  /* Returns the full path for @a relPath if it should be added according to
+   * the scrape rules, otherwise `std::nullopt'. */
+  auto allowedPath = [&]( const std::string & relPath )
+    -> std::optional<AttrPath>
+  {
+    AttrPath path = prefix;
+    for ( auto & attr : splitAttrPath( relPath ) )
+      {
+        path.emplace_back( std::move( attr ) );
+        /* Do not recurse down the `packages` subtree */
+        if ( ( subtree == ST_PACKAGES ) && ( prefix.size() + 1 < path.size() ) )
+          {
+            return std::nullopt;
+          }
+        /* If the package or any of its parents are disallowed, bail. */
+        if ( std::optional<bool> rule = rules.applyRules( path );
+             rule.has_value() && ( ! ( *rule ) ) )
+          {
+            if ( nix::lvlTalkative <= nix::verbosity )
+              {
+                traceLog( "scrapeRules: skipping disallowed attribute: "
+                          + concatStringsSep( ".", path ) );
+              }
+            return std::nullopt;
+          }
+      }
+    return path;
+  };
+
+  size_t      count = 0;
+  std::string relPath;
+
+  /* Entries are processed and discarded as soon as they are parsed so that
+   * we never hold the full dump in memory. */
+  auto onEvent = [&]( int                               depth,
+                      nlohmann::ordered_json::parse_event_t event,
+                      nlohmann::ordered_json & parsed ) -> bool
+  {
+    using parse_event_t = nlohmann::ordered_json::parse_event_t;
+    if ( depth != 1 ) { return true; }
+    if ( event == parse_event_t::key )
+      {
+        relPath = parsed.get<std::string>();
+        return true;
+      }
+    /* Keep building the entry until it is complete. */
+    if ( event != parse_event_t::object_end ) { return true; }
+
+    std::optional<AttrPath> path = allowedPath( relPath );
+    if ( ! path.has_value() ) { return false; }
+
+    AttrPath parent( path->begin(), path->end() - 1 );
+    for ( size_t idx = prefix.size() + 1; idx <= parent.size(); ++idx )
+      {
+        getAttrSetId( AttrPath( parent.begin(), parent.begin() + idx ) );
+      }
+    row_id parentId = getAttrSetId( parent );
+
+    std::string attrName = path->back();
+    this->addPackage( parentId,
+                      attrName,
+                      packageFromDumpEntry( std::move( *path ), parsed ) );
+    ++count;
+    return false;
+  };
+
+  this->execute( "BEGIN TRANSACTION" );
+  try
+    {
+      /* Entries are discarded once imported, so nothing useful is left. */
+      nlohmann::ordered_json rest
+        = nlohmann::ordered_json::parse( dump, onEvent );
+    }
+  catch ( nlohmann::json::exception & err )
+    {
+      this->execute( "ROLLBACK TRANSACTION" );
+      throw PkgDbException(
+        nix::fmt( "failed to parse metadata dump '%s'", dumpPath.string() ),
+        extract_json_errmsg( err ) );
+    }
+  catch ( ... )
+    {
+      this->execute( "ROLLBACK TRANSACTION" );
+      throw;
+    }
+
+  /* Record where this prefix's contents came from. */
+  nlohmann::json source = {
+    { "type", "metadata-dump" },
+    { "path", std::filesystem::absolute( dumpPath ).string() },
+    { "sha256",
+      nix::hashFile( nix::htSHA256, dumpPath.string() )
+        .to_string( nix::Base16, false ) },
+    { "packages", count },
+  };
+  sqlite3pp::command cmd(
+    this->db,
+    "INSERT OR REPLACE INTO DbScrapeMeta ( key, value ) VALUES ( ?, ? )" );
+  cmd.bind( 1, "source:" + concatStringsSep( ".", prefix ), sqlite3pp::copy );
+  cmd.bind( 2, source.dump(), sqlite3pp::copy );
+  if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+    {
+      this->execute( "ROLLBACK TRANSACTION" );
+      throw PkgDbException( "failed to write DbScrapeMeta info",
+                            this->db.error_msg() );
+    }
+
+  /* Everything under the prefix is now known. */
+  this->setPrefixDone( attrSetIds.at( prefix ), true );
+  this->execute( "COMMIT TRANSACTION" );
+
+  return count;
+}
+// NOLINTEND(readability-function-cognitive-complexity)
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::pkgdb
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -106,6 +106,7 @@ to_json( nlohmann::json & jto, const PkgQueryArgs & args )
     { "partialNameMatch", args.partialNameMatch },
     { "pnameOrAttrName", args.pnameOrAttrName },
     { "licenses", args.licenses },
+    { "deniedLicenses", args.deniedLicenses },
     { "allowBroken", args.allowBroken },
     { "allowUnfree", args.allowUnfree },
     { "preferPreReleases", args.preferPreReleases },
@@ -114,9 +115,102 @@ to_json( nlohmann::json & jto, const PkgQueryArgs & args )
     { "relPath", args.relPath },
     { "limit", args.limit },
     { "deduplicate", args.deduplicate },
+    { "collapseAliases", args.collapseAliases },
+    { "rankByUsage", args.rankByUsage },
+    { "provides", args.provides },
+    { "providesPrefix", args.providesPrefix },
   };
 }
 
+
+/* -------------------------------------------------------------------------- */
+
+void
+from_json( const nlohmann::json & jfrom, PkgQueryArgs & args )
+{
+  auto getOrFail
+    = [&]( const std::string & key, const nlohmann::json & from, auto & sink )
+  {
+    if ( from.is_null() ) { return; }
+    try
+      {
+        from.get_to( sink );
+      }
+    catch ( nlohmann::json::exception & err )
+      {
+        throw InvalidPkgQueryArg( "parsing field: '" + key + "'",
+                                  extract_json_errmsg( err ) );
+      }
+  };
+
+  args = PkgQueryArgs();
+  for ( const auto & [key, value] : jfrom.items() )
+    {
+      if ( key == "name" ) { getOrFail( key, value, args.name ); }
+      else if ( key == "pname" ) { getOrFail( key, value, args.pname ); }
+      else if ( key == "version" ) { getOrFail( key, value, args.version ); }
+      else if ( key == "semver" ) { getOrFail( key, value, args.semver ); }
+      else if ( key == "partialMatch" )
+        {
+          getOrFail( key, value, args.partialMatch );
+        }
+      else if ( key == "partialNameMatch" )
+        {
+          getOrFail( key, value, args.partialNameMatch );
+        }
+      else if ( key == "partialNameOrRelPathMatch" )
+        {
+          getOrFail( key, value, args.partialNameOrRelPathMatch );
+        }
+      else if ( key == "pnameOrAttrName" )
+        {
+          getOrFail( key, value, args.pnameOrAttrName );
+        }
+      else if ( key == "licenses" ) { getOrFail( key, value, args.licenses ); }
+      else if ( key == "deniedLicenses" )
+        {
+          getOrFail( key, value, args.deniedLicenses );
+        }
+      else if ( key == "allowBroken" )
+        {
+          getOrFail( key, value, args.allowBroken );
+        }
+      else if ( key == "allowUnfree" )
+        {
+          getOrFail( key, value, args.allowUnfree );
+        }
+      else if ( key == "preferPreReleases" )
+        {
+          getOrFail( key, value, args.preferPreReleases );
+        }
+      else if ( key == "subtrees" ) { getOrFail( key, value, args.subtrees ); }
+      else if ( key == "systems" ) { getOrFail( key, value, args.systems ); }
+      else if ( key == "relPath" ) { getOrFail( key, value, args.relPath ); }
+      else if ( key == "limit" ) { getOrFail( key, value, args.limit ); }
+      else if ( key == "deduplicate" )
+        {
+          getOrFail( key, value, args.deduplicate );
+        }
+      else if ( key == "collapseAliases" )
+        {
+          getOrFail( key, value, args.collapseAliases );
+        }
+      else if ( key == "rankByUsage" )
+        {
+          getOrFail( key, value, args.rankByUsage );
+        }
+      else if ( key == "provides" ) { getOrFail( key, value, args.provides ); }
+      else if ( key == "providesPrefix" )
+        {
+          getOrFail( key, value, args.providesPrefix );
+        }
+      else
+        {
+          throw InvalidPkgQueryArg( "unrecognized key '" + key + "'" );
+        }
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 
 void
@@ -130,12 +224,17 @@ PkgQueryArgs::clear()
   this->partialNameMatch  = std::nullopt;
   this->pnameOrAttrName   = std::nullopt;
   this->licenses          = std::nullopt;
+  this->deniedLicenses    = std::nullopt;
   this->allowBroken       = false;
   this->allowUnfree       = true;
   this->preferPreReleases = false;
   this->subtrees          = std::nullopt;
   this->systems           = { nix::settings.thisSystem.get() };
   this->relPath           = std::nullopt;
+  this->provides          = std::nullopt;
+  this->providesPrefix    = false;
+  this->collapseAliases   = false;
+  this->rankByUsage       = false;
 }
 
 
@@ -198,6 +297,70 @@ addIn( std::stringstream & oss, const std::vector<std::string> & elems )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Write ` IN ( :<prefix>0, :<prefix>1, ... )` to @a oss, binding each
+ *        parameter to the corresponding member of @a elems.
+ */
+static void
+addBoundIn( std::stringstream &                            oss,
+            std::string_view                               prefix,
+            const std::vector<std::string> &               elems,
+            std::unordered_map<std::string, std::string> & binds )
+{
+  oss << " IN ( ";
+  for ( size_t idx = 0; idx < elems.size(); ++idx )
+    {
+      std::string var = ":" + std::string( prefix ) + std::to_string( idx );
+      if ( 0 < idx ) { oss << ", "; }
+      oss << var;
+      binds.emplace( var, elems[idx] );
+    }
+  oss << " )";
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::string
+licensePolicyCondition(
+  const std::optional<std::vector<std::string>> & allowed,
+  const std::optional<std::vector<std::string>> & denied,
+  std::unordered_map<std::string, std::string> & binds )
+{
+  /* Both checks are anti-joins driven by the `licenseId' index of
+   * `PackagesLicenses', so `Packages' is never scanned for them. */
+  static constexpr std::string_view withLicense
+    = "SELECT PackagesLicenses.packageId FROM Licenses INNER JOIN "
+      "PackagesLicenses ON ( PackagesLicenses.licenseId = Licenses.id ) "
+      "WHERE Licenses.name";
+
+  std::stringstream cond;
+  bool              first = true;
+
+  if ( allowed.has_value() && ( ! allowed->empty() ) )
+    {
+      first = false;
+      cond << "( id IN ( SELECT packageId FROM PackagesLicenses ) ) AND ( id "
+              "NOT IN ( "
+           << withLicense << " NOT";
+      addBoundIn( cond, "allowedLicense", *allowed, binds );
+      cond << " ) )";
+    }
+
+  if ( denied.has_value() && ( ! denied->empty() ) )
+    {
+      if ( ! first ) { cond << " AND "; }
+      cond << "( id NOT IN ( " << withLicense;
+      addBoundIn( cond, "deniedLicense", *denied, binds );
+      cond << " ) )";
+    }
+
+  return cond.str();
+}
+
+
 /* -------------------------------------------------------------------------- */
 std::string
 PkgQuery::mkPatternString( const std::string & matchString )
@@ -210,6 +373,14 @@ PkgQuery::mkPatternString( const std::string & matchString )
   return pattern;
 }
 
+std::string
+PkgQuery::mkGlobPrefixString( const std::string & prefix )
+{
+  /* GLOB has no escape character, but special characters lose their meaning
+   * inside of a bracket expression. */
+  return std::regex_replace( prefix, std::regex( "([*?[])" ), "[$&]" ) + "*";
+}
+
 void
 PkgQuery::initMatch()
 {
@@ -405,6 +576,7 @@ PkgQuery::initOrderBy()
   , exactAttrName           DESC
   , matchExactAttrName      DESC
   , matchExactRelPath       DESC
+  , usageRank               DESC
   , depth                   ASC
   , matchPartialPname       DESC
   , matchPartialAttrName    DESC
@@ -440,9 +612,11 @@ PkgQuery::initOrderBy()
   this->addOrderBy( R"SQL(
     versionDate DESC NULLS LAST
   -- Lexicographic as fallback for misc. versions
-  , v_PackagesSearch.version ASC NULLS LAST
+  , version ASC NULLS LAST
   , brokenRank ASC
   , unfreeRank ASC
+  -- Prefer canonical packages over their aliases
+  , isAlias ASC
   , attrName ASC
   )SQL" );
 }
@@ -488,15 +662,13 @@ PkgQuery::init()
       this->addWhere( "semver IS NOT NULL" );
     }
 
-  /* Handle `licenses' filtering. */
-  if ( this->licenses.has_value() && ( ! this->licenses->empty() ) )
+  /* Handle `licenses' and `deniedLicenses' filtering. */
+  if ( std::string cond = licensePolicyCondition( this->licenses,
+                                                  this->deniedLicenses,
+                                                  this->binds );
+       ! cond.empty() )
     {
-      this->addWhere( "license IS NOT NULL" );
-      /* licenses IN ( ... ) */
-      std::stringstream cond;
-      cond << "license";
-      addIn( cond, *this->licenses );
-      this->addWhere( cond.str() );
+      this->addWhere( cond );
     }
 
   /* Handle `broken' filtering. */
@@ -519,6 +691,41 @@ PkgQuery::init()
       this->binds.emplace( ":relPath", relPath.dump() );
     }
 
+  /* Handle `provides' filtering.
+   * `Provides' is keyed by file name, so both forms are index seeks. */
+  if ( this->provides.has_value() )
+    {
+      if ( this->providesPrefix )
+        {
+          this->addWhere( "id IN ( SELECT packageId FROM Provides "
+                          "WHERE file GLOB :providesPattern )" );
+          this->binds.emplace( ":providesPattern",
+                               mkGlobPrefixString( *this->provides ) );
+        }
+      else
+        {
+          this->addWhere(
+            "id IN ( SELECT packageId FROM Provides WHERE file = :provides )" );
+          this->binds.emplace( ":provides", *this->provides );
+        }
+    }
+
+  /* Handle `rankByUsage' ranking.
+   * `Usage' is keyed by `( pname, relPath )', so this is an index seek. */
+  if ( this->rankByUsage )
+    {
+      this->addSelection(
+        "COALESCE( ( SELECT rank FROM usage.Usage"
+        " WHERE ( Usage.pname = v_PackagesSearch.pname )"
+        " AND ( Usage.relPath = v_PackagesSearch.relPath ) ), 0 )"
+        " AS usageRank" );
+    }
+  else
+    {
+      /* Add a bogus rank so `ORDER BY usageRank' works. */
+      this->addSelection( "0 AS usageRank" );
+    }
+
   this->initSubtrees();
   this->initSystems();
   this->initOrderBy();
@@ -529,27 +736,46 @@ PkgQuery::init()
 
 std::string
 PkgQuery::str() const
+{
+  return this->str( this->exportedColumns );
+}
+
+std::string
+PkgQuery::str( const std::vector<std::string> & columns ) const
 {
   std::stringstream qry;
   qry << "SELECT ";
   bool firstExport = true;
-  for ( const auto & column : this->exportedColumns )
+  for ( const auto & column : columns )
     {
       if ( firstExport ) { firstExport = false; }
       else { qry << ", "; }
       qry << column;
     }
   qry << " FROM ( SELECT ";
+  /* Rank rows sharing a `relPath' using the same ordering that we use for the
+   * final results, and only keep the best one.
+   * Unlike `GROUP BY relPath' this is deterministic. */
+  if ( this->deduplicate )
+    {
+      qry << "* FROM ( SELECT *, ROW_NUMBER() OVER ( PARTITION BY relPath";
+      if ( ! this->firstOrder ) { qry << " ORDER BY " << this->orders.str(); }
+      qry << " ) AS dedupRank FROM ( SELECT ";
+    }
+  /* Likewise keep the best row of each alias group, before deduplicating so
+   * that an alias can't hide another package sharing its `relPath'. */
+  if ( this->collapseAliases )
+    {
+      qry << "* FROM ( SELECT *, ROW_NUMBER() OVER ( PARTITION BY aliasGroup";
+      if ( ! this->firstOrder ) { qry << " ORDER BY " << this->orders.str(); }
+      qry << " ) AS aliasRank FROM ( SELECT ";
+    }
   if ( this->firstSelect ) { qry << "*"; }
   else { qry << this->selects.str(); }
   qry << " FROM v_PackagesSearch";
   if ( ! this->firstWhere ) { qry << " WHERE " << this->wheres.str(); }
-  /* This will cause an arbitrary row to be chosen for all values other than
-   * relPath. See "a single arbitrarily chosen row from within the group" from
-   * https://www.sqlite.org/lang_select.html. This is a bit hacky, but we know
-   * that `flox search` only uses `relPath` and `description`, and we assume
-   * that `description` is the same for all packages that share `relPath`. */
-  if ( this->deduplicate ) { qry << "\n GROUP BY relPath\n"; }
+  if ( this->collapseAliases ) { qry << " ) ) WHERE ( aliasRank = 1 )"; }
+  if ( this->deduplicate ) { qry << " ) ) WHERE ( dedupRank = 1 )"; }
   if ( ! this->firstOrder ) { qry << " ORDER BY " << this->orders.str(); }
   qry << " )";
   // Dump the bindings as well
@@ -595,7 +821,14 @@ PkgQuery::filterSemvers(
 std::shared_ptr<sqlite3pp::query>
 PkgQuery::bind( sqlite3pp::database & pdb ) const
 {
-  std::string                       stmt = this->str();
+  return this->bind( pdb, this->exportedColumns );
+}
+
+std::shared_ptr<sqlite3pp::query>
+PkgQuery::bind( sqlite3pp::database &             pdb,
+                const std::vector<std::string> & columns ) const
+{
+  std::string                       stmt = this->str( columns );
   std::shared_ptr<sqlite3pp::query> qry
     = std::make_shared<sqlite3pp::query>( pdb, stmt.c_str() );
   for ( const auto & [var, val] : this->binds )
@@ -650,6 +883,87 @@ PkgQuery::execute( sqlite3pp::database & pdb ) const
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+std::vector<PkgQueryResult>
+PkgQuery::executeKeyed( sqlite3pp::database & pdb ) const
+{
+  std::shared_ptr<sqlite3pp::query> qry
+    = this->bind(
+      pdb,
+      { "id", "semver", "relPath", "version", "system", "description" } );
+
+  std::vector<PkgQueryResult>     rsl;
+  std::vector<std::string>        semvers;
+  std::unordered_set<std::string> versions;
+  for ( const auto & row : *qry )
+    {
+      PkgQueryResult result;
+      result.id = row.get<long long>( 0 );
+      if ( this->semver.has_value() )
+        {
+          const auto & semver = semvers.emplace_back( row.get<std::string>( 1 ) );
+          versions.emplace( semver );
+        }
+      result.relPath = row.get<std::string>( 2 );
+      if ( row.column_type( 3 ) != SQLITE_NULL )
+        {
+          result.version = row.get<std::string>( 3 );
+        }
+      result.system = row.get<std::string>( 4 );
+      if ( row.column_type( 5 ) != SQLITE_NULL )
+        {
+          result.description = row.get<std::string>( 5 );
+        }
+      rsl.emplace_back( std::move( result ) );
+    }
+
+  if ( ! this->semver.has_value() ) { return rsl; }
+
+  /* Filter SQL results to be those in the satisfactory list while preserving
+   * the original ordering. */
+  versions = this->filterSemvers( versions );
+  std::vector<PkgQueryResult> filtered;
+  for ( size_t idx = 0; idx < rsl.size(); ++idx )
+    {
+      if ( versions.find( semvers[idx] ) != versions.end() )
+        {
+          filtered.emplace_back( std::move( rsl[idx] ) );
+        }
+    }
+  return filtered;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+bool
+PkgQuery::hasResults( sqlite3pp::database & pdb ) const
+{
+  /* `semver' filtering happens after the SQL query, so we have no choice but
+   * to collect candidate versions. */
+  if ( this->semver.has_value() ) { return ! this->execute( pdb ).empty(); }
+
+  /* Ordering and de-duplication never change whether a row exists.
+   * Selections are kept because our conditions refer to their aliases. */
+  std::stringstream stmt;
+  stmt << "SELECT EXISTS ( SELECT ";
+  if ( this->firstSelect ) { stmt << "*"; }
+  else { stmt << this->selects.str(); }
+  stmt << " FROM v_PackagesSearch";
+  if ( ! this->firstWhere ) { stmt << " WHERE " << this->wheres.str(); }
+  stmt << " )";
+
+  sqlite3pp::query qry( pdb, stmt.str().c_str() );
+  for ( const auto & [var, val] : this->binds )
+    {
+      qry.bind( var.c_str(), val, sqlite3pp::copy );
+    }
+  /* `EXISTS' always yields exactly one row. */
+  return ( *qry.begin() ).get<int>( 0 ) != 0;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox::pkgdb
@@ -7,6 +7,11 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
 #include <nix/json-to-value.hh>
 #include <nix/primops.hh>
 #include <nix/value-to-json.hh>
@@ -14,6 +19,7 @@
 
 #include "flox/core/expr.hh"
 #include "flox/core/nix-state.hh"
+#include "flox/pkgdb/input.hh"
 #include "flox/pkgdb/pkg-query.hh"
 #include "flox/pkgdb/primops.hh"
 #include "flox/registry.hh"
@@ -73,6 +79,141 @@ static const nix::RegisterPrimOp
 // NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
 
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Inputs opened by each evaluator, keyed by flake-ref. */
+using MemoizedInputs
+  = std::map<const nix::EvalState *,
+             std::map<std::string, std::shared_ptr<PkgDbInput>>>;
+
+
+/** @brief Get the inputs memoized by @a getMemoizedInput. */
+[[nodiscard]] static MemoizedInputs &
+getMemoizedInputs()
+{
+  static MemoizedInputs inputs;
+  return inputs;
+}
+
+
+/* Drop an evaluator's inputs when it is destroyed so that they don't outlive
+ * it, and aren't handed to a later evaluator allocated at the same address. */
+// NOLINTBEGIN(cert-err58-cpp)
+static const RegisterEvalStateHook
+  forgetMemoizedInputs( []( const nix::EvalState & state )
+                        { getMemoizedInputs().erase( &state ); } );
+// NOLINTEND(cert-err58-cpp)
+
+
+/**
+ * @brief Lookup an opened input for @a input, opening it if this is the first
+ *        time it was requested by @a state.
+ *
+ * Inputs are memoized by the flake-ref as written so that repeated searches
+ * don't need to lock the flake or reopen its database.
+ * They are kept until @a state is destroyed, which requires @a state to have
+ * been opened by @a flox::NixState.
+ */
+[[nodiscard]] static std::shared_ptr<PkgDbInput>
+getMemoizedInput( nix::EvalState & state, const RegistryInput & input )
+{
+  auto & stateInputs = getMemoizedInputs()[&state];
+  auto   key         = input.getFlakeRef()->to_string();
+  if ( auto known = stateInputs.find( key ); known != stateInputs.end() )
+    {
+      return known->second;
+    }
+  nix::ref<nix::Store> store  = state.store;
+  auto                 opened = std::make_shared<PkgDbInput>( store, input );
+  stateInputs.emplace( std::move( key ), opened );
+  return opened;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+// NOLINTBEGIN(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+void
+prim_searchPackages( nix::EvalState &  state,
+                     const nix::PosIdx pos,
+                     nix::Value **     args,
+                     nix::Value &      value )
+{
+  if ( args[0]->isThunk() && args[0]->isTrivial() )
+    {
+      state.forceValue( *args[0], pos );
+    }
+  RegistryInput input( valueToFlakeRef(
+    state,
+    *args[0],
+    pos,
+    "while processing 'flakeRef' argument to 'builtins.searchPackages'" ) );
+
+  state.forceAttrs(
+    *args[1],
+    pos,
+    "while processing 'query' argument to 'builtins.searchPackages'" );
+  nix::NixStringContext context;
+  PkgQueryArgs          queryArgs
+    = nix::printValueAsJSON( state, true, *args[1], pos, context, false );
+  queryArgs.check();
+
+  auto dbInput = getMemoizedInput( state, input );
+
+  /* Only scrape the prefixes the query can match. */
+  for ( const auto & subtree :
+        queryArgs.subtrees.value_or( dbInput->getSubtrees() ) )
+    {
+      for ( const auto & system : queryArgs.systems )
+        {
+          dbInput->scrapePrefix(
+            { static_cast<std::string>( to_string( subtree ) ), system } );
+        }
+    }
+
+  auto           dbRO    = dbInput->getDbReadOnly();
+  nlohmann::json results = nlohmann::json::array();
+  for ( const auto & row : PkgQuery( queryArgs ).execute( dbRO->db ) )
+    {
+      nlohmann::json pkg = dbRO->getPackage( row );
+      results.emplace_back(
+        nlohmann::json { { "attrPath", std::move( pkg["absPath"] ) },
+                         { "pname", std::move( pkg["pname"] ) },
+                         { "version", std::move( pkg["version"] ) },
+                         { "description", std::move( pkg["description"] ) },
+                         { "system", std::move( pkg["system"] ) } } );
+    }
+
+  nix::parseJSON( state, results.dump(), value );
+}
+// NOLINTEND(cppcoreguidelines-pro-bounds-pointer-arithmetic)
+
+
+/* -------------------------------------------------------------------------- */
+
+// NOLINTBEGIN(cert-err58-cpp)
+// This can throw an exception that cannot be caught.
+static const nix::RegisterPrimOp
+  primop_searchPackages( { .name                = "__searchPackages",
+                           .args                = { "flakeRef", "query" },
+                           .arity               = 0,
+                           .doc                 = R"(
+    Search a flake's package database, scraping it if needed.
+    Takes the following arguments:
+
+    - `flakeRef`: Either an attribute set or string flake-ref.
+
+    - `query`: An attribute set of `flox::pkgdb::PkgQueryArgs` such as
+               `pname`, `semver`, `partialMatch`, `subtrees`, and `systems`.
+
+    Returns a list of attribute sets with the fields `attrPath`, `pname`,
+    `version`, `description`, and `system`.
+    )",
+                           .fun                 = prim_searchPackages,
+                           .experimentalFeature = nix::Xp::Flakes } );
+// NOLINTEND(cert-err58-cpp)
+
+
 /* -------------------------------------------------------------------------- */
 
 }  // namespace flox::pkgdb
@@ -0,0 +1,301 @@
+/* ========================================================================== *
+ *
+ * @file pkgdb/provides.cc
+ *
+ * @brief Index the executables and shared libraries installed by packages,
+ *        and implementation of the `pkgdb provides` subcommand.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <regex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <nix/fs-accessor.hh>
+#include <nix/store-api.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/core/util.hh"
+#include "flox/pkgdb/command.hh"
+#include "flox/pkgdb/input.hh"
+#include "flox/pkgdb/provides.hh"
+#include "flox/pkgdb/write.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::pkgdb {
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Directories of an output which are searched for provided files. */
+static const std::vector<std::string> providesDirs = { "bin", "sbin", "lib" };
+
+
+/* -------------------------------------------------------------------------- */
+
+bool
+isProvidedFile( std::string_view dir, std::string_view file )
+{
+  if ( ( dir == "bin" ) || ( dir == "sbin" ) ) { return true; }
+  if ( dir != "lib" ) { return false; }
+  static const std::regex sharedObject( R"(.+\.so(\..+)?)" );
+  return std::regex_match( file.begin(), file.end(), sharedObject );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<ProvidedFile>
+listProvidedFiles( const nlohmann::json & listing )
+{
+  std::vector<ProvidedFile> files;
+
+  auto root = listing.find( "root" );
+  if ( ( root == listing.end() ) || ( ! root->is_object() ) ) { return files; }
+  auto entries = root->find( "entries" );
+  if ( ( entries == root->end() ) || ( ! entries->is_object() ) )
+    {
+      return files;
+    }
+
+  for ( const auto & dir : providesDirs )
+    {
+      /* Directories which are symlinks are skipped, matching the store. */
+      auto node = entries->find( dir );
+      if ( ( node == entries->end() )
+           || ( node->value( "type", "" ) != "directory" ) )
+        {
+          continue;
+        }
+      auto children = node->find( "entries" );
+      if ( ( children == node->end() ) || ( ! children->is_object() ) )
+        {
+          continue;
+        }
+      for ( const auto & [name, _] : children->items() )
+        {
+          if ( isProvidedFile( dir, name ) )
+            {
+              files.emplace_back( ProvidedFile { dir, name } );
+            }
+        }
+    }
+  return files;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::optional<std::vector<ProvidedFile>>
+listProvidedFiles( nix::Store &                                 store,
+                   const nix::StorePath &                       path,
+                   const std::optional<std::filesystem::path> & binaryCache )
+{
+  if ( store.isValidPath( path ) )
+    {
+      std::vector<ProvidedFile> files;
+      auto                      accessor = store.getFSAccessor();
+      std::string               root     = store.printStorePath( path );
+      for ( const auto & dir : providesDirs )
+        {
+          std::string dirPath = root + "/" + dir;
+          if ( accessor->stat( dirPath ).type
+               != nix::FSAccessor::Type::tDirectory )
+            {
+              continue;
+            }
+          for ( const auto & name : accessor->readDirectory( dirPath ) )
+            {
+              if ( isProvidedFile( dir, name ) )
+                {
+                  files.emplace_back( ProvidedFile { dir, name } );
+                }
+            }
+        }
+      return files;
+    }
+
+  if ( ! binaryCache.has_value() ) { return std::nullopt; }
+
+  std::filesystem::path listingPath
+    = *binaryCache / ( std::string( path.hashPart() ) + ".ls" );
+  std::ifstream listingFile( listingPath );
+  if ( ! listingFile.is_open() ) { return std::nullopt; }
+  try
+    {
+      return listProvidedFiles( nlohmann::json::parse( listingFile ) );
+    }
+  catch ( nlohmann::json::exception & err )
+    {
+      /* Compressed listings are not supported. */
+      debugLog( nix::fmt( "skipping unreadable listing '%s': %s",
+                          listingPath.string(),
+                          extract_json_errmsg( err ) ) );
+      return std::nullopt;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+size_t
+PkgDbInput::indexProvides(
+  const flox::AttrPath &                       prefix,
+  const std::optional<std::filesystem::path> & binaryCache )
+{
+  /* Collect `( id, path, outputs )' for each package beneath `prefix'. */
+  std::vector<std::tuple<row_id, flox::AttrPath, std::vector<std::string>>>
+    packages;
+  {
+    auto             dbRO = this->getDbReadOnly();
+    sqlite3pp::query qry( dbRO->db, R"SQL(
+      SELECT Packages.id, v_PackagesPaths.path, Packages.outputs
+      FROM Packages
+      INNER JOIN v_PackagesPaths ON ( Packages.id = v_PackagesPaths.id )
+    )SQL" );
+    for ( const auto & row : qry )
+      {
+        auto path = nlohmann::json::parse( row.get<std::string>( 1 ) )
+                      .get<flox::AttrPath>();
+        if ( ! hasPrefix( prefix, path ) ) { continue; }
+        packages.emplace_back(
+          static_cast<row_id>( row.get<long long>( 0 ) ),
+          std::move( path ),
+          nlohmann::json::parse( row.get<std::string>( 2 ) )
+            .get<std::vector<std::string>>() );
+      }
+  }
+
+  auto & store = *this->getFlake()->state->store;
+
+  /* Evaluate everything before opening a write connection so that the
+   * database isn't locked while we wait on the evaluator. */
+  std::vector<std::tuple<row_id, std::string, std::vector<ProvidedFile>>>
+    provided;
+  for ( const auto & [row, path, outputs] : packages )
+    {
+      MaybeCursor cursor = this->getFlake()->maybeOpenCursor( path );
+      if ( cursor == nullptr ) { continue; }
+      for ( const auto & output : outputs )
+        {
+          try
+            {
+              MaybeCursor outCursor = cursor->maybeGetAttr( output );
+              if ( outCursor == nullptr ) { continue; }
+              auto storePath = store.parseStorePath(
+                outCursor->getAttr( "outPath" )->getString() );
+              if ( auto files
+                   = listProvidedFiles( store, storePath, binaryCache );
+                   files.has_value() )
+                {
+                  provided.emplace_back( row, output, std::move( *files ) );
+                }
+            }
+          catch ( const nix::Error & err )
+            {
+              debugLog( nix::fmt( "indexProvides: skipping '%s.%s': %s",
+                                  concatStringsSep( ".", path ),
+                                  output,
+                                  err.what() ) );
+            }
+        }
+    }
+
+  auto dbRW = this->getDbReadWrite();
+  dbRW->execute( "BEGIN TRANSACTION" );
+  try
+    {
+      for ( const auto & [row, output, files] : provided )
+        {
+          dbRW->setProvidedFiles( row, output, files );
+        }
+    }
+  catch ( ... )
+    {
+      dbRW->execute( "ROLLBACK TRANSACTION" );
+      throw;
+    }
+  dbRW->execute( "COMMIT TRANSACTION" );
+  this->closeDbReadWrite();
+
+  return provided.size();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+ProvidesCommand::ProvidesCommand() : parser( "provides" )
+{
+  this->parser.add_description(
+    "Find packages which provide an executable or shared library" );
+  this->addTargetArg( this->parser );
+  this->parser.add_argument( "file" )
+    .help( "name of a file in `bin', `sbin', or `lib'" )
+    .required()
+    .metavar( "NAME" )
+    .action( [&]( const std::string & file ) { this->file = file; } );
+  this->parser.add_argument( "--prefix" )
+    .help( "match file names beginning with NAME" )
+    .nargs( 0 )
+    .action( [&]( const auto & ) { this->prefix = true; } );
+  this->parser.add_argument( "--system" )
+    .help( "system to search, defaults to the current system" )
+    .metavar( "SYSTEM" )
+    .nargs( 1 )
+    .action( [&]( const std::string & system ) { this->system = system; } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+ProvidesCommand::run()
+{
+  this->openPkgDb();
+
+  PkgQueryArgs args;
+  args.provides       = this->file;
+  args.providesPrefix = this->prefix;
+  if ( this->system.has_value() ) { args.systems = { *this->system }; }
+
+  /* Results use the same ranking as `pkgdb search'. */
+  for ( const auto & row : PkgQuery( args ).execute( this->db->db ) )
+    {
+      nlohmann::json pkg = this->db->getPackage( row );
+
+      std::vector<std::string> files;
+      for ( auto & path : this->db->getProvidedFiles( row ) )
+        {
+          std::string_view name
+            = std::string_view( path ).substr( path.find( '/' ) + 1 );
+          if ( this->prefix ? hasPrefix( this->file, name )
+                            : ( name == this->file ) )
+            {
+              files.emplace_back( std::move( path ) );
+            }
+        }
+      pkg.emplace( "provides", std::move( files ) );
+
+      std::cout << pkg.dump() << '\n';
+    }
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::pkgdb
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
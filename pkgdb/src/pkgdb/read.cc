@@ -7,14 +7,21 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
+#include <filesystem>
 #include <functional>
 #include <limits>
 #include <list>
 #include <memory>
+#include <optional>
+#include <sstream>
 #include <string>
+#include <unordered_map>
 #include <unordered_set>
 #include <vector>
 
+#include <nix/fetchers.hh>
+
 #include "flox/core/util.hh"
 #include "flox/flake-package.hh"
 #include "flox/pkgdb/read.hh"
@@ -67,6 +74,97 @@ genPkgDbName( const Fingerprint &           fingerprint,
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+std::vector<std::filesystem::path>
+findPkgDbs( const nix::FlakeRef &            ref,
+            const std::vector<Fingerprint> & fingerprints,
+            const std::filesystem::path &    cacheDir )
+{
+  std::vector<std::filesystem::path> candidates;
+  for ( const auto & fingerprint : fingerprints )
+    {
+      for ( auto & path : findPkgDbs( fingerprint, cacheDir ) )
+        {
+          candidates.emplace_back( std::move( path ) );
+        }
+    }
+
+  std::vector<std::filesystem::path> rsl;
+  nlohmann::json wanted = nix::fetchers::attrsToJSON( ref.toAttrs() );
+  for ( const auto & path : candidates )
+    {
+      /* Skip databases which can't be read, such as those of another schema
+       * or those still being created, rather than failing every lookup. */
+      auto skip = [&]( const std::exception & err )
+      {
+        nix::logger->log( nix::lvlTalkative,
+                          nix::fmt( "skipping unreadable database '%s': %s",
+                                    path.string(),
+                                    err.what() ) );
+      };
+      std::optional<PkgDbReadOnly> dbRO;
+      try
+        {
+          dbRO.emplace( path.string() );
+        }
+      catch ( const PkgDbException & err )
+        {
+          skip( err );
+          continue;
+        }
+      catch ( const sqlite3pp::database_error & err )
+        {
+          skip( err );
+          continue;
+        }
+
+      bool matches = true;
+      for ( const auto & [key, value] : wanted.items() )
+        {
+          auto attr = dbRO->lockedRef.attrs.find( key );
+          if ( ( attr == dbRO->lockedRef.attrs.end() ) || ( *attr != value ) )
+            {
+              matches = false;
+              break;
+            }
+        }
+      if ( matches ) { rsl.emplace_back( path ); }
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<std::filesystem::path>
+findPkgDbs( const Fingerprint &           fingerprint,
+            const std::filesystem::path & cacheDir )
+{
+  std::vector<std::filesystem::path> rsl;
+  if ( ! std::filesystem::exists( cacheDir ) ) { return rsl; }
+
+  std::string fpStr = fingerprint.to_string( nix::Base16, false );
+  for ( const auto & entry : std::filesystem::directory_iterator( cacheDir ) )
+    {
+      std::string name = entry.path().filename().string();
+      if ( ( name.substr( 0, name.find( '.' ) ) != fpStr )
+           || ( ! isSQLiteDb( entry.path() ) ) )
+        {
+          continue;
+        }
+      rsl.emplace_back( std::filesystem::absolute( entry.path() ) );
+    }
+
+  /* Prefer the database scraped with the default rules. */
+  std::stable_partition( rsl.begin(),
+                         rsl.end(),
+                         [&]( const std::filesystem::path & path )
+                         { return path.filename() == ( fpStr + ".sqlite" ); } );
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 void
@@ -261,6 +359,85 @@ PkgDbReadOnly::hasPackage( const flox::AttrPath & path )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+std::map<flox::AttrPath, std::string>
+PkgDbReadOnly::getQuarantined( const flox::AttrPath & prefix )
+{
+  std::map<flox::AttrPath, std::string> rsl;
+  sqlite3pp::query                      qry( this->db,
+                        "SELECT parentId, attrName, reason FROM Quarantine" );
+  for ( const auto & row : qry )
+    {
+      flox::AttrPath path = this->getAttrSetPath( row.get<long long>( 0 ) );
+      path.emplace_back( row.get<std::string>( 1 ) );
+      if ( ! hasPrefix( prefix, path ) ) { continue; }
+      rsl.emplace( std::move( path ),
+                   row.column_type( 2 ) == SQLITE_NULL
+                     ? ""
+                     : row.get<std::string>( 2 ) );
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<std::string>
+PkgDbReadOnly::getProvidedFiles( row_id row )
+{
+  sqlite3pp::query qry( this->db, R"SQL(
+    SELECT DISTINCT ( dir || '/' || file ) AS path FROM Provides
+    WHERE ( packageId = ? ) ORDER BY path
+  )SQL" );
+  qry.bind( 1, static_cast<long long>( row ) );
+  std::vector<std::string> rsl;
+  for ( const auto & file : qry )
+    {
+      rsl.emplace_back( file.get<std::string>( 0 ) );
+    }
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<flox::AttrPath>
+PkgDbReadOnly::getAliases( row_id row )
+{
+  /* Matching on `id' and `aliasOf' separately lets both use an index.
+   * The same `relPath' may appear in several subtrees, so those rows are
+   * skipped rather than being reported as aliases. */
+  sqlite3pp::query qry( this->db, R"SQL(
+    WITH AliasGroup ( groupId, relPath ) AS (
+      SELECT COALESCE( Packages.aliasOf, Packages.id ), v_PackagesPaths.relPath
+      FROM Packages
+      INNER JOIN v_PackagesPaths ON ( Packages.id = v_PackagesPaths.id )
+      WHERE ( Packages.id = ? )
+    )
+    SELECT v_PackagesPaths.relPath FROM Packages
+    INNER JOIN AliasGroup
+    INNER JOIN v_PackagesPaths ON ( Packages.id = v_PackagesPaths.id )
+    WHERE ( ( Packages.id = AliasGroup.groupId )
+            OR ( Packages.aliasOf = AliasGroup.groupId ) )
+      AND ( v_PackagesPaths.relPath != AliasGroup.relPath )
+    ORDER BY ( Packages.aliasOf IS NOT NULL ), v_PackagesPaths.relPath
+  )SQL" );
+  qry.bind( 1, static_cast<long long>( row ) );
+  std::vector<flox::AttrPath> rsl;
+  for ( const auto & alias : qry )
+    {
+      auto relPath = nlohmann::json::parse( alias.get<std::string>( 0 ) )
+                       .get<flox::AttrPath>();
+      if ( std::find( rsl.begin(), rsl.end(), relPath ) == rsl.end() )
+        {
+          rsl.emplace_back( std::move( relPath ) );
+        }
+    }
+  return rsl;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 row_id
@@ -375,6 +552,44 @@ PkgDbReadOnly::getPackages( const PkgQueryArgs & params )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+std::vector<row_id>
+PkgDbReadOnly::getLicenseViolations(
+  const std::vector<row_id> &                     rows,
+  const std::optional<std::vector<std::string>> & allowed,
+  const std::optional<std::vector<std::string>> & denied )
+{
+  std::unordered_map<std::string, std::string> binds;
+  std::string cond = licensePolicyCondition( allowed, denied, binds );
+  if ( rows.empty() || cond.empty() ) { return {}; }
+
+  std::stringstream stmt;
+  stmt << "SELECT id FROM Packages WHERE ( id IN ( ";
+  bool first = true;
+  for ( const auto & row : rows )
+    {
+      if ( first ) { first = false; }
+      else { stmt << ", "; }
+      stmt << row;
+    }
+  stmt << " ) ) AND NOT ( " << cond << " ) ORDER BY id";
+
+  sqlite3pp::query qry( this->db, stmt.str().c_str() );
+  for ( const auto & [var, val] : binds )
+    {
+      qry.bind( var.c_str(), val, sqlite3pp::copy );
+    }
+
+  std::vector<row_id> violations;
+  for ( const auto & row : qry )
+    {
+      violations.emplace_back( row.get<long long>( 0 ) );
+    }
+  return violations;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 nlohmann::json
@@ -98,13 +98,87 @@ CREATE TABLE IF NOT EXISTS Packages (
 , broken            BOOL
 , unfree            BOOL
 , descriptionId     INTEGER
+-- Hash part of `outPath', set by `pkgdb scrape --aliases'.
+, outHash           VARCHAR( 32 )
+-- The canonical package sharing `outHash', or NULL for canonical packages.
+, aliasOf           INTEGER
 , FOREIGN KEY ( parentId      ) REFERENCES AttrSets  ( id )
 , FOREIGN KEY ( descriptionId ) REFERENCES Descriptions ( id     )
 , CONSTRAINT UC_Packages UNIQUE ( parentId, attrName )
 );
 
 CREATE UNIQUE INDEX IF NOT EXISTS idx_Packages
-  ON Packages ( parentId, attrName )
+  ON Packages ( parentId, attrName );
+
+CREATE INDEX IF NOT EXISTS idx_PackagesOutHash ON Packages ( outHash );
+
+CREATE INDEX IF NOT EXISTS idx_PackagesAliasOf ON Packages ( aliasOf )
+)SQL";
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Attributes which repeatedly crashed, timed out, or failed to evaluate
+ * while scraping, and which later scrapes should skip. */
+static const char * sql_quarantine = R"SQL(
+CREATE TABLE IF NOT EXISTS Quarantine (
+  id        INTEGER        PRIMARY KEY
+, parentId  INTEGER        NOT NULL
+, attrName  VARCHAR( 255 ) NOT NULL
+, reason    TEXT
+, FOREIGN KEY ( parentId ) REFERENCES AttrSets ( id )
+, CONSTRAINT UC_Quarantine UNIQUE ( parentId, attrName )
+);
+
+CREATE UNIQUE INDEX IF NOT EXISTS idx_Quarantine
+  ON Quarantine ( parentId, attrName )
+)SQL";
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Executables and shared libraries installed by realised package outputs.
+ * Rows are keyed by file name first so that exact and prefix lookups are
+ * index seeks. */
+static const char * sql_provides = R"SQL(
+CREATE TABLE IF NOT EXISTS Provides (
+  file       TEXT           NOT NULL
+, dir        VARCHAR( 15 )  NOT NULL
+, packageId  INTEGER        NOT NULL
+, output     VARCHAR( 255 ) NOT NULL
+, PRIMARY KEY ( file, packageId, dir, output )
+, FOREIGN KEY ( packageId ) REFERENCES Packages ( id )
+) WITHOUT ROWID;
+
+CREATE INDEX IF NOT EXISTS idx_ProvidesPackages ON Provides ( packageId )
+)SQL";
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Licenses listed by packages' `meta.license`, keyed by `spdxId`,
+ * `shortName`, or `fullName` in that order of preference.
+ * `PackagesLicenses` is indexed from both sides so that license policies can
+ * be checked for a single package or for every package with a license. */
+static const char * sql_licenses = R"SQL(
+CREATE TABLE IF NOT EXISTS Licenses (
+  id               INTEGER PRIMARY KEY
+, name             TEXT    NOT NULL UNIQUE
+, spdxId           TEXT
+, free             BOOL
+, redistributable  BOOL
+);
+
+CREATE TABLE IF NOT EXISTS PackagesLicenses (
+  packageId  INTEGER NOT NULL
+, licenseId  INTEGER NOT NULL
+, PRIMARY KEY ( packageId, licenseId )
+, FOREIGN KEY ( packageId ) REFERENCES Packages ( id )
+, FOREIGN KEY ( licenseId ) REFERENCES Licenses ( id )
+) WITHOUT ROWID;
+
+CREATE INDEX IF NOT EXISTS idx_PackagesLicenses
+  ON PackagesLicenses ( licenseId, packageId )
 )SQL";
 
 
@@ -222,6 +296,8 @@ CREATE VIEW IF NOT EXISTS v_PackagesSearch AS SELECT
                            ELSE 0
   END AS unfreeRank
 , Descriptions.description
+, COALESCE( Packages.aliasOf, Packages.id ) AS aliasGroup
+, ( Packages.aliasOf IS NOT NULL ) AS isAlias
 FROM Packages
 LEFT OUTER JOIN Descriptions ON ( Packages.descriptionId = Descriptions.id )
 LEFT OUTER JOIN v_Semvers    ON ( Packages.semver = v_Semvers.semver )
@@ -8,6 +8,7 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
 #include <optional>
 #include <string>
 
@@ -43,12 +44,14 @@ scrapeRuleToString( ScrapeRule rule )
 /* -------------------------------------------------------------------------- */
 
 void
-RulesTreeNode::addRule( AttrPathGlob & relPath, ScrapeRule rule )
+RulesTreeNode::addRule( AttrPathGlob & relPath,
+                        ScrapeRule     rule,
+                        bool           overwrite )
 {
   /* Modify our rule. */
   if ( relPath.empty() )
     {
-      if ( this->rule != SR_DEFAULT )
+      if ( ( this->rule != SR_DEFAULT ) && ( ! overwrite ) )
         {
           // TODO: Pass abs-path
           throw FloxException( "attempted to overwrite existing rule '"
@@ -79,7 +82,7 @@ RulesTreeNode::addRule( AttrPathGlob & relPath, ScrapeRule rule )
         {
           AttrPathGlob relPathCopy = relPath;
           relPathCopy.front()      = system;
-          this->addRule( relPathCopy, rule );
+          this->addRule( relPathCopy, rule, overwrite );
         }
       return;
     }
@@ -95,7 +98,7 @@ RulesTreeNode::addRule( AttrPathGlob & relPath, ScrapeRule rule )
     {
       traceLog( "found existing child '" + attrName + '\'' );
       /* Add to existing child node. */
-      itChild->second.addRule( relPath, rule );
+      itChild->second.addRule( relPath, rule, overwrite );
     }
   else if ( relPath.empty() )
     {
@@ -193,32 +196,41 @@ to_json( nlohmann::json & jto, const RulesTreeNode & rules )
 
 /* -------------------------------------------------------------------------- */
 
-RulesTreeNode::RulesTreeNode( const ScrapeRulesRaw & raw )
+void
+RulesTreeNode::addRules( const ScrapeRulesRaw & raw, bool overwrite )
 {
   /* Add rules in order of precedence */
   for ( const auto & path : raw.allowPackage )
     {
       AttrPathGlob pathCopy( path );
-      this->addRule( pathCopy, SR_ALLOW_PACKAGE );
+      this->addRule( pathCopy, SR_ALLOW_PACKAGE, overwrite );
     }
   for ( const auto & path : raw.disallowPackage )
     {
       AttrPathGlob pathCopy( path );
-      this->addRule( pathCopy, SR_DISALLOW_PACKAGE );
+      this->addRule( pathCopy, SR_DISALLOW_PACKAGE, overwrite );
     }
   for ( const auto & path : raw.allowRecursive )
     {
       AttrPathGlob pathCopy( path );
-      this->addRule( pathCopy, SR_ALLOW_RECURSIVE );
+      this->addRule( pathCopy, SR_ALLOW_RECURSIVE, overwrite );
     }
   for ( const auto & path : raw.disallowRecursive )
     {
       AttrPathGlob pathCopy( path );
-      this->addRule( pathCopy, SR_DISALLOW_RECURSIVE );
+      this->addRule( pathCopy, SR_DISALLOW_RECURSIVE, overwrite );
     }
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+RulesTreeNode::RulesTreeNode( const ScrapeRulesRaw & raw )
+{
+  this->addRules( raw );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 void
@@ -259,17 +271,96 @@ from_json( const nlohmann::json & jfrom, ScrapeRulesRaw & rules )
         {
           addPaths( key, rules.disallowRecursive, value );
         }
+      else if ( key == "scope" ) { addPaths( key, rules.scope, value ); }
       else { throw FloxException( "unknown scrape rule: '" + key + "'" ); }
     }
 }
 
+
+/* -------------------------------------------------------------------------- */
+
+void
+to_json( nlohmann::json & jto, const ScrapeRulesRaw & rules )
+{
+  jto = nlohmann::json::object();
+  auto addPaths
+    = [&]( const std::string & key, const std::vector<AttrPathGlob> & vect )
+  {
+    if ( ! vect.empty() ) { jto.emplace( key, vect ); }
+  };
+  addPaths( "allowPackage", rules.allowPackage );
+  addPaths( "disallowPackage", rules.disallowPackage );
+  addPaths( "allowRecursive", rules.allowRecursive );
+  addPaths( "disallowRecursive", rules.disallowRecursive );
+  addPaths( "scope", rules.scope );
+}
+
 /* -------------------------------------------------------------------------- */
 
 ScrapeRules::ScrapeRules( const std::string_view & rulesJSON )
   : hash( nix::hashString( nix::htMD5, rulesJSON ) )
 {
   ScrapeRulesRaw raw = nlohmann::json::parse( rulesJSON );
-  this->rootNode     = RulesTreeNode( std::move( raw ) );
+  this->rootNode     = RulesTreeNode( raw );
+  this->scope        = std::move( raw.scope );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+ScrapeRules::ScrapeRules( const ScrapeRules &    base,
+                          const ScrapeRulesRaw & overlay )
+  : rootNode( base.rootNode )
+  , hash( nix::hashString(
+      nix::htMD5,
+      base.hashString() + nlohmann::json( overlay ).dump() ) )
+  , scope( overlay.scope.empty() ? base.scope : overlay.scope )
+{
+  this->rootNode.addRules( overlay, true );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Whether @a glob matches the leading attributes of @a path, or
+ *        the leading attributes of @a glob match @a path.
+ */
+[[nodiscard]] static bool
+globOverlapsPath( const AttrPathGlob & glob, const AttrPath & path )
+{
+  size_t len = std::min( glob.size(), path.size() );
+  for ( size_t idx = 0; idx < len; ++idx )
+    {
+      if ( glob[idx].has_value() && ( *glob[idx] != path[idx] ) )
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::optional<bool>
+ScrapeRules::applyRules( const AttrPath & path ) const
+{
+  if ( this->scope.empty() ) { return this->rootNode.applyRules( path ); }
+
+  bool isAncestor = false;
+  for ( const auto & prefix : this->scope )
+    {
+      if ( ! globOverlapsPath( prefix, path ) ) { continue; }
+      /* Beneath a scope prefix, so the usual rules apply. */
+      if ( prefix.size() <= path.size() )
+        {
+          return this->rootNode.applyRules( path );
+        }
+      isAncestor = true;
+    }
+  /* Ancestors are recursed into to reach the prefixes beneath them. */
+  return isAncestor;
 }
 
 /* Currently returns the one and only set of rules for scraping.
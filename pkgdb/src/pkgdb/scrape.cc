@@ -27,6 +27,35 @@ ScrapeCommand::ScrapeCommand() : parser( "scrape" )
     .help( "force re-evaluation of flake" )
     .nargs( 0 )
     .action( [&]( const auto & ) { this->force = true; } );
+  this->parser.add_argument( "--metadata-dump" )
+    .help( "populate the database from a `nix-env -qaP --json --meta' dump "
+           "instead of evaluating the flake" )
+    .metavar( "PATH" )
+    .nargs( 1 )
+    .action( [&]( const std::string & path )
+             { this->metadataDump = nix::absPath( path ); } );
+  this->addScrapeRulesArg( this->parser );
+  this->parser.add_argument( "--provides" )
+    .help( "index executables and shared libraries of realised outputs" )
+    .nargs( 0 )
+    .action( [&]( const auto & ) { this->provides = true; } );
+  this->parser.add_argument( "--binary-cache" )
+    .help( "also index outputs listed in a local `file://' binary cache, "
+           "implies `--provides'" )
+    .metavar( "PATH" )
+    .nargs( 1 )
+    .action(
+      [&]( const std::string & path )
+      {
+        std::string_view dir = path;
+        if ( hasPrefix( "file://", dir ) ) { dir.remove_prefix( 7 ); }
+        this->binaryCache = nix::absPath( std::string( dir ) );
+        this->provides    = true;
+      } );
+  this->parser.add_argument( "--aliases" )
+    .help( "evaluate output paths to detect packages which are aliases" )
+    .nargs( 0 )
+    .action( [&]( const auto & ) { this->aliases = true; } );
   this->addDatabasePathOption( this->parser );
   this->addFlakeRefArg( this->parser );
   this->addAttrPathArgs( this->parser );
@@ -65,22 +94,58 @@ ScrapeCommand::run()
   assert( this->input.has_value() );
 
   /* If `--force' was given, clear the `done' fields for the prefix and its
-   * descendants to force them to re-evaluate. */
+   * descendants to force them to re-evaluate, and retry any attributes that
+   * were previously quarantined. */
   if ( this->force )
     {
       this->input->getDbReadWrite()->setPrefixDone( this->attrPath, false );
+      this->input->getDbReadWrite()->clearQuarantine( this->attrPath );
       this->input->closeDbReadWrite();
     }
 
-  /* scrape it up! */
-  this->input->scrapePrefix( this->attrPath );
+  if ( this->metadataDump.has_value() )
+    {
+      /* Skip evaluation and ingest precomputed metadata. */
+      size_t count = this->input->getDbReadWrite()->importMetadataDump(
+        this->attrPath,
+        *this->metadataDump );
+      this->input->closeDbReadWrite();
+      debugLog( nix::fmt( "imported %d packages from '%s'",
+                          count,
+                          this->metadataDump->string() ) );
+    }
+  else
+    {
+      /* scrape it up! */
+      this->input->scrapePrefix( this->attrPath );
+    }
 
-  /* Print path to database. */
-  std::cout << nlohmann::json(
-                 { { "database-path",
-                     static_cast<std::string>( *this->dbPath ) } } )
-                 .dump()
-            << std::endl;
+  /* Print path to database, and any attributes which were skipped. */
+  nlohmann::json rsl
+    = { { "database-path", this->input->getDbPath().string() } };
+
+  if ( this->provides )
+    {
+      rsl.emplace( "provides",
+                   this->input->indexProvides( this->attrPath,
+                                               this->binaryCache ) );
+    }
+  if ( this->aliases )
+    {
+      rsl.emplace( "aliases", this->input->indexAliases( this->attrPath ) );
+    }
+  auto quarantined
+    = this->input->getDbReadOnly()->getQuarantined( this->attrPath );
+  if ( ! quarantined.empty() )
+    {
+      nlohmann::json jQuarantined = nlohmann::json::object();
+      for ( const auto & [path, reason] : quarantined )
+        {
+          jQuarantined.emplace( concatStringsSep( ".", path ), reason );
+        }
+      rsl.emplace( "quarantined", std::move( jQuarantined ) );
+    }
+  std::cout << rsl.dump() << std::endl;
   return EXIT_SUCCESS; /* GG, GG */
 }
 
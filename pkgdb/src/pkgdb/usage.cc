@@ -0,0 +1,334 @@
+/* ========================================================================== *
+ *
+ * @file pkgdb/usage.cc
+ *
+ * @brief A local record of how often packages are locked, and implementation
+ *        of the `pkgdb usage` subcommands.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <bit>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nix/util.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/core/util.hh"
+#include "flox/pkgdb/command.hh"
+#include "flox/pkgdb/read.hh"
+#include "flox/pkgdb/usage.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::pkgdb {
+
+/* -------------------------------------------------------------------------- */
+
+static const char * sql_usage = R"SQL(
+CREATE TABLE IF NOT EXISTS Usage (
+  pname      TEXT    NOT NULL
+, relPath    JSON    NOT NULL
+, lockCount  INTEGER NOT NULL
+, rank       INTEGER NOT NULL
+, PRIMARY KEY ( pname, relPath )
+) WITHOUT ROWID
+)SQL";
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+from_json( const nlohmann::json & jfrom, PackageUsage & usage )
+{
+  jfrom.at( "pname" ).get_to( usage.pname );
+  jfrom.at( "relPath" ).get_to( usage.relPath );
+  usage.count = jfrom.value( "count", std::uint64_t( 1 ) );
+}
+
+
+void
+to_json( nlohmann::json & jto, const PackageUsage & usage )
+{
+  jto = { { "pname", usage.pname },
+          { "relPath", usage.relPath },
+          { "count", usage.count } };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+unsigned
+getUsageRank( std::uint64_t count )
+{
+  return static_cast<unsigned>( std::bit_width( count ) );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::filesystem::path
+getUsageDbPath()
+{
+  if ( std::optional<std::string> fromEnv = nix::getEnv( "PKGDB_USAGE" );
+       fromEnv.has_value() )
+    {
+      return *fromEnv;
+    }
+  return std::filesystem::path( nix::getDataDir() ) / "flox" / "usage.sqlite";
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+UsageDb::UsageDb( const std::filesystem::path & dbPath, bool create )
+  : dbPath( dbPath )
+{
+  if ( this->dbPath.empty() )
+    {
+      throw PkgDbException( "recording package usage is disabled" );
+    }
+  if ( create )
+    {
+      std::filesystem::create_directories( this->dbPath.parent_path() );
+      this->db.connect( this->dbPath.string().c_str(),
+                        SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE );
+    }
+  else
+    {
+      if ( ! std::filesystem::exists( this->dbPath ) )
+        {
+          throw PkgDbException( "no such usage database '"
+                                + this->dbPath.string() + "'" );
+        }
+      this->db.connect( this->dbPath.string().c_str(),
+                        SQLITE_OPEN_READWRITE );
+    }
+  this->db.set_busy_timeout( DB_BUSY_TIMEOUT );
+
+  if ( sql_rc rcode = this->db.execute_all( sql_usage ); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to initialize usage database '%s':(%d) %s",
+                  this->dbPath.string(),
+                  rcode,
+                  this->db.error_msg() ) );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::size_t
+UsageDb::record( const std::vector<PackageUsage> & usages )
+{
+  /* Combine usages of the same package so each row is written once. */
+  std::map<std::pair<std::string, std::string>, std::uint64_t> counts;
+  for ( const auto & usage : usages )
+    {
+      if ( usage.count == 0 ) { continue; }
+      counts[{ usage.pname, nlohmann::json( usage.relPath ).dump() }]
+        += usage.count;
+    }
+  if ( counts.empty() ) { return 0; }
+
+  this->db.execute( "BEGIN TRANSACTION" );
+  try
+    {
+      sqlite3pp::query qry(
+        this->db,
+        "SELECT lockCount FROM Usage WHERE ( pname = ? ) AND ( relPath = ? )" );
+      sqlite3pp::command cmd( this->db, R"SQL(
+        INSERT INTO Usage ( pname, relPath, lockCount, rank )
+        VALUES ( ?, ?, ?, ? )
+        ON CONFLICT ( pname, relPath ) DO UPDATE SET
+          lockCount = excluded.lockCount
+        , rank      = excluded.rank
+      )SQL" );
+
+      for ( const auto & [key, count] : counts )
+        {
+          const auto & [pname, relPath] = key;
+
+          qry.reset();
+          qry.bind( 1, pname, sqlite3pp::copy );
+          qry.bind( 2, relPath, sqlite3pp::copy );
+          std::uint64_t total = count;
+          if ( auto itr = qry.begin(); itr != qry.end() )
+            {
+              total += ( *itr ).get<long long>( 0 );
+            }
+
+          cmd.reset();
+          cmd.bind( 1, pname, sqlite3pp::copy );
+          cmd.bind( 2, relPath, sqlite3pp::copy );
+          cmd.bind( 3, static_cast<long long>( total ) );
+          cmd.bind( 4, static_cast<int>( getUsageRank( total ) ) );
+          if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+            {
+              throw PkgDbException(
+                nix::fmt( "failed to record usage of '%s'", pname ),
+                this->db.error_msg() );
+            }
+        }
+    }
+  catch ( ... )
+    {
+      this->db.execute( "ROLLBACK TRANSACTION" );
+      throw;
+    }
+  this->db.execute( "COMMIT TRANSACTION" );
+  return counts.size();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::size_t
+UsageDb::importFile( const std::filesystem::path & usagePath )
+{
+  std::ifstream file( usagePath );
+  if ( ! file.is_open() )
+    {
+      throw InvalidUsageFileException(
+        nix::fmt( "unable to open usage file '%s'", usagePath.string() ) );
+    }
+
+  std::vector<PackageUsage> usages;
+  try
+    {
+      nlohmann::json::parse( file ).get_to( usages );
+    }
+  catch ( const nlohmann::json::exception & err )
+    {
+      throw InvalidUsageFileException(
+        nix::fmt( "failed to parse usage file '%s'", usagePath.string() ),
+        extract_json_errmsg( err ) );
+    }
+
+  this->record( usages );
+  return usages.size();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::uint64_t
+UsageDb::getCount( const std::string & pname, const AttrPath & relPath )
+{
+  sqlite3pp::query qry(
+    this->db,
+    "SELECT lockCount FROM Usage WHERE ( pname = ? ) AND ( relPath = ? )" );
+  qry.bind( 1, pname, sqlite3pp::copy );
+  qry.bind( 2, nlohmann::json( relPath ).dump(), sqlite3pp::copy );
+  auto itr = qry.begin();
+  if ( itr == qry.end() ) { return 0; }
+  return ( *itr ).get<long long>( 0 );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+bool
+UsageDb::attach( sqlite3pp::database &         other,
+                 const std::filesystem::path & dbPath )
+{
+  if ( dbPath.empty() || ( ! std::filesystem::exists( dbPath ) ) )
+    {
+      return false;
+    }
+
+  /* Finish this query before attaching. */
+  {
+    sqlite3pp::query attached(
+      other,
+      "SELECT 1 FROM pragma_database_list WHERE ( name = 'usage' )" );
+    if ( attached.begin() != attached.end() ) { return true; }
+  }
+
+  sqlite3pp::command cmd( other, "ATTACH DATABASE ? AS usage" );
+  cmd.bind( 1, dbPath.string(), sqlite3pp::copy );
+  if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to attach usage database '%s'", dbPath.string() ),
+        other.error_msg() );
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+UsageImportCommand::UsageImportCommand() : parser( "import" )
+{
+  this->parser.add_description(
+    "Add the counts of a usage file to the usage database" );
+  this->addDatabasePathOption( this->parser );
+  this->parser.add_argument( "file" )
+    .help( "path to a JSON list of package usages" )
+    .required()
+    .metavar( "FILE" )
+    .action( [&]( const std::string & file )
+             { this->file = nix::absPath( file ); } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+UsageImportCommand::run()
+{
+  UsageDb     usage( this->dbPath.value_or( getUsageDbPath() ), true );
+  std::size_t count = usage.importFile( this->file );
+  std::cout << nlohmann::json { { "database-path", usage.dbPath },
+                                { "usages", count } }
+                 .dump()
+            << '\n';
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+UsageCommand::UsageCommand() : parser( "usage" )
+{
+  this->parser.add_description(
+    "Manage the local record of locked packages used to rank search results" );
+  this->parser.add_subparser( this->cmdImport.getParser() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+UsageCommand::run()
+{
+  if ( this->parser.is_subcommand_used( "import" ) )
+    {
+      return this->cmdImport.run();
+    }
+  std::cerr << this->parser << '\n';
+  throw flox::FloxException( "You must provide a valid 'usage' subcommand" );
+  return EXIT_FAILURE;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::pkgdb
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -7,6 +7,7 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
 #include <fstream>
 #include <limits>
 #include <memory>
@@ -125,6 +126,30 @@ initTables( PkgDb & pdb )
                   rcode,
                   pdb.db.error_msg() ) );
     }
+
+  if ( sql_rc rcode = pdb.execute_all( sql_quarantine ); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to initialize Quarantine table:(%d) %s",
+                  rcode,
+                  pdb.db.error_msg() ) );
+    }
+
+  if ( sql_rc rcode = pdb.execute_all( sql_provides ); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to initialize Provides table:(%d) %s",
+                  rcode,
+                  pdb.db.error_msg() ) );
+    }
+
+  if ( sql_rc rcode = pdb.execute_all( sql_licenses ); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to initialize Licenses table:(%d) %s",
+                  rcode,
+                  pdb.db.error_msg() ) );
+    }
 }
 
 
@@ -153,7 +178,7 @@ initVersions( PkgDb & pdb )
 static void
 initScrapeMeta( PkgDb & pdb )
 {
-  const ScrapeRules & scrapeRules = getDefaultRules();
+  const ScrapeRules & scrapeRules = pdb.getScrapeRules();
   sqlite3pp::command  defineScrapeMeta(
     pdb.db,
     "INSERT OR IGNORE INTO DbScrapeMeta ( key, value ) VALUES"
@@ -212,7 +237,10 @@ writeInput( PkgDb & pdb )
 
 /* -------------------------------------------------------------------------- */
 
-PkgDb::PkgDb( const nix::flake::LockedFlake & flake, std::string_view dbPath )
+PkgDb::PkgDb( const nix::flake::LockedFlake &    flake,
+              std::string_view                   dbPath,
+              std::shared_ptr<const ScrapeRules> scrapeRules )
+  : scrapeRules( std::move( scrapeRules ) )
 {
   this->dbPath      = dbPath;
   this->fingerprint = flake.getFingerprint();
@@ -225,6 +253,16 @@ PkgDb::PkgDb( const nix::flake::LockedFlake & flake, std::string_view dbPath )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+const ScrapeRules &
+PkgDb::getScrapeRules() const
+{
+  if ( this->scrapeRules == nullptr ) { return getDefaultRules(); }
+  return *this->scrapeRules;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 void
@@ -321,6 +359,50 @@ PkgDb::addOrGetDescriptionId( const std::string & description )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+row_id
+PkgDb::addOrGetLicenseId( const License & license )
+{
+  sqlite3pp::query qry( this->db,
+                        "SELECT id FROM Licenses WHERE name = ? LIMIT 1" );
+  qry.bind( 1, license.name, sqlite3pp::copy );
+  if ( auto itr = qry.begin(); itr != qry.end() )
+    {
+      return ( *itr ).get<long long>( 0 );
+    }
+
+  sqlite3pp::command cmd( this->db, R"SQL(
+    INSERT INTO Licenses ( name, spdxId, free, redistributable )
+    VALUES ( ?, ?, ?, ? )
+  )SQL" );
+  cmd.bind( 1, license.name, sqlite3pp::copy );
+  if ( license.spdxId.has_value() )
+    {
+      cmd.bind( 2, *license.spdxId, sqlite3pp::copy );
+    }
+  else { cmd.bind( 2 ); }
+  if ( license.free.has_value() )
+    {
+      cmd.bind( 3, static_cast<int>( *license.free ) );
+    }
+  else { cmd.bind( 3 ); }
+  if ( license.redistributable.has_value() )
+    {
+      cmd.bind( 4, static_cast<int>( *license.redistributable ) );
+    }
+  else { cmd.bind( 4 ); }
+  if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+    {
+      throw PkgDbException( nix::fmt( "failed to add License '%s':(%d) %s",
+                                      license.name,
+                                      rcode,
+                                      this->db.error_msg() ) );
+    }
+  return this->db.last_insert_rowid();
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 row_id
@@ -328,6 +410,64 @@ PkgDb::addPackage( row_id               parentId,
                    std::string_view     attrName,
                    const flox::Cursor & cursor )
 {
+  /* We don't need to reference any `attrPath' related info here, so
+   * we can avoid looking up the parent path by passing a phony one to the
+   * `FlakePackage' constructor here. */
+  FlakePackage pkg( cursor, { "packages", "x86_64-linux", "phony" }, true );
+  return this->addPackage( parentId, attrName, pkg );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+row_id
+PkgDb::addPackage( row_id           parentId,
+                   std::string_view attrName,
+                   const Package &  pkg )
+{
+  std::string attrNameS( attrName );
+
+  /* Replacing a package gives it a new `id', so drop the licenses and
+   * provided files recorded for its old one.
+   * This is rare while scraping, so only the lookup runs for every package,
+   * using a statement which is prepared once. */
+  if ( this->packageIdQuery == nullptr )
+    {
+      this->packageIdQuery = std::make_unique<sqlite3pp::query>(
+        this->db,
+        "SELECT id FROM Packages WHERE ( parentId = ? ) AND ( attrName = ? )" );
+    }
+  std::optional<row_id> oldId;
+  {
+    sqlite3pp::query & qry = *this->packageIdQuery;
+    qry.reset();
+    qry.bind( 1, static_cast<long long>( parentId ) );
+    qry.bind( 2, attrNameS, sqlite3pp::copy );
+    if ( auto itr = qry.begin(); itr != qry.end() )
+      {
+        oldId = static_cast<row_id>( ( *itr ).get<long long>( 0 ) );
+      }
+    qry.reset();
+  }
+  if ( oldId.has_value() )
+    {
+      for ( const std::string table : { "PackagesLicenses", "Provides" } )
+        {
+          sqlite3pp::command clear(
+            this->db,
+            ( "DELETE FROM " + table + " WHERE ( packageId = ? )" ).c_str() );
+          clear.bind( 1, static_cast<long long>( *oldId ) );
+          if ( sql_rc rcode = clear.execute(); isSQLError( rcode ) )
+            {
+              throw PkgDbException(
+                nix::fmt( "failed to clear %s of Package '%s'",
+                          table,
+                          attrNameS ),
+                this->db.error_msg() );
+            }
+        }
+    }
+
   sqlite3pp::command cmd( this->db, R"SQL(
     INSERT OR REPLACE INTO Packages (
       parentId, attrName, name, pname, version, semver, license
@@ -338,23 +478,22 @@ PkgDb::addPackage( row_id               parentId,
     )
   )SQL" );
 
-  /* We don't need to reference any `attrPath' related info here, so
-   * we can avoid looking up the parent path by passing a phony one to the
-   * `FlakePackage' constructor here. */
-  FlakePackage pkg( cursor, { "packages", "x86_64-linux", "phony" }, true );
-  std::string  attrNameS( attrName );
+  std::string fullName = pkg.getFullName();
 
   cmd.bind( ":parentId", static_cast<long long>( parentId ) );
   cmd.bind( ":attrName", attrNameS, sqlite3pp::copy );
-  cmd.bind( ":name", pkg._fullName, sqlite3pp::nocopy );
-  cmd.bind( ":pname", pkg._pname, sqlite3pp::nocopy );
+  cmd.bind( ":name", fullName, sqlite3pp::copy );
+  cmd.bind( ":pname", pkg.getPname(), sqlite3pp::copy );
 
-  if ( pkg._version.empty() ) { cmd.bind( ":version" ); /* bind NULL */ }
-  else { cmd.bind( ":version", pkg._version, sqlite3pp::nocopy ); }
+  if ( auto maybe = pkg.getVersion(); maybe.has_value() )
+    {
+      cmd.bind( ":version", *maybe, sqlite3pp::copy );
+    }
+  else { cmd.bind( ":version" ); /* bind NULL */ }
 
-  if ( pkg._semver.has_value() )
+  if ( auto maybe = pkg.getSemver(); maybe.has_value() )
     {
-      cmd.bind( ":semver", *pkg._semver, sqlite3pp::nocopy );
+      cmd.bind( ":semver", *maybe, sqlite3pp::copy );
     }
   else { cmd.bind( ":semver" ); /* binds NULL */ }
 
@@ -367,50 +506,60 @@ PkgDb::addPackage( row_id               parentId,
     cmd.bind( ":outputsToInstall", jOutsInstall.dump(), sqlite3pp::copy );
   }
 
-
-  if ( pkg._hasMetaAttr )
+  /* Each of these are `std::nullopt' when `meta' is undefined. */
+  if ( auto maybe = pkg.getLicense(); maybe.has_value() )
     {
-      if ( auto maybe = pkg.getLicense(); maybe.has_value() )
-        {
-          cmd.bind( ":license", *maybe, sqlite3pp::copy );
-        }
-      else { cmd.bind( ":license" ); }
-
-      if ( auto maybe = pkg.isBroken(); maybe.has_value() )
-        {
-          cmd.bind( ":broken", static_cast<int>( *maybe ) );
-        }
-      else { cmd.bind( ":broken" ); }
+      cmd.bind( ":license", *maybe, sqlite3pp::copy );
+    }
+  else { cmd.bind( ":license" ); }
 
-      if ( auto maybe = pkg.isUnfree(); maybe.has_value() )
-        {
-          cmd.bind( ":unfree", static_cast<int>( *maybe ) );
-        }
-      else /* TODO: Derive value from `license'? */ { cmd.bind( ":unfree" ); }
+  if ( auto maybe = pkg.isBroken(); maybe.has_value() )
+    {
+      cmd.bind( ":broken", static_cast<int>( *maybe ) );
+    }
+  else { cmd.bind( ":broken" ); }
 
-      if ( auto maybe = pkg.getDescription(); maybe.has_value() )
-        {
-          row_id descriptionId = this->addOrGetDescriptionId( *maybe );
-          cmd.bind( ":descriptionId", static_cast<long long>( descriptionId ) );
-        }
-      else { cmd.bind( ":descriptionId" ); }
+  if ( auto maybe = pkg.isUnfree(); maybe.has_value() )
+    {
+      cmd.bind( ":unfree", static_cast<int>( *maybe ) );
     }
-  else
+  else /* TODO: Derive value from `license'? */ { cmd.bind( ":unfree" ); }
+
+  if ( auto maybe = pkg.getDescription(); maybe.has_value() )
     {
-      /* binds NULL */
-      cmd.bind( ":license" );
-      cmd.bind( ":broken" );
-      cmd.bind( ":unfree" );
-      cmd.bind( ":descriptionId" );
+      row_id descriptionId = this->addOrGetDescriptionId( *maybe );
+      cmd.bind( ":descriptionId", static_cast<long long>( descriptionId ) );
     }
+  else { cmd.bind( ":descriptionId" ); }
 
   if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
     {
       throw PkgDbException(
-        nix::fmt( "failed to write Package '%s'", pkg._fullName ),
+        nix::fmt( "failed to write Package '%s'", fullName ),
         this->db.error_msg() );
     }
-  return this->db.last_insert_rowid();
+  row_id row = this->db.last_insert_rowid();
+
+  sqlite3pp::command addLicense( this->db, R"SQL(
+    INSERT OR IGNORE INTO PackagesLicenses ( packageId, licenseId )
+    VALUES ( ?, ? )
+  )SQL" );
+  for ( const auto & license : pkg.getLicenses() )
+    {
+      row_id licenseId = this->addOrGetLicenseId( license );
+      addLicense.reset();
+      addLicense.bind( 1, static_cast<long long>( row ) );
+      addLicense.bind( 2, static_cast<long long>( licenseId ) );
+      if ( sql_rc rcode = addLicense.execute(); isSQLError( rcode ) )
+        {
+          throw PkgDbException(
+            nix::fmt( "failed to record license '%s' of Package '%s'",
+                      license.name,
+                      fullName ),
+            this->db.error_msg() );
+        }
+    }
+  return row;
 }
 
 
@@ -450,6 +599,159 @@ PkgDb::setPrefixDone( const flox::AttrPath & prefix, bool done )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+void
+PkgDb::addQuarantine( const flox::AttrPath & path, std::string_view reason )
+{
+  flox::AttrPath parent( path.begin(), path.end() - 1 );
+  row_id         parentId = this->addOrGetAttrSetId( parent );
+
+  sqlite3pp::command cmd( this->db, R"SQL(
+    INSERT OR REPLACE INTO Quarantine ( parentId, attrName, reason )
+    VALUES ( ?, ?, ? )
+  )SQL" );
+  cmd.bind( 1, static_cast<long long>( parentId ) );
+  cmd.bind( 2, path.back(), sqlite3pp::copy );
+  cmd.bind( 3, std::string( reason ), sqlite3pp::copy );
+  if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to quarantine attribute '%s'",
+                  concatStringsSep( ".", path ) ),
+        this->db.error_msg() );
+    }
+  if ( this->quarantined.has_value() )
+    {
+      this->quarantined->emplace( parentId, path.back() );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+PkgDb::clearQuarantine( const flox::AttrPath & prefix )
+{
+  sqlite3pp::command cmd( this->db, R"SQL(
+    DELETE FROM Quarantine WHERE parentId IN (
+      WITH RECURSIVE Tree AS (
+        SELECT id FROM AttrSets WHERE ( id = ? )
+        UNION ALL SELECT O.id FROM AttrSets O
+        JOIN Tree AS Parent ON ( Parent.id = O.parent )
+      ) SELECT id FROM Tree
+    )
+  )SQL" );
+  cmd.bind( 1, static_cast<long long>( this->addOrGetAttrSetId( prefix ) ) );
+  if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to clear quarantine for subtree '%s'",
+                  concatStringsSep( ".", prefix ) ),
+        this->db.error_msg() );
+    }
+  this->quarantined = std::nullopt;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+PkgDb::setProvidedFiles( row_id                            row,
+                         const std::string &               output,
+                         const std::vector<ProvidedFile> & files )
+{
+  sqlite3pp::command clear(
+    this->db,
+    "DELETE FROM Provides WHERE ( packageId = ? ) AND ( output = ? )" );
+  clear.bind( 1, static_cast<long long>( row ) );
+  clear.bind( 2, output, sqlite3pp::copy );
+  if ( sql_rc rcode = clear.execute(); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to clear provided files for package %d", row ),
+        this->db.error_msg() );
+    }
+
+  sqlite3pp::command cmd( this->db, R"SQL(
+    INSERT OR IGNORE INTO Provides ( file, dir, packageId, output )
+    VALUES ( ?, ?, ?, ? )
+  )SQL" );
+  for ( const auto & file : files )
+    {
+      cmd.reset();
+      cmd.bind( 1, file.file, sqlite3pp::copy );
+      cmd.bind( 2, file.dir, sqlite3pp::copy );
+      cmd.bind( 3, static_cast<long long>( row ) );
+      cmd.bind( 4, output, sqlite3pp::copy );
+      if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+        {
+          throw PkgDbException(
+            nix::fmt( "failed to record provided file '%s/%s' for package %d",
+                      file.dir,
+                      file.file,
+                      row ),
+            this->db.error_msg() );
+        }
+    }
+}
+
+
+void
+PkgDb::setOutHash( row_id row, std::string_view outHash )
+{
+  sqlite3pp::command cmd( this->db,
+                          "UPDATE Packages SET outHash = ? WHERE ( id = ? )" );
+  cmd.bind( 1, std::string( outHash ), sqlite3pp::copy );
+  cmd.bind( 2, static_cast<long long>( row ) );
+  if ( sql_rc rcode = cmd.execute(); isSQLError( rcode ) )
+    {
+      throw PkgDbException(
+        nix::fmt( "failed to record output hash for package %d", row ),
+        this->db.error_msg() );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+size_t
+PkgDb::updateAliases()
+{
+  /* Groups are recomputed from scratch since replacing a package during a
+   * scrape gives it a new `id'. */
+  if ( sql_rc rcode = this->execute_all( R"SQL(
+         UPDATE Packages SET aliasOf = NULL WHERE ( aliasOf IS NOT NULL );
+         UPDATE Packages SET aliasOf = Ranked.canonicalId FROM (
+           SELECT Packages.id, first_value( Packages.id ) OVER (
+             PARTITION BY Packages.outHash
+             ORDER BY v_PackagesPaths.depth
+                    , length( v_PackagesPaths.relPath )
+                    , v_PackagesPaths.relPath
+                    , Packages.id
+           ) AS canonicalId
+           FROM Packages
+           INNER JOIN v_PackagesPaths ON ( Packages.id = v_PackagesPaths.id )
+           WHERE ( Packages.outHash IS NOT NULL )
+         ) AS Ranked
+         WHERE ( Packages.id = Ranked.id )
+           AND ( Ranked.canonicalId != Ranked.id )
+       )SQL" );
+       isSQLError( rcode ) )
+    {
+      throw PkgDbException( "failed to update package aliases",
+                            this->db.error_msg() );
+    }
+
+  sqlite3pp::query qry(
+    this->db,
+    "SELECT COUNT( id ) FROM Packages WHERE ( aliasOf IS NOT NULL )" );
+  return static_cast<size_t>( ( *qry.begin() ).get<long long>( 0 ) );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
 // NOLINTBEGIN(readability-function-cognitive-complexity)
 // TODO reduce complexity
 void
@@ -469,9 +771,21 @@ PkgDb::processSingleAttrib( const nix::SymbolStr &    sym,
       flox::AttrPath path = prefix;
       path.emplace_back( sym );
 
+      if ( this->onScrapeAttrib ) { this->onScrapeAttrib( path ); }
+
+      /* Skip attributes which previously failed to scrape. */
+      if ( this->quarantined.has_value()
+           && this->quarantined->contains(
+             std::make_pair( parentId, std::string( sym ) ) ) )
+        {
+          traceLog( "scrape: skipping quarantined attribute: "
+                    + getPathString() );
+          return;
+        }
+
       /* If the package or prefix is disallowed, bail. */
       std::optional<bool> rulesBasedOverride
-        = getDefaultRules().applyRules( path );
+        = this->getScrapeRules().applyRules( path );
       if ( rulesBasedOverride.has_value() && ( ! ( *rulesBasedOverride ) ) )
         {
           if ( nix::lvlTalkative <= nix::verbosity )
@@ -546,26 +860,57 @@ PkgDb::scrape( nix::SymbolTable & syms,
                const Target &     target,
                uint               pageSize,
                uint               pageIdx )
+{
+  return this->scrapeRange( syms,
+                            target,
+                            static_cast<size_t>( pageIdx ) * pageSize,
+                            pageSize );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+bool
+PkgDb::scrapeRange( nix::SymbolTable & syms,
+                    const Target &     target,
+                    size_t             startIdx,
+                    size_t             count )
 {
   const auto & [prefix, cursor, parentId] = target;
 
   /* If it has previously been scraped then bail out. */
   if ( this->completedAttrSet( parentId ) ) { return true; }
 
+  if ( ! this->quarantined.has_value() )
+    {
+      this->quarantined = std::set<std::pair<row_id, std::string>>();
+      sqlite3pp::query qry( this->db,
+                            "SELECT parentId, attrName FROM Quarantine" );
+      for ( const auto & row : qry )
+        {
+          this->quarantined->emplace( row.get<long long>( 0 ),
+                                      row.get<std::string>( 1 ) );
+        }
+    }
+
   /* Store the subtree we are in for later use in various logic */
   auto subtree = Subtree( prefix.front() );
 
   debugLog( nix::fmt( "evaluating package set '%s'",
                       concatStringsSep( ".", prefix ) ) );
 
-  auto allAttribs   = cursor->getAttrs();
-  uint startIdx     = pageIdx * pageSize;
-  uint thisPageSize = startIdx + pageSize < allAttribs.size()
-                        ? pageSize
-                        : allAttribs.size() % pageSize;
-  bool lastPage     = thisPageSize < pageSize;
-  auto page
-    = std::views::counted( allAttribs.begin() + startIdx, thisPageSize );
+  auto   allAttribs   = cursor->getAttrs();
+  size_t thisPageSize = startIdx < allAttribs.size()
+                          ? std::min( count, allAttribs.size() - startIdx )
+                          : 0;
+  bool   lastPage     = allAttribs.size() <= ( startIdx + count );
+  /* Offsetting past the end of `allAttribs' is undefined, so empty pages
+   * start at its end. */
+  auto pageBegin = ( 0 < thisPageSize )
+                     ? allAttribs.begin() + static_cast<long>( startIdx )
+                     : allAttribs.end();
+  auto page = std::views::counted( pageBegin,
+                                   static_cast<long>( thisPageSize ) );
   Todos todo;
 
   for ( nix::Symbol & aname : page )
@@ -108,6 +108,19 @@ from_json( const nlohmann::json & jfrom, RawPackage & pkg )
                 flox::extract_json_errmsg( e ) );
             }
         }
+      else if ( key == "licenses" )
+        {
+          try
+            {
+              value.get_to( pkg.licenses );
+            }
+          catch ( nlohmann::json::exception & e )
+            {
+              throw flox::pkgdb::PkgDbException(
+                "couldn't interpret field 'licenses'",
+                flox::extract_json_errmsg( e ) );
+            }
+        }
       else if ( key == "outputs" )
         {
           try
@@ -196,6 +209,7 @@ to_json( nlohmann::json & jto, const flox::RawPackage & pkg )
           { "version", pkg.version },
           { "semver", pkg.semver },
           { "license", pkg.license },
+          { "licenses", pkg.licenses },
           { "outputs", pkg.outputs },
           { "outputsToInstall", pkg.outputsToInstall },
           { "broken", pkg.broken },
@@ -124,6 +124,26 @@ from_json( const nlohmann::json & jfrom, RegistryInput & rip )
                 flox::extract_json_errmsg( err ) );
             }
         }
+      else if ( key == "scrape" )
+        {
+          if ( value.is_null() ) { continue; }
+          try
+            {
+              rip.scrape = value.get<pkgdb::ScrapeRulesRaw>();
+            }
+          catch ( nlohmann::json::exception & err )
+            {
+              throw InvalidRegistryException(
+                "couldn't interpret registry input field 'scrape'",
+                flox::extract_json_errmsg( err ) );
+            }
+          catch ( const FloxException & err )
+            {
+              throw InvalidRegistryException(
+                "couldn't interpret registry input field 'scrape'",
+                err.what() );
+            }
+        }
       else { throw InvalidRegistryException( "unknown field '" + key + "'" ); }
     }
 }
@@ -140,6 +160,8 @@ to_json( nlohmann::json & jto, const RegistryInput & rip )
     {
       jto.emplace( "from", nix::fetchers::attrsToJSON( rip.from->toAttrs() ) );
     }
+  /* Only emitted when set so that existing lockfiles are unchanged. */
+  if ( rip.scrape.has_value() ) { jto.emplace( "scrape", *rip.scrape ); }
 }
 
 /* -------------------------------------------------------------------------- */
@@ -317,7 +339,10 @@ FloxFlakeInput::getSubtrees()
 RegistryInput
 FloxFlakeInput::getLockedInput()
 {
-  return { this->getSubtrees(), this->getFlake()->lockedFlake.flake.lockedRef };
+  RegistryInput locked( this->getSubtrees(),
+                        this->getFlake()->lockedFlake.flake.lockedRef );
+  locked.scrape = this->scrape;
+  return locked;
 }
 
 
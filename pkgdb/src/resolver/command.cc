@@ -7,9 +7,20 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
+#include <thread>
+
+#include <nix/eval-cache.hh>
+#include <nix/eval.hh>
+#include <nix/store-api.hh>
 #include <nlohmann/json.hpp>
 
+#include "flox/buildenv/realise.hh"
+#include "flox/core/command.hh"
+#include "flox/pkgdb/usage.hh"
 #include "flox/resolver/command.hh"
+#include "flox/resolver/lockfile-diff.hh"
+#include "flox/resolver/lockfile-verify.hh"
 
 
 /* -------------------------------------------------------------------------- */
@@ -26,21 +37,91 @@ LockCommand::LockCommand() : parser( "lock" )
   this->addGlobalManifestFileOption( this->parser );
   this->addLockfileOption( this->parser );
   this->addGARegistryOption( this->parser );
+
+  this->parser.add_argument( "--native" )
+    .help( "lock only the current system, leaving others pending" )
+    .nargs( 0 )
+    .action( [&]( const std::string & ) { this->mode = LM_NATIVE; } );
+
+  this->parser.add_argument( "--complete" )
+    .help( "lock systems left pending by `--native'" )
+    .nargs( 0 )
+    .action( [&]( const std::string & ) { this->complete = true; } );
+
+  command::addOutputFormatArg( this->parser );
+
   /* TODO: make manifest file optional and support locking global manifest. */
   this->addManifestFileArg( this->parser, true );
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+void
+LockCommand::setFiles(
+  const std::filesystem::path &                manifestPath,
+  const std::optional<std::filesystem::path> & lockfilePath )
+{
+  this->setManifestRaw( nix::absPath( manifestPath ) );
+  if ( lockfilePath.has_value() )
+    {
+      this->setLockfileRaw( nix::absPath( *lockfilePath ) );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+nlohmann::json
+LockCommand::lock()
+{
+  if ( this->complete )
+    {
+      if ( this->mode == LM_NATIVE )
+        {
+          throw command::InvalidArgException(
+            "`--native' and `--complete' may not be used together" );
+        }
+      if ( ! this->getLockfileRaw().has_value() )
+        {
+          throw command::InvalidArgException(
+            "`--complete' requires an existing lockfile" );
+        }
+    }
+  Lockfile lockfile = this->getEnvironment().createLockfile( this->mode );
+
+  /* Count packages newly locked by this environment to rank searches.
+   * Usage is only a hint, so failing to record it doesn't fail locking. */
+  if ( std::filesystem::path usagePath = pkgdb::getUsageDbPath();
+       ! usagePath.empty() )
+    {
+      try
+        {
+          auto usages = lockfile.getNewUsage( this->getLockfileRaw() );
+          if ( ! usages.empty() )
+            {
+              pkgdb::UsageDb( usagePath, true ).record( usages );
+            }
+        }
+      catch ( const std::exception & err )
+        {
+          debugLog( std::string( "failed to record package usage: " )
+                    + err.what() );
+        }
+    }
+
+  // TODO: `RegistryRaw' should drop empty fields.
+  return lockfile.getLockfileRaw();
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 int
 LockCommand::run()
 {
-  // TODO: `RegistryRaw' should drop empty fields.
-  nlohmann::json lockfile
-    = this->getEnvironment().createLockfile().getLockfileRaw();
   /* Print that bad boii */
-  std::cout << lockfile.dump() << '\n';
+  command::writeRecord( this->lock() );
   return EXIT_SUCCESS;
 }
 
@@ -306,37 +387,16 @@ UpgradeCommand::run()
   LockfileRaw newLockfile = environment.createLockfile().getLockfileRaw();
 
   /* Compare old and new lockfile to generate confirmation message. */
-  std::optional<LockfileRaw> oldLockfile;
-  if ( auto lockfile = environment.getOldLockfile(); lockfile.has_value() )
-    {
-      oldLockfile = lockfile->getLockfileRaw();
-    }
   std::vector<std::string> upgraded;
-  for ( const auto & [system, systemPackages] : newLockfile.packages )
+  if ( const auto & lockfile = environment.getOldLockfile();
+       lockfile.has_value() )
     {
-      for ( const auto & [iid, descriptor] : systemPackages )
+      for ( const auto & change :
+            diffLockfiles( lockfile->getLockfileRaw(), newLockfile ) )
         {
-          if ( oldLockfile.has_value() )
+          if ( change.type == PC_CHANGED )
             {
-              /* system is in oldLockfile */
-              if ( const auto & systemPackagesIterator
-                   = oldLockfile->packages.find( system );
-                   systemPackagesIterator != oldLockfile->packages.end() )
-                {
-                  /* iid is in oldLockfile */
-                  if ( const auto & maybeOldDescriptor
-                       = systemPackagesIterator->second.find( iid );
-                       maybeOldDescriptor
-                       != systemPackagesIterator->second.end() )
-                    {
-                      const auto & [_, oldDescriptor] = *maybeOldDescriptor;
-                      if ( descriptor != oldDescriptor )
-                        {
-                          upgraded.emplace_back( iid );
-                        }
-                      /* else package unchanged */
-                    }
-                }
+              upgraded.emplace_back( change.installId );
             }
         }
     }  // we don't currently print installs or uninstalls
@@ -388,7 +448,7 @@ RegistryCommand::run()
       registries["global-locked"] = nullptr;
     }
 
-  if ( auto maybeLock = this->getEnvironment().getOldLockfile();
+  if ( const auto & maybeLock = this->getEnvironment().getOldLockfile();
        maybeLock.has_value() )
     {
       registries["lockfile"]          = maybeLock->getRegistryRaw();
@@ -461,14 +521,249 @@ CheckCommand::getLockfile()
 int
 CheckCommand::run()
 {
-  auto warnings = this->getLockfile().checkPackages(
-    this->system.value_or( nix::nativeSystem ) );
+  Lockfile lockfile = this->getLockfile();
+  System   system   = this->system.value_or( nix::nativeSystem );
+  auto     warnings = lockfile.checkPackages( system );
+
+  if ( auto advisories = pkgdb::AdvisoryDb::openDefault();
+       advisories != nullptr )
+    {
+      auto matched = lockfile.checkAdvisories( *advisories, system );
+      warnings.insert( warnings.end(), matched.begin(), matched.end() );
+    }
 
   std::cout << nlohmann::json( warnings ).dump() << std::endl;
 
   return EXIT_SUCCESS;
 }
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Read a lockfile for `pkgdb lockfile` subcommands. */
+[[nodiscard]] static LockfileRaw
+readLockfileRaw( const std::filesystem::path & path )
+{
+  if ( ! std::filesystem::exists( path ) )
+    {
+      throw InvalidLockfileException( "lockfile '" + path.string()
+                                      + "' does not exist." );
+    }
+  return readAndCoerceJSON( path );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Evaluate the store paths of a locked package's outputs, and
+ *        optionally the size of their closure in the local store.
+ */
+[[nodiscard]] static PackageStoreInfo
+getPackageStoreInfo( nix::ref<nix::EvalState> & state,
+                     const InstallID &          iid,
+                     const LockedPackageRaw &   pkg,
+                     bool                       closureSize )
+{
+  PackageStoreInfo info;
+  auto             cursor
+    = buildenv::evalCacheCursorForInput( state, pkg.input, pkg.attrPath );
+  for ( auto & [output, path] :
+        buildenv::outpathsForPackageOutputs( state, iid, cursor ) )
+    {
+      info.outputs.emplace( output, std::move( path ) );
+    }
+  if ( ! closureSize ) { return info; }
+
+  /* Only measure closures which are fully present in the local store. */
+  nix::StorePathSet paths;
+  for ( const auto & [_, path] : info.outputs )
+    {
+      auto storePath = state->store->parseStorePath( path );
+      if ( ! state->store->isValidPath( storePath ) ) { return info; }
+      paths.insert( std::move( storePath ) );
+    }
+  nix::StorePathSet closure;
+  state->store->computeFSClosure( paths, closure );
+  uint64_t size = 0;
+  for ( const auto & path : closure )
+    {
+      size += state->store->queryPathInfo( path )->narSize;
+    }
+  info.closureSize = size;
+  return info;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+LockfileDiffCommand::LockfileDiffCommand() : parser( "diff" )
+{
+  this->parser.add_description(
+    "Show changes to locked packages between two lockfiles as newline "
+    "delimited JSON objects" );
+
+  this->parser.add_argument( "old-lockfile" )
+    .help( "path to old lockfile" )
+    .required()
+    .metavar( "OLD" )
+    .action( [&]( const std::string & path )
+             { this->oldLockfilePath = nix::absPath( path ); } );
+
+  this->parser.add_argument( "new-lockfile" )
+    .help( "path to new lockfile" )
+    .required()
+    .metavar( "NEW" )
+    .action( [&]( const std::string & path )
+             { this->newLockfilePath = nix::absPath( path ); } );
+
+  this->parser.add_argument( "--store-paths" )
+    .help( "evaluate store paths of packages whose input or attribute path "
+           "changed" )
+    .nargs( 0 )
+    .action( [&]( const std::string & ) { this->storePaths = true; } );
+
+  this->parser.add_argument( "--closure-size" )
+    .help( "measure closure sizes of packages in the local store, "
+           "implies `--store-paths'" )
+    .nargs( 0 )
+    .action(
+      [&]( const std::string & )
+      {
+        this->storePaths  = true;
+        this->closureSize = true;
+      } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+LockfileDiffCommand::run()
+{
+  LockfileRaw oldLockfile = readLockfileRaw( this->oldLockfilePath );
+  LockfileRaw newLockfile = readLockfileRaw( this->newLockfilePath );
+
+  for ( auto & change : diffLockfiles( oldLockfile, newLockfile ) )
+    {
+      /* Packages with the same input and attribute path must have the same
+       * store paths, so we only evaluate the others. */
+      if ( this->storePaths && change.mayChangeStorePaths() )
+        {
+          auto state = this->getState();
+          try
+            {
+              if ( change.oldPackage.has_value() )
+                {
+                  change.oldStoreInfo
+                    = getPackageStoreInfo( state,
+                                           change.installId,
+                                           *change.oldPackage,
+                                           this->closureSize );
+                }
+              if ( change.newPackage.has_value() )
+                {
+                  change.newStoreInfo
+                    = getPackageStoreInfo( state,
+                                           change.installId,
+                                           *change.newPackage,
+                                           this->closureSize );
+                }
+            }
+          catch ( const std::exception & err )
+            {
+              nix::warn( "failed to evaluate store paths for '%s' on '%s': %s",
+                         change.installId,
+                         change.system,
+                         err.what() );
+            }
+        }
+      std::cout << nlohmann::json( change ).dump() << '\n';
+    }
+
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+LockfileVerifyCommand::LockfileVerifyCommand()
+  : jobs( std::max( 1U, std::thread::hardware_concurrency() ) )
+  , parser( "verify" )
+{
+  this->parser.add_description(
+    "Re-evaluate locked packages and report those which no longer match "
+    "their locked inputs as newline delimited JSON objects" );
+
+  this->parser.add_argument( "lockfile" )
+    .help( "path to lockfile" )
+    .required()
+    .metavar( "LOCKFILE" )
+    .action( [&]( const std::string & path )
+             { this->lockfilePath = nix::absPath( path ); } );
+
+  this->parser.add_argument( "-j", "--jobs" )
+    .help( "maximum number of evaluators to run at once, "
+           "defaults to the number of CPUs" )
+    .metavar( "N" )
+    .nargs( 1 )
+    .action( [&]( const std::string & jobs )
+             { this->jobs = std::stoul( jobs ); } );
+
+  this->parser.add_argument( "--all" )
+    .help( "also report packages which match their locked inputs" )
+    .nargs( 0 )
+    .action( [&]( const std::string & ) { this->all = true; } );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+LockfileVerifyCommand::run()
+{
+  LockfileRaw lockfile = readLockfileRaw( this->lockfilePath );
+
+  bool valid = true;
+  for ( const auto & verification : verifyLockfile( lockfile, this->jobs ) )
+    {
+      if ( verification.isValid() && ( ! this->all ) ) { continue; }
+      valid = valid && verification.isValid();
+      std::cout << nlohmann::json( verification ).dump() << '\n';
+    }
+
+  return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+LockfileCommand::LockfileCommand() : parser( "lockfile" )
+{
+  this->parser.add_description( "Lockfile subcommands" );
+  this->parser.add_subparser( this->cmdDiff.getParser() );
+  this->parser.add_subparser( this->cmdVerify.getParser() );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+LockfileCommand::run()
+{
+  if ( this->parser.is_subcommand_used( "diff" ) )
+    {
+      return this->cmdDiff.run();
+    }
+  if ( this->parser.is_subcommand_used( "verify" ) )
+    {
+      return this->cmdVerify.run();
+    }
+  std::cerr << this->parser << '\n';
+  throw flox::FloxException( "You must provide a valid 'lockfile' subcommand" );
+  return EXIT_FAILURE;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 ManifestCommand::ManifestCommand() : parser( "manifest" )
@@ -750,6 +750,21 @@ to_json( nlohmann::json & jto, const ManifestDescriptor & descriptor )
   };
 }
 
+
+/* -------------------------------------------------------------------------- */
+
+std::string
+getResolutionFingerprint( const ManifestDescriptor & descriptor )
+{
+  return nlohmann::json::array( { descriptor.name,
+                                  descriptor.pkgPath,
+                                  descriptor.version,
+                                  descriptor.semver,
+                                  descriptor.subtree,
+                                  descriptor.input } )
+    .dump();
+}
+
 }  // namespace flox::resolver
 
 
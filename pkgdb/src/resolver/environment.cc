@@ -8,21 +8,25 @@
  * -------------------------------------------------------------------------- */
 
 #include <algorithm>
+#include <filesystem>
 #include <memory>
 #include <optional>
 #include <ostream>
 #include <string>
 #include <sys/wait.h>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
 #include <nix/flake/flakeref.hh>
+#include <nix/globals.hh>
 #include <nix/logging.hh>
 #include <nix/ref.hh>
 #include <nlohmann/json.hpp>
 
 #include "flox/core/types.hh"
+#include "flox/pkgdb/advisories.hh"
 #include "flox/pkgdb/input.hh"
 #include "flox/pkgdb/pkg-query.hh"
 #include "flox/pkgdb/read.hh"
@@ -47,6 +51,38 @@ class Store;
 
 namespace flox::resolver {
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Get the pinned form of @a input from the first included lockfile
+ *        whose manifest declares the same input.
+ */
+[[nodiscard]] static std::optional<RegistryInput>
+getIncludedPin( const std::vector<Lockfile> & includedLockfiles,
+                const std::string &           name,
+                const RegistryInput &         input )
+{
+  nlohmann::json unlocked = input;
+  for ( const auto & included : includedLockfiles )
+    {
+      const auto & registry = included.getManifestRaw().registry;
+      if ( ! registry.has_value() ) { continue; }
+      if ( auto declared = registry->inputs.find( name );
+           ( declared == registry->inputs.end() )
+           || ( nlohmann::json( declared->second ) != unlocked ) )
+        {
+          continue;
+        }
+      const auto & pins = included.getRegistryRaw().inputs;
+      if ( auto pinned = pins.find( name ); pinned != pins.end() )
+        {
+          return pinned->second;
+        }
+    }
+  return std::nullopt;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 RegistryRaw &
@@ -67,49 +103,58 @@ Environment::getCombinedRegistryRaw()
 
       /* If there's a lockfile, use pinned inputs.
        * However, do not preserve any inputs that were removed from
-       * the manifest. */
-      std::optional<nix::ref<nix::Store>>  store;
+       * the manifest.
+       * Inputs missing from the lock are pinned as an included environment
+       * pinned them if it declares them identically, and are locked
+       * otherwise. */
+      RegistryRaw lockedRegistry;
+      if ( const auto & maybeLock = this->getOldLockfile();
+           maybeLock.has_value() )
+        {
+          lockedRegistry = maybeLock->getRegistryRaw();
+        }
       std::optional<FloxFlakeInputFactory> factory;
-      if ( auto maybeLock = this->getOldLockfile(); maybeLock.has_value() )
+      for ( auto & [name, input] : this->combinedRegistryRaw->inputs )
         {
-          auto lockedRegistry = maybeLock->getRegistryRaw();
-          for ( auto & [name, input] : this->combinedRegistryRaw->inputs )
+          /* Use the pinned input from the lock if it exists. */
+          if ( auto locked = lockedRegistry.inputs.find( name );
+               locked != lockedRegistry.inputs.end() )
             {
-              /* Use the pinned input from the lock if it exists. */
-              if ( auto locked = lockedRegistry.inputs.find( name );
-                   locked != lockedRegistry.inputs.end() )
-                {
-                  input = locked->second;
-                }
-              /* Lock the input if it's not in the lock. */
-              else
+              input = locked->second;
+            }
+          else if ( auto pinned
+                    = getIncludedPin( this->includedLockfiles, name, input );
+                    pinned.has_value() )
+            {
+              input = std::move( *pinned );
+            }
+          /* Lock the input if it's not in the lock, reusing the session's
+           * lock of it if there is one. */
+          else
+            {
+              std::string unlocked = nlohmann::json( input ).dump();
+              if ( this->inputCache != nullptr )
                 {
-                  if ( ! store.has_value() )
-                    {
-                      store = NixStoreMixin().getStore();
-                    }
-                  if ( ! factory.has_value() )
+                  if ( auto cached = this->inputCache->locked.find( unlocked );
+                       cached != this->inputCache->locked.end() )
                     {
-                      factory = FloxFlakeInputFactory( *store );
+                      input = cached->second;
+                      continue;
                     }
-                  auto flakeInput = factory->mkInput( name, input );
-                  input           = flakeInput->getLockedInput();
+                }
+              if ( ! factory.has_value() )
+                {
+                  factory = FloxFlakeInputFactory( this->getStore() );
+                }
+              auto flakeInput = factory->mkInput( name, input );
+              input           = flakeInput->getLockedInput();
+              if ( this->inputCache != nullptr )
+                {
+                  this->inputCache->locked.emplace( std::move( unlocked ),
+                                                    input );
                 }
             }
         }
-      /* Lock all inputs since we don't have a lock. */
-      else
-        {
-          store   = NixStoreMixin().getStore();
-          factory = FloxFlakeInputFactory( *store );
-          {
-            for ( auto & [name, input] : this->combinedRegistryRaw->inputs )
-              {
-                auto flakeInput = factory->mkInput( name, input );
-                input           = flakeInput->getLockedInput();
-              }
-          }
-        }
     }
   return *this->combinedRegistryRaw;
 }
@@ -122,15 +167,22 @@ Environment::getPkgDbRegistry()
 {
   if ( this->dbs == nullptr )
     {
-      nix::ref<nix::Store> store   = this->getStore();
-      auto                 factory = pkgdb::PkgDbInputFactory( store );
+      nix::ref<nix::Store>     store = this->getStore();
+      pkgdb::PkgDbInputFactory factory( store,
+                                        pkgdb::getPkgDbCachedir(),
+                                        this->inputCache );
       this->dbs = std::make_shared<Registry<pkgdb::PkgDbInputFactory>>(
         this->getCombinedRegistryRaw(),
         factory );
       /* Scrape if needed. */
+      std::vector<System> systems = this->getSystems();
+      if ( this->lockMode == LM_NATIVE )
+        {
+          systems = { nix::settings.thisSystem.get() };
+        }
       for ( auto & [name, input] : *this->dbs )
         {
-          input->scrapeSystems( this->getSystems() );
+          input->scrapeSystems( systems );
         }
     }
   return static_cast<nix::ref<Registry<pkgdb::PkgDbInputFactory>>>( this->dbs );
@@ -188,6 +240,26 @@ systemSkipped( const System &                             system,
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Whether the descriptor of @a iid in @a manifest resolves to the same
+ *        package as its descriptor in @a oldLockfile, comparing the
+ *        fingerprints computed when each was loaded.
+ */
+[[nodiscard]] static bool
+descriptorUnchanged( const EnvironmentManifest & manifest,
+                     const Lockfile &            oldLockfile,
+                     const InstallID &           iid )
+{
+  const std::string * fingerprint = manifest.getDescriptorFingerprint( iid );
+  const std::string * oldFingerprint
+    = oldLockfile.getDescriptorFingerprint( iid );
+  return ( fingerprint != nullptr ) && ( oldFingerprint != nullptr )
+         && ( *fingerprint == *oldFingerprint );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 bool
@@ -200,12 +272,11 @@ Environment::groupIsLocked( const GroupName &          name,
    * locked again. */
   if ( upgradingGroup( name ) ) { return false; }
 
-  auto packages = oldLockfile.getLockfileRaw().packages;
-  if ( ! packages.contains( system ) ) { return false; }
-
-  SystemPackages oldSystemPackages = packages.at( system );
+  const SystemPackages * oldSystemPackages
+    = oldLockfile.getSystemPackages( system );
+  if ( oldSystemPackages == nullptr ) { return false; }
 
-  InstallDescriptors oldDescriptors = oldLockfile.getDescriptors();
+  const InstallDescriptors & oldDescriptors = oldLockfile.getDescriptors();
 
   /* Check for upgrades. */
   for ( const auto & [iid, descriptor] : group )
@@ -220,15 +291,10 @@ Environment::groupIsLocked( const GroupName &          name,
           return false;
         }
 
-      auto & [_, oldDescriptor] = *oldDescriptorPair;
+      const auto & [_, oldDescriptor] = *oldDescriptorPair;
 
       /* We ignore `priority' and handle `systems' below. */
-      if ( ( descriptor.name != oldDescriptor.name )
-           || ( descriptor.pkgPath != oldDescriptor.pkgPath )
-           || ( descriptor.version != oldDescriptor.version )
-           || ( descriptor.semver != oldDescriptor.semver )
-           || ( descriptor.subtree != oldDescriptor.subtree )
-           || ( descriptor.input != oldDescriptor.input )
+      if ( ( ! descriptorUnchanged( this->getManifest(), oldLockfile, iid ) )
            || ( descriptor.group != oldDescriptor.group )
            || ( descriptor.optional != oldDescriptor.optional ) )
         {
@@ -243,8 +309,7 @@ Environment::groupIsLocked( const GroupName &          name,
         }
 
       /* Check if the descriptor exists in the lockfile lock */
-      if ( auto oldLockedPackagePair = oldSystemPackages.find( iid );
-           oldLockedPackagePair == oldSystemPackages.end() )
+      if ( ! oldSystemPackages->contains( iid ) )
         {
           /* If the descriptor doesn't even exist in the lockfile lock, it needs
            * to be locked again.
@@ -267,44 +332,148 @@ Environment::groupIsLocked( const GroupName &          name,
 
 /* -------------------------------------------------------------------------- */
 
-Groups
-Environment::getUnlockedGroups( const System & system )
+const std::unordered_set<InstallID> &
+Environment::getLicenseViolations( const Lockfile & lockfile,
+                                   const System &   system )
 {
-  auto   lockfile           = this->getOldLockfile();
-  Groups groupedDescriptors = this->getManifest().getGroupedDescriptors();
-  if ( ! lockfile.has_value() ) { return groupedDescriptors; }
+  auto key = std::make_pair( &lockfile, system );
+  if ( auto cached = this->licenseViolations.find( key );
+       cached != this->licenseViolations.end() )
+    {
+      return cached->second;
+    }
+  auto & violations = this->licenseViolations[key];
 
-  for ( auto groupIterator = groupedDescriptors.begin();
-        groupIterator != groupedDescriptors.end(); )
+  const pkgdb::PkgQueryArgs & args = this->getCombinedBaseQueryArgs();
+  if ( ( ! args.licenses.has_value() || args.licenses->empty() )
+       && ( ! args.deniedLicenses.has_value()
+            || args.deniedLicenses->empty() ) )
     {
-      const auto & [name, group] = *groupIterator;
-      if ( groupIsLocked( name, group, *lockfile, system ) )
+      return violations;
+    }
+
+  const auto & packages       = lockfile.getLockfileRaw().packages;
+  auto         systemPackages = packages.find( system );
+  if ( systemPackages == packages.end() ) { return violations; }
+
+  /* Group locked packages by input so each database is queried once. */
+  using LockedMembers
+    = std::vector<std::pair<InstallID, const LockedPackageRaw *>>;
+  std::unordered_map<std::string, LockedMembers> byInput;
+  for ( const auto & [iid, pkg] : systemPackages->second )
+    {
+      if ( ! pkg.has_value() ) { continue; }
+      byInput[pkg->input.fingerprint.to_string( nix::Base16, false )]
+        .emplace_back( iid, &( *pkg ) );
+    }
+
+  for ( const auto & [_, locked] : byInput )
+    {
+      /* Inputs with scrape rules use databases suffixed with the hash of
+       * their rules, so each package is looked up in every database of its
+       * fingerprint until one holds it. */
+      const auto & fingerprint = locked.front().second->input.fingerprint;
+      LockedMembers remaining  = locked;
+      for ( const auto & dbPath : pkgdb::findPkgDbs( fingerprint ) )
         {
-          groupIterator = groupedDescriptors.erase( groupIterator );
+          if ( remaining.empty() ) { break; }
+          pkgdb::PkgDbReadOnly dbRO( fingerprint, dbPath.string() );
+
+          std::unordered_map<pkgdb::row_id, InstallID> iids;
+          std::vector<pkgdb::row_id>                   rows;
+          LockedMembers                                missing;
+          for ( const auto & [iid, pkg] : remaining )
+            {
+              try
+                {
+                  pkgdb::row_id row = dbRO.getPackageId( pkg->attrPath );
+                  iids.emplace( row, iid );
+                  rows.emplace_back( row );
+                }
+              catch ( const pkgdb::PkgDbException & )
+                {
+                  /* The package's prefix hasn't been scraped, or rules
+                   * excluded it from this database. */
+                  missing.emplace_back( iid, pkg );
+                }
+            }
+          remaining = std::move( missing );
+
+          for ( const auto & row :
+                dbRO.getLicenseViolations( rows,
+                                           args.licenses,
+                                           args.deniedLicenses ) )
+            {
+              violations.emplace( iids.at( row ) );
+            }
         }
-      else { ++groupIterator; }
     }
 
-  return groupedDescriptors;
+  return violations;
 }
 
 
 /* -------------------------------------------------------------------------- */
 
-Groups
-Environment::getLockedGroups( const System & system )
+bool
+Environment::groupIsReusable( const GroupName &          name,
+                              const InstallDescriptors & group,
+                              const Lockfile &           oldLockfile,
+                              const System &             system )
 {
-  auto lockfile = this->getOldLockfile();
-  if ( ! lockfile.has_value() ) { return Groups {}; }
+  if ( ! this->groupIsLocked( name, group, oldLockfile, system ) )
+    {
+      return false;
+    }
+  const auto & violations = this->getLicenseViolations( oldLockfile, system );
+  return std::none_of( group.begin(),
+                       group.end(),
+                       [&]( const auto & member )
+                       { return violations.contains( member.first ); } );
+}
 
+
+/* -------------------------------------------------------------------------- */
+
+const Lockfile *
+Environment::getGroupLockfile( const GroupName &          name,
+                               const InstallDescriptors & group,
+                               const System &             system )
+{
+  if ( this->oldLockfile.has_value()
+       && this->groupIsReusable( name, group, *this->oldLockfile, system ) )
+    {
+      return &( *this->oldLockfile );
+    }
+  for ( const auto & included : this->includedLockfiles )
+    {
+      if ( this->groupIsReusable( name, group, included, system ) )
+        {
+          debugLog( "adopting locks of included environment for group: "
+                    + name );
+          return &included;
+        }
+    }
+  return nullptr;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+Groups
+Environment::getUnlockedGroups( const System & system )
+{
   Groups groupedDescriptors = this->getManifest().getGroupedDescriptors();
+  if ( ( ! this->oldLockfile.has_value() ) && this->includedLockfiles.empty() )
+    {
+      return groupedDescriptors;
+    }
 
-  /* Remove all groups that are *not* already locked. */
   for ( auto groupIterator = groupedDescriptors.begin();
         groupIterator != groupedDescriptors.end(); )
     {
       const auto & [name, group] = *groupIterator;
-      if ( ! groupIsLocked( name, group, *lockfile, system ) )
+      if ( this->getGroupLockfile( name, group, system ) != nullptr )
         {
           groupIterator = groupedDescriptors.erase( groupIterator );
         }
@@ -363,32 +532,16 @@ Environment::getCombinedBaseQueryArgs()
 
 /* -------------------------------------------------------------------------- */
 
-std::optional<pkgdb::row_id>
-Environment::tryResolveDescriptorIn( const ManifestDescriptor & descriptor,
-                                     const pkgdb::PkgDbInput &  input,
-                                     const System &             system )
+/**
+ * @brief Create query parameters for a single descriptor in a
+ *        group candidate.
+ */
+[[nodiscard]] static pkgdb::PkgQueryArgs
+mkDescriptorQueryArgs( const GroupCandidate &     candidate,
+                       const ManifestDescriptor & descriptor,
+                       const System &             system )
 {
-  std::string dPath;
-  if ( descriptor.pkgPath.has_value() )
-    {
-      dPath = concatStringsSep( ".", *descriptor.pkgPath );
-    }
-  std::string dName;
-  if ( descriptor.name.has_value() ) { dName = *descriptor.name; }
-  debugLog( "resolving descriptor: path='" + dPath + "', name='" + dName
-            + "'" );
-  /* Skip unrequested systems. */
-  if ( descriptor.systems.has_value()
-       && ( std::find( descriptor.systems->begin(),
-                       descriptor.systems->end(),
-                       system )
-            == descriptor.systems->end() ) )
-    {
-      return std::nullopt;
-    }
-
-  pkgdb::PkgQueryArgs args = this->getCombinedBaseQueryArgs();
-  input.fillPkgQueryArgs( args );
+  pkgdb::PkgQueryArgs args = candidate.args;
   descriptor.fillPkgQueryArgs( args );
   /* Limit results to the target system. */
   args.systems = std::vector<System> { system };
@@ -405,14 +558,152 @@ Environment::tryResolveDescriptorIn( const ManifestDescriptor & descriptor,
   args.allowUnfree = true;
   args.allowBroken = true;
 
-  pkgdb::PkgQuery query( args );
-  auto            rows = query.execute( input.getDbReadOnly()->db );
-  if ( rows.empty() )
+  return args;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+GroupCandidate
+Environment::mkGroupCandidate( const pkgdb::PkgDbInput &             input,
+                               std::shared_ptr<pkgdb::PkgDbReadOnly> dbRO )
+{
+  if ( dbRO == nullptr ) { dbRO = input.getDbReadOnly().get_ptr(); }
+  pkgdb::PkgQueryArgs args = this->getCombinedBaseQueryArgs();
+  input.fillPkgQueryArgs( args );
+  LockedInputRaw lockedInput( *dbRO );
+  return GroupCandidate { std::move( lockedInput ),
+                          std::move( dbRO ),
+                          std::move( args ) };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Get the `lastModified` time of a database's flake, or 0. */
+[[nodiscard]] static uint64_t
+getLastModified( const pkgdb::PkgDbReadOnly & dbRO )
+{
+  if ( auto lastModified = dbRO.lockedRef.attrs.find( "lastModified" );
+       ( lastModified != dbRO.lockedRef.attrs.end() )
+       && lastModified->is_number_unsigned() )
     {
-      debugLog( "package not found in input" );
-      return std::nullopt;
+      return lastModified->get<uint64_t>();
+    }
+  return 0;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<pkgdb::Fingerprint>
+Environment::getKnownFingerprints()
+{
+  std::vector<pkgdb::Fingerprint> fingerprints;
+  auto add = [&]( const pkgdb::Fingerprint & fingerprint )
+  {
+    if ( std::find( fingerprints.begin(), fingerprints.end(), fingerprint )
+         == fingerprints.end() )
+      {
+        fingerprints.emplace_back( fingerprint );
+      }
+  };
+
+  for ( const auto & [_, input] : *this->getPkgDbRegistry() )
+    {
+      add( input->getDbReadOnly()->fingerprint );
+    }
+
+  auto addLocked = [&]( const Lockfile & lockfile )
+  {
+    for ( const auto & [system, pkgs] : lockfile.getLockfileRaw().packages )
+      {
+        for ( const auto & [iid, pkg] : pkgs )
+          {
+            if ( pkg.has_value() ) { add( pkg->input.fingerprint ); }
+          }
+      }
+  };
+  if ( const auto & oldLockfile = this->getOldLockfile();
+       oldLockfile.has_value() )
+    {
+      addLocked( *oldLockfile );
     }
-  return rows.front();
+  for ( const auto & included : this->includedLockfiles )
+    {
+      addLocked( included );
+    }
+  return fingerprints;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+const std::vector<std::shared_ptr<pkgdb::PkgDbReadOnly>> &
+Environment::getRevisionDbs( const std::string & inputName )
+{
+  if ( ! this->revisionDbs.has_value() )
+    {
+      this->revisionDbs = std::unordered_map<
+        std::string,
+        std::vector<std::shared_ptr<pkgdb::PkgDbReadOnly>>> {};
+      const auto & revisions = this->getCombinedOptions().groupRevisions;
+      if ( revisions.has_value() )
+        {
+          auto fingerprints = this->getKnownFingerprints();
+          for ( const auto & [name, refs] : *revisions )
+            {
+              auto & dbs = ( *this->revisionDbs )[name];
+              for ( const auto & ref : refs )
+                {
+                  for ( const auto & path :
+                        pkgdb::findPkgDbs( parseFlakeRef( ref ),
+                                           fingerprints ) )
+                    {
+                      dbs.emplace_back( std::make_shared<pkgdb::PkgDbReadOnly>(
+                        path.string() ) );
+                    }
+                }
+              if ( dbs.empty() )
+                {
+                  nix::logger->log(
+                    nix::lvlTalkative,
+                    nix::fmt( "no cached databases found for revisions of "
+                              "input '%s'",
+                              name ) );
+                }
+              /* Try the newest revisions first. */
+              std::stable_sort( dbs.begin(),
+                                dbs.end(),
+                                []( const auto & lhs, const auto & rhs )
+                                {
+                                  return getLastModified( *rhs )
+                                         < getLastModified( *lhs );
+                                } );
+            }
+        }
+    }
+
+  static const std::vector<std::shared_ptr<pkgdb::PkgDbReadOnly>> none;
+  if ( auto dbs = this->revisionDbs->find( inputName );
+       dbs != this->revisionDbs->end() )
+    {
+      return dbs->second;
+    }
+  return none;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+pkgdb::AdvisoryDb *
+Environment::getAdvisories()
+{
+  if ( ! this->advisories.has_value() )
+    {
+      this->advisories = pkgdb::AdvisoryDb::openDefault();
+    }
+  return this->advisories->get();
 }
 
 
@@ -446,134 +737,62 @@ Environment::getGroupInput( const InstallDescriptors & group,
                             const Lockfile &           oldLockfile,
                             const System &             system ) const
 {
-  auto packages = oldLockfile.getLockfileRaw().packages;
-  if ( ! packages.contains( system ) ) { return std::nullopt; }
-  SystemPackages oldSystemPackages = packages.at( system );
+  if ( oldLockfile.getSystemPackages( system ) == nullptr )
+    {
+      return std::nullopt;
+    }
 
-  InstallDescriptors oldDescriptors = oldLockfile.getDescriptors();
+  const InstallDescriptors & oldDescriptors = oldLockfile.getDescriptors();
 
   std::optional<LockedInputRaw> wrongGroupInput;
   /* We could look for packages where just the _iid_ has changed, but for now
    * just use _iid_. */
   for ( const auto & [iid, descriptor] : group )
     {
-      if ( auto itPackage = oldSystemPackages.find( iid );
-           itPackage != oldSystemPackages.end() )
-        {
-          auto & [_, maybeLockedPackage] = *itPackage;
-          if ( maybeLockedPackage.has_value() )
-            {
-              if ( auto oldDescriptorPair = oldDescriptors.find( iid );
-                   oldDescriptorPair != oldDescriptors.end() )
-                {
-                  auto & [_, oldDescriptor] = *oldDescriptorPair;
-                  /* At this point we know the same _iid_ is both locked in the
-                   * old lockfile and present in the new manifest.
-                   *
-                   * Don't use a locked input if the package has changed.
-                   * The fields handled below control what the package actually
-                   * *is* while:
-                   * - `optional' and `systems' control how we behave if
-                   *   resolution fails, but they don't change the package.
-                   * - `priority' is a setting for `mkEnv' and is passed through
-                   *   without effecting resolution.
-                   * - `group' is handled below. */
-                  if ( ( descriptor.name == oldDescriptor.name )
-                       && ( descriptor.pkgPath == oldDescriptor.pkgPath )
-                       && ( descriptor.version == oldDescriptor.version )
-                       && ( descriptor.semver == oldDescriptor.semver )
-                       && ( descriptor.subtree == oldDescriptor.subtree )
-                       && ( descriptor.input == oldDescriptor.input ) )
-                    {
-                      if ( descriptor.group == oldDescriptor.group )
-                        {
-                          // TODO: check that input is still present in a
-                          // registry somewhere?
-                          return maybeLockedPackage->input;
-                        }
-
-                      /* The group has changed but the package hasn't, so we'll
-                       * return this input below if we don't ever find a package
-                       * with the correct group.
-                       * If packages have come from multiple different wrong
-                       * groups, just return the first one we encounter.
-                       * We could come up with a better heuristic like most
-                       * packages or newest, or we could try resolving in all
-                       * of them.
-                       * For now, don't get too fancy. */
-                      if ( ! wrongGroupInput.has_value() )
-                        {
-                          wrongGroupInput = maybeLockedPackage->input;
-                        }
-                    }
-                }
-            }
-        }
-    }
-  // TODO: check that input is still present in a registry somewhere?
-  return wrongGroupInput;
-}
-
-
-/* -------------------------------------------------------------------------- */
-
-std::variant<InstallID, SystemPackages>
-Environment::tryResolveGroupIn( const InstallDescriptors & group,
-                                const pkgdb::PkgDbInput &  input,
-                                const System &             system )
-{
-  std::unordered_map<InstallID, std::optional<pkgdb::row_id>> pkgRows;
+      const LockedPackageRaw * lockedPackage
+        = oldLockfile.getLockedPackage( system, iid );
+      if ( lockedPackage == nullptr ) { continue; }
 
-  std::string inputName;
-  if ( auto name = input.getName(); name.has_value() ) { inputName = *name; }
-  else { inputName = "<none>"; }
-  debugLog( "resolving group in input: " + inputName );
-  /* Loop over each descriptor. */
-  for ( const auto & [iid, descriptor] : group )
-    {
-      debugLog( "resolving install ID '" + iid + "'" );
-      /* Skip unrequested systems. */
-      if ( descriptor.systems.has_value()
-           && ( std::find( descriptor.systems->begin(),
-                           descriptor.systems->end(),
-                           system )
-                == descriptor.systems->end() ) )
+      auto oldDescriptorPair = oldDescriptors.find( iid );
+      if ( oldDescriptorPair == oldDescriptors.end() ) { continue; }
+      const auto & [_, oldDescriptor] = *oldDescriptorPair;
+
+      /* At this point we know the same _iid_ is both locked in the old
+       * lockfile and present in the new manifest.
+       *
+       * Don't use a locked input if the package has changed.
+       * The fields compared by fingerprint control what the package actually
+       * *is* while:
+       * - `optional' and `systems' control how we behave if resolution fails,
+       *   but they don't change the package.
+       * - `priority' is a setting for `mkEnv' and is passed through without
+       *   effecting resolution.
+       * - `group' is handled below. */
+      if ( ! descriptorUnchanged( this->getManifest(), oldLockfile, iid ) )
         {
-          pkgRows.emplace( iid, std::nullopt );
           continue;
         }
 
-      /* Try resolving.
-       * If resolution fails, return the _iid_ of the **first**
-       * failed descriptor. */
-      std::optional<pkgdb::row_id> maybeRow
-        = this->tryResolveDescriptorIn( descriptor, input, system );
-      if ( maybeRow.has_value() || descriptor.optional )
+      if ( descriptor.group == oldDescriptor.group )
         {
-          debugLog( "found match for install ID '" + iid + "'" );
-          pkgRows.emplace( iid, maybeRow );
+          // TODO: check that input is still present in a registry somewhere?
+          return lockedPackage->input;
         }
-      else { return iid; }
-    }
 
-  /* Convert to `LockedPackageRaw's */
-  SystemPackages pkgs;
-  LockedInputRaw lockedInput( input );
-  auto           dbRO = input.getDbReadOnly();
-  for ( const auto & [iid, maybeRow] : pkgRows )
-    {
-      if ( maybeRow.has_value() )
+      /* The group has changed but the package hasn't, so we'll return this
+       * input below if we don't ever find a package with the correct group.
+       * If packages have come from multiple different wrong groups, just
+       * return the first one we encounter.
+       * We could come up with a better heuristic like most packages or newest,
+       * or we could try resolving in all of them.
+       * For now, don't get too fancy. */
+      if ( ! wrongGroupInput.has_value() )
         {
-          pkgs.emplace( iid,
-                        Environment::lockPackage( lockedInput,
-                                                  *dbRO,
-                                                  *maybeRow,
-                                                  group.at( iid ).priority ) );
+          wrongGroupInput = lockedPackage->input;
         }
-      else { pkgs.emplace( iid, std::nullopt ); }
     }
-
-  return pkgs;
+  // TODO: check that input is still present in a registry somewhere?
+  return wrongGroupInput;
 }
 
 
@@ -596,6 +815,97 @@ getGroupName( const InstallDescriptors & group )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+ResolutionResult
+Environment::solveGroup( const InstallDescriptors &          group,
+                         const std::vector<GroupCandidate> & candidates,
+                         const System &                      system,
+                         size_t                              numPinned,
+                         pkgdb::AdvisoryDb *                 advisories )
+{
+  ResolutionFailure failure;
+
+  /* Members which must resolve for a candidate to be chosen.
+   * A member which rules out a candidate is moved to the front so that later
+   * candidates are checked against the most restrictive members first. */
+  std::vector<InstallID> required;
+  for ( const auto & [iid, descriptor] : group )
+    {
+      if ( ( ! systemSkipped( system, descriptor.systems ) )
+           && ( ! descriptor.optional ) )
+        {
+          required.emplace_back( iid );
+        }
+    }
+
+  for ( size_t idx = 0; idx < candidates.size(); ++idx )
+    {
+      const GroupCandidate & candidate = candidates[idx];
+      debugLog( "resolving group in input: " + candidate.input.url );
+
+      /* Rule out the candidate as soon as any required member is missing,
+       * without ranking or hydrating any rows. */
+      auto missing = std::find_if(
+        required.begin(),
+        required.end(),
+        [&]( const InstallID & iid )
+        {
+          pkgdb::PkgQuery query(
+            mkDescriptorQueryArgs( candidate, group.at( iid ), system ) );
+          return ! query.hasResults( candidate.dbRO->db );
+        } );
+      if ( missing != required.end() )
+        {
+          debugLog( "install ID '" + *missing + "' not found in input" );
+          failure.emplace_back( *missing, candidate.input.url );
+          std::rotate( required.begin(), missing, missing + 1 );
+          continue;
+        }
+
+      /* Every required member resolves, so pick the best match for each. */
+      SystemPackages pkgs;
+      for ( const auto & [iid, descriptor] : group )
+        {
+          if ( systemSkipped( system, descriptor.systems ) )
+            {
+              pkgs.emplace( iid, std::nullopt );
+              continue;
+            }
+          pkgdb::PkgQuery query(
+            mkDescriptorQueryArgs( candidate, descriptor, system ) );
+          auto rows = query.execute( candidate.dbRO->db );
+          if ( rows.empty() )
+            {
+              pkgs.emplace( iid, std::nullopt );
+              continue;
+            }
+          if ( advisories != nullptr )
+            {
+              advisories->demoteVulnerable( *candidate.dbRO, rows );
+            }
+          debugLog( "found match for install ID '" + iid + "'" );
+          pkgs.emplace( iid,
+                        Environment::lockPackage( candidate.input,
+                                                  *candidate.dbRO,
+                                                  rows.front(),
+                                                  descriptor.priority ) );
+        }
+
+      if ( numPinned <= idx )
+        {
+          nix::logger->log( nix::lvlInfo,
+                            nix::fmt( "upgrading group '%s' to avoid "
+                                      "resolution failure",
+                                      getGroupName( group ) ) );
+        }
+      return pkgs;
+    }
+
+  return failure;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 ResolutionResult
@@ -603,110 +913,97 @@ Environment::tryResolveGroup( const GroupName &          name,
                               const InstallDescriptors & group,
                               const System &             system )
 {
-  /* List of resolution failures to group descriptors with the inputs they
-   * failed to resolve in. */
-  ResolutionFailure failure;
-
   std::vector<std::string> ids;
   for ( const auto & [id, _] : group ) { ids.emplace_back( id ); }
   std::string groupStr = concatStringsSep( " ", ids );
   debugLog( "starting resolution for group: " + groupStr );
 
+  std::vector<GroupCandidate> candidates;
+  /* Skip inputs+revs which have already been added. */
+  auto addCandidate = [&]( GroupCandidate candidate )
+  {
+    if ( std::find_if( candidates.begin(),
+                       candidates.end(),
+                       [&]( const GroupCandidate & other )
+                       { return other.input == candidate.input; } )
+         == candidates.end() )
+      {
+        candidates.emplace_back( std::move( candidate ) );
+      }
+  };
+
   /* When there is an existing lock with this group pinned to an existing
-   * input+rev try to use it to resolve the group.
-   * If we fail collect a list of failed descriptors; presumably these are
-   * new group members.
+   * input+rev try it first.
+   * If it fails, presumably because of new group members, we fall back to
+   * the registry's inputs.
    * Skip this step if a group is being upgraded. */
-  std::optional<pkgdb::PkgDbInput> oldGroupInput;
+  size_t numPinned = 0;
   if ( ! upgradingGroup( name ) )
     {
-      if ( auto oldLockfile = this->getOldLockfile(); oldLockfile.has_value() )
+      std::optional<LockedInputRaw> lockedInput;
+      if ( const auto & oldLockfile = this->getOldLockfile();
+           oldLockfile.has_value() )
         {
           debugLog( "using old lockfile" );
-          auto lockedInput
-            = getGroupInput( group, *this->getOldLockfile(), system );
-          if ( lockedInput.has_value() )
+          lockedInput = getGroupInput( group, *oldLockfile, system );
+          /* Nothing is locked for a pending system yet, so start from the
+           * group's input on the first locked system. */
+          if ( ( ! lockedInput.has_value() )
+               && oldLockfile->isPending( system ) )
             {
-              RegistryInput registryInput( *lockedInput );
-              debugLog( "group previously had input: "
-                        + registryInput.from->to_string() );
-              nix::ref<nix::Store> store = this->getStore();
-              oldGroupInput = pkgdb::PkgDbInput( store, registryInput );
-
-              auto maybeResolved
-                = this->tryResolveGroupIn( group, *oldGroupInput, system );
-
-              /* If we're able to resolve the group with the same input+rev as
-               * the old lockfile's pin, then we're done. */
-              // XXX: I tried `std::variant( overloaded { ... } )' pattern here
-              // but
-              //      template deduction failed with `gcc'.
-              //      Rather than adding deduction guides and stuff
-              //      `std::get_if' is fine here.
-              if ( const SystemPackages * resolved
-                   = std::get_if<SystemPackages>( &maybeResolved ) )
-                {
-                  return *resolved;
-                }
-
-              if ( const InstallID * iid
-                   = std::get_if<InstallID>( &maybeResolved ) )
+              for ( const auto & lockedSystem : this->getSystems() )
                 {
-                  failure.emplace_back( std::pair<InstallID, std::string> {
-                    *iid,
-                    oldGroupInput->getDbReadOnly()->lockedRef.string } );
-                }
-              else
-                {
-                  throw ResolutionFailureException(
-                    "we thought this was an unreachable error" );
+                  lockedInput
+                    = getGroupInput( group, *oldLockfile, lockedSystem );
+                  if ( lockedInput.has_value() ) { break; }
                 }
             }
         }
+      /* Otherwise start from an input that an included environment locked
+       * some of the group's members to. */
+      for ( const auto & included : this->includedLockfiles )
+        {
+          if ( lockedInput.has_value() ) { break; }
+          lockedInput = getGroupInput( group, included, system );
+        }
+      if ( lockedInput.has_value() )
+        {
+          RegistryInput registryInput( *lockedInput );
+          debugLog( "group previously had input: "
+                    + registryInput.from->to_string() );
+          nix::ref<nix::Store> store = this->getStore();
+          pkgdb::PkgDbInput    oldGroupInput( store, registryInput );
+          addCandidate( this->mkGroupCandidate( oldGroupInput ) );
+          numPinned = 1;
+        }
     }
 
-  /* If we've made it to this point, we know there are some unlocked descriptors
-   * in this group that need to be resolved. */
-  for ( const auto & [_, input] : *this->getPkgDbRegistry() )
+  /* Then try each input in priority order, followed by any older revisions
+   * of that input which have already been scraped. */
+  for ( const auto & [inputName, input] : *this->getPkgDbRegistry() )
     {
-      /* If there is an existing lock we'll try to use the same input+rev as the
-       * old lockfile's pin.
-       * If we fail collect a list of failed descriptors we will return a list
-       * of failed descriptors. */
-      if ( ! ( oldGroupInput.has_value() && *input == *oldGroupInput ) )
+      addCandidate( this->mkGroupCandidate( *input ) );
+      for ( const auto & dbRO : this->getRevisionDbs( inputName ) )
         {
-          auto maybeResolved = this->tryResolveGroupIn( group, *input, system );
-          if ( const SystemPackages * resolved
-               = std::get_if<SystemPackages>( &maybeResolved ) )
-            {
-              nix::logger->log( nix::lvlInfo,
-                                nix::fmt( "upgrading group '%s' to avoid "
-                                          "resolution failure",
-                                          getGroupName( group ) ) );
-
-              return *resolved;
-            }
-
-          if ( const InstallID * iid
-               = std::get_if<InstallID>( &maybeResolved ) )
-            {
-              failure.push_back( std::pair<InstallID, std::string> {
-                *iid,
-                input->getDbReadOnly()->lockedRef.string } );
-            }
-          else
-            {
-              throw ResolutionFailureException(
-                "we thought this was an unreachable error" );
-            }
+          addCandidate( this->mkGroupCandidate( *input, dbRO ) );
         }
     }
-  return failure;
+
+  pkgdb::AdvisoryDb * advisories = nullptr;
+  if ( this->getCombinedOptions().demoteVulnerable.value_or( false ) )
+    {
+      advisories = this->getAdvisories();
+    }
+
+  return Environment::solveGroup( group,
+                                  candidates,
+                                  system,
+                                  numPinned,
+                                  advisories );
 }
 
 
 /* -------------------------------------------------------------------------- */
-
 /** @brief Add a decription of a resolution failure to an exception message. */
 static inline std::stringstream &
 describeResolutionFailure( std::stringstream &       msg,
@@ -776,26 +1073,24 @@ Environment::lockSystem( const System & system )
 
   if ( ! groups.empty() ) { throw ResolutionFailureException( msg.str() ); }
 
-  /* Copy over old lockfile entries we want to keep.
+  /* Copy over old lockfile entries we want to keep, or adopt them from an
+   * included environment's lockfile.
    * Make sure to update the priority if the entry was copied over from
    * the old. */
-  if ( auto oldLockfile = this->getOldLockfile();
-       oldLockfile.has_value()
-       && oldLockfile->getLockfileRaw().packages.contains( system ) )
+  for ( const auto & [name, group] :
+        this->getManifest().getGroupedDescriptors() )
     {
-      SystemPackages systemPackages
-        = oldLockfile->getLockfileRaw().packages.at( system );
-      auto oldDescriptors = oldLockfile->getDescriptors();
-      for ( const auto & [_, group] : this->getLockedGroups( system ) )
+      const Lockfile * lockfile = this->getGroupLockfile( name, group, system );
+      if ( lockfile == nullptr ) { continue; }
+      const SystemPackages & systemPackages
+        = lockfile->getLockfileRaw().packages.at( system );
+      for ( const auto & [iid, descriptor] : group )
         {
-          for ( const auto & [iid, descriptor] : group )
+          if ( auto oldLockedPackagePair = systemPackages.find( iid );
+               oldLockedPackagePair != systemPackages.end() )
             {
-              if ( auto oldLockedPackagePair = systemPackages.find( iid );
-                   oldLockedPackagePair != systemPackages.end() )
-                {
-                  pkgs.emplace( *oldLockedPackagePair );
-                  pkgs.at( iid )->priority = descriptor.priority;
-                }
+              pkgs.emplace( *oldLockedPackagePair );
+              pkgs.at( iid )->priority = descriptor.priority;
             }
         }
     }
@@ -807,22 +1102,50 @@ Environment::lockSystem( const System & system )
 /* -------------------------------------------------------------------------- */
 
 Lockfile
-Environment::createLockfile()
+Environment::createLockfile( lock_mode mode )
 {
   if ( ! this->lockfileRaw.has_value() )
     {
+      const System & native  = nix::settings.thisSystem.get();
+      auto           systems = this->getSystems();
+      if ( ( mode == LM_NATIVE )
+           && ( std::find( systems.begin(), systems.end(), native )
+                == systems.end() ) )
+        {
+          debugLog( "current system '" + native
+                    + "' is not supported, locking every system" );
+          mode = LM_ALL;
+        }
+      this->lockMode = mode;
+
       this->lockfileRaw           = LockfileRaw {};
       this->lockfileRaw->manifest = this->getManifestRaw();
       this->lockfileRaw->registry = this->getCombinedRegistryRaw();
       /* Lock each system. */
-      for ( const auto & system : this->getSystems() )
+      for ( const auto & system : systems )
         {
+          /* Defer other systems unless their old locks can be kept as is,
+           * which doesn't require any resolution. */
+          if ( ( mode == LM_NATIVE ) && ( system != native )
+               && ( ! this->getUnlockedGroups( system ).empty() ) )
+            {
+              debugLog( "deferring locking of system: " + system );
+              this->lockfileRaw->pendingSystems.emplace_back( system );
+              continue;
+            }
           this->lockSystem( system );
         }
     }
   Lockfile lockfile( *this->lockfileRaw );
 
   lockfile.checkPackages();
+  if ( auto * advisories = this->getAdvisories(); advisories != nullptr )
+    {
+      for ( const auto & warning : lockfile.checkAdvisories( *advisories ) )
+        {
+          nix::logger->warn( warning.message );
+        }
+    }
   lockfile.removeUnusedInputs();
   return lockfile;
 }
@@ -0,0 +1,286 @@
+/* ========================================================================== *
+ *
+ * @file resolver/lockfile-diff.cc
+ *
+ * @brief Semantic differences between two lockfiles.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "flox/resolver/lockfile-diff.hh"
+#include "flox/resolver/lockfile.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::resolver {
+
+/* -------------------------------------------------------------------------- */
+
+bool
+PackageChange::mayChangeStorePaths() const
+{
+  if ( ! ( this->oldPackage.has_value() && this->newPackage.has_value() ) )
+    {
+      return true;
+    }
+  return ( this->oldPackage->input != this->newPackage->input )
+         || ( this->oldPackage->attrPath != this->newPackage->attrPath );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Get a package's `version`, or `null` if it is unknown. */
+[[nodiscard]] static nlohmann::json
+getVersion( const LockedPackageRaw & pkg )
+{
+  if ( auto version = pkg.info.find( "version" ); version != pkg.info.end() )
+    {
+      return *version;
+    }
+  return nullptr;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<std::string>
+PackageChange::getChangedFields() const
+{
+  std::vector<std::string> fields;
+  if ( ! ( this->oldPackage.has_value() && this->newPackage.has_value() ) )
+    {
+      return fields;
+    }
+  const LockedPackageRaw & oldPkg = *this->oldPackage;
+  const LockedPackageRaw & newPkg = *this->newPackage;
+
+  if ( getVersion( oldPkg ) != getVersion( newPkg ) )
+    {
+      fields.emplace_back( "version" );
+    }
+  if ( oldPkg.input != newPkg.input ) { fields.emplace_back( "input" ); }
+  if ( oldPkg.attrPath != newPkg.attrPath )
+    {
+      fields.emplace_back( "attr-path" );
+    }
+  if ( oldPkg.priority != newPkg.priority )
+    {
+      fields.emplace_back( "priority" );
+    }
+  /* Report changes to other metadata such as `license' or `broken'. */
+  nlohmann::json oldInfo = oldPkg.info;
+  nlohmann::json newInfo = newPkg.info;
+  oldInfo.erase( "version" );
+  newInfo.erase( "version" );
+  if ( oldInfo != newInfo ) { fields.emplace_back( "info" ); }
+
+  if ( this->oldStoreInfo.has_value() && this->newStoreInfo.has_value()
+       && ( this->oldStoreInfo->outputs != this->newStoreInfo->outputs ) )
+    {
+      fields.emplace_back( "outputs" );
+    }
+  return fields;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Summarize one side of a @a PackageChange as a JSON object. */
+[[nodiscard]] static nlohmann::json
+summarizePackage( const std::optional<LockedPackageRaw> & pkg )
+{
+  if ( ! pkg.has_value() ) { return nullptr; }
+  nlohmann::json rev = nullptr;
+  if ( auto attr = pkg->input.attrs.find( "rev" );
+       attr != pkg->input.attrs.end() )
+    {
+      rev = *attr;
+    }
+  return { { "version", getVersion( *pkg ) },
+           { "input", pkg->input.url },
+           { "rev", std::move( rev ) },
+           { "attr-path", pkg->attrPath },
+           { "priority", pkg->priority } };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+to_json( nlohmann::json & jto, const PackageChange & change )
+{
+  jto = { { "system", change.system },
+          { "install-id", change.installId },
+          { "change", change.type },
+          { "fields", change.getChangedFields() },
+          { "old", summarizePackage( change.oldPackage ) },
+          { "new", summarizePackage( change.newPackage ) } };
+
+  if ( ( ! change.oldStoreInfo.has_value() )
+       && ( ! change.newStoreInfo.has_value() ) )
+    {
+      return;
+    }
+
+  /* Pair up store paths by output name. */
+  nlohmann::json outputs = nlohmann::json::object();
+  if ( change.oldStoreInfo.has_value() )
+    {
+      for ( const auto & [name, path] : change.oldStoreInfo->outputs )
+        {
+          outputs[name] = { { "old", path }, { "new", nullptr } };
+        }
+    }
+  if ( change.newStoreInfo.has_value() )
+    {
+      for ( const auto & [name, path] : change.newStoreInfo->outputs )
+        {
+          if ( ! outputs.contains( name ) )
+            {
+              outputs[name] = { { "old", nullptr } };
+            }
+          outputs[name]["new"] = path;
+        }
+    }
+  jto.emplace( "outputs", std::move( outputs ) );
+
+  std::optional<uint64_t> oldSize;
+  std::optional<uint64_t> newSize;
+  if ( change.oldStoreInfo.has_value() )
+    {
+      oldSize = change.oldStoreInfo->closureSize;
+    }
+  if ( change.newStoreInfo.has_value() )
+    {
+      newSize = change.newStoreInfo->closureSize;
+    }
+  nlohmann::json closureSize = { { "old", nullptr },
+                                 { "new", nullptr },
+                                 { "delta", nullptr } };
+  if ( oldSize.has_value() ) { closureSize["old"] = *oldSize; }
+  if ( newSize.has_value() ) { closureSize["new"] = *newSize; }
+  /* Treat missing sides as empty closures, such as those of added and
+   * removed packages. */
+  if ( ( oldSize.has_value() || ( ! change.oldPackage.has_value() ) )
+       && ( newSize.has_value() || ( ! change.newPackage.has_value() ) ) )
+    {
+      closureSize["delta"] = static_cast<int64_t>( newSize.value_or( 0 ) )
+                             - static_cast<int64_t>( oldSize.value_or( 0 ) );
+    }
+  jto.emplace( "closure-size", std::move( closureSize ) );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<PackageChange>
+diffLockfiles( const LockfileRaw & oldLockfile,
+               const LockfileRaw & newLockfile )
+{
+  static const SystemPackages noPackages;
+
+  auto getSystemPackages
+    = []( const LockfileRaw & lockfile,
+          const System &      system ) -> const SystemPackages &
+  {
+    if ( auto pkgs = lockfile.packages.find( system );
+         pkgs != lockfile.packages.end() )
+      {
+        return pkgs->second;
+      }
+    return noPackages;
+  };
+
+  std::vector<PackageChange> changes;
+
+  /* Removed and changed packages. */
+  for ( const auto & [system, oldPkgs] : oldLockfile.packages )
+    {
+      /* Packages of systems deferred by a `--native' lock aren't removed. */
+      if ( std::find( newLockfile.pendingSystems.begin(),
+                      newLockfile.pendingSystems.end(),
+                      system )
+           != newLockfile.pendingSystems.end() )
+        {
+          continue;
+        }
+      const SystemPackages & newPkgs = getSystemPackages( newLockfile, system );
+      for ( const auto & [iid, oldPkg] : oldPkgs )
+        {
+          auto newPkg = newPkgs.find( iid );
+          if ( newPkg == newPkgs.end() )
+            {
+              if ( oldPkg.has_value() )
+                {
+                  changes.emplace_back( PackageChange { system,
+                                                        iid,
+                                                        PC_REMOVED,
+                                                        oldPkg,
+                                                        std::nullopt } );
+                }
+            }
+          /* Packages listed in both lockfiles are changed even if only one
+           * of them is locked. */
+          else if ( oldPkg != newPkg->second )
+            {
+              changes.emplace_back( PackageChange { system,
+                                                    iid,
+                                                    PC_CHANGED,
+                                                    oldPkg,
+                                                    newPkg->second } );
+            }
+        }
+    }
+
+  /* Added packages. */
+  for ( const auto & [system, newPkgs] : newLockfile.packages )
+    {
+      const SystemPackages & oldPkgs = getSystemPackages( oldLockfile, system );
+      for ( const auto & [iid, newPkg] : newPkgs )
+        {
+          if ( newPkg.has_value() && ( ! oldPkgs.contains( iid ) ) )
+            {
+              changes.emplace_back( PackageChange { system,
+                                                    iid,
+                                                    PC_ADDED,
+                                                    std::nullopt,
+                                                    newPkg } );
+            }
+        }
+    }
+
+  /* Hash map iteration order is unspecified, so sort for stable output. */
+  std::sort( changes.begin(),
+             changes.end(),
+             []( const PackageChange & lhs, const PackageChange & rhs )
+             {
+               if ( lhs.system != rhs.system )
+                 {
+                   return lhs.system < rhs.system;
+                 }
+               return lhs.installId < rhs.installId;
+             } );
+
+  return changes;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::resolver
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
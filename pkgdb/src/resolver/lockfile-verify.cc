@@ -0,0 +1,455 @@
+/* ========================================================================== *
+ *
+ * @file resolver/lockfile-verify.cc
+ *
+ * @brief Re-evaluate locked packages to detect lockfiles which no longer
+ *        match their locked inputs.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <optional>
+#include <poll.h>
+#include <set>
+#include <string>
+#include <sys/wait.h>
+#include <tuple>
+#include <unistd.h>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <nix/eval-cache.hh>
+#include <nix/eval.hh>
+#include <nix/flake/flake.hh>
+#include <nix/logging.hh>
+#include <nix/util.hh>
+#include <nlohmann/json.hpp>
+
+#include "flox/buildenv/realise.hh"
+#include "flox/core/nix-state.hh"
+#include "flox/core/util.hh"
+#include "flox/fetchers/wrapped-nixpkgs-input.hh"
+#include "flox/flake-package.hh"
+#include "flox/resolver/lockfile-verify.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::resolver {
+
+/* -------------------------------------------------------------------------- */
+
+void
+from_json( const nlohmann::json & jfrom, InfoMismatch & mismatch )
+{
+  jfrom.at( "field" ).get_to( mismatch.field );
+  mismatch.locked    = jfrom.at( "locked" );
+  mismatch.evaluated = jfrom.at( "evaluated" );
+}
+
+
+void
+to_json( nlohmann::json & jto, const InfoMismatch & mismatch )
+{
+  jto = { { "field", mismatch.field },
+          { "locked", mismatch.locked },
+          { "evaluated", mismatch.evaluated } };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+from_json( const nlohmann::json & jfrom, PackageVerification & verification )
+{
+  jfrom.at( "system" ).get_to( verification.system );
+  jfrom.at( "install-id" ).get_to( verification.installId );
+  jfrom.at( "mismatches" ).get_to( verification.mismatches );
+  jfrom.at( "outputs" ).get_to( verification.outputs );
+  if ( auto error = jfrom.find( "error" );
+       ( error != jfrom.end() ) && ( ! error->is_null() ) )
+    {
+      verification.error = error->get<std::string>();
+    }
+  else { verification.error = std::nullopt; }
+}
+
+
+void
+to_json( nlohmann::json & jto, const PackageVerification & verification )
+{
+  jto = { { "system", verification.system },
+          { "install-id", verification.installId },
+          { "valid", verification.isValid() },
+          { "mismatches", verification.mismatches },
+          { "outputs", verification.outputs } };
+  if ( verification.error.has_value() )
+    {
+      jto.emplace( "error", *verification.error );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<InfoMismatch>
+compareLockedInfo( const nlohmann::json & locked,
+                   const nlohmann::json & evaluated )
+{
+  static const std::array<const char *, 5> fields
+    = { "pname", "version", "license", "broken", "unfree" };
+
+  std::vector<InfoMismatch> mismatches;
+  for ( const char * field : fields )
+    {
+      auto lockedValue = locked.find( field );
+      if ( lockedValue == locked.end() ) { continue; }
+      nlohmann::json evaluatedValue
+        = evaluated.value( field, nlohmann::json() );
+      if ( *lockedValue != evaluatedValue )
+        {
+          mismatches.emplace_back(
+            InfoMismatch { field, *lockedValue, std::move( evaluatedValue ) } );
+        }
+    }
+  return mismatches;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Re-evaluate a locked package beneath the root of its input's
+ *        eval cache.
+ */
+[[nodiscard]] static PackageVerification
+verifyPackageAt( nix::ref<nix::EvalState> & state,
+                 const Cursor &             root,
+                 const System &             system,
+                 const InstallID &          iid,
+                 const LockedPackageRaw &   pkg )
+{
+  PackageVerification verification;
+  verification.system    = system;
+  verification.installId = iid;
+
+  Cursor cursor = root;
+  for ( const auto & attrName : pkg.attrPath )
+    {
+      cursor = cursor->getAttr( attrName );
+    }
+
+  /* Evaluate `info' the same way scraping does so that fields only differ if
+   * the package itself changed. */
+  FlakePackage   flakePkg( cursor, pkg.attrPath, false );
+  nlohmann::json evaluated = flakePkg.getInfo().begin().value();
+  verification.mismatches  = compareLockedInfo( pkg.info, evaluated );
+
+  for ( auto & [output, path] :
+        buildenv::outpathsForPackageOutputs( state, iid, cursor ) )
+    {
+      verification.outputs.emplace( output, std::move( path ) );
+    }
+  return verification;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Lock a package's input the same way `pkgdb buildenv` does. */
+[[nodiscard]] static std::shared_ptr<nix::flake::LockedFlake>
+lockInput( nix::ref<nix::EvalState> & state, const LockedInputRaw & input )
+{
+  auto ref = nix::FlakeRef::fromAttrs(
+    flox::githubAttrsToFloxNixpkgsAttrs( input.attrs ) );
+  return std::make_shared<nix::flake::LockedFlake>(
+    nix::flake::lockFlake( *state, ref, nix::flake::LockFlags {} ) );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+PackageVerification
+verifyPackage( nix::ref<nix::EvalState> &      state,
+               const nix::flake::LockedFlake & flake,
+               const System &                  system,
+               const InstallID &               iid,
+               const LockedPackageRaw &        pkg )
+{
+  auto evalCache = nix::openEvalCache(
+    *state,
+    std::make_shared<nix::flake::LockedFlake>( flake ) );
+  auto root = evalCache->getRoot();
+  return verifyPackageAt( state, root, system, iid, pkg );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief A locked package to be verified by an evaluator. */
+struct VerifyTask
+{
+  const System *           system;
+  const InstallID *        installId;
+  const LockedPackageRaw * package;
+  std::string              fingerprint;
+}; /* End struct `VerifyTask' */
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Verify @a tasks in a forked evaluator, writing each result to
+ *        @a reportFd as a line of JSON.
+ *
+ * Each input is locked, and its eval cache opened, once.
+ */
+[[nodiscard]] static int
+verifyWorker( const std::vector<VerifyTask> & tasks,
+              std::size_t                     begin,
+              std::size_t                     end,
+              int                             reportFd )
+{
+  try
+    {
+      NixState                 nstate;
+      nix::ref<nix::EvalState> state = nstate.getState();
+
+      std::unordered_map<std::string, MaybeCursor> roots;
+      /* Eval caches must outlive their cursors. */
+      std::vector<nix::ref<nix::eval_cache::EvalCache>> evalCaches;
+
+      for ( std::size_t idx = begin; idx < end; ++idx )
+        {
+          const VerifyTask &  task = tasks[idx];
+          PackageVerification verification;
+          try
+            {
+              auto & root = roots[task.fingerprint];
+              if ( root == nullptr )
+                {
+                  evalCaches.emplace_back( nix::openEvalCache(
+                    *state,
+                    lockInput( state, task.package->input ) ) );
+                  root = evalCaches.back()->getRoot();
+                }
+              verification = verifyPackageAt( state,
+                                              Cursor( root ),
+                                              *task.system,
+                                              *task.installId,
+                                              *task.package );
+            }
+          catch ( const std::exception & err )
+            {
+              verification.system    = *task.system;
+              verification.installId = *task.installId;
+              verification.error     = err.what();
+            }
+          nix::writeFull( reportFd,
+                          nlohmann::json( verification ).dump() + "\n",
+                          false );
+        }
+    }
+  catch ( const std::exception & err )
+    {
+      nix::logger->log( nix::lvlError, err.what() );
+      close( reportFd );
+      return EXIT_FAILURE;
+    }
+  close( reportFd );
+  return EXIT_SUCCESS;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief A running evaluator and the results it has reported so far. */
+struct VerifyWorker
+{
+  pid_t       pid = -1;
+  int         fd  = -1;
+  std::size_t begin;
+  std::size_t end;
+  std::string buffer;
+}; /* End struct `VerifyWorker' */
+
+
+/* -------------------------------------------------------------------------- */
+
+std::vector<PackageVerification>
+verifyLockfile( const LockfileRaw & lockfile, std::size_t jobs )
+{
+  std::vector<VerifyTask> tasks;
+  for ( const auto & [system, pkgs] : lockfile.packages )
+    {
+      for ( const auto & [iid, pkg] : pkgs )
+        {
+          if ( ! pkg.has_value() ) { continue; }
+          tasks.emplace_back(
+            VerifyTask { &system,
+                         &iid,
+                         &( *pkg ),
+                         pkg->input.fingerprint.to_string( nix::Base16,
+                                                           false ) } );
+        }
+    }
+
+  /* Keep each input's packages together so that evaluators share as few
+   * inputs as possible. */
+  std::sort( tasks.begin(),
+             tasks.end(),
+             []( const VerifyTask & lhs, const VerifyTask & rhs )
+             {
+               return std::tie( lhs.fingerprint, *lhs.system, *lhs.installId )
+                      < std::tie( rhs.fingerprint,
+                                  *rhs.system,
+                                  *rhs.installId );
+             } );
+
+  std::vector<PackageVerification> results;
+  if ( tasks.empty() ) { return results; }
+
+  jobs = std::clamp<std::size_t>( jobs, 1, tasks.size() );
+  debugLog( nix::fmt( "verifying %d packages with %d evaluators",
+                      tasks.size(),
+                      jobs ) );
+
+  /* Split tasks into contiguous slices of nearly equal size. */
+  std::vector<VerifyWorker> workers;
+  for ( std::size_t idx = 0; idx < jobs; ++idx )
+    {
+      VerifyWorker worker;
+      worker.begin = ( tasks.size() * idx ) / jobs;
+      worker.end   = ( tasks.size() * ( idx + 1 ) ) / jobs;
+
+      std::array<int, 2> fds {};
+      if ( pipe( fds.data() ) == -1 )
+        {
+          throw FloxException( "failed to create pipe to verify lockfile" );
+        }
+      worker.pid = fork();
+      if ( worker.pid == -1 )
+        {
+          close( fds[0] );
+          close( fds[1] );
+          throw FloxException( "fork to verify lockfile failed" );
+        }
+      if ( worker.pid == 0 )
+        {
+          /* Don't run exit handlers, see `PkgDbInput::runScrapeChild'. */
+          close( fds[0] );
+          for ( const auto & other : workers ) { close( other.fd ); }
+          _exit( verifyWorker( tasks, worker.begin, worker.end, fds[1] ) );
+        }
+      close( fds[1] );
+      worker.fd = fds[0];
+      workers.emplace_back( std::move( worker ) );
+    }
+
+  /* Read results from every evaluator as they are written. */
+  std::set<std::pair<System, InstallID>> reported;
+  auto handleLine = [&]( const std::string & line )
+  {
+    nlohmann::json msg = nlohmann::json::parse( line, nullptr, false );
+    if ( ! msg.is_object() ) { return; }
+    auto verification = msg.get<PackageVerification>();
+    reported.emplace( verification.system, verification.installId );
+    results.emplace_back( std::move( verification ) );
+  };
+
+  std::vector<pollfd> pfds;
+  for ( const auto & worker : workers )
+    {
+      pfds.emplace_back( pollfd { worker.fd, POLLIN, 0 } );
+    }
+  std::size_t            open = workers.size();
+  std::array<char, 4096> chunk {};
+  while ( 0 < open )
+    {
+      if ( poll( pfds.data(), pfds.size(), -1 ) == -1 )
+        {
+          if ( errno == EINTR ) { continue; }
+          throw FloxException( "failed to read results of lockfile "
+                               "verification" );
+        }
+      for ( std::size_t idx = 0; idx < pfds.size(); ++idx )
+        {
+          if ( ( pfds[idx].fd < 0 ) || ( pfds[idx].revents == 0 ) )
+            {
+              continue;
+            }
+          VerifyWorker & worker = workers[idx];
+          ssize_t        nread  = read( worker.fd, chunk.data(), chunk.size() );
+          if ( ( nread < 0 ) && ( errno == EINTR ) ) { continue; }
+          if ( nread <= 0 )
+            {
+              close( worker.fd );
+              pfds[idx].fd = -1;
+              --open;
+              continue;
+            }
+          worker.buffer.append( chunk.data(), nread );
+          for ( std::size_t eol = worker.buffer.find( '\n' );
+                eol != std::string::npos;
+                eol = worker.buffer.find( '\n' ) )
+            {
+              handleLine( worker.buffer.substr( 0, eol ) );
+              worker.buffer.erase( 0, eol + 1 );
+            }
+        }
+    }
+
+  /* Report packages whose evaluator died before reaching them. */
+  for ( const auto & worker : workers )
+    {
+      int status = 0;
+      waitpid( worker.pid, &status, 0 );
+      for ( std::size_t idx = worker.begin; idx < worker.end; ++idx )
+        {
+          const VerifyTask & task = tasks[idx];
+          if ( reported.contains( { *task.system, *task.installId } ) )
+            {
+              continue;
+            }
+          PackageVerification verification;
+          verification.system    = *task.system;
+          verification.installId = *task.installId;
+          verification.error
+            = WIFSIGNALED( status )
+                ? nix::fmt( "evaluator exited abnormally, signal: %d (%s)",
+                            WTERMSIG( status ),
+                            strsignal( WTERMSIG( status ) ) )
+                : nix::fmt( "evaluator exited with code %d",
+                            WEXITSTATUS( status ) );
+          results.emplace_back( std::move( verification ) );
+        }
+    }
+
+  std::sort( results.begin(),
+             results.end(),
+             []( const PackageVerification & lhs,
+                 const PackageVerification & rhs )
+             {
+               return std::tie( lhs.system, lhs.installId )
+                      < std::tie( rhs.system, rhs.installId );
+             } );
+  return results;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::resolver
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -10,6 +10,8 @@
  * -------------------------------------------------------------------------- */
 
 #include <algorithm>
+#include <set>
+#include <utility>
 
 #include <nix/hash.hh>
 
@@ -32,6 +34,14 @@ LockfileRaw::check() const
         "unsupported lockfile version "
         + std::to_string( this->lockfileVersion ) );
     }
+  for ( const auto & system : this->pendingSystems )
+    {
+      if ( this->packages.contains( system ) )
+        {
+          throw InvalidLockfileException( "pending system '" + system
+                                          + "' has locked packages" );
+        }
+    }
 }
 
 
@@ -40,47 +50,28 @@ LockfileRaw::check() const
 void
 Lockfile::checkGroups() const
 {
-  for ( const auto & [_, group] : this->getManifest().getGroupedDescriptors() )
+  for ( const auto & [_, members] : this->groupMembers )
     {
       for ( const auto & system : this->manifest.getSystems() )
         {
-          std::optional<LockedInputRaw> groupInput;
-          for ( const auto & [iid, descriptor] : group )
+          const LockedInputRaw * groupInput = nullptr;
+          for ( const auto & iid : members )
             {
-              /* Handle system skips.  */
-              if ( descriptor.systems.has_value()
-                   && ( std::find( this->manifest.getSystems().begin(),
-                                   this->manifest.getSystems().end(),
-                                   system )
-                        == descriptor.systems->end() ) )
-                {
-                  continue;
-                }
-
-              auto maybeSystem = this->lockfileRaw.packages.find( system );
-              if ( maybeSystem == this->lockfileRaw.packages.end() )
-                {
-                  continue;
-                }
-
-              auto maybeLocked = maybeSystem->second.at( iid );
-
-              /* Package was unresolved, we don't enforce `optional' here. */
-              if ( ! maybeLocked.has_value() ) { continue; }
-
-              if ( ! groupInput.has_value() )
+              /* Package was unresolved or skipped, we don't enforce
+               * `optional' here. */
+              const LockedPackageRaw * locked
+                = this->getLockedPackage( system, iid );
+              if ( locked == nullptr ) { continue; }
+
+              if ( groupInput == nullptr ) { groupInput = &locked->input; }
+              else if ( groupInput->fingerprint != locked->input.fingerprint )
                 {
-                  groupInput = maybeLocked->input;
-                }
-              else if ( groupInput->fingerprint
-                        != maybeLocked->input.fingerprint )
-                {
-                  if ( auto descriptor = group.begin();
-                       descriptor != group.end()
-                       && descriptor->second.group.has_value() )
+                  if ( const auto & group
+                       = this->getDescriptors().at( members.front() ).group;
+                       group.has_value() )
                     {
                       throw InvalidLockfileException(
-                        "invalid group '" + *descriptor->second.group
+                        "invalid group '" + *group
                         + "' uses multiple inputs" );
                     }
 
@@ -139,6 +130,13 @@ Lockfile::init()
 
   this->manifest = EnvironmentManifest( this->lockfileRaw.manifest );
 
+  for ( const auto & [iid, descriptor] : this->getDescriptors() )
+    {
+      GroupName name
+        = descriptor.group.value_or( GroupName( TOPLEVEL_GROUP_NAME ) );
+      this->groupMembers[name].emplace_back( iid );
+    }
+
   this->check();
 }
 
@@ -421,6 +419,7 @@ LockfileRaw::clear()
   this->registry.clear();
   this->packages        = std::unordered_map<System, SystemPackages> {};
   this->lockfileVersion = 0;
+  this->pendingSystems.clear();
 }
 
 
@@ -495,6 +494,19 @@ from_json( const nlohmann::json & jfrom, LockfileRaw & raw )
               raw.packages.emplace( system, std::move( sysPkgs ) );
             }
         }
+      else if ( key == "pending-systems" )
+        {
+          try
+            {
+              value.get_to( raw.pendingSystems );
+            }
+          catch ( nlohmann::json::exception & err )
+            {
+              throw InvalidLockfileException( "couldn't parse lockfile field '"
+                                                + key + "'",
+                                              extract_json_errmsg( err ) );
+            }
+        }
       else if ( key == "lockfile-version" )
         {
           try
@@ -524,6 +536,11 @@ to_json( nlohmann::json & jto, const LockfileRaw & raw )
           { "registry", raw.registry },
           { "packages", raw.packages },
           { "lockfile-version", raw.lockfileVersion } };
+  /* Only written by `--native' locks so that other lockfiles are unchanged. */
+  if ( ! raw.pendingSystems.empty() )
+    {
+      jto["pending-systems"] = raw.pendingSystems;
+    }
 }
 
 
@@ -576,6 +593,41 @@ Lockfile::removeUnusedInputs()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+bool
+Lockfile::isPending( const System & system ) const
+{
+  const auto & pending = this->lockfileRaw.pendingSystems;
+  return std::find( pending.begin(), pending.end(), system ) != pending.end();
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+const SystemPackages *
+Lockfile::getSystemPackages( const System & system ) const
+{
+  auto packages = this->lockfileRaw.packages.find( system );
+  if ( packages == this->lockfileRaw.packages.end() ) { return nullptr; }
+  return &packages->second;
+}
+
+
+const LockedPackageRaw *
+Lockfile::getLockedPackage( const System & system, const InstallID & iid ) const
+{
+  const SystemPackages * packages = this->getSystemPackages( system );
+  if ( packages == nullptr ) { return nullptr; }
+  auto package = packages->find( iid );
+  if ( ( package == packages->end() ) || ( ! package->second.has_value() ) )
+    {
+      return nullptr;
+    }
+  return &( *package->second );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 std::vector<CheckPackageWarning>
@@ -587,11 +639,11 @@ Lockfile::checkPackages( const std::optional<flox::System> & system ) const
                   .manifest.options.value_or( Options {} )
                   .allow.value_or( Options::Allows {} );
 
-  for ( auto [system_, packages] : this->getLockfileRaw().packages )
+  for ( const auto & [system_, packages] : this->getLockfileRaw().packages )
     {
       if ( system.has_value() && system_ != system.value() ) { continue; }
 
-      for ( auto [pid, package] : packages )
+      for ( const auto & [pid, package] : packages )
         {
           // disabled for current system or optional
           if ( ! package.has_value() ) { continue; }
@@ -607,6 +659,117 @@ Lockfile::checkPackages( const std::optional<flox::System> & system ) const
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+std::vector<CheckPackageWarning>
+Lockfile::checkAdvisories( pkgdb::AdvisoryDb &                 advisories,
+                           const std::optional<flox::System> & system ) const
+{
+  std::vector<CheckPackageWarning> warnings;
+
+  /* Pairs of _install ID_ and advisory which have been reported. */
+  std::set<std::pair<std::string, std::string>> reported;
+
+  for ( const auto & [system_, packages] : this->getLockfileRaw().packages )
+    {
+      if ( system.has_value() && system_ != system.value() ) { continue; }
+
+      for ( const auto & [pid, package] : packages )
+        {
+          if ( ! package.has_value() ) { continue; }
+
+          const nlohmann::json & info    = package->info;
+          auto                   pname   = info.find( "pname" );
+          auto                   version = info.find( "version" );
+          if ( ( pname == info.end() ) || ( ! pname->is_string() )
+               || ( version == info.end() ) || ( ! version->is_string() ) )
+            {
+              continue;
+            }
+
+          for ( const auto & advisory :
+                advisories.match( pname->get<std::string>(),
+                                  version->get<std::string>() ) )
+            {
+              if ( ! reported.emplace( pid, advisory.id ).second )
+                {
+                  continue;
+                }
+              std::string ids = advisory.id;
+              if ( ! advisory.aliases.empty() )
+                {
+                  ids += " ( " + concatStringsSep( ", ", advisory.aliases )
+                         + " )";
+                }
+              warnings.emplace_back( CheckPackageWarning {
+                pid,
+                nix::fmt( "The package '%s' version '%s' is affected by "
+                          "%s%s",
+                          pid,
+                          version->get<std::string>(),
+                          ids,
+                          advisory.severity.has_value()
+                            ? " with severity '" + *advisory.severity + "'"
+                            : "" ) } );
+            }
+        }
+    }
+
+  return warnings;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Get the `( pname, relPath )` pairs of packages in @a lockfile. */
+[[nodiscard]] static std::set<std::pair<std::string, AttrPath>>
+getLockedUsageKeys( const LockfileRaw & lockfile )
+{
+  std::set<std::pair<std::string, AttrPath>> keys;
+  for ( const auto & [system, packages] : lockfile.packages )
+    {
+      for ( const auto & [pid, package] : packages )
+        {
+          /* Skip packages without a `relPath' following their system. */
+          if ( ( ! package.has_value() ) || ( package->attrPath.size() < 3 ) )
+            {
+              continue;
+            }
+          auto pname = package->info.find( "pname" );
+          if ( ( pname == package->info.end() ) || ( ! pname->is_string() ) )
+            {
+              continue;
+            }
+          keys.emplace( pname->get<std::string>(),
+                        AttrPath( package->attrPath.begin() + 2,
+                                  package->attrPath.end() ) );
+        }
+    }
+  return keys;
+}
+
+
+std::vector<pkgdb::PackageUsage>
+Lockfile::getNewUsage( const std::optional<LockfileRaw> & previous ) const
+{
+  auto keys = getLockedUsageKeys( this->getLockfileRaw() );
+  if ( previous.has_value() )
+    {
+      for ( const auto & key : getLockedUsageKeys( *previous ) )
+        {
+          keys.erase( key );
+        }
+    }
+
+  std::vector<pkgdb::PackageUsage> usages;
+  for ( const auto & [pname, relPath] : keys )
+    {
+      usages.emplace_back( pkgdb::PackageUsage { pname, relPath, 1 } );
+    }
+  return usages;
+}
+
+
 }  // namespace flox::resolver
 
 
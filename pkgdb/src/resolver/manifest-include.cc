@@ -0,0 +1,400 @@
+/* ========================================================================== *
+ *
+ * @file resolver/manifest-include.cc
+ *
+ * @brief Compose manifests from the manifests and lockfiles of other
+ *        environments listed in their `include` field.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <filesystem>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#include "flox/core/util.hh"
+#include "flox/resolver/lockfile.hh"
+#include "flox/resolver/manifest-include.hh"
+#include "flox/resolver/manifest-raw.hh"
+#include "flox/resolver/manifest.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+namespace flox::resolver {
+
+/* -------------------------------------------------------------------------- */
+
+namespace {
+
+/** @brief The state of composing a single manifest with its includes. */
+struct Composition
+{
+
+  /** The fields of the includes merged so far. */
+  ManifestRaw merged;
+
+  /** The include which first defined each member, such as `vars.FOO`. */
+  std::map<std::string, std::string> origins;
+
+  /** Members defined differently by includes, with an explanation. */
+  std::map<std::string, std::string> conflicts;
+
+}; /* End struct `Composition' */
+
+}  // namespace
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Merge members of @a from into @a into, recording members which are
+ *        defined differently by another include as conflicts.
+ */
+template<typename Map>
+static void
+mergeMembers( Composition &       composition,
+              Map &               into,
+              const Map &         from,
+              const std::string & field,
+              const std::string & origin )
+{
+  for ( const auto & [key, value] : from )
+    {
+      std::string member        = field + "." + key;
+      auto [existing, inserted] = into.try_emplace( key, value );
+      if ( inserted )
+        {
+          composition.origins.emplace( member, origin );
+          continue;
+        }
+      if ( ( nlohmann::json( existing->second ) != nlohmann::json( value ) )
+           && ( ! composition.conflicts.contains( member ) ) )
+        {
+          composition.conflicts.emplace(
+            member,
+            "'" + member + "' is defined differently by included manifests '"
+              + composition.origins.at( member ) + "' and '" + origin
+              + "'" );
+        }
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Append the script @a from to @a into on a new line. */
+static void
+appendScript( std::optional<std::string> &       into,
+              const std::optional<std::string> & from )
+{
+  if ( ! from.has_value() ) { return; }
+  if ( ! into.has_value() ) { into = *from; }
+  else
+    {
+      if ( ( ! into->empty() ) && ( into->back() != '\n' ) ) { *into += '\n'; }
+      *into += *from;
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Append the `profile` and `hook` scripts of @a from to @a into. */
+static void
+appendScripts( ManifestRaw & into, const ManifestRaw & from )
+{
+  if ( from.profile.has_value() )
+    {
+      if ( ! into.profile.has_value() ) { into.profile = ProfileScriptsRaw {}; }
+      appendScript( into.profile->common, from.profile->common );
+      appendScript( into.profile->bash, from.profile->bash );
+      appendScript( into.profile->zsh, from.profile->zsh );
+    }
+  if ( from.hook.has_value() )
+    {
+      if ( ! into.hook.has_value() ) { into.hook = HookRaw {}; }
+      appendScript( into.hook->script, from.hook->script );
+      appendScript( into.hook->onActivate, from.hook->onActivate );
+    }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Merge an already composed include into @a composition. */
+static void
+mergeInclude( Composition &       composition,
+              const ManifestRaw & included,
+              const std::string & origin )
+{
+  ManifestRaw & merged = composition.merged;
+
+  if ( included.install.has_value() )
+    {
+      if ( ! merged.install.has_value() ) { merged.install.emplace(); }
+      mergeMembers( composition,
+                    *merged.install,
+                    *included.install,
+                    "install",
+                    origin );
+    }
+
+  if ( included.vars.has_value() )
+    {
+      if ( ! merged.vars.has_value() ) { merged.vars.emplace(); }
+      mergeMembers( composition, *merged.vars, *included.vars, "vars", origin );
+    }
+
+  if ( included.registry.has_value() )
+    {
+      if ( ! merged.registry.has_value() ) { merged.registry = RegistryRaw {}; }
+      mergeMembers( composition,
+                    merged.registry->inputs,
+                    included.registry->inputs,
+                    "registry.inputs",
+                    origin );
+      /* Later includes override `defaults' and `priority'. */
+      RegistryRaw rest = *included.registry;
+      rest.inputs.clear();
+      merged.registry->merge( rest );
+    }
+
+  if ( included.options.has_value() )
+    {
+      if ( ! merged.options.has_value() ) { merged.options = Options {}; }
+      merged.options->merge( *included.options );
+    }
+
+  appendScripts( merged, included );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Apply the fields of an including manifest over its includes. */
+static ManifestRaw
+overrideIncludes( Composition & composition, const ManifestRaw & manifest )
+{
+  ManifestRaw & merged = composition.merged;
+
+  if ( manifest.install.has_value() )
+    {
+      if ( ! merged.install.has_value() ) { merged.install.emplace(); }
+      for ( const auto & [iid, descriptor] : *manifest.install )
+        {
+          ( *merged.install )[iid] = descriptor;
+          composition.conflicts.erase( "install." + iid );
+        }
+    }
+
+  if ( manifest.vars.has_value() )
+    {
+      if ( ! merged.vars.has_value() ) { merged.vars.emplace(); }
+      for ( const auto & [name, value] : *manifest.vars )
+        {
+          ( *merged.vars )[name] = value;
+          composition.conflicts.erase( "vars." + name );
+        }
+    }
+
+  if ( manifest.registry.has_value() )
+    {
+      if ( ! merged.registry.has_value() ) { merged.registry = RegistryRaw {}; }
+      for ( const auto & [name, _] : manifest.registry->inputs )
+        {
+          composition.conflicts.erase( "registry.inputs." + name );
+        }
+      merged.registry->merge( *manifest.registry );
+    }
+
+  if ( manifest.options.has_value() )
+    {
+      if ( ! merged.options.has_value() ) { merged.options = Options {}; }
+      merged.options->merge( *manifest.options );
+    }
+
+  appendScripts( merged, manifest );
+  merged.envBase = manifest.envBase;
+
+  if ( ! composition.conflicts.empty() )
+    {
+      throw InvalidManifestFileException(
+        composition.conflicts.begin()->second
+        + ", which must be overridden by the including manifest" );
+    }
+
+  merged.check();
+  return merged;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Compose @a manifest with its includes, recursively.
+ *
+ * @param stack Paths of the manifests being composed, used to detect cycles.
+ * @param locks Lockfiles of included environments, which are appended to.
+ */
+static ManifestRaw
+composeIncludes( ManifestRaw                          manifest,
+                 const std::filesystem::path &        baseDir,
+                 std::vector<std::filesystem::path> & stack,
+                 std::vector<LockfileRaw> &           locks )
+{
+  if ( ! manifest.include.has_value() ) { return manifest; }
+  std::vector<std::string> includes = std::move( *manifest.include );
+  manifest.include                  = std::nullopt;
+
+  Composition composition;
+  for ( const auto & entry : includes )
+    {
+      std::filesystem::path path = baseDir / entry;
+      if ( ! std::filesystem::exists( path ) )
+        {
+          throw InvalidManifestFileException( "no such included manifest: "
+                                              + path.string() );
+        }
+      path = std::filesystem::canonical( path );
+
+      if ( std::find( stack.begin(), stack.end(), path ) != stack.end() )
+        {
+          std::string cycle;
+          for ( const auto & member : stack )
+            {
+              cycle += member.string() + " -> ";
+            }
+          throw InvalidManifestFileException( "manifest includes form a cycle: "
+                                              + cycle + path.string() );
+        }
+
+      /* Lockfiles contribute their composed manifest and their locks. */
+      nlohmann::json             contents = readAndCoerceJSON( path );
+      std::optional<LockfileRaw> lock;
+      ManifestRaw                included;
+      if ( contents.contains( "lockfile-version" ) )
+        {
+          lock     = contents.get<LockfileRaw>();
+          included = lock->manifest;
+        }
+      else { included = contents.get<ManifestRaw>(); }
+
+      std::vector<LockfileRaw> nestedLocks;
+      stack.emplace_back( path );
+      included = composeIncludes( std::move( included ),
+                                  path.parent_path(),
+                                  stack,
+                                  nestedLocks );
+      stack.pop_back();
+
+      /* A lockfile already covers its own includes, so prefer it to
+       * theirs. */
+      if ( lock.has_value() )
+        {
+          lock->manifest = included;
+          locks.emplace_back( std::move( *lock ) );
+        }
+      std::move( nestedLocks.begin(),
+                 nestedLocks.end(),
+                 std::back_inserter( locks ) );
+
+      mergeInclude( composition, included, path.string() );
+    }
+
+  return overrideIncludes( composition, manifest );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Whether @a manifest declares every registry input of @a lock's
+ *        manifest the same way.
+ */
+[[nodiscard]] static bool
+inputsUnchanged( const ManifestRaw & manifest, const LockfileRaw & lock )
+{
+  if ( ! lock.manifest.registry.has_value() ) { return true; }
+  for ( const auto & [name, input] : lock.manifest.registry->inputs )
+    {
+      if ( ! manifest.registry.has_value() ) { return false; }
+      const auto & inputs   = manifest.registry->inputs;
+      auto         declared = inputs.find( name );
+      if ( declared == inputs.end() ) { return false; }
+      if ( nlohmann::json( declared->second ) != nlohmann::json( input ) )
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+static ComposedManifest
+composeManifest( ManifestRaw                          manifest,
+                 const std::filesystem::path &        baseDir,
+                 std::vector<std::filesystem::path> & stack )
+{
+  ComposedManifest         composed;
+  std::vector<LockfileRaw> locks;
+  composed.manifest
+    = composeIncludes( std::move( manifest ), baseDir, stack, locks );
+
+  for ( auto & lock : locks )
+    {
+      if ( inputsUnchanged( composed.manifest, lock ) )
+        {
+          composed.includedLocks.emplace_back( std::move( lock ) );
+        }
+      else
+        {
+          debugLog( "not adopting locks of an included environment whose "
+                    "registry inputs were overridden" );
+        }
+    }
+  return composed;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+ComposedManifest
+composeManifest( ManifestRaw manifest, const std::filesystem::path & baseDir )
+{
+  std::vector<std::filesystem::path> stack;
+  return composeManifest( std::move( manifest ), baseDir, stack );
+}
+
+
+ComposedManifest
+composeManifest( const std::filesystem::path & manifestPath )
+{
+  auto manifest = readManifestFromPath<ManifestRaw>( manifestPath );
+  std::vector<std::filesystem::path> stack
+    = { std::filesystem::canonical( manifestPath ) };
+  return composeManifest( std::move( manifest ),
+                          manifestPath.parent_path(),
+                          stack );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+}  // namespace flox::resolver
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
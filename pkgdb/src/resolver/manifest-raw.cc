@@ -62,6 +62,15 @@ Options::merge( const Options & overrides )
         }
     }
 
+  if ( overrides.deny.has_value() )
+    {
+      if ( ! this->deny.has_value() ) { this->deny = overrides.deny; }
+      else if ( overrides.deny->licenses.has_value() )
+        {
+          this->deny->licenses = overrides.deny->licenses;
+        }
+    }
+
   if ( overrides.semver.has_value() )
     {
       if ( ! this->semver.has_value() ) { this->semver = overrides.semver; }
@@ -84,6 +93,31 @@ Options::merge( const Options & overrides )
     {
       this->activationStrategy = overrides.activationStrategy;
     }
+
+  if ( overrides.groupRevisions.has_value() )
+    {
+      if ( ! this->groupRevisions.has_value() )
+        {
+          this->groupRevisions = overrides.groupRevisions;
+        }
+      else
+        {
+          for ( const auto & [name, revisions] : *overrides.groupRevisions )
+            {
+              ( *this->groupRevisions )[name] = revisions;
+            }
+        }
+    }
+
+  if ( overrides.demoteVulnerable.has_value() )
+    {
+      this->demoteVulnerable = overrides.demoteVulnerable;
+    }
+
+  if ( overrides.resolveLinks.has_value() )
+    {
+      this->resolveLinks = overrides.resolveLinks;
+    }
 }
 
 
@@ -108,6 +142,8 @@ Options::operator pkgdb::PkgQueryArgs() const
       args.licenses = this->allow->licenses;
     }
 
+  if ( this->deny.has_value() ) { args.deniedLicenses = this->deny->licenses; }
+
   if ( this->semver.has_value() && this->semver->preferPreReleases.has_value() )
     {
       args.preferPreReleases = *this->semver->preferPreReleases;
@@ -246,6 +282,54 @@ to_json( nlohmann::json & jto, const Options::Allows & allow )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+static void
+from_json( const nlohmann::json & jfrom, Options::Denies & deny )
+{
+  assertIsJSONObject<InvalidManifestFileException>(
+    jfrom,
+    "manifest field 'options.deny'" );
+
+  /* Clear fields. */
+  deny.licenses = std::nullopt;
+
+  for ( const auto & [key, value] : jfrom.items() )
+    {
+      if ( key == "licenses" )
+        {
+          try
+            {
+              value.get_to( deny.licenses );
+            }
+          catch ( const nlohmann::json::exception & )
+            {
+              throw InvalidManifestFileException(
+                "failed to parse manifest field 'options.deny.licenses' "
+                "with value: "
+                + value.dump() );
+            }
+        }
+      else
+        {
+          throw InvalidManifestFileException(
+            "unrecognized manifest field 'options.deny." + key + "'." );
+        }
+    }
+}
+
+
+static void
+to_json( nlohmann::json & jto, const Options::Denies & deny )
+{
+  jto = nlohmann::json::object();
+  if ( deny.licenses.has_value() )
+    {
+      jto.emplace( "licenses", *deny.licenses );
+    }
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 void
@@ -275,6 +359,11 @@ from_json( const nlohmann::json & jfrom, Options & opts )
           /* Rely on the underlying exception handlers. */
           value.get_to( opts.allow );
         }
+      else if ( key == "deny" )
+        {
+          /* Rely on the underlying exception handlers. */
+          value.get_to( opts.deny );
+        }
       else if ( key == "semver" )
         {
           /* Rely on the underlying exception handlers. */
@@ -310,6 +399,48 @@ from_json( const nlohmann::json & jfrom, Options & opts )
                 + value.dump() );
             }
         }
+      else if ( key == "group-revisions" )
+        {
+          try
+            {
+              value.get_to( opts.groupRevisions );
+            }
+          catch ( const nlohmann::json::exception & )
+            {
+              throw InvalidManifestFileException(
+                "failed to parse manifest field "
+                "'options.group-revisions' with value: "
+                + value.dump() );
+            }
+        }
+      else if ( key == "demote-vulnerable" )
+        {
+          try
+            {
+              value.get_to( opts.demoteVulnerable );
+            }
+          catch ( const nlohmann::json::exception & )
+            {
+              throw InvalidManifestFileException(
+                "failed to parse manifest field "
+                "'options.demote-vulnerable' with value: "
+                + value.dump() );
+            }
+        }
+      else if ( key == "resolve-links" )
+        {
+          try
+            {
+              value.get_to( opts.resolveLinks );
+            }
+          catch ( const nlohmann::json::exception & )
+            {
+              throw InvalidManifestFileException(
+                "failed to parse manifest field "
+                "'options.resolve-links' with value: "
+                + value.dump() );
+            }
+        }
       else
         {
           throw InvalidManifestFileException(
@@ -327,6 +458,8 @@ to_json( nlohmann::json & jto, const Options & opts )
 
   if ( opts.allow.has_value() ) { jto.emplace( "allow", *opts.allow ); }
 
+  if ( opts.deny.has_value() ) { jto.emplace( "deny", *opts.deny ); }
+
   if ( opts.semver.has_value() ) { jto.emplace( "semver", *opts.semver ); }
 
   if ( opts.packageGroupingStrategy.has_value() )
@@ -338,6 +471,21 @@ to_json( nlohmann::json & jto, const Options & opts )
     {
       jto.emplace( "activation-strategy", *opts.activationStrategy );
     }
+
+  if ( opts.groupRevisions.has_value() )
+    {
+      jto.emplace( "group-revisions", *opts.groupRevisions );
+    }
+
+  if ( opts.demoteVulnerable.has_value() )
+    {
+      jto.emplace( "demote-vulnerable", *opts.demoteVulnerable );
+    }
+
+  if ( opts.resolveLinks.has_value() )
+    {
+      jto.emplace( "resolve-links", *opts.resolveLinks );
+    }
 }
 
 
@@ -715,6 +863,19 @@ from_json( const nlohmann::json & jfrom, ManifestRaw & manifest )
       else if ( key == "hook" ) { value.get_to( manifest.hook ); }
       else if ( key == "options" ) { value.get_to( manifest.options ); }
       else if ( key == "env-base" ) { value.get_to( manifest.envBase ); }
+      else if ( key == "include" )
+        {
+          try
+            {
+              value.get_to( manifest.include );
+            }
+          catch ( nlohmann::json::exception & err )
+            {
+              throw InvalidManifestFileException(
+                "couldn't parse manifest field 'include'",
+                extract_json_errmsg( err ) );
+            }
+        }
       else
         {
           throw InvalidManifestFileException( "unrecognized manifest field: '"
@@ -744,6 +905,8 @@ to_json( nlohmann::json & jto, const ManifestRaw & manifest )
   if ( manifest.profile.has_value() ) { jto["profile"] = *manifest.profile; }
 
   if ( manifest.hook.has_value() ) { jto["hook"] = *manifest.hook; }
+
+  if ( manifest.include.has_value() ) { jto["include"] = *manifest.include; }
 }
 
 
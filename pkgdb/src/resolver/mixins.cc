@@ -13,12 +13,14 @@
 #include <string_view>
 #include <utility>
 #include <variant>
+#include <vector>
 
 #include <argparse/argparse.hpp>
 #include <nix/util.hh>
 
 #include "flox/resolver/environment.hh"
 #include "flox/resolver/lockfile.hh"
+#include "flox/resolver/manifest-include.hh"
 #include "flox/resolver/manifest-raw.hh"
 #include "flox/resolver/manifest.hh"
 #include "flox/resolver/mixins.hh"
@@ -127,7 +129,9 @@ EnvironmentMixin::setManifestRaw(
         "initialized" );
     }
 
-  this->manifestRaw = readManifestFromPath<ManifestRaw>( *maybePath );
+  ComposedManifest composed = composeManifest( *maybePath );
+  this->manifestRaw          = std::move( composed.manifest );
+  this->includedLocks        = std::move( composed.includedLocks );
 }
 
 void
@@ -147,7 +151,11 @@ EnvironmentMixin::setManifestRaw( std::optional<ManifestRaw> maybeRaw )
         "initialized" );
     }
 
-  this->manifestRaw = std::move( maybeRaw );
+  ComposedManifest composed
+    = composeManifest( std::move( *maybeRaw ),
+                       std::filesystem::current_path() );
+  this->manifestRaw   = std::move( composed.manifest );
+  this->includedLocks = std::move( composed.includedLocks );
 }
 
 const EnvironmentManifest &
@@ -256,16 +264,44 @@ EnvironmentMixin::getEnvironment()
 {
   if ( ! this->environment.has_value() )
     {
+      std::vector<Lockfile> includedLockfiles;
+      for ( const auto & lockRaw : this->includedLocks )
+        {
+          includedLockfiles.emplace_back( lockRaw );
+        }
       this->environment = std::make_optional<Environment>(
         this->getGlobalManifest(),
         this->getManifest(),
         this->getLockfile(),
-        this->upgrades.has_value() ? *this->upgrades : false );
+        this->upgrades.has_value() ? *this->upgrades : false,
+        std::move( includedLockfiles ) );
+      if ( this->sessionStore != nullptr )
+        {
+          this->environment->useSession(
+            static_cast<nix::ref<nix::Store>>( this->sessionStore ),
+            this->sessionInputs );
+        }
     }
   return *this->environment;
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+void
+EnvironmentMixin::useSession( const nix::ref<nix::Store> &            store,
+                              std::shared_ptr<pkgdb::PkgDbInputCache> inputs )
+{
+  if ( this->environment.has_value() )
+    {
+      throw EnvironmentMixinException(
+        "session may not be set after environment is initialized" );
+    }
+  this->sessionStore  = static_cast<std::shared_ptr<nix::Store>>( store );
+  this->sessionInputs = std::move( inputs );
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 argparse::Argument &
@@ -7,12 +7,17 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
 #include <cstdlib>
 #include <filesystem>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <optional>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <variant>
 #include <vector>
 
@@ -25,6 +30,7 @@
 #include "flox/pkgdb/input.hh"
 #include "flox/pkgdb/pkg-query.hh"
 #include "flox/pkgdb/read.hh"
+#include "flox/pkgdb/usage.hh"
 #include "flox/registry.hh"
 #include "flox/resolver/environment.hh"
 #include "flox/resolver/lockfile.hh"
@@ -118,6 +124,20 @@ SearchCommand::addSearchQueryOptions( argparse::ArgumentParser & parser )
     .action( [&]( const std::string & arg )
              { this->params.query.partialNameOrRelPathMatch = arg; } );
 
+  parser.add_argument( "--collapse-systems" )
+    .help( "emit one result for a package found on multiple systems." )
+    .nargs( 0 )
+    .implicit_value( true )
+    .action( [&]( const auto & )
+             { this->params.query.collapseSystems = true; } );
+
+  parser.add_argument( "--collapse-aliases" )
+    .help( "emit one result for packages which are aliases of each other." )
+    .nargs( 0 )
+    .implicit_value( true )
+    .action( [&]( const auto & )
+             { this->params.query.collapseAliases = true; } );
+
   parser.add_argument( "--dump-query" )
     .help( "print the generated SQL query and exit." )
     .nargs( 0 )
@@ -142,6 +162,7 @@ SearchCommand::SearchCommand() : parser( "search" )
   this->addSearchParamArgs( this->parser );
   this->addFloxDirectoryOption( this->parser );
   this->addSearchQueryOptions( this->parser );
+  command::addOutputFormatArg( this->parser );
 }
 
 
@@ -188,83 +209,255 @@ SearchCommand::initEnvironment()
 
 /* -------------------------------------------------------------------------- */
 
-int
-SearchCommand::run()
+/**
+ * @brief Rows of a single search result, paired with the system they were
+ *        found for.
+ *
+ * These only hold multiple rows when collapsing systems.
+ */
+using ResultRows = std::vector<std::pair<System, pkgdb::row_id>>;
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Group keyed query results sharing a `relPath`, `version`, and
+ *        `description` across systems.
+ *
+ * Groups are ordered by their best ranked row.
+ * When @a deduplicate is set only the best ranked group of each `relPath` is
+ * kept, and groups already provided by a higher priority input, as recorded
+ * in @a seen, are dropped.
+ */
+[[nodiscard]] static std::vector<ResultRows>
+collapseSystems( std::vector<pkgdb::PkgQueryResult> results,
+                 const std::vector<System> &        systems,
+                 bool                               deduplicate,
+                 std::unordered_set<std::string> &  seen )
+{
+  std::vector<ResultRows>                 groups;
+  std::unordered_map<std::string, size_t> groupIndices;
+  /* Maps `relPath' to the key of its best group when deduplicating. */
+  std::unordered_map<std::string, std::string> bestGroups;
+  for ( auto & result : results )
+    {
+      /* `relPath' is a JSON list and can't contain a raw NUL. */
+      std::string dedupKey = result.relPath + '\0' + result.version;
+      if ( deduplicate && seen.contains( dedupKey ) ) { continue; }
+
+      std::string key = dedupKey + '\0' + result.description;
+      if ( deduplicate )
+        {
+          auto [best, _] = bestGroups.try_emplace( result.relPath, key );
+          if ( best->second != key ) { continue; }
+        }
+
+      auto [index, inserted] = groupIndices.try_emplace( key, groups.size() );
+      if ( inserted ) { groups.emplace_back(); }
+      ResultRows & rows = groups[index->second];
+      /* Keep the best ranked row for each system. */
+      if ( std::find_if( rows.begin(),
+                         rows.end(),
+                         [&]( const auto & row )
+                         { return row.first == result.system; } )
+           == rows.end() )
+        {
+          rows.emplace_back( std::move( result.system ), result.id );
+        }
+    }
+
+  if ( deduplicate )
+    {
+      for ( const auto & [relPath, key] : bestGroups )
+        {
+          seen.emplace( key.substr( 0, key.rfind( '\0' ) ) );
+        }
+    }
+
+  /* List systems in the order they were requested. */
+  auto bySystemRank = [&]( const auto & lhs, const auto & rhs )
+  {
+    return std::find( systems.begin(), systems.end(), lhs.first )
+           < std::find( systems.begin(), systems.end(), rhs.first );
+  };
+  for ( auto & rows : groups )
+    {
+      std::sort( rows.begin(), rows.end(), bySystemRank );
+    }
+  return groups;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Hydrate a collapsed result from the row of its first system,
+ *        replacing the per-system `id`, `system`, and `absPath` fields with
+ *        `systems` and `ids` keyed by system.
+ */
+[[nodiscard]] static nlohmann::json
+getCollapsedRowJSON( pkgdb::PkgDbInput & input, const ResultRows & rows )
+{
+  nlohmann::json rsl = input.getRowJSON( rows.front().second );
+  rsl.erase( "id" );
+  rsl.erase( "system" );
+  rsl.erase( "absPath" );
+  nlohmann::json systems = nlohmann::json::array();
+  nlohmann::json ids     = nlohmann::json::object();
+  for ( const auto & [system, id] : rows )
+    {
+      systems.emplace_back( system );
+      ids[system] = id;
+    }
+  rsl.emplace( "systems", std::move( systems ) );
+  rsl.emplace( "ids", std::move( ids ) );
+  return rsl;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+void
+SearchCommand::search(
+  const std::function<bool( const nlohmann::json & )> & onRecord )
 {
   /* Initialize environment. */
   this->initEnvironment();
 
   pkgdb::PkgQueryArgs args = this->getEnvironment().getCombinedBaseQueryArgs();
   this->params.query.fillPkgQueryArgs( args );
+  /* SQL deduplication keeps a single system for each `relPath', so collapsed
+   * results are deduplicated while grouping them instead. */
+  const bool collapse    = this->params.query.collapseSystems;
+  const bool deduplicate = args.deduplicate;
+  if ( collapse ) { args.deduplicate = false; }
+  /* Rank packages locked more often on this machine first.
+   * Locking never does this, so that locks don't depend on the machine. */
+  std::filesystem::path usagePath = pkgdb::getUsageDbPath();
+  args.rankByUsage
+    = ( ! usagePath.empty() ) && std::filesystem::exists( usagePath );
   nlohmann::json queryJson;
   to_json( queryJson, args );
   debugLog( "performing search with query: " + queryJson.dump() );
   auto query = pkgdb::PkgQuery( args );
   if ( this->dumpQuery ) { std::cout << query.str() << std::endl; }
 
-  /* Collect results from each input */
+  /* Collect results from each input.
+   * Inputs are visited in priority order, so when deduplicating we keep the
+   * first occurrence of each `( relPath, version )' pair and drop the same
+   * package from lower priority inputs before it is ever hydrated. */
   auto                                            globalResultCount = 0;
-  std::vector<std::vector<pkgdb::row_id>>         globallyFoundIds;
+  std::vector<std::vector<ResultRows>>            globallyFoundRows;
   std::vector<std::shared_ptr<pkgdb::PkgDbInput>> inputs;
+  std::unordered_set<std::string>                 seen;
   for ( const auto & [name, input] :
         *this->getEnvironment().getPkgDbRegistry() )
     {
-      auto                       dbRO = input->getDbReadOnly();
-      std::vector<pkgdb::row_id> thisInputIds;
+      auto                    dbRO = input->getDbReadOnly();
+      std::vector<ResultRows> thisInputRows;
+      if ( args.rankByUsage ) { pkgdb::UsageDb::attach( dbRO->db, usagePath ); }
 
       debugLog( "querying input=" + name );
-      for ( const auto & id : query.execute( dbRO->db ) )
+      if ( collapse )
         {
-          thisInputIds.emplace_back( id );
+          thisInputRows = collapseSystems( query.executeKeyed( dbRO->db ),
+                                           args.systems,
+                                           deduplicate,
+                                           seen );
+        }
+      else if ( query.deduplicate )
+        {
+          size_t dropped = 0;
+          for ( auto & result : query.executeKeyed( dbRO->db ) )
+            {
+              /* `relPath' is a JSON list and can't contain a raw NUL. */
+              std::string key
+                = std::move( result.relPath ) + '\0' + result.version;
+              if ( seen.emplace( std::move( key ) ).second )
+                {
+                  thisInputRows.emplace_back(
+                    ResultRows { { std::move( result.system ), result.id } } );
+                }
+              else { ++dropped; }
+            }
+          if ( 0 < dropped )
+            {
+              debugLog( "dropped " + std::to_string( dropped )
+                        + " results already provided by higher priority "
+                          "inputs, input="
+                        + name );
+            }
+        }
+      else
+        {
+          for ( const auto & id : query.execute( dbRO->db ) )
+            {
+              thisInputRows.emplace_back( ResultRows { { System {}, id } } );
+            }
         }
       inputs.emplace_back( input );
 
-      globalResultCount += thisInputIds.size();
-      debugLog( "found " + std::to_string( thisInputIds.size() )
+      globalResultCount += thisInputRows.size();
+      debugLog( "found " + std::to_string( thisInputRows.size() )
                 + " results, input=" + name );
-      globallyFoundIds.emplace_back( std::move( thisInputIds ) );
+      globallyFoundRows.emplace_back( std::move( thisInputRows ) );
     }
 
   /* Return results as a single flat list by iterating over each input with
    * results */
   debugLog( "found " + std::to_string( globalResultCount )
             + " total results across all inputs" );
+  std::optional<size_t> remaining;
   if ( query.limit.has_value() )
     {
       debugLog( "returning the first " + std::to_string( *query.limit )
                 + " results" );
-      // Emit the number of results as the first line
+      // Emit the number of results as the first record
       nlohmann::json resultCountRecord
         = { { "result-count", globalResultCount } };
-      std::cout << resultCountRecord << std::endl;
-      // Only print the first `limit` results
-      for ( size_t i = 0; i < inputs.size(); i++ )
-        {
-          if ( *query.limit == 0 ) { break; }
-          auto input    = inputs[i];
-          auto inputIds = globallyFoundIds[i];
-          for ( auto & id : inputIds )
-            {
-              if ( *query.limit == 0 ) { break; }
-              std::cout << input->getRowJSON( id ).dump() << std::endl;
-              *query.limit -= 1;
-            }
-        }
+      if ( ! onRecord( resultCountRecord ) ) { return; }
+      remaining = *query.limit;
     }
-  else
+  else { debugLog( "returning all results" ); }
+
+  for ( size_t i = 0; i < inputs.size(); i++ )
     {
-      debugLog( "returning all results" );
-      // Print all of the results
-      for ( size_t i = 0; i < inputs.size(); i++ )
+      for ( const auto & rows : globallyFoundRows[i] )
         {
-          auto input    = inputs[i];
-          auto inputIds = globallyFoundIds[i];
-          for ( auto & id : inputIds )
+          // Only emit the first `limit` results
+          if ( remaining.has_value() )
+            {
+              if ( *remaining == 0 ) { return; }
+              --*remaining;
+            }
+          nlohmann::json record
+            = collapse ? getCollapsedRowJSON( *inputs[i], rows )
+                       : inputs[i]->getRowJSON( rows.front().second );
+          if ( this->params.query.collapseAliases )
             {
-              std::cout << input->getRowJSON( id ).dump() << std::endl;
+              record.emplace( "aliases",
+                              inputs[i]->getDbReadOnly()->getAliases(
+                                rows.front().second ) );
             }
+          if ( ! onRecord( record ) ) { return; }
         }
     }
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+SearchCommand::run()
+{
+  this->search(
+    []( const nlohmann::json & record )
+    {
+      command::writeRecord( record );
+      /* Flush so that callers can stream results. */
+      std::cout.flush();
+      return true;
+    } );
   return EXIT_SUCCESS;
 }
 
@@ -26,6 +26,8 @@ SearchQuery::clear()
   this->semver           = std::nullopt;
   this->partialMatch     = std::nullopt;
   this->partialNameMatch = std::nullopt;
+  this->collapseSystems  = false;
+  this->collapseAliases  = false;
 }
 
 
@@ -118,6 +120,14 @@ from_json( const nlohmann::json & jfrom, SearchQuery & qry )
         {
           getOrFail( key, value, qry.deduplicate );
         }
+      else if ( key == "collapse-systems" )
+        {
+          getOrFail( key, value, qry.collapseSystems );
+        }
+      else if ( key == "collapse-aliases" )
+        {
+          getOrFail( key, value, qry.collapseAliases );
+        }
       else if ( key == "match-name" )
         {
           getOrFail( key, value, qry.partialNameMatch );
@@ -154,6 +164,8 @@ to_json( nlohmann::json & jto, const SearchQuery & qry )
   jto["match-name-or-rel-path"] = qry.partialNameOrRelPathMatch;
   jto["limit"]                  = qry.limit;
   jto["deduplicate"]            = qry.deduplicate;
+  jto["collapse-systems"]       = qry.collapseSystems;
+  jto["collapse-aliases"]       = qry.collapseAliases;
 }
 
 
@@ -173,6 +185,7 @@ SearchQuery::fillPkgQueryArgs( pkgdb::PkgQueryArgs & pqa ) const
   pqa.partialNameOrRelPathMatch = this->partialNameOrRelPathMatch;
   pqa.limit                     = this->limit;
   pqa.deduplicate               = this->deduplicate;
+  pqa.collapseAliases           = this->collapseAliases;
   return pqa;
 }
 
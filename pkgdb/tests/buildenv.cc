@@ -0,0 +1,276 @@
+/* ========================================================================== *
+ *
+ * @file buildenv.cc
+ *
+ * @brief Tests for `flox::buildenv::buildEnvironment` link resolution.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <filesystem>
+#include <sys/stat.h>
+
+#include <nix/globals.hh>
+#include <nix/util.hh>
+
+#include "flox/buildenv/buildenv.hh"
+
+#include "test.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Create packages whose files are reached through chains of links.
+ *
+ * - `real` provides `bin/hello` and `share/doc`.
+ * - `unwrapped/bin` links to `real/bin`.
+ * - `wrapped/bin/hello` links to `unwrapped/bin/hello`.
+ * - `pkgA/bin/hello` links to `wrapped/bin/hello`.
+ * - `pkgB/bin` links to `real/bin`.
+ * - `pkgC/bin/other` is a regular file.
+ * - `pkgD/share` links to `real/share`.
+ */
+static void
+createFixture( const std::filesystem::path & root )
+{
+  std::filesystem::create_directories( root / "real/bin" );
+  std::filesystem::create_directories( root / "real/share/doc" );
+  nix::writeFile( root / "real/bin/hello", "hello" );
+
+  std::filesystem::create_directories( root / "unwrapped" );
+  nix::createSymlink( "../real/bin", root / "unwrapped/bin" );
+
+  std::filesystem::create_directories( root / "wrapped/bin" );
+  nix::createSymlink( "../../unwrapped/bin/hello", root / "wrapped/bin/hello" );
+
+  std::filesystem::create_directories( root / "pkgA/bin" );
+  nix::createSymlink( root / "wrapped/bin/hello", root / "pkgA/bin/hello" );
+
+  std::filesystem::create_directories( root / "pkgB" );
+  nix::createSymlink( "../real/bin", root / "pkgB/bin" );
+
+  std::filesystem::create_directories( root / "pkgC/bin" );
+  nix::writeFile( root / "pkgC/bin/other", "other" );
+
+  std::filesystem::create_directories( root / "pkgD" );
+  nix::createSymlink( "../real/share", root / "pkgD/share" );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Count the links followed to resolve @a path.
+ *
+ * The fixture's relative links never apply `..` to a link, so lexical
+ * normalization is sufficient.
+ */
+static unsigned
+linkDepth( const std::filesystem::path & path )
+{
+  unsigned              depth = 0;
+  std::filesystem::path current( path );
+  for ( bool found = true; found; )
+    {
+      found = false;
+      std::filesystem::path prefix;
+      for ( const auto & part : current )
+        {
+          prefix /= part;
+          if ( ! std::filesystem::is_symlink( prefix ) ) { continue; }
+          auto rest   = current.lexically_relative( prefix );
+          auto target = std::filesystem::read_symlink( prefix );
+          if ( target.is_relative() )
+            {
+              target = prefix.parent_path() / target;
+            }
+          if ( rest != "." ) { target /= rest; }
+          current = target.lexically_normal();
+          ++depth;
+          found = true;
+          break;
+        }
+    }
+  return depth;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Build an environment from fixture packages of the same priority. */
+static std::filesystem::path
+buildFixtureEnv( const std::filesystem::path &    root,
+                 const std::string &              name,
+                 const std::vector<std::string> & pkgNames,
+                 bool                             resolveLinks )
+{
+  std::vector<flox::buildenv::RealisedPackage> pkgs;
+  for ( const auto & pkgName : pkgNames )
+    {
+      pkgs.emplace_back( root / pkgName,
+                         true,
+                         flox::buildenv::Priority( 5, pkgName ) );
+    }
+  auto out = root / name;
+  std::filesystem::create_directories( out );
+  flox::buildenv::buildEnvironment( out, pkgs, resolveLinks );
+  return out;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Files are linked through their packages' links by default. */
+bool
+test_linkDepth0( const std::filesystem::path & root )
+{
+  auto out = buildFixtureEnv( root, "out0", { "pkgA", "pkgC", "pkgD" }, false );
+
+  EXPECT_EQ( nix::readLink( out / "bin/hello" ),
+             ( root / "pkgA/bin/hello" ).string() );
+  EXPECT_EQ( linkDepth( out / "bin/hello" ), 4U );
+  EXPECT_EQ( linkDepth( out / "bin/other" ), 1U );
+  EXPECT_EQ( linkDepth( out / "share/doc" ), 2U );
+  EXPECT_EQ( nix::readFile( out / "bin/hello" ), "hello" );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Resolved files and directories link to their final targets. */
+bool
+test_linkDepth1( const std::filesystem::path & root )
+{
+  auto out = buildFixtureEnv( root, "out1", { "pkgA", "pkgC", "pkgD" }, true );
+
+  EXPECT_EQ( nix::readLink( out / "bin/hello" ),
+             ( root / "real/bin/hello" ).string() );
+  EXPECT_EQ( linkDepth( out / "bin/hello" ), 1U );
+  EXPECT_EQ( linkDepth( out / "bin/other" ), 1U );
+  EXPECT_EQ( nix::readLink( out / "share" ), ( root / "real/share" ).string() );
+  EXPECT_EQ( linkDepth( out / "share/doc" ), 1U );
+  EXPECT_EQ( nix::readFile( out / "bin/hello" ), "hello" );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief The same file reached through different links conflicts. */
+bool
+test_resolveConflicts0( const std::filesystem::path & root )
+{
+  try
+    {
+      (void) buildFixtureEnv( root, "out2", { "pkgA", "pkgB" }, false );
+      return false;
+    }
+  catch ( const flox::buildenv::FileConflict & err )
+    {
+      /* Conflicts are reported with the files of the packages. */
+      EXPECT_EQ( err.fileA, ( root / "pkgA/bin/hello" ).string() );
+      EXPECT_EQ( err.fileB, ( root / "pkgB/bin/hello" ).string() );
+    }
+  return true;
+}
+
+
+/** @brief The same file reached through different links does not conflict
+ *         when links are resolved. */
+bool
+test_resolveConflicts1( const std::filesystem::path & root )
+{
+  auto out = buildFixtureEnv( root, "out3", { "pkgA", "pkgB" }, true );
+  EXPECT_EQ( nix::readLink( out / "bin/hello" ),
+             ( root / "real/bin/hello" ).string() );
+  return true;
+}
+
+
+/** @brief Different files still conflict when links are resolved, and are
+ *         reported with the files of the packages rather than their targets.
+ */
+bool
+test_resolveConflicts2( const std::filesystem::path & root )
+{
+  std::filesystem::create_directories( root / "pkgE/bin" );
+  nix::writeFile( root / "pkgE/bin/hello", "goodbye" );
+  try
+    {
+      (void) buildFixtureEnv( root, "out4", { "pkgA", "pkgE" }, true );
+      return false;
+    }
+  catch ( const flox::buildenv::FileConflict & err )
+    {
+      EXPECT_EQ( err.fileA, ( root / "pkgA/bin/hello" ).string() );
+      EXPECT_EQ( err.fileB, ( root / "pkgE/bin/hello" ).string() );
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Dangling links and links leaving the store are linked unchanged
+ *         when links are resolved. */
+bool
+test_resolveMissing0( const std::filesystem::path & root )
+{
+  auto outside = std::filesystem::canonical( nix::createTempDir() );
+  nix::writeFile( outside / "other", "other" );
+
+  std::filesystem::create_directories( root / "pkgF/bin" );
+  nix::createSymlink( root / "missing/hello", root / "pkgF/bin/hello" );
+  nix::createSymlink( outside / "other", root / "pkgF/bin/other" );
+
+  auto out = buildFixtureEnv( root, "out5", { "pkgF" }, true );
+  std::filesystem::remove_all( outside );
+
+  EXPECT_EQ( nix::readLink( out / "bin/hello" ),
+             ( root / "pkgF/bin/hello" ).string() );
+  EXPECT_EQ( nix::readLink( out / "bin/other" ),
+             ( root / "pkgF/bin/other" ).string() );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+main( int argc, char * argv[] )
+{
+  int exitCode = EXIT_SUCCESS;
+#define RUN_TEST( ... ) _RUN_TEST( exitCode, __VA_ARGS__ )
+
+  nix::verbosity = nix::lvlWarn;
+  if ( ( 1 < argc ) && ( std::string_view( argv[1] ) == "-v" ) )  // NOLINT
+    {
+      nix::verbosity = nix::lvlDebug;
+    }
+
+  /* Resolve the temporary directory itself so it doesn't add to depths. */
+  auto root = std::filesystem::canonical( nix::createTempDir() );
+  createFixture( root );
+  /* Links are only resolved to targets in the store. */
+  nix::settings.nixStore = root.string();
+
+  RUN_TEST( linkDepth0, root );
+  RUN_TEST( linkDepth1, root );
+  RUN_TEST( resolveConflicts0, root );
+  RUN_TEST( resolveConflicts1, root );
+  RUN_TEST( resolveConflicts2, root );
+  RUN_TEST( resolveMissing0, root );
+
+  std::filesystem::remove_all( root );
+
+  return exitCode;
+}
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
@@ -0,0 +1,111 @@
+#! /usr/bin/env bats
+# -*- mode: bats; -*-
+# ============================================================================ #
+#
+# `pkgdb bundle' tests.
+#
+# A small closure is written to a chroot store, exported, and imported into a
+# second chroot store.
+#
+#
+# ---------------------------------------------------------------------------- #
+
+load setup_suite.bash
+
+# bats file_tags=bundle
+
+# ---------------------------------------------------------------------------- #
+
+setup_file() {
+  export SRC_STORE="$BATS_FILE_TMPDIR/src-store"
+  mkdir -p "$SRC_STORE"
+
+  # `b' references `a', so the closure of `b' holds two paths.
+  FIXTURE="$(
+    nix --extra-experimental-features nix-command eval --raw              \
+        --store "$SRC_STORE" --expr '
+      builtins.toFile "bundle-fixture-b"
+        "${builtins.toFile "bundle-fixture-a" "bundle-fixture-content"}"'
+  )"
+  export FIXTURE
+}
+
+setup() {
+  export DST_STORE="$BATS_TEST_TMPDIR/dst-store"
+  mkdir -p "$DST_STORE"
+}
+
+# path_info STORE PATH
+# --------------------
+# List the closure of PATH in STORE.
+path_info() {
+  nix --extra-experimental-features nix-command path-info -r \
+      --store "$1" "$2"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=bundle:round-trip
+@test "'pkgdb bundle' round trips a closure between stores" {
+  NIX_CONFIG="store = $SRC_STORE" run --separate-stderr "$PKGDB_BIN" \
+    bundle export "$FIXTURE" -o "$BATS_TEST_TMPDIR/fixture.bundle"
+  assert_success
+  run jq -r '.paths' <<< "$output"
+  assert_output 2
+
+  NIX_CONFIG="store = $DST_STORE" run --separate-stderr "$PKGDB_BIN" \
+    bundle import "$BATS_TEST_TMPDIR/fixture.bundle"
+  assert_success
+  run jq -r '"\(.root) \(.paths) \(.skipped)"' <<< "$output"
+  assert_output "$FIXTURE 2 0"
+
+  run path_info "$DST_STORE" "$FIXTURE"
+  assert_success
+  assert_equal "${#lines[@]}" 2
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=bundle:skip
+@test "'pkgdb bundle import' skips valid paths" {
+  NIX_CONFIG="store = $SRC_STORE" run --separate-stderr "$PKGDB_BIN" \
+    bundle export "$FIXTURE" -o "$BATS_TEST_TMPDIR/fixture.bundle"
+  assert_success
+
+  NIX_CONFIG="store = $SRC_STORE" run --separate-stderr "$PKGDB_BIN" \
+    bundle import "$BATS_TEST_TMPDIR/fixture.bundle"
+  assert_success
+  run jq -r '"\(.paths) \(.skipped)"' <<< "$output"
+  assert_output "0 2"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=bundle:verify
+@test "'pkgdb bundle import' rejects modified contents" {
+  NIX_CONFIG="store = $SRC_STORE" run --separate-stderr "$PKGDB_BIN" \
+    bundle export "$FIXTURE" -o "$BATS_TEST_TMPDIR/fixture.bundle"     \
+                  --compression none
+  assert_success
+
+  sed -i 's/bundle-fixture-content/bundle-fixture-c0ntent/' \
+    "$BATS_TEST_TMPDIR/fixture.bundle"
+
+  NIX_CONFIG="store = $DST_STORE" run "$PKGDB_BIN" \
+    bundle import "$BATS_TEST_TMPDIR/fixture.bundle"
+  assert_failure
+  assert_output --partial "hash mismatch"
+
+  run path_info "$DST_STORE" "$FIXTURE"
+  assert_failure
+}
+
+
+# ---------------------------------------------------------------------------- #
+#
+#
+#
+# ============================================================================ #
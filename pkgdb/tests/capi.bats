@@ -0,0 +1,181 @@
+#! /usr/bin/env bats
+# -*- mode: bats; -*-
+# ============================================================================ #
+#
+# `libpkgdb' C interface tests.
+#
+# A small C program linked against `libpkgdb' is compiled and its output is
+# compared against the equivalent `pkgdb' subcommands.
+#
+#
+# ---------------------------------------------------------------------------- #
+
+load setup_suite.bash
+
+# bats file_tags=capi
+
+# ---------------------------------------------------------------------------- #
+
+setup_file() {
+  : "${LIBPKGDB:=$REPO_ROOT/pkgdb/lib/libpkgdb.so}"
+  : "${CC:=cc}"
+  export LIBPKGDB CC
+
+  export TDATA="$TESTS_DIR/data/search"
+  export PKGDB_CACHEDIR="$BATS_FILE_TMPDIR/pkgdbs"
+  export BATS_NO_PARALLELIZE_WITHIN_FILE=true
+
+  export HARNESS="$BATS_FILE_TMPDIR/harness"
+  $CC -o "$HARNESS" "$TESTS_DIR/data/capi/harness.c"                         \
+      -I"$REPO_ROOT/pkgdb/include" -L"${LIBPKGDB%/*}" -lpkgdb               \
+      -Wl,-rpath,"${LIBPKGDB%/*}"
+
+  export NIXPKGS_INPUT='{
+    "from": {
+      "type": "github", "owner": "NixOS", "repo": "nixpkgs",
+      "rev": "'"$NIXPKGS_REV"'"
+    },
+    "subtrees": ["legacyPackages"]
+  }'
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=capi:version
+@test "'libpkgdb' reports its ABI version" {
+  run "$HARNESS" version
+  assert_success
+  assert_output "1 1"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=capi:query
+@test "'pkgdb_input_query' reuses an input across queries" {
+  run --separate-stderr "$HARNESS" query "$NIXPKGS_INPUT"                \
+    '{"pname": "hello", "systems": ["x86_64-linux"]}'                   \
+    '{"pname": "hello", "systems": ["x86_64-linux"]}'
+  assert_success
+  assert_equal "${#lines[@]}" 2
+  run jq -r '.relPath|join(".")' <<< "${lines[0]}"
+  assert_output "hello"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=capi:query
+@test "'pkgdb_input_query' stops when the callback returns non-zero" {
+  run --separate-stderr "$HARNESS" first "$NIXPKGS_INPUT"                \
+    '{"partialMatch": "hello", "systems": ["x86_64-linux"]}'
+  assert_success
+  assert_equal "${#lines[@]}" 1
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=capi:search
+@test "'pkgdb_search' matches 'pkgdb search'" {
+  run --separate-stderr "$PKGDB_BIN" search "$TDATA/params0.json"
+  assert_success
+  _expected="$output"
+
+  run --separate-stderr "$HARNESS" search "$(< "$TDATA/params0.json")"
+  assert_success
+  assert_output "$_expected"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=capi:search
+@test "'pkgdb_search' reuses a session's inputs" {
+  run --separate-stderr "$PKGDB_BIN" search "$TDATA/params0.json"
+  assert_success
+  _expected="$output"
+
+  _FLOX_PKGDB_VERBOSITY=2 run --separate-stderr "$HARNESS" search \
+    "$(< "$TDATA/params0.json")" "$(< "$TDATA/params0.json")"
+  assert_success
+  assert_output "$_expected"$'\n'"$_expected"
+  # The second search opens nothing of its own.
+  run grep -c "reusing input 'nixpkgs' opened by this session" \
+    <<< "$stderr"
+  assert_output 1
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=capi:lock
+@test "'pkgdb_lock' matches 'pkgdb manifest lock'" {
+  _MANIFEST="$BATS_TEST_TMPDIR/manifest.toml"
+  cat > "$_MANIFEST" <<EOF
+[options]
+systems = ["x86_64-linux"]
+
+[registry.inputs.nixpkgs.from]
+type = "github"
+owner = "NixOS"
+repo = "nixpkgs"
+rev = "$NIXPKGS_REV"
+
+[install.hello]
+pkg-path = "hello"
+EOF
+
+  run --separate-stderr "$PKGDB_BIN" manifest lock --manifest "$_MANIFEST"
+  assert_success
+  _expected="$output"
+
+  run --separate-stderr "$HARNESS" lock "$_MANIFEST"
+  assert_success
+  assert_output "$_expected"
+
+  echo "$_expected" > "$BATS_TEST_TMPDIR/manifest.lock"
+  run --separate-stderr "$HARNESS" lock "$_MANIFEST"                         \
+                                        "$BATS_TEST_TMPDIR/manifest.lock"
+  assert_success
+  assert_output "$_expected"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=capi:error
+@test "'libpkgdb' reports errors as JSON" {
+  run --separate-stderr "$HARNESS" search '{ not json'
+  assert_failure
+  run jq -r '.category_message' <<< "$output"
+  assert_output "invalid argument"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=capi:buildenv
+@test "'pkgdb_buildenv' matches 'pkgdb buildenv'" {
+  export _PKGDB_GA_REGISTRY_REF_OR_REV="$NIXPKGS_REV"
+  _LOCKFILE="$BATS_TEST_TMPDIR/manifest.lock"
+  "$PKGDB_BIN" manifest lock --ga-registry --manifest                        \
+    "$TESTS_DIR/data/buildenv/lockfiles/single-package/manifest.toml"        \
+    > "$_LOCKFILE"
+
+  run --separate-stderr "$PKGDB_BIN" buildenv "$_LOCKFILE"
+  assert_success
+  _expected="$(jq -r '.store_path' <<< "$output")"
+
+  run --separate-stderr "$HARNESS" buildenv "$(< "$_LOCKFILE")"
+  assert_success
+  assert_output "$_expected"
+}
+
+
+# ---------------------------------------------------------------------------- #
+#
+#
+#
+# ============================================================================ #
@@ -80,3 +80,35 @@ setup_file() {
   assert [ "$($JQ -r '. | length' $BATS_TEST_TMPDIR/warnings.json)" == "1" ]
   assert [ "$($JQ -r '.[0].package' $BATS_TEST_TMPDIR/warnings.json)" == "yi" ]
 }
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=advisories,advisories:check
+@test "Packages with known advisories produce warnings" {
+  run --separate-stderr ${PKGDB_BIN?} manifest lock --ga-registry --manifest "${MANIFESTS?}/unfree/manifest.toml"
+  assert_success
+  echo "$output" > $BATS_TEST_TMPDIR/manifest.lock
+
+  _INFO="$($JQ -c ".packages[\"${NIX_SYSTEM?}\"].hello.info" $BATS_TEST_TMPDIR/manifest.lock)"
+  $JQ -n --argjson info "$_INFO" '[{
+    id: "CVE-0000-0001", aliases: ["GHSA-0001"], pname: $info.pname,
+    severity: "high", affected: [{ introduced: $info.version }]
+  }]' > $BATS_TEST_TMPDIR/feed.json
+
+  export PKGDB_ADVISORIES="$BATS_TEST_TMPDIR/advisories.sqlite"
+  run ${PKGDB_BIN?} advisories import $BATS_TEST_TMPDIR/feed.json
+  assert_success
+  assert [ "$(echo "$output" | $JQ -r '.advisories')" == "1" ]
+
+  run ${PKGDB_BIN?} advisories match "$($JQ -r '.pname' <<< "$_INFO")" "$($JQ -r '.version' <<< "$_INFO")"
+  assert_success
+  assert [ "$(echo "$output" | $JQ -r '.id')" == "CVE-0000-0001" ]
+
+  run ${PKGDB_BIN?} manifest check --lockfile $BATS_TEST_TMPDIR/manifest.lock
+  assert_success
+  echo "$output" > $BATS_TEST_TMPDIR/warnings.json
+
+  assert [ "$($JQ -r '. | length' $BATS_TEST_TMPDIR/warnings.json)" == "2" ]
+  assert [ "$($JQ -r '.[1].package' $BATS_TEST_TMPDIR/warnings.json)" == "hello" ]
+  assert [ "$($JQ -r '.[1].message | test("CVE-0000-0001")' $BATS_TEST_TMPDIR/warnings.json)" == "true" ]
+}
@@ -0,0 +1,117 @@
+/*
+ * Exercises the `libpkgdb' C interface.
+ *
+ * Usage:
+ *   harness version
+ *   harness query INPUT QUERY...   Run each query on one opened input.
+ *   harness first INPUT QUERY      Stop after the first result.
+ *   harness search PARAMS...       Run each search on one session.
+ *   harness lock MANIFEST [LOCKFILE]
+ *   harness buildenv LOCKFILE
+ *
+ * Records are printed one per line.
+ * On failure the session's last error is printed and its code is returned.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "flox/libpkgdb.h"
+
+static int
+printRecord( const char * json, void * userdata )
+{
+  int * count = (int *) userdata;
+  printf( "%s\n", json );
+  ++*count;
+  return 0;
+}
+
+static int
+printFirst( const char * json, void * userdata )
+{
+  printRecord( json, userdata );
+  return 1;
+}
+
+static int
+fail( pkgdb_session * session, int rc )
+{
+  const char * err = pkgdb_session_last_error( session );
+  printf( "%s\n", ( err == NULL ) ? "null" : err );
+  pkgdb_session_free( session );
+  return rc;
+}
+
+int
+main( int argc, char * argv[] )
+{
+  if ( argc < 2 ) { return 1; }
+
+  if ( strcmp( argv[1], "version" ) == 0 )
+    {
+      printf( "%u %d\n", pkgdb_abi_version(), PKGDB_ABI_VERSION );
+      return 0;
+    }
+
+  pkgdb_session * session = NULL;
+  int             rc      = pkgdb_session_new( &session );
+  if ( rc != 0 ) { return rc; }
+
+  int count = 0;
+  if ( ( ( strcmp( argv[1], "query" ) == 0 )
+         || ( strcmp( argv[1], "first" ) == 0 ) )
+       && ( 3 < argc ) )
+    {
+      pkgdb_input * input = NULL;
+      if ( ( rc = pkgdb_input_open( session, argv[2], &input ) ) != 0 )
+        {
+          return fail( session, rc );
+        }
+      pkgdb_record_callback callback
+        = ( strcmp( argv[1], "first" ) == 0 ) ? printFirst : printRecord;
+      for ( int idx = 3; idx < argc; ++idx )
+        {
+          rc = pkgdb_input_query( session, input, argv[idx], callback, &count );
+          if ( rc != 0 )
+            {
+              pkgdb_input_free( input );
+              return fail( session, rc );
+            }
+        }
+      pkgdb_input_free( input );
+    }
+  else if ( ( strcmp( argv[1], "search" ) == 0 ) && ( 3 <= argc ) )
+    {
+      for ( int idx = 2; idx < argc; ++idx )
+        {
+          rc = pkgdb_search( session, argv[idx], printRecord, &count );
+          if ( rc != 0 ) { return fail( session, rc ); }
+        }
+    }
+  else if ( ( strcmp( argv[1], "lock" ) == 0 ) && ( 3 <= argc ) )
+    {
+      const char * lockfilePath = ( argc < 4 ) ? NULL : argv[3];
+      char *       lockfile     = NULL;
+      rc = pkgdb_lock( session, argv[2], lockfilePath, &lockfile );
+      if ( rc != 0 ) { return fail( session, rc ); }
+      printf( "%s\n", lockfile );
+      pkgdb_string_free( lockfile );
+    }
+  else if ( ( strcmp( argv[1], "buildenv" ) == 0 ) && ( argc == 3 ) )
+    {
+      char * storePath = NULL;
+      rc = pkgdb_buildenv( session, argv[2], NULL, &storePath );
+      if ( rc != 0 ) { return fail( session, rc ); }
+      printf( "%s\n", storePath );
+      pkgdb_string_free( storePath );
+    }
+  else
+    {
+      pkgdb_session_free( session );
+      return 1;
+    }
+
+  pkgdb_session_free( session );
+  return 0;
+}
@@ -0,0 +1,7 @@
+/* Tiny shared library served up by `ld-floxlib.so' in `ld-floxlib.bats'. */
+
+int
+floxtest_answer( void )
+{
+  return 42;
+}
@@ -0,0 +1,24 @@
+/*
+ * Links against `libfloxtest.so' without a RUNPATH so that it can only be
+ * found by way of `ld-floxlib.so'.
+ * Prints the value of `FLOX_ENV_LIB_DIRS' after loading so that tests can
+ * assert that the environment was not modified by the audit library.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+int floxtest_answer( void );
+
+int
+main( int argc, char * argv[] )
+{
+  // Optionally `dlopen' additional missing libraries to exercise repeated
+  // lookups of the same name.
+  for ( int idx = 1; idx < argc; ++idx ) { (void) dlopen( argv[idx], RTLD_NOW ); }
+  const char * dirs = getenv( "FLOX_ENV_LIB_DIRS" );
+  printf( "answer: %d\n", floxtest_answer() );
+  printf( "FLOX_ENV_LIB_DIRS: %s\n", ( dirs == NULL ) ? "" : dirs );
+  return 0;
+}
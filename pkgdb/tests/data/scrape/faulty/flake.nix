@@ -0,0 +1,71 @@
+# ============================================================================ #
+#
+# A flake with packages that fail to evaluate, never finish evaluating, or
+# exhaust memory.
+#
+# Used to test quarantine of attributes by `pkgdb scrape'.
+#
+# ---------------------------------------------------------------------------- #
+{
+  description = "A flake with poisoned packages";
+
+  outputs = _: let
+    defaultSystems = [
+      "x86_64-linux"
+      "aarch64-linux"
+      "x86_64-darwin"
+      "aarch64-darwin"
+    ];
+
+    # Exponential, but constant memory, so only a time limit stops it.
+    spin = n:
+      if n == 0
+      then 1
+      else (spin (n - 1)) + (spin (n - 1));
+
+    # Needs several GiB to hold its elements, so only a memory limit stops it.
+    hoard = builtins.genList (i: i) 100000000;
+
+    mkPkg = system: name:
+      derivation {
+        inherit name system;
+        builder = "/bin/sh";
+        args = ["-c" "echo > $out"];
+      };
+
+    mkPackages = system: {
+      good = mkPkg system "good";
+      also-good = mkPkg system "also-good";
+      bad = throw "this package is poisoned";
+      slow =
+        if 0 < (spin 64)
+        then mkPkg system "slow"
+        else null;
+    };
+
+    # Kept out of `packages' so that only tests setting
+    # `FLOX_SCRAPE_MEMORY_LIMIT' evaluate it.
+    mkLegacyPackages = system: {
+      good = mkPkg system "good";
+      hungry =
+        if 0 < (builtins.length hoard)
+        then mkPkg system "hungry"
+        else null;
+    };
+
+    forAllSystems = f:
+      builtins.listToAttrs (map (system: {
+          name = system;
+          value = f system;
+        })
+        defaultSystems);
+  in {
+    packages = forAllSystems mkPackages;
+    legacyPackages = forAllSystems mkLegacyPackages;
+  };
+}
+# ---------------------------------------------------------------------------- #
+#
+#
+#
+# ============================================================================ #
@@ -4,12 +4,19 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <memory>
 
+#include <nix/util.hh>
 #include <nlohmann/json.hpp>
+#include <sqlite3pp.hh>
 
 #include "flox/core/util.hh"
+#include "flox/pkgdb/read.hh"
+#include "flox/pkgdb/write.hh"
+#include "flox/raw-package.hh"
 #include "flox/resolver/environment.hh"
 #include "flox/resolver/manifest.hh"
 #include "test.hh"
@@ -31,6 +38,7 @@ public:
   using Environment::Environment;
   using Environment::getGroupInput;
   using Environment::groupIsLocked;
+  using Environment::solveGroup;
 };
 
 /**
@@ -766,6 +774,71 @@ test_getGroupInput3()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Old locks are looked up by reference in a 2,000 package lockfile,
+ *        and changing one package only unlocks its group.
+ */
+bool
+test_groupIsLocked_large()
+{
+  /* Create manifest with 200 groups of 10 packages. */
+  ManifestRaw manifestRaw;
+  manifestRaw.install.emplace();
+  manifestRaw.options          = Options {};
+  manifestRaw.options->systems = { _system };
+  manifestRaw.registry         = registryWithNixpkgs;
+
+  SystemPackages packages;
+  for ( unsigned idx = 0; idx < 2000; ++idx )
+    {
+      InstallID      iid  = "pkg" + std::to_string( idx );
+      nlohmann::json desc = { { "pkg-path", iid },
+                              { "pkg-group",
+                                "group" + std::to_string( idx / 10 ) } };
+      manifestRaw.install->emplace( iid, ManifestDescriptorRaw( desc ) );
+
+      LockedPackageRaw locked = mockHelloLocked;
+      locked.attrPath         = { "mock", iid };
+      packages.emplace( iid, std::move( locked ) );
+    }
+
+  LockfileRaw lockfileRaw;
+  lockfileRaw.packages = { { _system, std::move( packages ) } };
+  lockfileRaw.manifest = manifestRaw;
+
+  Lockfile lockfile( lockfileRaw );
+  EXPECT( lockfile.getSystemPackages( "aarch64-darwin" ) == nullptr );
+  const LockedPackageRaw * locked
+    = lockfile.getLockedPackage( _system, "pkg7" );
+  EXPECT( locked != nullptr );
+  EXPECT( locked->attrPath == AttrPath( { "mock", "pkg7" } ) );
+
+  /* Change the path of a single package. */
+  ManifestRaw modifiedManifestRaw( manifestRaw );
+  modifiedManifestRaw.install->at( "pkg15" ) = ManifestDescriptorRaw(
+    nlohmann::json( { { "pkg-path", "other" }, { "pkg-group", "group1" } } ) );
+  EnvironmentManifest manifest( modifiedManifestRaw );
+
+  TestEnvironment environment( std::nullopt, manifest, lockfile );
+  auto            groups = manifest.getGroupedDescriptors();
+  EXPECT_EQ( groups.size(), std::size_t( 200 ) );
+  for ( const auto & [name, group] : groups )
+    {
+      EXPECT_EQ( environment.groupIsLocked( name, group, lockfile, _system ),
+                 name != "group1" );
+    }
+
+  /* The changed group is pinned to the input of its unchanged members. */
+  auto input
+    = environment.getGroupInput( groups.at( "group1" ), lockfile, _system );
+  EXPECT( input.has_value() );
+  EXPECT_EQ( *input, mockHelloLocked.input );
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /** @brief createLockfile creates a lock when there is no existing lockfile. */
@@ -922,6 +995,100 @@ test_createLockfile_error()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief `createLockfile()` adopts locks of an included environment for
+ *        unchanged groups and only resolves the project's own additions.
+ */
+bool
+test_createLockfile_included()
+{
+  /* The included environment locked hello. */
+  ManifestRaw includedManifestRaw;
+  includedManifestRaw.install          = { { "hello", std::nullopt } };
+  includedManifestRaw.options          = Options {};
+  includedManifestRaw.options->systems = { _system };
+  includedManifestRaw.registry         = registryWithNixpkgs;
+
+  LockfileRaw includedLockfileRaw;
+  includedLockfileRaw.packages
+    = { { _system, { { "hello", mockHelloLocked } } } };
+  includedLockfileRaw.manifest = includedManifestRaw;
+  includedLockfileRaw.registry = registryWithNixpkgsLocked;
+
+  /* The project adds curl in its own group. */
+  ManifestRaw           manifestRaw( includedManifestRaw );
+  nlohmann::json        curlJSON = { { "pkg-group", "blue" } };
+  ManifestDescriptorRaw curl( curlJSON );
+  manifestRaw.install = { { "hello", std::nullopt }, { "curl", curl } };
+
+  EnvironmentManifest manifest( manifestRaw );
+
+  LockfileRaw expectedLockfileRaw;
+  expectedLockfileRaw.packages
+    = { { _system, { { "hello", mockHelloLocked }, { "curl", curlLocked } } } };
+  expectedLockfileRaw.manifest = manifestRaw;
+
+  Lockfile expectedLockfile( expectedLockfileRaw );
+
+  Environment environment( std::nullopt,
+                           manifest,
+                           std::nullopt,
+                           false,
+                           { Lockfile( includedLockfileRaw ) } );
+  Lockfile    actualLockfile = environment.createLockfile();
+  EXPECT( equalLockfile( actualLockfile, expectedLockfile ) );
+
+  return true;
+}
+
+
+/**
+ * @brief `createLockfile()` resolves packages from an included environment
+ *        again when the including manifest changes their descriptors.
+ */
+bool
+test_createLockfile_included_changed()
+{
+  ManifestRaw includedManifestRaw;
+  includedManifestRaw.install          = { { "hello", std::nullopt } };
+  includedManifestRaw.options          = Options {};
+  includedManifestRaw.options->systems = { _system };
+  includedManifestRaw.registry         = registryWithNixpkgs;
+
+  LockfileRaw includedLockfileRaw;
+  includedLockfileRaw.packages
+    = { { _system, { { "hello", mockHelloLocked } } } };
+  includedLockfileRaw.manifest = includedManifestRaw;
+  includedLockfileRaw.registry = registryWithNixpkgsLocked;
+
+  /* The project overrides hello's descriptor. */
+  ManifestRaw           manifestRaw( includedManifestRaw );
+  nlohmann::json        helloJSON = { { "pkg-path", "hello" } };
+  ManifestDescriptorRaw hello( helloJSON );
+  manifestRaw.install = { { "hello", hello } };
+
+  EnvironmentManifest manifest( manifestRaw );
+
+  LockfileRaw expectedLockfileRaw;
+  expectedLockfileRaw.packages = { { _system, { { "hello", helloLocked } } } };
+  expectedLockfileRaw.manifest = manifestRaw;
+
+  Lockfile expectedLockfile( expectedLockfileRaw );
+
+  Environment environment( std::nullopt,
+                           manifest,
+                           std::nullopt,
+                           false,
+                           { Lockfile( includedLockfileRaw ) } );
+  Lockfile    actualLockfile = environment.createLockfile();
+  EXPECT( equalLockfile( actualLockfile, expectedLockfile ) );
+
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -1028,6 +1195,316 @@ test_getCombinedRegistryRaw_uses_lock_for_global_manifest()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Create a synthetic package database for revision @a rev of
+ *        `github:owner/repo` containing @a packages.
+ *
+ * @param packages `pname` and `version` pairs to add under
+ *                 `legacyPackages.<SYSTEM>`.
+ */
+static std::shared_ptr<pkgdb::PkgDbReadOnly>
+mkRevisionDb(
+  const std::filesystem::path &                            cacheDir,
+  const std::string &                                      rev,
+  uint64_t                                                 lastModified,
+  const std::vector<std::pair<std::string, std::string>> & packages )
+{
+  std::string    url   = "github:owner/repo/" + rev;
+  nlohmann::json attrs = { { "type", "github" },
+                           { "owner", "owner" },
+                           { "repo", "repo" },
+                           { "rev", rev },
+                           { "lastModified", lastModified } };
+  pkgdb::Fingerprint    fingerprint = nix::hashString( nix::htSHA256, url );
+  std::filesystem::path dbPath = pkgdb::genPkgDbName( fingerprint, cacheDir );
+
+  /* `PkgDb' only creates databases for real flakes, so write the
+   * `LockedFlake' row ourselves. */
+  {
+    sqlite3pp::database pdb( dbPath.c_str() );
+    pdb.execute( "CREATE TABLE LockedFlake ( fingerprint TEXT PRIMARY KEY"
+                 ", string TEXT NOT NULL, attrs JSON NOT NULL )" );
+    sqlite3pp::command cmd( pdb,
+                            "INSERT INTO LockedFlake ( fingerprint, string, "
+                            "attrs ) VALUES ( ?, ?, ? )" );
+    cmd.bind( 1,
+              fingerprint.to_string( nix::Base16, false ),
+              sqlite3pp::copy );
+    cmd.bind( 2, url, sqlite3pp::copy );
+    cmd.bind( 3, attrs.dump(), sqlite3pp::copy );
+    cmd.execute();
+  }
+
+  {
+    pkgdb::PkgDb  pdb( dbPath.string() );
+    pkgdb::row_id parentId
+      = pdb.addOrGetAttrSetId( AttrPath { "legacyPackages", _system } );
+    for ( const auto & [pname, version] : packages )
+      {
+        pdb.addPackage( parentId,
+                        pname,
+                        RawPackage( { "legacyPackages", _system, pname },
+                                    pname + "-" + version,
+                                    pname,
+                                    version,
+                                    version ) );
+      }
+  }
+
+  return std::make_shared<pkgdb::PkgDbReadOnly>( dbPath.string() );
+}
+
+
+/** @brief Create a group candidate with default query parameters. */
+static GroupCandidate
+mkCandidate( const std::shared_ptr<pkgdb::PkgDbReadOnly> & dbRO )
+{
+  return GroupCandidate { LockedInputRaw( *dbRO ), dbRO, {} };
+}
+
+
+/** @brief Get the URL of the input a package was locked from. */
+static std::string
+lockedUrl( const SystemPackages & pkgs, const InstallID & iid )
+{
+  return pkgs.at( iid ).value().input.url;
+}
+
+
+const std::string revNewest( 40, 'c' );
+const std::string revMiddle( 40, 'b' );
+const std::string revOldest( 40, 'a' );
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that the first candidate is chosen when every revision
+ *        satisfies the group.
+ */
+bool
+test_solveGroup_newest()
+{
+  std::filesystem::path cacheDir = nix::createTempDir();
+  auto                  newest   = mkRevisionDb( cacheDir,
+                                      revNewest,
+                                      3,
+                                      { { "hello", "2.12.1" },
+                                        { "curl", "8.4.0" } } );
+  auto                  oldest   = mkRevisionDb( cacheDir,
+                                      revOldest,
+                                      1,
+                                      { { "hello", "2.10" },
+                                        { "curl", "7.88.1" } } );
+
+  InstallDescriptors group = {
+    { "hello", ManifestDescriptor( "hello", ManifestDescriptorRaw( R"( {
+        "pkg-path": "hello"
+      } )"_json ) ) },
+    { "curl", ManifestDescriptor( "curl", ManifestDescriptorRaw( R"( {
+        "pkg-path": "curl"
+      } )"_json ) ) }
+  };
+
+  auto rsl
+    = TestEnvironment::solveGroup( group,
+                                   { mkCandidate( newest ),
+                                     mkCandidate( oldest ) },
+                                   _system );
+  auto * pkgs = std::get_if<SystemPackages>( &rsl );
+  EXPECT( pkgs != nullptr );
+  EXPECT_EQ( lockedUrl( *pkgs, "hello" ), newest->lockedRef.string );
+  EXPECT_EQ( lockedUrl( *pkgs, "curl" ), newest->lockedRef.string );
+  EXPECT_EQ( pkgs->at( "curl" )->info.at( "version" ), "8.4.0" );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that older revisions are used when a member is missing or its
+ *        version is unsatisfiable in newer ones.
+ */
+bool
+test_solveGroup_older()
+{
+  std::filesystem::path cacheDir = nix::createTempDir();
+  /* Lacks `curl'. */
+  auto newest
+    = mkRevisionDb( cacheDir, revNewest, 3, { { "hello", "2.12.1" } } );
+  /* Has `curl', but not `^7'. */
+  auto middle = mkRevisionDb( cacheDir,
+                              revMiddle,
+                              2,
+                              { { "hello", "2.12" }, { "curl", "8.4.0" } } );
+  auto oldest = mkRevisionDb( cacheDir,
+                              revOldest,
+                              1,
+                              { { "hello", "2.10" }, { "curl", "7.88.1" } } );
+
+  InstallDescriptors group = {
+    { "hello", ManifestDescriptor( "hello", ManifestDescriptorRaw( R"( {
+        "pkg-path": "hello"
+      } )"_json ) ) },
+    { "curl", ManifestDescriptor( "curl", ManifestDescriptorRaw( R"( {
+        "pkg-path": "curl",
+        "version": "^7"
+      } )"_json ) ) },
+    { "jq", ManifestDescriptor( "jq", ManifestDescriptorRaw( R"( {
+        "pkg-path": "jq",
+        "optional": true
+      } )"_json ) ) }
+  };
+
+  auto rsl = TestEnvironment::solveGroup( group,
+                                          { mkCandidate( newest ),
+                                            mkCandidate( middle ),
+                                            mkCandidate( oldest ) },
+                                          _system );
+  auto * pkgs = std::get_if<SystemPackages>( &rsl );
+  EXPECT( pkgs != nullptr );
+  EXPECT_EQ( lockedUrl( *pkgs, "hello" ), oldest->lockedRef.string );
+  EXPECT_EQ( lockedUrl( *pkgs, "curl" ), oldest->lockedRef.string );
+  EXPECT_EQ( pkgs->at( "hello" )->info.at( "version" ), "2.10" );
+  /* Optional members never rule out a revision. */
+  EXPECT( ! pkgs->at( "jq" ).has_value() );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that a failure is recorded for each candidate when no revision
+ *        satisfies the group.
+ */
+bool
+test_solveGroup_failure()
+{
+  std::filesystem::path cacheDir = nix::createTempDir();
+  auto newest
+    = mkRevisionDb( cacheDir, revNewest, 3, { { "hello", "2.12.1" } } );
+  auto oldest
+    = mkRevisionDb( cacheDir, revOldest, 1, { { "curl", "7.88.1" } } );
+
+  InstallDescriptors group = {
+    { "hello", ManifestDescriptor( "hello", ManifestDescriptorRaw( R"( {
+        "pkg-path": "hello"
+      } )"_json ) ) },
+    { "curl", ManifestDescriptor( "curl", ManifestDescriptorRaw( R"( {
+        "pkg-path": "curl"
+      } )"_json ) ) }
+  };
+
+  auto rsl
+    = TestEnvironment::solveGroup( group,
+                                   { mkCandidate( newest ),
+                                     mkCandidate( oldest ) },
+                                   _system );
+  auto * failure = std::get_if<ResolutionFailure>( &rsl );
+  EXPECT( failure != nullptr );
+  EXPECT_EQ( failure->size(), std::size_t( 2 ) );
+  EXPECT_EQ( failure->at( 0 ).first, "curl" );
+  EXPECT_EQ( failure->at( 0 ).second, newest->lockedRef.string );
+  EXPECT_EQ( failure->at( 1 ).first, "hello" );
+  EXPECT_EQ( failure->at( 1 ).second, oldest->lockedRef.string );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that configured revisions are matched to existing databases.
+ */
+bool
+test_findPkgDbs()
+{
+  std::filesystem::path cacheDir = nix::createTempDir();
+  auto newest
+    = mkRevisionDb( cacheDir, revNewest, 3, { { "hello", "2.12.1" } } );
+  auto oldest
+    = mkRevisionDb( cacheDir, revOldest, 1, { { "hello", "2.10" } } );
+
+  std::vector<pkgdb::Fingerprint> fingerprints
+    = { newest->fingerprint, oldest->fingerprint };
+
+  /* Databases which can't be read are skipped. */
+  {
+    std::filesystem::path brokenPath = oldest->dbPath;
+    brokenPath.replace_extension( "0a1b2c3d.sqlite" );
+    sqlite3pp::database broken( brokenPath.c_str() );
+    broken.execute( "CREATE TABLE Other ( id INTEGER PRIMARY KEY )" );
+  }
+
+  auto found = pkgdb::findPkgDbs(
+    nix::parseFlakeRef( "github:owner/repo/" + revOldest ),
+    fingerprints,
+    cacheDir );
+  EXPECT_EQ( found.size(), std::size_t( 1 ) );
+  EXPECT( found.front() == oldest->dbPath );
+
+  /* References which don't pin a revision match every revision. */
+  found = pkgdb::findPkgDbs( nix::parseFlakeRef( "github:owner/repo" ),
+                             fingerprints,
+                             cacheDir );
+  EXPECT_EQ( found.size(), std::size_t( 2 ) );
+
+  found = pkgdb::findPkgDbs( nix::parseFlakeRef( "github:owner/other" ),
+                             fingerprints,
+                             cacheDir );
+  EXPECT( found.empty() );
+
+  /* Databases of other fingerprints aren't considered. */
+  found = pkgdb::findPkgDbs( nix::parseFlakeRef( "github:owner/repo" ),
+                             { newest->fingerprint },
+                             cacheDir );
+  EXPECT_EQ( found.size(), std::size_t( 1 ) );
+  EXPECT( found.front() == newest->dbPath );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that databases of inputs with scrape rules are found by their
+ *        fingerprint.
+ */
+bool
+test_findPkgDbs_fingerprint()
+{
+  std::filesystem::path cacheDir = nix::createTempDir();
+  auto newest
+    = mkRevisionDb( cacheDir, revNewest, 3, { { "hello", "2.12.1" } } );
+  auto oldest
+    = mkRevisionDb( cacheDir, revOldest, 1, { { "hello", "2.10" } } );
+  std::filesystem::path withRules = newest->dbPath;
+  withRules.replace_extension( "0a1b2c3d.sqlite" );
+  std::filesystem::copy_file( newest->dbPath, withRules );
+
+  /* The database with the default rules comes first. */
+  auto found = pkgdb::findPkgDbs( newest->fingerprint, cacheDir );
+  EXPECT_EQ( found.size(), std::size_t( 2 ) );
+  EXPECT( found.front() == newest->dbPath );
+  EXPECT( found.back() == withRules );
+
+  std::filesystem::remove( newest->dbPath );
+  found = pkgdb::findPkgDbs( newest->fingerprint, cacheDir );
+  EXPECT_EQ( found.size(), std::size_t( 1 ) );
+  EXPECT( found.front() == withRules );
+
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 int
@@ -1051,15 +1528,24 @@ main()
   RUN_TEST( getGroupInput1 );
   RUN_TEST( getGroupInput2 );
   RUN_TEST( getGroupInput3 );
+  RUN_TEST( groupIsLocked_large );
 
   RUN_TEST( createLockfile_new );
   RUN_TEST( createLockfile_existing );
   RUN_TEST( createLockfile_both );
   RUN_TEST( createLockfile_error );
+  RUN_TEST( createLockfile_included );
+  RUN_TEST( createLockfile_included_changed );
 
   RUN_TEST( getCombinedRegistryRaw_uses_lock )
   RUN_TEST( getCombinedRegistryRaw_uses_lock_for_global_manifest )
 
+  RUN_TEST( solveGroup_newest );
+  RUN_TEST( solveGroup_older );
+  RUN_TEST( solveGroup_failure );
+  RUN_TEST( findPkgDbs );
+  RUN_TEST( findPkgDbs_fingerprint );
+
   return exitCode;
 }
 
@@ -67,3 +67,58 @@ setup() {
 
   assert [ -f "$BATS_TEST_TMPDIR/stale.sqlite" ] # stale db is not removed
 }
+
+
+# ---------------------------------------------------------------------------- #
+
+# Databases and eval caches are both named after their flake's fingerprint.
+FINGERPRINT='0c7a9a8ca8f4a3a2e1c36d3c07b5bd1d05d07f3a08b7b0b0f4e2d1b06f5d3a41'
+
+# Create an eval cache with `nix's schema holding a derivation with `meta'.
+mk_eval_cache() {
+  mkdir -p "$XDG_CACHE_HOME/nix/eval-cache-v5"
+  sqlite3 "$XDG_CACHE_HOME/nix/eval-cache-v5/${1?}.sqlite" "
+    CREATE TABLE Attributes (
+      parent INTEGER NOT NULL, name TEXT, type INTEGER NOT NULL,
+      value TEXT, context TEXT, PRIMARY KEY ( parent, name )
+    );
+    INSERT INTO Attributes ( rowid, parent, name, type, value ) VALUES
+      ( 1, 0, '', 1, 'hello' ), ( 2, 1, 'hello', 1, 'meta type' ),
+      ( 3, 2, 'type', 2, 'derivation' ), ( 4, 2, 'meta', 1, 'description' ),
+      ( 5, 4, 'description', 2, 'A friendly greeting' );"
+}
+
+# bats test_tags=gc:eval-cache
+@test "pkgdb gc removes eval caches of stale databases" {
+  export XDG_CACHE_HOME="$BATS_TEST_TMPDIR/cache"
+  mv "$BATS_TEST_TMPDIR/stale.sqlite" "$BATS_TEST_TMPDIR/$FINGERPRINT.sqlite"
+  touch -ad "- 4 days" "$BATS_TEST_TMPDIR/$FINGERPRINT.sqlite"
+  mk_eval_cache "$FINGERPRINT"
+
+  run $PKGDB_BIN gc -c "$BATS_TEST_TMPDIR" --min-age 3
+  assert_success
+  assert_line --index 0 "Found 1 stale databases."
+  assert_line --index 1 "deleting \"$BATS_TEST_TMPDIR/$FINGERPRINT.sqlite\""
+  assert_line --index 2 "deleting \"$XDG_CACHE_HOME/nix/eval-cache-v5/$FINGERPRINT.sqlite\""
+  assert_line --regexp '^Reclaimed [0-9.]+ MiB\.$'
+
+  assert [ ! -f "$XDG_CACHE_HOME/nix/eval-cache-v5/$FINGERPRINT.sqlite" ]
+}
+
+# bats test_tags=gc:prune-eval-cache
+@test "pkgdb gc --prune-eval-caches removes metadata from fully scraped databases" {
+  export XDG_CACHE_HOME="$BATS_TEST_TMPDIR/cache"
+  mv "$BATS_TEST_TMPDIR/current.sqlite" "$BATS_TEST_TMPDIR/$FINGERPRINT.sqlite"
+  # Only part of the flake was scraped, so mark the remainder as done.
+  sqlite3 "$BATS_TEST_TMPDIR/$FINGERPRINT.sqlite" 'UPDATE AttrSets SET done = TRUE'
+  mk_eval_cache "$FINGERPRINT"
+
+  run $PKGDB_BIN gc -c "$BATS_TEST_TMPDIR" --min-age 3 --prune-eval-caches
+  assert_success
+  assert_line "pruning \"$XDG_CACHE_HOME/nix/eval-cache-v5/$FINGERPRINT.sqlite\": removed 2 attributes"
+
+  run sqlite3 "$XDG_CACHE_HOME/nix/eval-cache-v5/$FINGERPRINT.sqlite" \
+    'SELECT COUNT( * ) FROM Attributes'
+  assert_output 3
+}
+
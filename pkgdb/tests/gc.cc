@@ -7,10 +7,13 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <cstdlib>
 #include <fstream>
 #include <sys/stat.h>
 #include <utime.h>
 
+#include <sqlite3pp.hh>
+
 #include "flox/pkgdb/db-package.hh"
 #include "flox/pkgdb/gc.hh"
 #include "flox/pkgdb/write.hh"
@@ -74,6 +77,187 @@ test_findStaleDb()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Fingerprint used to name fixture databases and eval caches. */
+static const std::string fixtureFingerprint
+  = "0c7a9a8ca8f4a3a2e1c36d3c07b5bd1d05d07f3a08b7b0b0f4e2d1b06f5d3a41";
+
+
+/** @brief Create a package database with one attribute set. */
+static void
+mkFixtureDb( const std::filesystem::path & path, bool done )
+{
+  sqlite3pp::database db( path.c_str() );
+  db.execute( "CREATE TABLE AttrSets ( id INTEGER PRIMARY KEY, done BOOL )" );
+  sqlite3pp::command cmd( db, "INSERT INTO AttrSets ( done ) VALUES ( ? )" );
+  cmd.bind( 1, static_cast<int>( done ) );
+  cmd.execute();
+}
+
+
+/**
+ * @brief Create an eval cache using `nix`'s schema, holding a single
+ *        derivation with `meta` and an attribute set named `meta`.
+ */
+static void
+mkFixtureEvalCache( const std::filesystem::path & path )
+{
+  std::filesystem::create_directories( path.parent_path() );
+  sqlite3pp::database db( path.c_str() );
+  db.execute_all( R"SQL(
+    CREATE TABLE Attributes (
+      parent   INTEGER NOT NULL
+    , name     TEXT
+    , type     INTEGER NOT NULL
+    , value    TEXT
+    , context  TEXT
+    , PRIMARY KEY ( parent, name )
+    );
+    INSERT INTO Attributes ( rowid, parent, name, type, value ) VALUES
+      ( 1, 0, '', 1, 'legacyPackages' )
+    , ( 2, 1, 'legacyPackages', 1, 'x86_64-linux' )
+    , ( 3, 2, 'x86_64-linux', 1, 'hello meta' )
+    , ( 4, 3, 'hello', 1, 'meta outPath type' )
+    , ( 5, 4, 'type', 2, 'derivation' )
+    , ( 6, 4, 'outPath', 2, '/nix/store/hello' )
+    , ( 7, 4, 'meta', 1, 'description license' )
+    , ( 8, 7, 'description', 2, 'A friendly greeting' )
+    , ( 9, 7, 'license', 1, 'spdxId' )
+    , ( 10, 9, 'spdxId', 2, 'GPL-3.0-or-later' )
+    , ( 11, 3, 'meta', 1, 'hello' );
+  )SQL" );
+}
+
+
+/** @brief Set the access time of @a path to @a days ago. */
+static void
+ageFile( const std::filesystem::path & path, int days )
+{
+  struct stat    statValue;
+  struct utimbuf newTimes;
+  stat( path.c_str(), &statValue );
+  auto atime = std::chrono::system_clock::now() - std::chrono::days( days );
+  newTimes.actime  = std::chrono::system_clock::to_time_t( atime );
+  newTimes.modtime = statValue.st_mtime;
+  utime( path.c_str(), &newTimes );
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Tests locating the eval cache belonging to a database. */
+bool
+test_findEvalCache0( const std::filesystem::path & tempdir )
+{
+  std::filesystem::path evalCacheDir = tempdir / "nix" / "eval-cache-v5";
+  EXPECT( flox::pkgdb::getEvalCacheDir() == evalCacheDir );
+
+  std::filesystem::path dbPath = tempdir / "pkgdbs" / "other.sqlite";
+  EXPECT( ! flox::pkgdb::findEvalCache( dbPath ).has_value() );
+
+  dbPath = tempdir / "pkgdbs" / ( fixtureFingerprint + ".sqlite" );
+  std::filesystem::path evalCache
+    = evalCacheDir / ( fixtureFingerprint + ".sqlite" );
+  mkFixtureEvalCache( evalCache );
+  EXPECT( flox::pkgdb::findEvalCache( dbPath ) == evalCache );
+
+  /* Databases scraped with rules are suffixed with the rules' hash. */
+  dbPath = tempdir / "pkgdbs" / ( fixtureFingerprint + ".0a1b2c3d.sqlite" );
+  EXPECT( flox::pkgdb::findEvalCache( dbPath ) == evalCache );
+
+  std::filesystem::remove( evalCache );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Tests that eval caches shared by databases are kept until the last of the
+ * databases is deleted. */
+bool
+test_findStaleEvalCaches0( const std::filesystem::path & tempdir )
+{
+  std::filesystem::path cacheDir = tempdir / "shared";
+  std::filesystem::create_directories( cacheDir );
+  std::filesystem::path dbA = cacheDir / ( fixtureFingerprint + ".sqlite" );
+  std::filesystem::path dbB
+    = cacheDir / ( fixtureFingerprint + ".0a1b2c3d.sqlite" );
+  mkFixtureDb( dbA, true );
+  mkFixtureDb( dbB, true );
+  std::filesystem::path evalCache = flox::pkgdb::getEvalCacheDir()
+                                    / ( fixtureFingerprint + ".sqlite" );
+  mkFixtureEvalCache( evalCache );
+
+  EXPECT( flox::pkgdb::findStaleEvalCaches( cacheDir, { dbB } ).empty() );
+  EXPECT( flox::pkgdb::findStaleEvalCaches( cacheDir, { dbA, dbB } )
+          == std::vector<std::filesystem::path> { evalCache } );
+
+  std::filesystem::remove( evalCache );
+  std::filesystem::remove_all( cacheDir );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Tests removing derivations' `meta' from eval caches. */
+bool
+test_pruneEvalCache0( const std::filesystem::path & tempdir )
+{
+  std::filesystem::path evalCache = tempdir / "prune.sqlite";
+  mkFixtureEvalCache( evalCache );
+
+  /* `meta', `description', `license', and `spdxId' of `hello'. */
+  EXPECT_EQ( flox::pkgdb::pruneEvalCache( evalCache ), 4u );
+
+  /* The attribute set named `meta' isn't a derivation's `meta'. */
+  sqlite3pp::database db( evalCache.c_str() );
+  sqlite3pp::query    qry( db, "SELECT rowid FROM Attributes ORDER BY rowid" );
+  std::vector<long long> rows;
+  for ( const auto & row : qry )
+    {
+      rows.emplace_back( row.get<long long>( 0 ) );
+    }
+  EXPECT( rows == ( std::vector<long long> { 1, 2, 3, 4, 5, 6, 11 } ) );
+
+  /* Pruning again is a no-op. */
+  EXPECT_EQ( flox::pkgdb::pruneEvalCache( evalCache ), 0u );
+
+  std::filesystem::remove( evalCache );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Tests that inspecting and vacuuming a database doesn't refresh it. */
+bool
+test_vacuumDatabase0( const std::filesystem::path & tempdir )
+{
+  std::filesystem::path cacheDir = tempdir / "vacuum";
+  std::filesystem::create_directories( cacheDir );
+  std::filesystem::path dbPath = cacheDir / "stale.sqlite";
+
+  mkFixtureDb( dbPath, false );
+  EXPECT( ! flox::pkgdb::isFullyScraped( dbPath ) );
+  {
+    sqlite3pp::database db( dbPath.c_str() );
+    db.execute( "UPDATE AttrSets SET done = TRUE" );
+  }
+  EXPECT( flox::pkgdb::isFullyScraped( dbPath ) );
+
+  ageFile( dbPath, 4 );
+  (void) flox::pkgdb::isFullyScraped( dbPath );
+  (void) flox::pkgdb::vacuumDatabase( dbPath );
+  EXPECT( flox::pkgdb::findStaleDatabases( cacheDir, 3 )
+          == std::vector<std::filesystem::path> { dbPath } );
+
+  std::filesystem::remove_all( cacheDir );
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 int
@@ -90,6 +274,17 @@ main( int argc, char * argv[] )
 
   RUN_TEST( findStaleDb );
 
+  /* Fixture eval caches live in a temporary `XDG_CACHE_HOME'. */
+  {
+    std::filesystem::path tempdir = nix::createTempDir();
+    setenv( "XDG_CACHE_HOME", tempdir.c_str(), 1 );
+    RUN_TEST( findEvalCache0, tempdir );
+    RUN_TEST( findStaleEvalCaches0, tempdir );
+    RUN_TEST( pruneEvalCache0, tempdir );
+    RUN_TEST( vacuumDatabase0, tempdir );
+    std::filesystem::remove_all( tempdir );
+  }
+
   return exitStatus;
 }
 
@@ -0,0 +1,269 @@
+/* ========================================================================== *
+ *
+ * @file layers.cc
+ *
+ * @brief Tests for `flox::buildenv::planLayers`.
+ *
+ *
+ * -------------------------------------------------------------------------- */
+
+#include <algorithm>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <nix/util.hh>
+
+#include "flox/buildenv/layers.hh"
+
+#include "test.hh"
+
+
+/* -------------------------------------------------------------------------- */
+
+using flox::buildenv::LayerPlan;
+using flox::buildenv::ReferenceGraph;
+
+static const std::string glibc   = "/nix/store/g-glibc";
+static const std::string openssl = "/nix/store/o-openssl";
+static const std::string bash    = "/nix/store/b-bash";
+static const std::string curl    = "/nix/store/c-curl";
+static const std::string hello1  = "/nix/store/h1-hello";
+static const std::string hello2  = "/nix/store/h2-hello";
+static const std::string env1    = "/nix/store/e1-environment";
+static const std::string env2    = "/nix/store/e2-environment";
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief The closure of the first version of an environment. */
+static ReferenceGraph
+getEnv1()
+{
+  return { { env1, { hello1, bash, glibc } },
+           { hello1, { glibc, openssl } },
+           { openssl, { glibc } },
+           { bash, { glibc } },
+           { glibc, {} } };
+}
+
+
+/**
+ * @brief The closure of the second version of an environment, which updates
+ *        `hello` to depend on `curl`.
+ */
+static ReferenceGraph
+getEnv2()
+{
+  return { { env2, { hello2, bash, glibc, curl } },
+           { hello2, { glibc, openssl, curl } },
+           { curl, { glibc, openssl } },
+           { openssl, { glibc } },
+           { bash, { glibc } },
+           { glibc, {} } };
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Paths depended on by more paths get their own layers first. */
+bool
+test_planLayers0()
+{
+  auto plan = flox::buildenv::planLayers( getEnv1(), env1, 5 );
+  EXPECT_EQ( plan.maxLayers, 5U );
+  EXPECT( plan.layers
+          == std::vector<std::vector<std::string>>(
+            { { glibc }, { openssl }, { bash }, { hello1, env1 } } ) );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Plans leave a layer for the image's customisation, contain every path
+ *        of the closure once, and end with the root.
+ */
+bool
+test_planLayers1()
+{
+  auto graph = getEnv2();
+  for ( unsigned maxLayers : { 2U, 3U, 4U, 100U } )
+    {
+      auto plan = flox::buildenv::planLayers( graph, env2, maxLayers );
+      EXPECT( plan.layers.size() < maxLayers );
+
+      auto paths = plan.getOrderedPaths();
+      EXPECT_EQ( paths.size(), graph.size() );
+      EXPECT_EQ( paths.back(), env2 );
+      for ( const auto & [path, _] : graph )
+        {
+          EXPECT_EQ( std::count( paths.begin(), paths.end(), path ), 1 );
+        }
+    }
+
+  /* With enough layers the root gets its own layer too. */
+  auto plan = flox::buildenv::planLayers( graph, env2, 100 );
+  EXPECT_EQ( plan.layers.size(), graph.size() );
+  EXPECT( plan.layers.back() == std::vector<std::string>( { env2 } ) );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Invalid bounds and roots are rejected. */
+bool
+test_planLayers2()
+{
+  try
+    {
+      (void) flox::buildenv::planLayers( getEnv1(), env1, 1 );
+      return false;
+    }
+  catch ( const flox::buildenv::InvalidLayerPlanException & )
+    {}
+
+  try
+    {
+      (void) flox::buildenv::planLayers( getEnv1(), env2, 5 );
+      return false;
+    }
+  catch ( const flox::buildenv::InvalidLayerPlanException & )
+    {}
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Planning a new version of an environment against the plan of the
+ *        previous version reuses more of its layers.
+ */
+bool
+test_layerReuse0()
+{
+  auto plan1 = flox::buildenv::planLayers( getEnv1(), env1, 5 );
+
+  /* Ranking by popularity alone gives `curl' the layer `bash' had. */
+  auto fresh = flox::buildenv::planLayers( getEnv2(), env2, 5 );
+  EXPECT( fresh.layers
+          == std::vector<std::vector<std::string>>(
+            { { glibc }, { openssl }, { curl }, { bash, hello2, env2 } } ) );
+  EXPECT_EQ( fresh.countSharedLayers( plan1 ), 2U );
+
+  auto plan2 = flox::buildenv::planLayers( getEnv2(), env2, 5, plan1 );
+  EXPECT( plan2.layers
+          == std::vector<std::vector<std::string>>(
+            { { glibc }, { openssl }, { bash }, { curl, hello2, env2 } } ) );
+  EXPECT_EQ( plan2.countSharedLayers( plan1 ), 3U );
+  return true;
+}
+
+
+/**
+ * @brief Previously dedicated paths which left the closure give up their
+ *        layers, and an unchanged closure keeps its plan.
+ */
+bool
+test_layerReuse1()
+{
+  auto plan2 = flox::buildenv::planLayers( getEnv2(), env2, 5 );
+
+  auto plan1 = flox::buildenv::planLayers( getEnv1(), env1, 5, plan2 );
+  EXPECT( plan1.layers
+          == std::vector<std::vector<std::string>>(
+            { { glibc }, { openssl }, { bash }, { hello1, env1 } } ) );
+
+  auto again = flox::buildenv::planLayers( getEnv2(), env2, 5, plan2 );
+  EXPECT( again == plan2 );
+  EXPECT_EQ( again.countSharedLayers( plan2 ), plan2.layers.size() );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Plans are persisted as JSON. */
+bool
+test_layerPlanJSON0( const std::filesystem::path & tempDir )
+{
+  auto plan = flox::buildenv::planLayers( getEnv1(), env1, 5 );
+
+  nlohmann::json json = plan;
+  EXPECT_EQ( json["max-layers"], 5 );
+  EXPECT( json.get<LayerPlan>() == plan );
+
+  auto path = tempDir / "layers.json";
+  EXPECT( ! flox::buildenv::readLayerPlan( path ).has_value() );
+  flox::buildenv::writeLayerPlan( path, plan );
+  auto read = flox::buildenv::readLayerPlan( path );
+  EXPECT( read.has_value() );
+  EXPECT( *read == plan );
+  return true;
+}
+
+
+/** @brief Malformed plans are rejected. */
+bool
+test_layerPlanJSON1( const std::filesystem::path & tempDir )
+{
+  auto path = tempDir / "invalid.json";
+  nix::writeFile( path, R"({ "max-layers": 5, "groups": [] })" );
+  try
+    {
+      (void) flox::buildenv::readLayerPlan( path );
+      return false;
+    }
+  catch ( const flox::buildenv::InvalidLayerPlanException & )
+    {}
+
+  nix::writeFile( path, R"({ "max-layers": "five", "layers": [] })" );
+  try
+    {
+      (void) flox::buildenv::readLayerPlan( path );
+      return false;
+    }
+  catch ( const flox::buildenv::InvalidLayerPlanException & )
+    {}
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+int
+main( int argc, char * argv[] )
+{
+  int exitCode = EXIT_SUCCESS;
+#define RUN_TEST( ... ) _RUN_TEST( exitCode, __VA_ARGS__ )
+
+  nix::verbosity = nix::lvlWarn;
+  if ( ( 1 < argc ) && ( std::string_view( argv[1] ) == "-v" ) )  // NOLINT
+    {
+      nix::verbosity = nix::lvlDebug;
+    }
+
+  std::filesystem::path tempDir = nix::createTempDir();
+
+  RUN_TEST( planLayers0 );
+  RUN_TEST( planLayers1 );
+  RUN_TEST( planLayers2 );
+  RUN_TEST( layerReuse0 );
+  RUN_TEST( layerReuse1 );
+  RUN_TEST( layerPlanJSON0, tempDir );
+  RUN_TEST( layerPlanJSON1, tempDir );
+
+  std::filesystem::remove_all( tempDir );
+
+  return exitCode;
+}
+
+
+/* -------------------------------------------------------------------------- *
+ *
+ *
+ *
+ * ========================================================================== */
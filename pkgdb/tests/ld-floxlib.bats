@@ -0,0 +1,152 @@
+#! /usr/bin/env bats
+# -*- mode: bats; -*-
+# ============================================================================ #
+#
+# Tests for `ld-floxlib.so' library lookups.
+#
+# A tiny shared library is compiled and copied into several fixture
+# directories, three of which are patched to carry a foreign ELF machine,
+# ELF class, or OSABI.
+# A test program linked against it without a RUNPATH is then run with
+# `LD_AUDIT' pointing at `ld-floxlib.so'.
+#
+#
+# ---------------------------------------------------------------------------- #
+
+load setup_suite.bash
+
+# bats file_tags=ld-floxlib
+
+# ---------------------------------------------------------------------------- #
+
+# patch_bytes FILE OFFSET OCTAL-BYTE...
+# -------------------------------------
+# Overwrite bytes of FILE starting at OFFSET.
+patch_bytes() {
+  local _file="$1" _offset="$2"
+  shift 2
+  # shellcheck disable=SC2059
+  printf "$(printf '\\%s' "$@")"                                            \
+    |dd of="$_file" bs=1 seek="$_offset" conv=notrunc 2>/dev/null
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+setup_file() {
+  if [[ "$(uname -s)" != "Linux" ]]; then
+    skip "not Linux"
+  fi
+
+  : "${LD_FLOXLIB:=$REPO_ROOT/pkgdb/lib/ld-floxlib.so}"
+  : "${CC:=cc}"
+  export LD_FLOXLIB CC
+
+  export FIXTURE_DIR="$BATS_FILE_TMPDIR/ld-floxlib"
+  local _src="$TESTS_DIR/data/ld-floxlib"
+  mkdir -p "$FIXTURE_DIR/"{good,machine,class,osabi,empty}
+
+  $CC -shared -fPIC -o "$FIXTURE_DIR/good/libfloxtest.so"                    \
+      "$_src/libfloxtest.c"
+  $CC -o "$FIXTURE_DIR/main" "$_src/main.c"                                  \
+      -L"$FIXTURE_DIR/good" -lfloxtest -ldl
+
+  # `e_machine' lives at offset 18, 0x28 is `EM_ARM'.
+  cp "$FIXTURE_DIR/good/libfloxtest.so" "$FIXTURE_DIR/machine/"
+  patch_bytes "$FIXTURE_DIR/machine/libfloxtest.so" 18 050 000
+  # `EI_CLASS' lives at offset 4, 1 is `ELFCLASS32'.
+  cp "$FIXTURE_DIR/good/libfloxtest.so" "$FIXTURE_DIR/class/"
+  patch_bytes "$FIXTURE_DIR/class/libfloxtest.so" 4 001
+  # `EI_OSABI' lives at offset 7, 9 is `ELFOSABI_FREEBSD'.
+  cp "$FIXTURE_DIR/good/libfloxtest.so" "$FIXTURE_DIR/osabi/"
+  patch_bytes "$FIXTURE_DIR/osabi/libfloxtest.so" 7 011
+
+  export FLOX_ENV_LIB_DIRS="$FIXTURE_DIR/empty:$FIXTURE_DIR/machine"
+  FLOX_ENV_LIB_DIRS="$FLOX_ENV_LIB_DIRS:$FIXTURE_DIR/class::"
+  FLOX_ENV_LIB_DIRS="$FLOX_ENV_LIB_DIRS$FIXTURE_DIR/osabi:$FIXTURE_DIR/good"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=ld-floxlib:fallback
+@test "program cannot find library without 'ld-floxlib.so'" {
+  run -127 "$FIXTURE_DIR/main"
+  assert_failure
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=ld-floxlib:elf
+@test "'ld-floxlib.so' skips incompatible ELF candidates" {
+  LD_AUDIT="$LD_FLOXLIB" LD_FLOXLIB_DEBUG=1 run --separate-stderr \
+    "$FIXTURE_DIR/main"
+  assert_success
+  assert_line 'answer: 42'
+  run echo "$stderr"
+  assert_line "DEBUG: la_objsearch() skipping $FIXTURE_DIR/machine/libfloxtest.so: wrong ELF machine"
+  assert_line "DEBUG: la_objsearch() skipping $FIXTURE_DIR/class/libfloxtest.so: wrong ELF class"
+  assert_line "DEBUG: la_objsearch() skipping $FIXTURE_DIR/osabi/libfloxtest.so: wrong ELF OSABI"
+  assert_line --regexp "^AUDIT: la_objsearch\(\) resolved .* -> $FIXTURE_DIR/good/libfloxtest.so\$"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=ld-floxlib:environ
+@test "'ld-floxlib.so' does not modify 'FLOX_ENV_LIB_DIRS'" {
+  LD_AUDIT="$LD_FLOXLIB" run --separate-stderr "$FIXTURE_DIR/main" \
+    libfloxmissing.so
+  assert_success
+  assert_line "FLOX_ENV_LIB_DIRS: $FLOX_ENV_LIB_DIRS"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=ld-floxlib:miss-cache
+@test "'ld-floxlib.so' searches for a missing library once" {
+  LD_AUDIT="$LD_FLOXLIB" LD_FLOXLIB_DEBUG=1 run --separate-stderr \
+    "$FIXTURE_DIR/main" libfloxmissing.so libfloxmissing.so
+  assert_success
+  # Each directory is probed once for the first `dlopen', the second one and
+  # every other default search path is answered by the cache.
+  run grep -c 'checking: .*/libfloxmissing.so$' <<< "$stderr"
+  assert_output 5
+  run grep -c 'cached miss: libfloxmissing.so$' <<< "$stderr"
+  assert_success
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=ld-floxlib:syscalls
+@test "'ld-floxlib.so' uses a bounded number of syscalls per lookup" {
+  if ! command -v strace >/dev/null; then
+    skip "strace is unavailable"
+  fi
+  LD_AUDIT="$LD_FLOXLIB" run strace -f -qq -e trace=openat,read,close \
+    -o "$BATS_TEST_TMPDIR/strace.log"                                   \
+    "$FIXTURE_DIR/main" libfloxmissing.so libfloxmissing.so
+  assert_success
+
+  # One `openat' per directory up to the selected candidate, plus the
+  # dynamic linker's own open of the selected library.
+  run grep -c "openat(.*\"$FIXTURE_DIR/[a-z]*/libfloxtest.so\"" \
+    "$BATS_TEST_TMPDIR/strace.log"
+  assert_output 6
+
+  # A single probe per directory for the missing library, no matter how many
+  # times it is requested.
+  run grep -c "openat(.*\"$FIXTURE_DIR/[a-z]*/libfloxmissing.so\"" \
+    "$BATS_TEST_TMPDIR/strace.log"
+  assert_output 5
+}
+
+
+# ---------------------------------------------------------------------------- #
+#
+#
+#
+# ============================================================================ #
@@ -59,6 +59,160 @@ systems = ["x86_64-darwin"]' > "$_MANIFEST";
 }
 
 
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=lockfile:diff
+
+@test "'pkgdb lockfile diff' reports changed packages as NDJSON" {
+  _MANIFEST="$BATS_TEST_TMPDIR/manifest.toml";
+  echo '[options]
+systems = ["x86_64-linux"]
+
+[install.hello]
+pkg-path = "hello"
+
+[install.curl]
+pkg-path = "curl"' > "$_MANIFEST";
+
+  run sh -c "$PKGDB_BIN manifest lock --ga-registry --manifest '$_MANIFEST'  \
+               > '$BATS_TEST_TMPDIR/old.lock'";
+  assert_success;
+
+  # Bump `hello', drop `curl', and add a copy of `hello' as `greeter'.
+  jq '.packages["x86_64-linux"].hello.info.version = "9.9.9"
+      |.packages["x86_64-linux"].greeter = .packages["x86_64-linux"].hello
+      |del( .packages["x86_64-linux"].curl )'                              \
+     "$BATS_TEST_TMPDIR/old.lock" > "$BATS_TEST_TMPDIR/new.lock";
+
+  run "$PKGDB_BIN" lockfile diff "$BATS_TEST_TMPDIR/old.lock"              \
+                                 "$BATS_TEST_TMPDIR/new.lock";
+  assert_success;
+  assert_equal "${#lines[@]}" 3;
+
+  run jq -rc '[."install-id", .change, ( .fields|join( "," ) )]|join( " " )' \
+             <<< "$output";
+  assert_success;
+  assert_line --index 0 'curl removed ';
+  assert_line --index 1 'greeter added ';
+  assert_line --index 2 'hello changed version';
+
+  # Identical lockfiles have no changes.
+  run "$PKGDB_BIN" lockfile diff "$BATS_TEST_TMPDIR/old.lock"              \
+                                 "$BATS_TEST_TMPDIR/old.lock";
+  assert_success;
+  assert_output '';
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=lockfile:verify
+
+@test "'pkgdb lockfile verify' reports packages which no longer evaluate" {
+  _MANIFEST="$BATS_TEST_TMPDIR/manifest.toml";
+  echo "[options]
+systems = [\"$NIX_SYSTEM\"]
+
+[install.hello]
+pkg-path = \"hello\"
+
+[install.curl]
+pkg-path = \"curl\"" > "$_MANIFEST";
+
+  run sh -c "$PKGDB_BIN manifest lock --ga-registry --manifest '$_MANIFEST'  \
+               > '$BATS_TEST_TMPDIR/manifest.lock'";
+  assert_success;
+
+  # An untouched lockfile matches its inputs.
+  run "$PKGDB_BIN" lockfile verify "$BATS_TEST_TMPDIR/manifest.lock";
+  assert_success;
+  assert_output '';
+
+  run "$PKGDB_BIN" lockfile verify --all --jobs 2                          \
+                                   "$BATS_TEST_TMPDIR/manifest.lock";
+  assert_success;
+  assert_equal "${#lines[@]}" 2;
+
+  # Tamper with the recorded version of `hello' and the attribute path of
+  # `curl'.
+  jq --arg system "$NIX_SYSTEM"                                            \
+     '.packages[$system].hello.info.version = "9.9.9"
+      |.packages[$system].curl["attr-path"][2] = "no-such-package"'        \
+     "$BATS_TEST_TMPDIR/manifest.lock" > "$BATS_TEST_TMPDIR/tampered.lock";
+
+  run "$PKGDB_BIN" lockfile verify --jobs 2 "$BATS_TEST_TMPDIR/tampered.lock";
+  assert_failure;
+  assert_equal "${#lines[@]}" 2;
+
+  run jq -rc '[."install-id", ( .mismatches|map( .field )|join( "," ) ),
+               has( "error" )]|join( " " )' <<< "$output";
+  assert_success;
+  assert_line --index 0 'curl  true';
+  assert_line --index 1 'hello version false';
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=lock:native
+
+@test "'--native' defers other systems until '--complete'" {
+  case "$NIX_SYSTEM" in
+    x86_64-linux) _OTHER="aarch64-darwin"; ;;
+    *)            _OTHER="x86_64-linux"; ;;
+  esac
+  _MANIFEST="$BATS_TEST_TMPDIR/manifest.toml";
+  echo "[options]
+systems = [\"$NIX_SYSTEM\", \"$_OTHER\"]
+
+[install.hello]
+pkg-path = \"hello\"" > "$_MANIFEST";
+
+  run sh -c "$PKGDB_BIN manifest lock --ga-registry --native                 \
+                                 --manifest '$_MANIFEST'                     \
+               > '$BATS_TEST_TMPDIR/native.lock'";
+  assert_success;
+
+  run jq -rc '."pending-systems"|join( " " )' "$BATS_TEST_TMPDIR/native.lock";
+  assert_success;
+  assert_output "$_OTHER";
+
+  run jq -r ".packages|has( \"$_OTHER\" )" "$BATS_TEST_TMPDIR/native.lock";
+  assert_output 'false';
+
+  # Pending systems can't be built.
+  run "$PKGDB_BIN" buildenv --system "$_OTHER"                               \
+                            "$BATS_TEST_TMPDIR/native.lock";
+  assert_failure;
+
+  # `--complete' requires a lockfile.
+  run "$PKGDB_BIN" manifest lock --ga-registry --complete                    \
+                                 --manifest "$_MANIFEST";
+  assert_failure;
+
+  run sh -c "$PKGDB_BIN manifest lock --ga-registry --complete               \
+                                 --manifest '$_MANIFEST'                     \
+                                 --lockfile '$BATS_TEST_TMPDIR/native.lock'  \
+               > '$BATS_TEST_TMPDIR/complete.lock'";
+  assert_success;
+
+  run jq -r 'has( "pending-systems" )' "$BATS_TEST_TMPDIR/complete.lock";
+  assert_output 'false';
+
+  # The pending system reuses the native system's input.
+  run jq -r ".packages[\"$_OTHER\"].hello.input.url ==
+              .packages[\"$NIX_SYSTEM\"].hello.input.url"                   \
+            "$BATS_TEST_TMPDIR/complete.lock";
+  assert_output 'true';
+
+  # Nothing is reported as removed when completing a lock.
+  run "$PKGDB_BIN" lockfile diff "$BATS_TEST_TMPDIR/complete.lock"           \
+                                 "$BATS_TEST_TMPDIR/native.lock";
+  assert_success;
+  assert_output '';
+}
+
+
 # ---------------------------------------------------------------------------- #
 #
 #
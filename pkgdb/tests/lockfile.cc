@@ -9,6 +9,8 @@
 
 #include <nlohmann/json.hpp>
 
+#include "flox/resolver/lockfile-diff.hh"
+#include "flox/resolver/lockfile-verify.hh"
 #include "flox/resolver/lockfile.hh"
 #include "test.hh"
 
@@ -57,6 +59,305 @@ test_LockedPackageRawFromJSON0()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Create a locked `nixpkgs' package for tests. */
+static flox::resolver::LockedPackageRaw
+mkLockedPackage( const std::string & rev,
+                 const std::string & attrName,
+                 const std::string & version )
+{
+  using namespace flox::resolver;
+  LockedPackageRaw pkg;
+  pkg.input.url   = "github:NixOS/nixpkgs/" + rev;
+  pkg.input.attrs = { { "owner", "NixOS" },
+                      { "repo", "nixpkgs" },
+                      { "rev", rev },
+                      { "type", "github" } };
+  pkg.attrPath    = { "legacyPackages", "x86_64-linux", attrName };
+  pkg.priority    = 5;
+  pkg.info        = { { "pname", attrName }, { "version", version } };
+  return pkg;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Test that added, removed, and changed packages are detected. */
+bool
+test_diffLockfiles0()
+{
+  using namespace flox::resolver;
+  const std::string oldRev( 40, 'a' );
+  const std::string newRev( 40, 'b' );
+
+  LockfileRaw oldLockfile;
+  oldLockfile.packages = {
+    { "x86_64-linux",
+      { { "hello", mkLockedPackage( oldRev, "hello", "2.12" ) },
+        { "curl", mkLockedPackage( oldRev, "curl", "8.4.0" ) },
+        { "jq", mkLockedPackage( oldRev, "jq", "1.7" ) },
+        { "optional", std::nullopt },
+        { "resolved", std::nullopt },
+        { "unresolved", mkLockedPackage( oldRev, "unresolved", "1.0" ) } } },
+    { "aarch64-darwin",
+      { { "hello", mkLockedPackage( oldRev, "hello", "2.12" ) } } }
+  };
+
+  LockfileRaw newLockfile;
+  newLockfile.packages = {
+    { "x86_64-linux",
+      { { "hello", mkLockedPackage( newRev, "hello", "2.12.1" ) },
+        { "curl", mkLockedPackage( oldRev, "curl", "8.4.0" ) },
+        { "ripgrep", mkLockedPackage( newRev, "ripgrep", "14.0.3" ) },
+        { "optional", std::nullopt },
+        { "resolved", mkLockedPackage( newRev, "resolved", "1.0" ) },
+        { "unresolved", std::nullopt } } }
+  };
+  /* Only the priority changes, which can't change store paths. */
+  newLockfile.packages["x86_64-linux"]["curl"]->priority = 1;
+
+  auto changes = diffLockfiles( oldLockfile, newLockfile );
+  EXPECT_EQ( changes.size(), std::size_t( 7 ) );
+
+  /* Ordered by system and then install ID. */
+  EXPECT_EQ( changes[0].system, "aarch64-darwin" );
+  EXPECT_EQ( changes[0].installId, "hello" );
+  EXPECT( changes[0].type == PC_REMOVED );
+
+  EXPECT_EQ( changes[1].installId, "curl" );
+  EXPECT( changes[1].type == PC_CHANGED );
+  EXPECT( ! changes[1].mayChangeStorePaths() );
+  EXPECT( changes[1].getChangedFields()
+          == std::vector<std::string> { "priority" } );
+
+  EXPECT_EQ( changes[2].installId, "hello" );
+  EXPECT( changes[2].type == PC_CHANGED );
+  EXPECT( changes[2].mayChangeStorePaths() );
+  EXPECT( changes[2].getChangedFields()
+          == ( std::vector<std::string> { "version", "input" } ) );
+
+  EXPECT_EQ( changes[3].installId, "jq" );
+  EXPECT( changes[3].type == PC_REMOVED );
+
+  /* Optional packages which become locked, or unlocked, are changed. */
+  EXPECT_EQ( changes[4].installId, "resolved" );
+  EXPECT( changes[4].type == PC_CHANGED );
+  EXPECT( ! changes[4].oldPackage.has_value() );
+  EXPECT( changes[4].mayChangeStorePaths() );
+
+  EXPECT_EQ( changes[5].installId, "ripgrep" );
+  EXPECT( changes[5].type == PC_ADDED );
+
+  EXPECT_EQ( changes[6].installId, "unresolved" );
+  EXPECT( changes[6].type == PC_CHANGED );
+  EXPECT( ! changes[6].newPackage.has_value() );
+
+  nlohmann::json hello = changes[2];
+  EXPECT_EQ( hello.at( "change" ), "changed" );
+  EXPECT_EQ( hello.at( "old" ).at( "version" ), "2.12" );
+  EXPECT_EQ( hello.at( "new" ).at( "version" ), "2.12.1" );
+  EXPECT_EQ( hello.at( "new" ).at( "rev" ), newRev );
+  EXPECT( ! hello.contains( "closure-size" ) );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Test that closure size deltas are reported when known. */
+bool
+test_diffLockfiles1()
+{
+  using namespace flox::resolver;
+  PackageChange change { "x86_64-linux",
+                         "hello",
+                         PC_ADDED,
+                         std::nullopt,
+                         mkLockedPackage( std::string( 40, 'a' ),
+                                          "hello",
+                                          "2.12" ) };
+  change.newStoreInfo = PackageStoreInfo {
+    { { "out", "/nix/store/00000000000000000000000000000000-hello-2.12" } },
+    1024
+  };
+
+  nlohmann::json json = change;
+  EXPECT_EQ( json.at( "closure-size" ).at( "old" ), nullptr );
+  EXPECT_EQ( json.at( "closure-size" ).at( "delta" ), 1024 );
+  EXPECT_EQ( json.at( "outputs" ).at( "out" ).at( "old" ), nullptr );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Test that pending systems round trip and aren't diffed. */
+bool
+test_pendingSystems0()
+{
+  using namespace flox::resolver;
+  const std::string rev( 40, 'a' );
+
+  LockfileRaw raw;
+  raw.packages
+    = { { "x86_64-linux",
+          { { "hello", mkLockedPackage( rev, "hello", "2.12" ) } } } };
+  nlohmann::json json = raw;
+  EXPECT( ! json.contains( "pending-systems" ) );
+
+  raw.pendingSystems = { "aarch64-darwin" };
+  json               = raw;
+  EXPECT_EQ( json.at( "pending-systems" ),
+             nlohmann::json( { "aarch64-darwin" } ) );
+  LockfileRaw parsed = json;
+  EXPECT( parsed.pendingSystems == raw.pendingSystems );
+
+  Lockfile lockfile( parsed );
+  EXPECT( lockfile.isPending( "aarch64-darwin" ) );
+  EXPECT( ! lockfile.isPending( "x86_64-linux" ) );
+
+  /* The old lock of a deferred system isn't reported as removed. */
+  LockfileRaw oldLockfile = raw;
+  oldLockfile.pendingSystems.clear();
+  oldLockfile.packages["aarch64-darwin"]
+    = { { "hello", mkLockedPackage( rev, "hello", "2.12" ) } };
+  EXPECT( diffLockfiles( oldLockfile, raw ).empty() );
+
+  /* A pending system can't have locked packages. */
+  try
+    {
+      oldLockfile.pendingSystems = { "aarch64-darwin" };
+      oldLockfile.check();
+      return false;
+    }
+  catch ( const InvalidLockfileException & )
+    {}
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that only packages missing from the previous lockfile are
+ *        counted as usage, once across systems.
+ */
+bool
+test_getNewUsage0()
+{
+  using namespace flox::resolver;
+  const std::string rev( 40, 'a' );
+
+  LockfileRaw oldLockfile;
+  oldLockfile.packages
+    = { { "x86_64-linux",
+          { { "hello", mkLockedPackage( rev, "hello", "2.12" ) },
+            { "optional", std::nullopt } } } };
+
+  LockfileRaw newLockfile = oldLockfile;
+  newLockfile.packages["x86_64-linux"]["curl"]
+    = mkLockedPackage( rev, "curl", "8.4.0" );
+  auto darwinCurl = mkLockedPackage( rev, "curl", "8.4.0" );
+  darwinCurl.attrPath[1] = "aarch64-darwin";
+  newLockfile.packages["aarch64-darwin"] = { { "curl", darwinCurl } };
+
+  Lockfile lockfile( newLockfile );
+  auto     usages = lockfile.getNewUsage( oldLockfile );
+  EXPECT_EQ( usages.size(), std::size_t( 1 ) );
+  EXPECT( usages[0]
+          == ( flox::pkgdb::PackageUsage { "curl", { "curl" }, 1 } ) );
+
+  /* Without a previous lockfile every package is new. */
+  EXPECT_EQ( lockfile.getNewUsage().size(), std::size_t( 2 ) );
+
+  /* Re-locking an unchanged environment records nothing. */
+  EXPECT( lockfile.getNewUsage( newLockfile ).empty() );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that only recorded `info` fields are compared against
+ *        evaluation.
+ */
+bool
+test_compareLockedInfo0()
+{
+  using namespace flox::resolver;
+  nlohmann::json evaluated = R"( {
+    "pname": "hello", "version": "2.12.1", "license": "GPL-3.0-or-later",
+    "broken": false, "unfree": false, "description": "A new description"
+  } )"_json;
+
+  nlohmann::json locked = evaluated;
+  locked.erase( "license" );
+  locked["description"] = "An old description";
+  EXPECT( compareLockedInfo( locked, evaluated ).empty() );
+
+  locked["version"] = "9.9.9";
+  locked["unfree"]  = nullptr;
+  auto mismatches   = compareLockedInfo( locked, evaluated );
+  EXPECT_EQ( mismatches.size(), std::size_t( 2 ) );
+  EXPECT_EQ( mismatches[0].field, "version" );
+  EXPECT_EQ( mismatches[0].locked, "9.9.9" );
+  EXPECT_EQ( mismatches[0].evaluated, "2.12.1" );
+  EXPECT_EQ( mismatches[1].field, "unfree" );
+
+  /* Fields which no longer evaluate are reported as `null'. */
+  evaluated.erase( "pname" );
+  mismatches = compareLockedInfo( locked, evaluated );
+  EXPECT_EQ( mismatches.size(), std::size_t( 3 ) );
+  EXPECT_EQ( mismatches[0].field, "pname" );
+  EXPECT( mismatches[0].evaluated.is_null() );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Test that verification results round trip through JSON. */
+bool
+test_PackageVerification_json0()
+{
+  using namespace flox::resolver;
+  PackageVerification verification;
+  verification.system    = "x86_64-linux";
+  verification.installId = "hello";
+  verification.mismatches.emplace_back(
+    InfoMismatch { "version", "9.9.9", "2.12.1" } );
+  verification.outputs.emplace( "out", "/nix/store/" + std::string( 32, 'a' )
+                                         + "-hello-2.12.1" );
+
+  nlohmann::json json = verification;
+  EXPECT_EQ( json.at( "valid" ), false );
+  EXPECT( ! json.contains( "error" ) );
+
+  PackageVerification parsed = json;
+  EXPECT_EQ( nlohmann::json( parsed ), json );
+  EXPECT( ! parsed.isValid() );
+
+  verification.mismatches.clear();
+  EXPECT( verification.isValid() );
+  verification.error = "attribute 'hello' missing";
+  parsed             = nlohmann::json( verification );
+  EXPECT( parsed.error == verification.error );
+  EXPECT( ! parsed.isValid() );
+
+  /* Lockfiles without locked packages don't start any evaluators. */
+  EXPECT( verifyLockfile( LockfileRaw {}, 4 ).empty() );
+
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 int
@@ -70,6 +371,16 @@ main()
 
   RUN_TEST( LockedPackageRawFromJSON0 );
 
+  RUN_TEST( diffLockfiles0 );
+  RUN_TEST( diffLockfiles1 );
+
+  RUN_TEST( pendingSystems0 );
+
+  RUN_TEST( getNewUsage0 );
+
+  RUN_TEST( compareLockedInfo0 );
+  RUN_TEST( PackageVerification_json0 );
+
   return exitCode;
 }
 
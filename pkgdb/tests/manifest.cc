@@ -4,13 +4,16 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <string_view>
 
 #include <nlohmann/json.hpp>
 
 #include "flox/core/util.hh"
 #include "flox/resolver/descriptor.hh"
+#include "flox/resolver/manifest-include.hh"
 #include "flox/resolver/manifest.hh"
 #include "test.hh"
 
@@ -341,6 +344,74 @@ test_parseManifestRaw_toml0()
   return true;
 }
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Test `options.deny` is parsed, merged, and passed to queries. */
+bool
+test_parseOptions_deny0()
+{
+  nlohmann::json raw = R"( {
+    "allow": { "licenses": ["MIT", "GPL-3.0-or-later"] },
+    "deny": { "licenses": ["GPL-3.0-or-later"] }
+  } )"_json;
+
+  auto opts = raw.template get<flox::resolver::Options>();
+  EXPECT_EQ( nlohmann::json( opts ).dump(), raw.dump() );
+
+  flox::resolver::Options overrides;
+  overrides.deny = flox::resolver::Options::Denies {
+    std::vector<std::string> { "MIT" } };
+  opts.merge( overrides );
+
+  auto args = static_cast<flox::pkgdb::PkgQueryArgs>( opts );
+  EXPECT( args.deniedLicenses == std::vector<std::string> { "MIT" } );
+  EXPECT( args.licenses
+          == ( std::vector<std::string> { "MIT", "GPL-3.0-or-later" } ) );
+
+  try
+    {
+      (void) R"( { "deny": { "unfree": true } } )"_json
+        .get<flox::resolver::Options>();
+      return false;
+    }
+  catch ( const flox::resolver::InvalidManifestFileException & )
+    { /* Expected */
+    }
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Test parsing and merging `options.demote-vulnerable`. */
+bool
+test_parseOptions_demoteVulnerable0()
+{
+  nlohmann::json raw  = R"( { "demote-vulnerable": true } )"_json;
+  auto           opts = raw.template get<flox::resolver::Options>();
+  EXPECT( opts.demoteVulnerable == true );
+  EXPECT_EQ( nlohmann::json( opts ).dump(), raw.dump() );
+
+  flox::resolver::Options overrides;
+  overrides.demoteVulnerable = false;
+  opts.merge( overrides );
+  EXPECT( opts.demoteVulnerable == false );
+
+  try
+    {
+      (void) R"( { "demote-vulnerable": "yes" } )"_json
+        .get<flox::resolver::Options>();
+      return false;
+    }
+  catch ( const flox::resolver::InvalidManifestFileException & )
+    { /* Expected */
+    }
+
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /** @brief Test `flox::resolver::ManifestDescriptorRaw` gets
@@ -435,6 +506,127 @@ test_parseManifestRawWithOnActivateScript()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Nested includes are composed, with the including manifest
+ *        overriding members defined differently by its includes.
+ */
+bool
+test_composeManifest_nested0()
+{
+  auto composed = flox::resolver::composeManifest(
+    std::filesystem::path( TEST_DATA_DIR "/manifest/include/project.toml" ) );
+  const auto & manifest = composed.manifest;
+
+  EXPECT( ! manifest.include.has_value() );
+  EXPECT( composed.includedLocks.empty() );
+
+  EXPECT( manifest.install.has_value() );
+  EXPECT_EQ( manifest.install->size(), std::size_t( 3 ) );
+  EXPECT( manifest.install->contains( "hello" ) );
+  EXPECT( manifest.install->contains( "curl" ) );
+  EXPECT( manifest.install->contains( "jq" ) );
+
+  EXPECT( manifest.vars.has_value() );
+  EXPECT_EQ( manifest.vars->at( "GREETING" ), "hi" );
+  EXPECT_EQ( manifest.vars->at( "TOOLS" ), "1" );
+
+  /* Scripts are concatenated in include order. */
+  EXPECT( manifest.profile.has_value() );
+  EXPECT_EQ( *manifest.profile->common,
+             "echo base profile\necho tools profile\n" );
+  EXPECT( manifest.hook.has_value() );
+  EXPECT_EQ( *manifest.hook->onActivate, "echo base\necho project\n" );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Includes which define a member differently conflict unless the
+ *        including manifest overrides it.
+ */
+bool
+test_composeManifest_conflict0()
+{
+  try
+    {
+      (void) flox::resolver::composeManifest( std::filesystem::path(
+        TEST_DATA_DIR "/manifest/include/conflict.toml" ) );
+      return false;
+    }
+  catch ( const flox::resolver::InvalidManifestFileException & err )
+    {
+      EXPECT( std::string_view( err.what() ).find( "vars.GREETING" )
+              != std::string_view::npos );
+    }
+  return true;
+}
+
+
+/** @brief Includes which form a cycle are rejected. */
+bool
+test_composeManifest_cycle0()
+{
+  try
+    {
+      (void) flox::resolver::composeManifest( std::filesystem::path(
+        TEST_DATA_DIR "/manifest/include/cycle-a.toml" ) );
+      return false;
+    }
+  catch ( const flox::resolver::InvalidManifestFileException & err )
+    {
+      EXPECT( std::string_view( err.what() ).find( "cycle" )
+              != std::string_view::npos );
+    }
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Included lockfiles contribute their composed manifest and are kept
+ *        for their locks.
+ */
+bool
+test_composeManifest_lockfile0()
+{
+  auto composed = flox::resolver::composeManifest(
+    std::filesystem::path( TEST_DATA_DIR "/manifest/include/locked.toml" ) );
+
+  EXPECT( composed.manifest.install.has_value() );
+  EXPECT( composed.manifest.install->contains( "hello" ) );
+  EXPECT( composed.manifest.install->contains( "curl" ) );
+  EXPECT( composed.manifest.registry.has_value() );
+  EXPECT( composed.manifest.registry->inputs.contains( "nixpkgs" ) );
+
+  EXPECT_EQ( composed.includedLocks.size(), std::size_t( 1 ) );
+  const auto & lock = composed.includedLocks.front();
+  EXPECT( ! lock.manifest.include.has_value() );
+  EXPECT( lock.manifest.install.has_value() );
+  EXPECT( lock.manifest.install->contains( "hello" ) );
+  EXPECT( lock.packages.at( "x86_64-linux" ).contains( "hello" ) );
+  return true;
+}
+
+
+/** @brief Included lockfiles are dropped when their inputs are overridden. */
+bool
+test_composeManifest_lockfile1()
+{
+  auto composed = flox::resolver::composeManifest( std::filesystem::path(
+    TEST_DATA_DIR "/manifest/include/locked-override.toml" ) );
+
+  EXPECT( composed.manifest.install.has_value() );
+  EXPECT( composed.manifest.install->contains( "hello" ) );
+  EXPECT( composed.includedLocks.empty() );
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 int
@@ -462,6 +654,8 @@ main()
   RUN_TEST( parseManifestDescriptor_path4 );
 
   RUN_TEST( parseManifestRaw_toml0 );
+  RUN_TEST( parseOptions_deny0 );
+  RUN_TEST( parseOptions_demoteVulnerable0 );
 
   RUN_TEST( serialize_manifest0 );
 
@@ -471,6 +665,12 @@ main()
   RUN_TEST( hookAllowsAtMostOneActivationHook );
   RUN_TEST( parseManifestRawWithOnActivateScript );
 
+  RUN_TEST( composeManifest_nested0 );
+  RUN_TEST( composeManifest_conflict0 );
+  RUN_TEST( composeManifest_cycle0 );
+  RUN_TEST( composeManifest_lockfile0 );
+  RUN_TEST( composeManifest_lockfile1 );
+
   return exitCode;
 }
 
@@ -258,6 +258,79 @@ setup_file() {
   refute_output --regexp '.'
 }
 
+# ---------------------------------------------------------------------------- #
+
+# Copy the faulty flake out of the repository so that `nix' may lock it.
+setup_faulty_flake() {
+  export FAULTY_FLAKE="$BATS_TEST_TMPDIR/faulty"
+  export FAULTY_DBPATH="$BATS_TEST_TMPDIR/faulty.sqlite"
+  cp -r "$TESTS_DIR/data/scrape/faulty" "$FAULTY_FLAKE"
+  chmod -R u+w "$FAULTY_FLAKE"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=scrape:quarantine
+@test "failing packages are quarantined" {
+  setup_faulty_flake
+  FLOX_SCRAPE_ATTR_TIMEOUT=2 run --separate-stderr "$PKGDB_BIN" scrape \
+    --database "$FAULTY_DBPATH" "$FAULTY_FLAKE" packages "$NIX_SYSTEM"
+  assert_success
+  run jq -r '.quarantined|keys[]' <<< "$output"
+  assert_output "packages.$NIX_SYSTEM.bad
+packages.$NIX_SYSTEM.slow"
+
+  run sqlite3 "$FAULTY_DBPATH" "SELECT attrName FROM Packages \
+    ORDER BY attrName"
+  assert_output "also-good
+good"
+
+  run sqlite3 "$FAULTY_DBPATH" "SELECT reason FROM Quarantine \
+    WHERE attrName = 'slow'"
+  assert_output 'exceeded the per-attribute time limit'
+  run sqlite3 "$FAULTY_DBPATH" "SELECT reason FROM Quarantine \
+    WHERE attrName = 'bad'"
+  assert_output --partial 'this package is poisoned'
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=scrape:quarantine
+@test "quarantined packages are skipped by later scrapes" {
+  setup_faulty_flake
+  FLOX_SCRAPE_ATTR_TIMEOUT=2 run "$PKGDB_BIN" scrape \
+    --database "$FAULTY_DBPATH" "$FAULTY_FLAKE" packages "$NIX_SYSTEM"
+  assert_success
+
+  # Without a time limit `slow' would never finish if it were retried.
+  sqlite3 "$FAULTY_DBPATH" "UPDATE AttrSets SET done = FALSE"
+  run --separate-stderr timeout 60 "$PKGDB_BIN" scrape                        \
+    --database "$FAULTY_DBPATH" "$FAULTY_FLAKE" packages "$NIX_SYSTEM"
+  assert_success
+  run jq -r '.quarantined|keys[]' <<< "$output"
+  assert_output "packages.$NIX_SYSTEM.bad
+packages.$NIX_SYSTEM.slow"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=scrape:quarantine
+@test "packages exceeding the memory limit are quarantined" {
+  setup_faulty_flake
+  FLOX_SCRAPE_MEMORY_LIMIT=2048 run --separate-stderr "$PKGDB_BIN" scrape \
+    --database "$FAULTY_DBPATH" "$FAULTY_FLAKE" legacyPackages "$NIX_SYSTEM"
+  assert_success
+  run jq -r '.quarantined|keys[]' <<< "$output"
+  assert_output "legacyPackages.$NIX_SYSTEM.hungry"
+
+  run sqlite3 "$FAULTY_DBPATH" "SELECT attrName FROM Packages"
+  assert_output "good"
+}
+
+
 # ---------------------------------------------------------------------------- #
 #
 #
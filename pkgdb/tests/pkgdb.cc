@@ -18,6 +18,7 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <algorithm>
 #include <assert.h>
 #include <cstdlib>
 #include <iostream>
@@ -35,11 +36,15 @@
 #include "flox/core/nix-state.hh"
 #include "flox/core/types.hh"
 #include "flox/flox-flake.hh"
+#include "flox/pkgdb/advisories.hh"
 #include "flox/pkgdb/db-package.hh"
 #include "flox/pkgdb/input.hh"
 #include "flox/pkgdb/pkg-query.hh"
+#include "flox/pkgdb/provides.hh"
 #include "flox/pkgdb/scrape-rules.hh"
+#include "flox/pkgdb/usage.hh"
 #include "flox/pkgdb/write.hh"
+#include "flox/raw-package.hh"
 #include "test.hh"
 
 
@@ -93,8 +98,9 @@ static inline void
 clearTables( flox::pkgdb::PkgDb & db )
 {
   /* Clear DB */
-  db.execute_all(
-    "DELETE FROM Packages; DELETE FROM AttrSets; DELETE FROM Descriptions" );
+  db.execute_all( "DELETE FROM Provides; DELETE FROM PackagesLicenses; "
+                  "DELETE FROM Licenses; DELETE FROM Packages; "
+                  "DELETE FROM AttrSets; DELETE FROM Descriptions" );
 }
 
 /* -------------------------------------------------------------------------- */
@@ -411,6 +417,14 @@ test_PkgQuery1( flox::pkgdb::PkgDb & db )
       throw flox::pkgdb::PkgDbException(
         nix::fmt( "Failed to write Packages:(%d) %s", rc, db.db.error_msg() ) );
     }
+  /* License filters read `PackagesLicenses' rather than `license'. */
+  db.addOrGetLicenseId( flox::License { "GPL-3.0-or-later" } );
+  db.addOrGetLicenseId( flox::License { "BUSL-1.1" } );
+  db.execute( R"SQL(
+    INSERT INTO PackagesLicenses ( packageId, licenseId )
+      SELECT Packages.id, Licenses.id FROM Packages
+      INNER JOIN Licenses ON ( Packages.license = Licenses.name )
+  )SQL" );
   flox::pkgdb::PkgQueryArgs qargs;
   qargs.systems = std::vector<std::string> { "x86_64-linux" };
 
@@ -608,6 +622,440 @@ test_PkgQuery2( flox::pkgdb::PkgDb & db )
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Tests that `deduplicate' keeps the best ranked row for each `relPath'. */
+bool
+test_PkgQuery3( flox::pkgdb::PkgDb & db )
+{
+  clearTables( db );
+
+  row_id linux = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "x86_64-linux" } );
+  row_id darwin = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "aarch64-darwin" } );
+  row_id desc = db.addOrGetDescriptionId( "A program with a friendly hello" );
+  /* Insert the `aarch64-darwin' rows first so that they are the ones picked
+   * by a naive `GROUP BY'. */
+  sqlite3pp::command cmd( db.db, R"SQL(
+    INSERT INTO Packages (
+      parentId, attrName, name, pname, version, semver, outputs, descriptionId
+    ) VALUES
+      ( :darwinId, 'hello', 'hello-2.12.1', 'hello', '2.12.1', '2.12.1'
+      , '["out"]', :descId
+      )
+    , ( :darwinId, 'goodbye', 'goodbye-1.0.0', 'goodbye', '1.0.0', '1.0.0'
+      , '["out"]', :descId
+      )
+    , ( :linuxId, 'hello', 'hello-2.12.1', 'hello', '2.12.1', '2.12.1'
+      , '["out"]', :descId
+      )
+    , ( :linuxId, 'goodbye', 'goodbye-1.0.0', 'goodbye', '1.0.0', '1.0.0'
+      , '["out"]', :descId
+      )
+  )SQL" );
+  cmd.bind( ":linuxId", static_cast<long long>( linux ) );
+  cmd.bind( ":darwinId", static_cast<long long>( darwin ) );
+  cmd.bind( ":descId", static_cast<long long>( desc ) );
+  if ( flox::pkgdb::sql_rc rc = cmd.execute(); flox::isSQLError( rc ) )
+    {
+      throw flox::pkgdb::PkgDbException(
+        nix::fmt( "Failed to write Packages:(%d) %s", rc, db.db.error_msg() ) );
+    }
+
+  flox::pkgdb::PkgQueryArgs qargs;
+  qargs.deduplicate = true;
+  qargs.systems     = std::vector<std::string> { "x86_64-linux",
+                                                 "aarch64-darwin" };
+
+  /* One row per `relPath', always from the highest ranked system. */
+  {
+    flox::pkgdb::PkgQuery qry( qargs,
+                               std::vector<std::string> { "system", "pname" } );
+    size_t count = 0;
+    auto   bound = qry.bind( db.db );
+    for ( const auto & row : *bound )
+      {
+        EXPECT_EQ( row.get<std::string>( 0 ), "x86_64-linux" );
+        ++count;
+      }
+    EXPECT_EQ( count, std::size_t( 2 ) );
+  }
+
+  /* Reversing system priority flips the chosen rows. */
+  qargs.systems = std::vector<std::string> { "aarch64-darwin", "x86_64-linux" };
+  {
+    flox::pkgdb::PkgQuery qry( qargs,
+                               std::vector<std::string> { "system", "pname" } );
+    size_t count = 0;
+    auto   bound = qry.bind( db.db );
+    for ( const auto & row : *bound )
+      {
+        EXPECT_EQ( row.get<std::string>( 0 ), "aarch64-darwin" );
+        ++count;
+      }
+    EXPECT_EQ( count, std::size_t( 2 ) );
+  }
+
+  /* `executeKeyed' agrees with `execute' and exposes merge keys. */
+  {
+    qargs.semver = "^2";
+    flox::pkgdb::PkgQuery qry( qargs );
+    auto                  ids   = qry.execute( db.db );
+    auto                  keyed = qry.executeKeyed( db.db );
+    EXPECT_EQ( ids.size(), std::size_t( 1 ) );
+    EXPECT_EQ( keyed.size(), std::size_t( 1 ) );
+    EXPECT_EQ( keyed.front().id, ids.front() );
+    EXPECT_EQ( keyed.front().relPath, R"(["hello"])" );
+    EXPECT_EQ( keyed.front().version, "2.12.1" );
+    EXPECT_EQ( keyed.front().system, "aarch64-darwin" );
+    EXPECT_EQ( keyed.front().description, "A program with a friendly hello" );
+  }
+
+  /* Without `deduplicate' each system's row is kept. */
+  {
+    qargs.deduplicate = false;
+    flox::pkgdb::PkgQuery qry( qargs );
+    auto                  keyed = qry.executeKeyed( db.db );
+    EXPECT_EQ( keyed.size(), std::size_t( 2 ) );
+    EXPECT_EQ( keyed.at( 0 ).relPath, keyed.at( 1 ).relPath );
+    EXPECT( keyed.at( 0 ).system != keyed.at( 1 ).system );
+  }
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Tests `licenses' and `deniedLicenses' filtering of packages with several
+ * licenses, and `getLicenseViolations'. */
+bool
+test_PkgQuery_licenses0( flox::pkgdb::PkgDb & db )
+{
+  clearTables( db );
+
+  row_id linux = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "x86_64-linux" } );
+
+  flox::RawPackage dual( { "legacyPackages", "x86_64-linux", "dual" },
+                         "dual-1.0",
+                         "dual",
+                         "1.0" );
+  dual.licenses = { flox::License { "MIT", "MIT" },
+                    flox::License { "Apache-2.0", "Apache-2.0" } };
+  flox::RawPackage gpl( { "legacyPackages", "x86_64-linux", "gpl" },
+                        "gpl-1.0",
+                        "gpl",
+                        "1.0",
+                        std::nullopt,
+                        "GPL-3.0-or-later" );
+  flox::RawPackage unlicensed( { "legacyPackages", "x86_64-linux", "none" },
+                               "none-1.0",
+                               "none",
+                               "1.0" );
+
+  row_id dualId = db.addPackage( linux, "dual", dual );
+  row_id gplId  = db.addPackage( linux, "gpl", gpl );
+  row_id noneId = db.addPackage( linux, "none", unlicensed );
+
+  /* Replacing a package must not leave its old licenses behind. */
+  dualId = db.addPackage( linux, "dual", dual );
+  EXPECT_EQ( getRowCount( db, "PackagesLicenses" ), row_id( 3 ) );
+  EXPECT_EQ( getRowCount( db, "Licenses" ), row_id( 3 ) );
+
+  flox::pkgdb::PkgQueryArgs qargs;
+  qargs.systems = std::vector<std::string> { "x86_64-linux" };
+
+  /* Every license must be allowed. */
+  {
+    qargs.licenses = std::vector<std::string> { "MIT" };
+    EXPECT( db.getPackages( qargs ).empty() );
+    qargs.licenses = std::vector<std::string> { "MIT", "Apache-2.0" };
+    EXPECT( db.getPackages( qargs ) == std::vector<row_id> { dualId } );
+    qargs.licenses = std::nullopt;
+  }
+
+  /* Any denied license excludes a package. */
+  {
+    qargs.deniedLicenses = std::vector<std::string> { "Apache-2.0" };
+    auto rows            = db.getPackages( qargs );
+    qargs.deniedLicenses = std::nullopt;
+    EXPECT_EQ( rows.size(), std::size_t( 2 ) );
+    EXPECT( std::find( rows.begin(), rows.end(), dualId ) == rows.end() );
+  }
+
+  /* Violations are reported for the given rows only. */
+  {
+    std::optional<std::vector<std::string>> allowed
+      = std::vector<std::string> { "MIT", "Apache-2.0" };
+    EXPECT( db.getLicenseViolations( { dualId, gplId, noneId },
+                                     allowed,
+                                     std::nullopt )
+            == ( std::vector<row_id> { gplId, noneId } ) );
+    EXPECT( db.getLicenseViolations( { dualId }, allowed, std::nullopt )
+              .empty() );
+    EXPECT( db.getLicenseViolations( { dualId, gplId, noneId },
+                                     std::nullopt,
+                                     std::nullopt )
+              .empty() );
+  }
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Tests that `PkgQueryArgs' round trip through JSON. */
+bool
+test_PkgQueryArgs_json0()
+{
+  flox::pkgdb::PkgQueryArgs args;
+  args.pname       = "hello";
+  args.semver      = "^2";
+  args.allowBroken = true;
+  args.systems     = { "x86_64-linux", "aarch64-darwin" };
+  args.subtrees    = std::vector<flox::Subtree> { flox::ST_LEGACY };
+  args.relPath     = flox::AttrPath { "hello" };
+  args.deniedLicenses = std::vector<std::string> { "BUSL-1.1" };
+  args.collapseAliases = true;
+
+  nlohmann::json jargs = args;
+  auto           rsl   = jargs.get<flox::pkgdb::PkgQueryArgs>();
+  EXPECT( rsl.pname == args.pname );
+  EXPECT( rsl.semver == args.semver );
+  EXPECT( rsl.allowBroken );
+  EXPECT( rsl.allowUnfree );
+  EXPECT( rsl.systems == args.systems );
+  EXPECT( rsl.subtrees == args.subtrees );
+  EXPECT( rsl.relPath == args.relPath );
+  EXPECT( rsl.deniedLicenses == args.deniedLicenses );
+  EXPECT( rsl.collapseAliases );
+
+  /* `null' keeps defaults. */
+  rsl = nlohmann::json { { "systems", nullptr } }
+          .get<flox::pkgdb::PkgQueryArgs>();
+  EXPECT( rsl.systems
+          == std::vector<flox::System> { nix::settings.thisSystem.get() } );
+
+  try
+    {
+      (void) nlohmann::json { { "match", "hello" } }
+        .get<flox::pkgdb::PkgQueryArgs>();
+      return false;
+    }
+  catch ( const flox::pkgdb::InvalidPkgQueryArg & e )
+    { /* Expected */
+    }
+  return true;
+}
+
+/* -------------------------------------------------------------------------- */
+
+bool
+test_isProvidedFile0()
+{
+  EXPECT( flox::pkgdb::isProvidedFile( "bin", "hello" ) );
+  EXPECT( flox::pkgdb::isProvidedFile( "sbin", "sshd" ) );
+  EXPECT( flox::pkgdb::isProvidedFile( "lib", "libz.so" ) );
+  EXPECT( flox::pkgdb::isProvidedFile( "lib", "libz.so.1.3" ) );
+  EXPECT( ! flox::pkgdb::isProvidedFile( "lib", "libz.a" ) );
+  EXPECT( ! flox::pkgdb::isProvidedFile( "lib", "libz.sources" ) );
+  EXPECT( ! flox::pkgdb::isProvidedFile( "lib", ".so" ) );
+  EXPECT( ! flox::pkgdb::isProvidedFile( "share", "hello" ) );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+bool
+test_listProvidedFiles0()
+{
+  nlohmann::json listing = R"( {
+    "version": 1,
+    "root": {
+      "type": "directory",
+      "entries": {
+        "bin": {
+          "type": "directory",
+          "entries": { "hello": { "type": "regular", "executable": true } }
+        },
+        "lib": {
+          "type": "directory",
+          "entries": {
+            "libhello.so.1": { "type": "regular" },
+            "libhello.a": { "type": "regular" }
+          }
+        },
+        "sbin": { "type": "symlink", "target": "bin" },
+        "share": {
+          "type": "directory",
+          "entries": { "hello": { "type": "directory", "entries": {} } }
+        }
+      }
+    }
+  } )"_json;
+
+  auto files = flox::pkgdb::listProvidedFiles( listing );
+  EXPECT( files
+          == ( std::vector<flox::pkgdb::ProvidedFile> {
+            { "bin", "hello" },
+            { "lib", "libhello.so.1" } } ) );
+
+  EXPECT( flox::pkgdb::listProvidedFiles( nlohmann::json::object() ).empty() );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Tests `provides' filtering by exact and prefix matches. */
+bool
+test_PkgQuery_provides0( flox::pkgdb::PkgDb & db )
+{
+  clearTables( db );
+
+  row_id linux = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "x86_64-linux" } );
+  flox::pkgdb::PkgQueryArgs qargs;
+  qargs.systems = std::vector<std::string> { "x86_64-linux" };
+
+  sqlite3pp::command cmd( db.db, R"SQL(
+    INSERT INTO Packages ( id, parentId, attrName, name, pname, outputs )
+    VALUES ( 1, :linuxId, 'hello', 'hello-2.12.1', 'hello', '["out"]' )
+         , ( 2, :linuxId, 'zlib', 'zlib-1.3', 'zlib', '["out","dev"]' )
+  )SQL" );
+  cmd.bind( ":linuxId", static_cast<long long>( linux ) );
+  if ( flox::pkgdb::sql_rc rc = cmd.execute(); flox::isSQLError( rc ) )
+    {
+      throw flox::pkgdb::PkgDbException(
+        nix::fmt( "Failed to write Packages:(%d) %s", rc, db.db.error_msg() ) );
+    }
+
+  db.setProvidedFiles( 1, "out", { { "bin", "hello" } } );
+  db.setProvidedFiles( 2,
+                       "out",
+                       { { "lib", "libz.so" }, { "lib", "libz.so.1" } } );
+
+  qargs.provides = "hello";
+  EXPECT( flox::pkgdb::PkgQuery( qargs ).execute( db.db )
+          == std::vector<row_id> { 1 } );
+
+  qargs.provides = "libz.so";
+  EXPECT( flox::pkgdb::PkgQuery( qargs ).execute( db.db )
+          == std::vector<row_id> { 2 } );
+
+  /* Without `providesPrefix' partial names don't match. */
+  qargs.provides = "libz";
+  EXPECT( flox::pkgdb::PkgQuery( qargs ).execute( db.db ).empty() );
+
+  qargs.providesPrefix = true;
+  EXPECT( flox::pkgdb::PkgQuery( qargs ).execute( db.db )
+          == std::vector<row_id> { 2 } );
+
+  /* Glob characters in the prefix are matched literally. */
+  qargs.provides = "lib*";
+  EXPECT( flox::pkgdb::PkgQuery( qargs ).execute( db.db ).empty() );
+
+  EXPECT( db.getProvidedFiles( 2 )
+          == ( std::vector<std::string> { "lib/libz.so", "lib/libz.so.1" } ) );
+
+  /* Replacing an output's files drops the old ones. */
+  db.setProvidedFiles( 2, "out", { { "lib", "libz.so.1" } } );
+  EXPECT( db.getProvidedFiles( 2 )
+          == std::vector<std::string> { "lib/libz.so.1" } );
+
+  /* Replacing a package must not leave its old files behind. */
+  flox::RawPackage zlib( { "legacyPackages", "x86_64-linux", "zlib" },
+                         "zlib-1.3",
+                         "zlib",
+                         "1.3" );
+  row_id zlibId = db.addPackage( linux, "zlib", zlib );
+  EXPECT( db.getProvidedFiles( zlibId ).empty() );
+  EXPECT_EQ( getRowCount( db, "Provides" ), row_id( 1 ) );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/* Tests grouping packages by `outHash', and collapsing aliases in queries. */
+bool
+test_PkgQuery_aliases0( flox::pkgdb::PkgDb & db )
+{
+  clearTables( db );
+
+  row_id linux = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "x86_64-linux" } );
+  row_id python3 = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "x86_64-linux", "python3Packages" } );
+  row_id python311 = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "x86_64-linux", "python311Packages" } );
+
+  sqlite3pp::command cmd( db.db, R"SQL(
+    INSERT INTO Packages ( id, parentId, attrName, name, pname, outputs )
+    VALUES ( 1, :py311Id, 'requests', 'requests-2.31.0', 'requests'
+           , '["out"]' )
+         , ( 2, :py3Id, 'requests', 'requests-2.31.0', 'requests', '["out"]' )
+         , ( 3, :linuxId, 'hello', 'hello-2.12.1', 'hello', '["out"]' )
+         , ( 4, :linuxId, 'greeting', 'hello-2.12.1', 'hello', '["out"]' )
+         , ( 5, :linuxId, 'zlib', 'zlib-1.3', 'zlib', '["out"]' )
+  )SQL" );
+  cmd.bind( ":linuxId", static_cast<long long>( linux ) );
+  cmd.bind( ":py3Id", static_cast<long long>( python3 ) );
+  cmd.bind( ":py311Id", static_cast<long long>( python311 ) );
+  if ( flox::pkgdb::sql_rc rc = cmd.execute(); flox::isSQLError( rc ) )
+    {
+      throw flox::pkgdb::PkgDbException(
+        nix::fmt( "Failed to write Packages:(%d) %s", rc, db.db.error_msg() ) );
+    }
+
+  /* `zlib' is left without a hash, as if it failed to evaluate. */
+  db.setOutHash( 1, "0c5a0wkkw3xqvj8ljq4m3qgaqkwrrk5h" );
+  db.setOutHash( 2, "0c5a0wkkw3xqvj8ljq4m3qgaqkwrrk5h" );
+  db.setOutHash( 3, "63l345l7dgcfz789w1y93j1540czafqh" );
+  db.setOutHash( 4, "63l345l7dgcfz789w1y93j1540czafqh" );
+  EXPECT_EQ( db.updateAliases(), 2UL );
+
+  /* The shortest `relPath' is canonical, and is listed first. */
+  EXPECT( db.getAliases( 1 )
+          == ( std::vector<flox::AttrPath> {
+            { "python3Packages", "requests" } } ) );
+  EXPECT( db.getAliases( 2 )
+          == ( std::vector<flox::AttrPath> {
+            { "python311Packages", "requests" } } ) );
+  EXPECT( db.getAliases( 4 )
+          == ( std::vector<flox::AttrPath> { { "hello" } } ) );
+  EXPECT( db.getAliases( 5 ).empty() );
+
+  /* The canonical package wins ties even though `greeting' sorts first. */
+  flox::pkgdb::PkgQueryArgs qargs;
+  qargs.systems = std::vector<std::string> { "x86_64-linux" };
+  qargs.pname   = "hello";
+  EXPECT( flox::pkgdb::PkgQuery( qargs ).execute( db.db )
+          == ( std::vector<row_id> { 3, 4 } ) );
+
+  qargs.collapseAliases = true;
+  EXPECT( flox::pkgdb::PkgQuery( qargs ).execute( db.db )
+          == std::vector<row_id> { 3 } );
+
+  qargs.pname = std::nullopt;
+  auto rows   = flox::pkgdb::PkgQuery( qargs ).execute( db.db );
+  std::sort( rows.begin(), rows.end() );
+  EXPECT( rows == ( std::vector<row_id> { 2, 3, 5 } ) );
+
+  /* Groups are recomputed from scratch. */
+  db.setOutHash( 4, "1b8m03r63zqhnjf7l5wnldhh7c134ap5" );
+  EXPECT_EQ( db.updateAliases(), 1UL );
+  EXPECT( db.getAliases( 3 ).empty() );
+
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /* Tests `getPackages', particularly `semver' filtering. */
@@ -962,6 +1410,316 @@ test_getPackages_semver0( flox::pkgdb::PkgDb & db )
   return true;
 }
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Test @a flox::pkgdb::AffectedRange::contains bounds. */
+bool
+test_AffectedRange_contains0()
+{
+  flox::pkgdb::AffectedRange range { "2.0", "2.12.1", std::nullopt };
+  EXPECT( ! range.contains( "1.9" ) );
+  EXPECT( range.contains( "2.0" ) );
+  EXPECT( range.contains( "2.12" ) );
+  EXPECT( ! range.contains( "2.12.1" ) );
+  EXPECT( ! range.contains( "2.13" ) );
+
+  range = { std::nullopt, std::nullopt, "2.12" };
+  EXPECT( range.contains( "1.0" ) );
+  EXPECT( range.contains( "2.12" ) );
+  EXPECT( ! range.contains( "2.12.1" ) );
+
+  EXPECT( flox::pkgdb::AffectedRange {}.contains( "0" ) );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test matching advisories by `pname` and version, including
+ *        advisories with several ranges or no ranges at all.
+ */
+bool
+test_AdvisoryDb_match0( flox::pkgdb::AdvisoryDb & advisories )
+{
+  advisories.setAdvisories( nlohmann::json::parse( R"( [
+    { "id": "CVE-2024-0001", "aliases": ["GHSA-0001"], "pname": "hello"
+    , "severity": "high"
+    , "affected": [{ "introduced": "2.0", "fixed": "2.12.1" }
+                  , { "introduced": "3.0", "fixed": "3.1" }]
+    }
+  , { "id": "CVE-2024-0002", "pname": "hello" }
+  , { "id": "CVE-2024-0003", "pname": "world"
+    , "affected": [{ "lastAffected": "1.0" }]
+    }
+  ] )" ).get<std::vector<flox::pkgdb::Advisory>>() );
+
+  auto matches = advisories.match( "hello", "2.12" );
+  EXPECT_EQ( matches.size(), std::size_t( 2 ) );
+  EXPECT_EQ( matches[0].id, "CVE-2024-0001" );
+  EXPECT( matches[0].aliases == std::vector<std::string> { "GHSA-0001" } );
+  EXPECT( matches[0].severity == "high" );
+  EXPECT_EQ( matches[0].affected.size(), std::size_t( 1 ) );
+  EXPECT( matches[0].affected[0].fixed == "2.12.1" );
+  EXPECT_EQ( matches[1].id, "CVE-2024-0002" );
+  EXPECT( matches[1].affected.empty() );
+
+  matches = advisories.match( "hello", "2.12.1" );
+  EXPECT_EQ( matches.size(), std::size_t( 1 ) );
+  EXPECT_EQ( matches[0].id, "CVE-2024-0002" );
+
+  EXPECT_EQ( advisories.match( "world", "1.0" ).size(), std::size_t( 1 ) );
+  EXPECT( advisories.match( "world", "1.0.1" ).empty() );
+  EXPECT( advisories.match( "goodbye", "1.0" ).empty() );
+
+  /* Replacing advisories drops the old ones. */
+  advisories.setAdvisories( {} );
+  EXPECT( advisories.match( "hello", "2.12" ).empty() );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that vulnerable packages are moved after the others while
+ *        retaining the order of each partition.
+ */
+bool
+test_AdvisoryDb_demoteVulnerable0( flox::pkgdb::PkgDb &      db,
+                                   flox::pkgdb::AdvisoryDb & advisories )
+{
+  clearTables( db );
+
+  row_id linux = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "x86_64-linux" } );
+  sqlite3pp::command cmd( db.db, R"SQL(
+    INSERT INTO Packages (
+      parentId, attrName, name, pname, version, semver, outputs
+    , outputsToInstall
+    ) VALUES
+      ( :parentId, 'hello0', 'hello-2.12', 'hello', '2.12', '2.12.0'
+      , '["out"]', '["out"]' )
+    , ( :parentId, 'hello1', 'hello-2.11', 'hello', '2.11', '2.11.0'
+      , '["out"]', '["out"]' )
+    , ( :parentId, 'hello2', 'hello-2.10', 'hello', '2.10', '2.10.0'
+      , '["out"]', '["out"]' )
+    , ( :parentId, 'hello3', 'hello', 'hello', NULL, NULL
+      , '["out"]', '["out"]' )
+  )SQL" );
+  cmd.bind( ":parentId", static_cast<long long>( linux ) );
+  if ( flox::pkgdb::sql_rc rc = cmd.execute(); flox::isSQLError( rc ) )
+    {
+      throw flox::pkgdb::PkgDbException(
+        nix::fmt( "Failed to write Packages:(%d) %s", rc, db.db.error_msg() ) );
+    }
+
+  advisories.setAdvisories( nlohmann::json::parse( R"( [
+    { "id": "CVE-2024-0001", "pname": "hello"
+    , "affected": [{ "introduced": "2.11", "fixed": "2.13" }]
+    }
+  ] )" ).get<std::vector<flox::pkgdb::Advisory>>() );
+
+  auto getId = [&]( const std::string & attrName )
+  {
+    return db.getPackageId(
+      flox::AttrPath { "legacyPackages", "x86_64-linux", attrName } );
+  };
+
+  std::vector<row_id> rows
+    = { getId( "hello0" ), getId( "hello1" ), getId( "hello2" ),
+        getId( "hello3" ) };
+  advisories.demoteVulnerable( db, rows );
+
+  /* Packages without a version are never matched. */
+  std::vector<row_id> expected
+    = { getId( "hello2" ), getId( "hello3" ), getId( "hello0" ),
+        getId( "hello1" ) };
+  EXPECT( rows == expected );
+
+  advisories.setAdvisories( {} );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/** @brief Test that usage ranks only change when counts double. */
+bool
+test_getUsageRank0()
+{
+  EXPECT_EQ( flox::pkgdb::getUsageRank( 0 ), 0U );
+  EXPECT_EQ( flox::pkgdb::getUsageRank( 1 ), 1U );
+  EXPECT_EQ( flox::pkgdb::getUsageRank( 2 ), 2U );
+  EXPECT_EQ( flox::pkgdb::getUsageRank( 3 ), 2U );
+  EXPECT_EQ( flox::pkgdb::getUsageRank( 4 ), 3U );
+  EXPECT_EQ( flox::pkgdb::getUsageRank( 7 ), 3U );
+  EXPECT_EQ( flox::pkgdb::getUsageRank( 1024 ), 11U );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that recorded and imported usages add up, and that recording
+ *        only writes the rows of the recorded packages.
+ */
+bool
+test_UsageDb_record0( flox::pkgdb::UsageDb & usage )
+{
+  usage.db.execute( "DELETE FROM Usage" );
+
+  /* Usages of the same package are combined into one row. */
+  EXPECT_EQ( usage.record( { { "git", { "git" }, 1 },
+                             { "git", { "git" }, 2 },
+                             { "git", { "gitFull" }, 1 },
+                             { "hello", { "hello" }, 0 } } ),
+             std::size_t( 2 ) );
+  EXPECT_EQ( usage.getCount( "git", { "git" } ), 3U );
+  EXPECT_EQ( usage.getCount( "git", { "gitFull" } ), 1U );
+  EXPECT_EQ( usage.getCount( "hello", { "hello" } ), 0U );
+
+  /* The cost of an update doesn't grow with the size of the table. */
+  std::vector<flox::pkgdb::PackageUsage> many;
+  for ( int idx = 0; idx < 1000; ++idx )
+    {
+      many.push_back( { "pkg" + std::to_string( idx ),
+                        { "pkg" + std::to_string( idx ) },
+                        1 } );
+    }
+  EXPECT_EQ( usage.record( many ), std::size_t( 1000 ) );
+  auto getTotalChanges = [&]()
+  {
+    sqlite3pp::query qry( usage.db, "SELECT total_changes()" );
+    return ( *qry.begin() ).get<long long>( 0 );
+  };
+  auto before = getTotalChanges();
+  EXPECT_EQ( usage.record( { { "git", { "git" }, 1 } } ), std::size_t( 1 ) );
+  EXPECT_EQ( getTotalChanges() - before, 1 );
+  EXPECT_EQ( usage.getCount( "git", { "git" } ), 4U );
+
+  /* Imported counts are added to recorded ones. */
+  auto [fd, importPath] = nix::createTempFile( "test-usage.json" );
+  fd.close();
+  nix::writeFile( importPath, R"( [
+    { "pname": "git", "relPath": ["git"], "count": 4 }
+  , { "pname": "ripgrep", "relPath": ["ripgrep"] }
+  ] )" );
+  EXPECT_EQ( usage.importFile( importPath ), std::size_t( 2 ) );
+  EXPECT_EQ( usage.getCount( "git", { "git" } ), 8U );
+  EXPECT_EQ( usage.getCount( "ripgrep", { "ripgrep" } ), 1U );
+
+  nix::writeFile( importPath, R"( [{ "relPath": ["git"] }] )" );
+  try
+    {
+      (void) usage.importFile( importPath );
+      return false;
+    }
+  catch ( const flox::pkgdb::InvalidUsageFileException & )
+    {}
+  std::filesystem::remove( importPath );
+
+  usage.db.execute( "DELETE FROM Usage" );
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Test that usage ranks packages after exact matches, and that
+ *        rankings only change when a package's count doubles.
+ */
+bool
+test_PkgQuery_usage0( flox::pkgdb::PkgDb & db, flox::pkgdb::UsageDb & usage )
+{
+  clearTables( db );
+  usage.db.execute( "DELETE FROM Usage" );
+
+  row_id linux = db.addOrGetAttrSetId(
+    flox::AttrPath { "legacyPackages", "x86_64-linux" } );
+  sqlite3pp::command cmd( db.db, R"SQL(
+    INSERT INTO Packages (
+      parentId, attrName, name, pname, version, semver, outputs
+    , outputsToInstall
+    ) VALUES
+      ( :parentId, 'git', 'git-2.42.0', 'git', '2.42.0', '2.42.0'
+      , '["out"]', '["out"]' )
+    , ( :parentId, 'gitFull', 'git-2.42.0', 'git', '2.42.0', '2.42.0'
+      , '["out"]', '["out"]' )
+    , ( :parentId, 'gitMinimal', 'git-2.42.0', 'git', '2.42.0', '2.42.0'
+      , '["out"]', '["out"]' )
+    , ( :parentId, 'gitui', 'gitui-0.24.3', 'gitui', '0.24.3', '0.24.3'
+      , '["out"]', '["out"]' )
+  )SQL" );
+  cmd.bind( ":parentId", static_cast<long long>( linux ) );
+  if ( flox::pkgdb::sql_rc rc = cmd.execute(); flox::isSQLError( rc ) )
+    {
+      throw flox::pkgdb::PkgDbException(
+        nix::fmt( "Failed to write Packages:(%d) %s", rc, db.db.error_msg() ) );
+    }
+
+  auto getId = [&]( const std::string & attrName )
+  {
+    return db.getPackageId(
+      flox::AttrPath { "legacyPackages", "x86_64-linux", attrName } );
+  };
+  auto getIds = [&]( const std::vector<std::string> & attrNames )
+  {
+    std::vector<row_id> ids;
+    for ( const auto & attrName : attrNames )
+      {
+        ids.emplace_back( getId( attrName ) );
+      }
+    return ids;
+  };
+
+  EXPECT( flox::pkgdb::UsageDb::attach( db.db, usage.dbPath ) );
+  /* Attaching twice is a no-op. */
+  EXPECT( flox::pkgdb::UsageDb::attach( db.db, usage.dbPath ) );
+
+  flox::pkgdb::PkgQueryArgs qargs;
+  qargs.systems          = std::vector<std::string> { "x86_64-linux" };
+  qargs.partialNameMatch = "git";
+
+  auto getRanked = [&]()
+  {
+    qargs.rankByUsage = true;
+    return flox::pkgdb::PkgQuery( qargs ).execute( db.db );
+  };
+
+  /* Without usage the usual heuristics apply. */
+  auto unranked = getIds( { "git", "gitFull", "gitMinimal", "gitui" } );
+  EXPECT( getRanked() == unranked );
+
+  usage.record( { { "git", { "gitMinimal" }, 4 },
+                  { "git", { "gitFull" }, 2 },
+                  { "gitui", { "gitui" }, 100 } } );
+  /* Exact matches stay first however often other packages are used. */
+  auto ranked = getIds( { "git", "gitMinimal", "gitFull", "gitui" } );
+  EXPECT( getRanked() == ranked );
+
+  /* Counts which don't double leave the ranking unchanged. */
+  usage.record( { { "git", { "gitFull" }, 1 } } );
+  EXPECT( getRanked() == ranked );
+
+  /* Once ranks are equal the usual heuristics apply again. */
+  usage.record( { { "git", { "gitFull" }, 1 } } );
+  EXPECT( getRanked() == unranked );
+
+  /* Queries which don't rank by usage ignore it. */
+  usage.record( { { "git", { "gitMinimal" }, 100 } } );
+  qargs.rankByUsage = false;
+  EXPECT( flox::pkgdb::PkgQuery( qargs ).execute( db.db ) == unranked );
+
+  db.execute( "DETACH DATABASE usage" );
+  usage.db.execute( "DELETE FROM Usage" );
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 /**
@@ -1155,6 +1913,75 @@ test_RulesTree_getRule2()
   return true;
 }
 
+/**
+ * @brief Ensure overlays replace existing rules, and that scopes limit
+ *        scraping to their prefixes and ancestors.
+ */
+bool
+test_ScrapeRules_overlay0()
+{
+  flox::pkgdb::ScrapeRules base( rulesJSON );
+
+  nlohmann::json overlayJSON = R"( {
+    "scope": [["legacyPackages", null, "python310Packages"]],
+    "allowRecursive": [["legacyPackages", null, "python310Packages"]],
+    "disallowPackage": [["legacyPackages", null, "python310Packages", "pip"]]
+  } )"_json;
+  flox::pkgdb::ScrapeRules rules(
+    base,
+    overlayJSON.get<flox::pkgdb::ScrapeRulesRaw>() );
+
+  using flox::AttrPath;
+  EXPECT( ! base.applyRules( AttrPath { "legacyPackages",
+                                        "x86_64-linux",
+                                        "hello" } )
+              .has_value() );
+
+  /* Outside of the scope. */
+  EXPECT( rules.applyRules(
+                 AttrPath { "legacyPackages", "x86_64-linux", "hello" } )
+          == false );
+  EXPECT( rules.applyRules( AttrPath { "packages", "x86_64-linux", "hello" } )
+          == false );
+  /* Ancestors of the scope. */
+  EXPECT( rules.applyRules( AttrPath { "legacyPackages", "x86_64-linux" } )
+          == true );
+  /* Overlay rules replace default rules. */
+  EXPECT( rules.applyRules( AttrPath { "legacyPackages",
+                                       "x86_64-linux",
+                                       "python310Packages" } )
+          == true );
+  EXPECT( rules.applyRules( AttrPath { "legacyPackages",
+                                       "x86_64-linux",
+                                       "python310Packages",
+                                       "pip" } )
+          == false );
+  EXPECT( ! rules
+              .applyRules( AttrPath { "legacyPackages",
+                                      "x86_64-linux",
+                                      "python310Packages",
+                                      "requests" } )
+              .has_value() );
+
+  /* Hashes are deterministic and distinguish overlays. */
+  EXPECT( rules.hashString() != base.hashString() );
+  EXPECT_EQ( rules.hashString(),
+             flox::pkgdb::ScrapeRules(
+               base,
+               overlayJSON.get<flox::pkgdb::ScrapeRulesRaw>() )
+               .hashString() );
+
+  /* Round trip */
+  EXPECT_EQ( nlohmann::json(
+               overlayJSON.get<flox::pkgdb::ScrapeRulesRaw>() ),
+             overlayJSON );
+
+  return true;
+}
+
+
+/* -------------------------------------------------------------------------- */
+
 bool
 test_scrapeMemoryUse()
 {
@@ -1182,6 +2009,40 @@ test_scrapeMemoryUse()
   return true;
 }
 
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Every entry of a metadata dump is imported, including entries with
+ *        nested objects.
+ */
+bool
+test_importMetadataDump0( flox::pkgdb::PkgDb & db )
+{
+  clearTables( db );
+
+  auto [fd, dumpPath] = nix::createTempFile( "test-dump.json" );
+  fd.close();
+  nix::writeFile( dumpPath, R"({
+    "hello": { "name": "hello-2.12.1",
+               "meta": { "description": "Say hello",
+                         "license": { "spdxId": "GPL-3.0-or-later" } } },
+    "cowsay": { "name": "cowsay-3.7.0", "outputs": ["out", "man"] }
+  })" );
+
+  size_t count = db.importMetadataDump(
+    flox::AttrPath { "legacyPackages", "x86_64-linux" },
+    dumpPath );
+  std::filesystem::remove( dumpPath );
+
+  EXPECT_EQ( count, std::size_t( 2 ) );
+  EXPECT( db.hasPackage(
+    flox::AttrPath { "legacyPackages", "x86_64-linux", "hello" } ) );
+  EXPECT( db.hasPackage(
+    flox::AttrPath { "legacyPackages", "x86_64-linux", "cowsay" } ) );
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 int
@@ -1232,6 +2093,13 @@ main( int argc, char * argv[] )
     RUN_TEST( PkgQuery0, db );
     RUN_TEST( PkgQuery1, db );
     RUN_TEST( PkgQuery2, db );
+    RUN_TEST( PkgQuery3, db );
+    RUN_TEST( PkgQuery_licenses0, db );
+    RUN_TEST( PkgQueryArgs_json0 );
+    RUN_TEST( PkgQuery_provides0, db );
+    RUN_TEST( PkgQuery_aliases0, db );
+    RUN_TEST( isProvidedFile0 );
+    RUN_TEST( listProvidedFiles0 );
 
     RUN_TEST( getPackages0, db );
     RUN_TEST( getPackages1, db );
@@ -1241,7 +2109,33 @@ main( int argc, char * argv[] )
 
     RUN_TEST( getPackages_semver0, db );
 
+    RUN_TEST( AffectedRange_contains0 );
+    {
+      auto [advisoriesFd, advisoriesPath]
+        = nix::createTempFile( "test-advisories.sql" );
+      advisoriesFd.close();
+      {
+        flox::pkgdb::AdvisoryDb advisories( advisoriesPath, true );
+        RUN_TEST( AdvisoryDb_match0, advisories );
+        RUN_TEST( AdvisoryDb_demoteVulnerable0, db, advisories );
+      }
+      std::filesystem::remove( advisoriesPath );
+    }
+
+    RUN_TEST( getUsageRank0 );
+    {
+      auto [usageFd, usagePath] = nix::createTempFile( "test-usage.sql" );
+      usageFd.close();
+      {
+        flox::pkgdb::UsageDb usage( usagePath, true );
+        RUN_TEST( UsageDb_record0, usage );
+        RUN_TEST( PkgQuery_usage0, db, usage );
+      }
+      std::filesystem::remove( usagePath );
+    }
+
     RUN_TEST( scrapeMemoryUse );
+    RUN_TEST( importMetadataDump0, db );
 
     RUN_TEST( RulesTree_parse0 );
     RUN_TEST( RulesTree_parse0_badRules );
@@ -1251,6 +2145,7 @@ main( int argc, char * argv[] )
     RUN_TEST( RulesTree_getRule1 );
     RUN_TEST( RulesTree_getRule2 );
     RUN_TEST( RulesTree_hash );
+    RUN_TEST( ScrapeRules_overlay0 );
   }
 
   /* XXX: You may find it useful to preserve the file and print it for some
@@ -116,6 +116,43 @@ test_EnvironmentManifest_NoIndirectRefs0()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/** @brief Ensure `scrape` rules are parsed, compared, and serialized. */
+bool
+test_RegistryInput_scrape0()
+{
+  nlohmann::json jinput = R"( {
+    "from": { "type": "github", "owner": "NixOS", "repo": "nixpkgs" },
+    "scrape": { "scope": [["legacyPackages", null, "python3Packages"]] }
+  } )"_json;
+
+  auto input = jinput.get<flox::RegistryInput>();
+  EXPECT( input.scrape.has_value() );
+  EXPECT_EQ( input.scrape->scope.size(), std::size_t( 1 ) );
+  EXPECT_EQ( nlohmann::json( input ).at( "scrape" ), jinput.at( "scrape" ) );
+
+  /* Inputs with different rules are different inputs. */
+  auto unscoped = input;
+  unscoped.scrape.reset();
+  EXPECT( input != unscoped );
+  EXPECT( ! nlohmann::json( unscoped ).contains( "scrape" ) );
+
+  /* Unknown rules are rejected. */
+  jinput["scrape"] = R"( { "allowEverything": [] } )"_json;
+  try
+    {
+      (void) jinput.get<flox::RegistryInput>();
+      return false;
+    }
+  catch ( const flox::InvalidRegistryException & )
+    { /* Expected */
+    }
+
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 int
@@ -134,6 +171,7 @@ main( int argc, char * argv[] )
   flox::NixState nstate;
 
   RUN_TEST( FloxFlakeInputRegistry0 );
+  RUN_TEST( RegistryInput_scrape0 );
 
   RUN_TEST( EnvironmentManifest_getRegistryRaw0 );
   RUN_TEST( EnvironmentManifest_badPath0 );
@@ -162,6 +162,43 @@ setup_file() {
   assert_output '0'
 }
 
+# ---------------------------------------------------------------------------- #
+
+# Importing a `nix-env' metadata dump yields the same rows as evaluating.
+# bats test_tags=scrape:metadata-dump
+@test "pkgdb scrape --metadata-dump matches evaluated scrape" {
+  run "$PKGDB_BIN" scrape --database "$DBPATH" "$NIXPKGS_REF" \
+    legacyPackages "$NIX_SYSTEM" 'akkoma-emoji'
+  assert_success
+
+  local _nixpkgs _dump _dumpDB
+  _nixpkgs="$(nix flake metadata --json "$NIXPKGS_REF" | jq -r '.path')"
+  _dump="$BATS_TEST_TMPDIR/dump.json"
+  _dumpDB="$BATS_TEST_TMPDIR/dump.sqlite"
+  NIXPKGS_ALLOW_UNFREE=1 nix-env -f "$_nixpkgs" --arg config '{}' \
+    --argstr system "$NIX_SYSTEM" -qaP --json --meta -A akkoma-emoji \
+    > "$_dump"
+
+  run "$PKGDB_BIN" scrape --database "$_dumpDB" --metadata-dump "$_dump" \
+    "$NIXPKGS_REF" legacyPackages "$NIX_SYSTEM"
+  assert_success
+
+  local _query="SELECT s.relPath, s.name, s.pname, s.version, s.semver,     \
+    s.license, p.outputs, p.outputsToInstall, s.broken, s.unfree,           \
+    s.description FROM v_PackagesSearch s JOIN Packages p ON ( s.id = p.id )\
+    WHERE json_extract( s.relPath, '\$[0]' ) = 'akkoma-emoji'                 \
+    ORDER BY s.relPath"
+  run sqlite3 "$_dumpDB" "$_query"
+  assert_success
+  assert_output --partial 'blobs.gg-unstable-2019-07-24'
+  assert_output "$(sqlite3 "$DBPATH" "$_query")"
+
+  run sqlite3 "$_dumpDB" "SELECT json_extract( value, '$.type' )  \
+    FROM DbScrapeMeta WHERE key = 'source:legacyPackages.$NIX_SYSTEM'"
+  assert_output 'metadata-dump'
+}
+
+
 # ---------------------------------------------------------------------------- #
 #
 #
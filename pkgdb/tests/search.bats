@@ -301,6 +301,114 @@ genParamsNixpkgsFlox() {
   refute_output --partial '2 '
 }
 
+# bats test_tags=search:system, search:pname, search:collapse
+
+# One result lists every system a package was found for.
+@test "'pkgdb search' collapses systems" {
+  params="$(
+    genParams '.manifest.options.systems=["x86_64-darwin","x86_64-linux"]
+               |.query.pname="hello"|.query."collapse-systems"=true'
+  )"
+
+  run sh -c "$PKGDB_BIN search '$params' | jq -sc 'length'"
+  assert_success
+  assert_output 1
+
+  run sh -c "$PKGDB_BIN search '$params' \
+             | jq -r '( .systems|join( \" \" ) ),
+                      ( .ids|keys|length ),
+                      has( \"id\" ), has( \"system\" )'"
+  assert_success
+  assert_line --index 0 'x86_64-darwin x86_64-linux'
+  assert_line --index 1 '2'
+  assert_line --index 2 'false'
+  assert_line --index 3 'false'
+
+  # The flag is equivalent to the query field.
+  params="$(
+    genParams '.manifest.options.systems=["x86_64-darwin","x86_64-linux"]
+               |.query.pname="hello"'
+  )"
+  run sh -c "$PKGDB_BIN search --collapse-systems '$params' | jq -sc 'length'"
+  assert_success
+  assert_output 1
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=search:dedup, search:pname
+
+# The same package found in two inputs is only emitted for the input with the
+# highest priority.
+@test "'pkgdb search' deduplicates across inputs by priority" {
+  genDedupParams() {
+    genParams ".manifest.registry.inputs|=( .mirror=.nixpkgs )
+               |.manifest.registry.priority=${1?}
+               |.query.pname=\"hello\"|.query.deduplicate=${2?}"
+  }
+
+  params="$(genDedupParams '["mirror","nixpkgs"]' false)"
+  run sh -c "$PKGDB_BIN search '$params' | jq -r '.input'"
+  assert_success
+  assert_output "mirror
+nixpkgs"
+
+  params="$(genDedupParams '["mirror","nixpkgs"]' true)"
+  run sh -c "$PKGDB_BIN search '$params' | jq -r '.input'"
+  assert_success
+  assert_output "mirror"
+
+  params="$(genDedupParams '["nixpkgs","mirror"]' true)"
+  run sh -c "$PKGDB_BIN search '$params' | jq -r '.input'"
+  assert_success
+  assert_output "nixpkgs"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# Print the length prefix of the first record in a file, and the file's size.
+frameSizes() {
+  od -An -N4 -tu1 "${1?}" \
+    | awk '{ print ( $1 * 16777216 ) + ( $2 * 65536 ) + ( $3 * 256 ) + $4 }'
+  wc -c < "$1" | tr -d ' '
+}
+
+# bats test_tags=search:output-format
+
+# Binary records are prefixed by their length.
+@test "'pkgdb search --output-format cbor' frames records" {
+  params="$(genParams '.query.pname="hello"')"
+  run sh -c "$PKGDB_BIN search --output-format cbor '$params' \
+               > '$BATS_TEST_TMPDIR/out.cbor'"
+  assert_success
+
+  # A single record is its length prefix followed by its payload.
+  run frameSizes "$BATS_TEST_TMPDIR/out.cbor"
+  assert_success
+  size="${lines[0]}"
+  assert_equal "${lines[1]}" "$(( size + 4 ))"
+}
+
+# bats test_tags=search:output-format
+
+# Errors are framed like any other record.
+@test "'pkgdb search --output-format msgpack' frames errors" {
+  params="$(genParams '.query.pname="hello"|.query.bogus=true')"
+  run sh -c "$PKGDB_BIN search --output-format msgpack '$params' \
+               > '$BATS_TEST_TMPDIR/out.msgpack'"
+  assert_failure
+
+  run frameSizes "$BATS_TEST_TMPDIR/out.msgpack"
+  assert_success
+  size="${lines[0]}"
+  assert_equal "${lines[1]}" "$(( size + 4 ))"
+
+  run "$PKGDB_BIN" search --output-format yaml "$params"
+  assert_failure
+}
+
 # ---------------------------------------------------------------------------- #
 
 # bats test_tags=search:params, search:params:fallbacks
@@ -496,6 +604,97 @@ genParamsNixpkgsFlox() {
   assert_equal "$n_lines" 40 # 5x number of results from hello
 }
 
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=search:primop
+
+@test "'builtins.searchPackages' returns lightweight records" {
+  run --separate-stderr "$PKGDB_BIN" eval --json "
+    builtins.searchPackages \"$NIXPKGS_REF\" {
+      pname    = \"hello\";
+      subtrees = [\"legacyPackages\"];
+      systems  = [\"x86_64-linux\"];
+    }"
+  assert_success
+  run jq -r '.[0]|[.attrPath|join(".")]+[.pname,.version,.system]|join(" ")' \
+    <<< "$output"
+  assert_output "legacyPackages.x86_64-linux.hello hello 2.12.1 x86_64-linux"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=search:primop
+
+@test "'builtins.searchPackages' memoizes inputs and filters by semver" {
+  run --separate-stderr "$PKGDB_BIN" eval "let
+    search = builtins.searchPackages \"$NIXPKGS_REF\";
+    all    = search { pname = \"hello\"; systems = [\"x86_64-linux\"]; };
+    none   = search {
+      pname   = \"hello\";
+      semver  = \">=3\";
+      systems = [\"x86_64-linux\"];
+    };
+  in assert all != []; assert none == []; true"
+  assert_success
+  assert_output "true"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=search:primop
+
+@test "'builtins.searchPackages' rejects unknown query fields" {
+  run --separate-stderr "$PKGDB_BIN" eval "
+    builtins.searchPackages \"$NIXPKGS_REF\" { match = \"hello\"; }"
+  assert_failure
+  assert_output --partial "unrecognized key 'match'"
+}
+
+
+# ---------------------------------------------------------------------------- #
+
+# bats test_tags=search:scope
+
+# Scoped inputs are scraped to their own database and only contain packages
+# inside of their scope.
+@test "'pkgdb search' with a scoped registry input" {
+  scope='.manifest.registry.inputs.nixpkgs.scrape={
+    "scope": [["legacyPackages", null, "hello"],
+              ["legacyPackages", null, "nodePackages"]]
+  }'
+
+  params="$(genParams "$scope|.query.pname=\"hello\"")"
+  run --separate-stderr "$PKGDB_BIN" search "$params"
+  assert_success
+  scoped="$output"
+
+  params="$(genParams '.query.pname="hello"')"
+  run --separate-stderr "$PKGDB_BIN" search "$params"
+  assert_success
+  assert_equal "$(jq -c 'del(.id)' <<< "$scoped")" \
+               "$(jq -c 'del(.id)' <<< "$output")"
+
+  # Nested scopes are scraped.
+  params="$(genParams "$scope|.query.pname=\"npm\"")"
+  run --separate-stderr sh -c \
+    "$PKGDB_BIN search '$params'|jq -r '.relPath[0]'|sort -u"
+  assert_success
+  assert_output nodePackages
+
+  # Packages outside of the scope are absent.
+  params="$(genParams "$scope|.query.pname=\"nodejs\"")"
+  run --separate-stderr "$PKGDB_BIN" search "$params"
+  assert_success
+  assert_output ''
+
+  # The scoped database is kept beside the full database.
+  run sh -c "ls '$PKGDB_CACHEDIR'/*.*.sqlite|wc -l"
+  assert_output 1
+}
+
+
 # ---------------------------------------------------------------------------- #
 #
 #
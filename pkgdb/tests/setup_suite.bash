@@ -117,6 +117,9 @@ misc_vars_setup() {
   # NOTE: Keep in line with `../src/registry/wrapped-nixpkgs-input.cc`
   export FLOX_NIXPKGS_VERSION="0";
 
+  # Don't record package usage or rank searches by it unless a test opts in.
+  export PKGDB_USAGE='';
+
   export __PD_RAN_MISC_VARS_SETUP=:
 }
 
@@ -7,10 +7,14 @@
  *
  * -------------------------------------------------------------------------- */
 
+#include <cstdint>
 #include <cstdlib>
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <vector>
 
+#include "flox/core/command.hh"
 #include "flox/core/types.hh"
 #include "flox/core/util.hh"
 #include "test.hh"
@@ -277,6 +281,51 @@ test_getAvailableMemory()
 }
 
 
+/* -------------------------------------------------------------------------- */
+
+/* Tests writing records in each output format. */
+bool
+test_writeRecord0()
+{
+  nlohmann::json record = { { "pname", "hello" }, { "version", "2.12.1" } };
+
+  flox::command::outputFormat = flox::command::OF_JSON;
+  std::stringstream json;
+  flox::command::writeRecord( record, json );
+  flox::command::writeRecord( record, json );
+  EXPECT_EQ( json.str(), record.dump() + '\n' + record.dump() + '\n' );
+
+  /* Read a frame's length and payload. */
+  auto readFrame = []( std::istream & iss ) -> std::vector<std::uint8_t>
+  {
+    std::uint32_t size = 0;
+    for ( int idx = 0; idx < 4; ++idx )
+      {
+        size = ( size << 8 ) | static_cast<std::uint8_t>( iss.get() );
+      }
+    std::vector<std::uint8_t> bytes( size );
+    iss.read( reinterpret_cast<char *>( bytes.data() ), size );
+    return bytes;
+  };
+
+  flox::command::outputFormat = flox::command::OF_CBOR;
+  std::stringstream cbor;
+  flox::command::writeRecord( record, cbor );
+  flox::command::writeRecord( record, cbor );
+  EXPECT( nlohmann::json::from_cbor( readFrame( cbor ) ) == record );
+  EXPECT( nlohmann::json::from_cbor( readFrame( cbor ) ) == record );
+  EXPECT( cbor.peek() == std::char_traits<char>::eof() );
+
+  flox::command::outputFormat = flox::command::OF_MSGPACK;
+  std::stringstream msgpack;
+  flox::command::writeRecord( record, msgpack );
+  EXPECT( nlohmann::json::from_msgpack( readFrame( msgpack ) ) == record );
+
+  flox::command::outputFormat = flox::command::OF_JSON;
+  return true;
+}
+
+
 /* -------------------------------------------------------------------------- */
 
 int
@@ -306,6 +355,8 @@ main()
 
   RUN_TEST( getAvailableMemory );
 
+  RUN_TEST( writeRecord0 );
+
   return ec;
 }
 
@@ -28,6 +28,7 @@
   git,
   coreutils,
   parallel,
+  strace,
   llvm, # for `llvm-symbolizer'
   gdb ? throw "`gdb' is required for debugging with `g++'",
   lldb ? throw "`lldb' is required for debugging with `clang++'",
@@ -196,17 +197,22 @@ in
           cpp-semver
           ;
 
-        ciPackages = [
-          # For tests
-          batsWith
-          yj
-          jq
-          git
-          sqlite
-          parallel
-          # For docs
-          doxygen
-        ];
+        ciPackages =
+          [
+            # For tests
+            batsWith
+            yj
+            jq
+            git
+            sqlite
+            parallel
+            # For docs
+            doxygen
+          ]
+          ++ (lib.optionals stdenv.isLinux [
+            # For `ld-floxlib' syscall counting tests
+            strace
+          ]);
 
         devPackages =
           [